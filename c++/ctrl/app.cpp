@@ -1,10 +1,27 @@
 #define _CRT_SECURE_NO_WARNINGS
+#include <algorithm>
+#include <atomic>
 #include <cstdlib>
 #include <cstring>
+#include <exception>
 #include <signal.h>
+#include <thread>
 #include <unistd.h>
+#include <vector>
+#include "archive.h"
+#include "blob.h"
+#include "capture.h"
+#include "codec.h"
 #include "common.h"
+#include "dapqueue.h"
+#include "daemon.h"
+#include "decimation.h"
+#include "executor.h"
+#include "dump.h"
 #include "peripherals.h"
+#include "telemetry.h"
+#include "timebase.h"
+#include "trace.h"
 #include "app.h"
 
 
@@ -163,7 +180,14 @@ static void help() {
             APP_FW_BUILD >> 16 & 0xFF, APP_FW_BUILD >> 8 & 0xFF, APP_FW_BUILD >> 24 & 0xFF );
     for (int n=strlen(title); --n>=0;  )  putchar('=');
     puts( "\n\n"
-        "usage:  sudo ./" APP_FILE " <option>*\n\n"
+        "usage:  sudo ./" APP_FILE " [-t <transport>] <option>*\n\n"
+        "<transport>:\n"
+        "    mmio                        -- DAP's memory-mapped registers (default; must run on the PYNQ-Z2)\n"
+        "    serial:<device>[:<baud>]    -- Debug Serial Port, e.g. serial:/dev/ttyUSB0:921600\n"
+        "    sim[:<key>=<value>,...]     -- In-process firmware simulator, e.g. sim:speed=100,rate0=1000,len0=4\n"
+        "                                   (keys: speed, rate0..rate5, len0..len5, sw, baud, lat; see simulator.h)\n"
+        "    unix[:<path>]               -- DAP daemon's socket (default: /run/ctrl.sock; see --daemon)\n"
+        "  If -t is omitted, environment variable DAP_TRANSPORT is used, if set.\n\n"
         "<option>:\n"
 //      "  PYNQ-Z2 Commands\n"
 //      "    -4 <u>                      -- Set 4-bit enable mask for LEDs {LD3, LD2, LD1, LD0} (0..15)\n"
@@ -173,31 +197,384 @@ static void help() {
         "    -r <mod> <addr>             -- Read 32-bit word from module <mod>, address <addr>\n"
         "    -w <mod> <addr> <x>         -- Write 32-bit word <x> to module <mod>, address <addr>\n"
         "    -s                          -- Print all peripherals' status\n"
+        "    --cache                     -- Enable the shadow-register cache for the following commands\n"
+        "    --daemon [<path>]           -- Serve DAP requests on a Unix socket until Ctrl-C or SIGTERM\n"
+        "                                   (default: /run/ctrl.sock); clients use -t unix[:<path>]\n"
+        "    --trace <file>              -- Record all following DAP transactions to a trace file\n"
+        "                                   (or set environment variable DAP_TRACE=<file>)\n"
+        "    --replay <file>             -- Replay a trace at full speed, and compare the words read\n"
+        "    --replay-timed <file>       -- Replay a trace at its recorded timing, and compare the words read\n"
+        "    --timebase <s>              -- Track the PL's usTime against the host's clock for <s> seconds (see Timebase),\n"
+        "                                   printing each round's prediction error and the PL's drift\n"
+        "  Spotter Commands\n"
+        "    --spot                      -- Read the spotter's frame buffer, and print its blobs found by the golden\n"
+        "                                   model of blob.v (see BlobModel)\n"
+        "    --spot-stream <s>           -- Read the spotter's frames for <s> seconds (0 = until Ctrl-C), keeping the\n"
+        "                                   next frame's read in flight (see DapExecutor) while the golden model finds\n"
+        "                                   the last one's blobs, and print the frame rate\n"
+        "    --blobs <frames> <csv>      -- Find the blobs in a file of 128x128 uint16_t frames with the golden model,\n"
+        "                                   and write their records to a CSV file\n"
+        "  Debug Capture Module Commands\n"
+        "    --dcm-clear                 -- Clear the debug capture buffer\n"
+        "    --dcm-dec <port> <d>        -- Set decimation on DCM port (0..5) to 1..65535, or 0 to disable the port\n"
+        "    --dcm-dump <file>           -- Read the DCM's buffer, and write it to a binary file\n"
+        "    --dcm-serial-dump <file>    -- Dump the DCM's buffer out the Debug Serial Port (needs -t serial), and\n"
+        "                                   receive it into a binary file (see DumpReceiver)\n"
+        "    --dcm-capture <s> <base>    -- Capture the DCM's telemetry continuously for <s> seconds (0 = until Ctrl-C)\n"
+        "                                   to files <base>.0000.bin, <base>.0001.bin, ..., logged in <base>.log\n"
+        "    --dcm-stream <s> <base>     -- Like --dcm-capture, but streams losslessly from the DCM's ring buffer\n"
+        "    --dcm-archive <s> <base>    -- Like --dcm-stream, but decodes the packets into a capture archive of\n"
+        "                                   segments <base>.0000.seg, ... (see archive.h), logged in <base>.log\n"
+        "    --dcm-auto <s>              -- Following captures adapt the ports' decimation, so that the buffer fills in\n"
+        "                                   about <s> seconds (see DecimationController), or 0 to stop adapting\n"
+        "    --dcm-share <port> <w>      -- Give DCM port (0..5) weight <w> in the adaptive decimation's bandwidth\n"
+        "                                   (default: 1 for every enabled port)\n"
+        "    --dcm-interest <port>       -- Raise DCM port's (0..5) rate during bursts of the adaptive decimation\n"
+        "    --dcm-timebase              -- Following captures track the PL's clock (see Timebase) on a second thread,\n"
+        "                                   sharing the DAP through a DapQueue, and print its status\n"
+        "    --dcm-decode <file>         -- Decode a dump or capture file's telemetry packets (see telemetry.def)\n"
+        "    --dcm-index <base>          -- Index a capture archive's segments (see ArchiveReader), and print its status\n"
+        "    --dcm-compress <base>       -- Compress a capture archive's closed segments to <base>.NNNN.segz (see codec.h)\n"
+        "    --dcm-expand <base>         -- Expand a capture archive's compressed segments back to <base>.NNNN.seg\n"
     );
 }
 
 
+// Does a Command Use the DAP?
+// The commands that only read and write files (and the settings for a later capture) run without the PL, e.g. on a
+// workstation, so the peripherals are initialized only before the first command that needs them.
+// in: sw = command's switch, e.g. "--dcm-decode"
+// out: returns false if the command does not touch the DAP
+static bool usesDap(const char *sw) {
+    static const char *const offline[] = {
+        "-h", "--blobs", "--dcm-auto", "--dcm-share", "--dcm-interest", "--dcm-timebase",
+        "--dcm-decode", "--dcm-index", "--dcm-compress", "--dcm-expand"
+    };
+    for (const char *s : offline)
+        if (strEq(sw, s))  return false;
+    return true;
+}
+
+
+// Execute Pending DAP Operations
+// Consecutive -r and -w commands are collected into one batch, so the batch is range checked once.
+// in out: ops = pending operations; on return it will be empty
+static void execute(std::vector<DapOp> &ops) {
+    if (ops.empty())  return;
+    std::vector<uint32_t> results(ops.size());
+    peripherals.dap.execute(ops.data(), ops.size(), results.data());
+    for (size_t i = 0; i < ops.size(); i++)
+        if (ops[i].type == DapOp::READ)  printf("0x%08X = %u\n", results[i], results[i]);
+    ops.clear();
+}
+
+
+// Replay a Trace
+// in: fn = trace file's name
+//     timed = true to replay at the recorded timing, false at full speed
+// throws: Exception if the replay fails, or if any word read differs from the trace
+static void replay(const char *fn, bool timed) {
+    ReplayStats s = replayTrace(peripherals.dap, fn, timed);
+    printf( "Replayed %llu operations (%llu words read) in %.3f s (%.0f operations/s)\n",
+            (unsigned long long) s.ops, (unsigned long long) s.reads, s.seconds,  s.seconds > 0  ?  s.ops / s.seconds  :  0.0 );
+    if (s.mismatches != 0)
+        throwException("%llu of %llu words read differ from the trace", (unsigned long long) s.mismatches, (unsigned long long) s.reads);
+}
+
+
+// Dump the DCM's Buffer out the Debug Serial Port
+// in: fn = binary file's path
+// throws: Exception if the transport is not the serial port, or the dump fails (see DumpReceiver::receive())
+static void serialDump(const char *fn) {
+    SerialTransport *t = nullptr;
+    for (DapTransport *d = peripherals.dap.transport(); d != nullptr && t == nullptr; d = d->inner())
+        t = dynamic_cast<SerialTransport *>(d);                 // (through decorators, e.g. a TraceRecorder)
+    if (t == nullptr)  throwException("--dcm-serial-dump needs the serial transport (-t serial:<device>[:<baud>])");
+    DumpReceiver rx(t->fileDescriptor(), t->baudRate());
+    peripherals.dap.write<regmap::dcm::control>(DebugCaptureModule::DUMP);
+    const DumpReceiver::Stats &st = rx.receive(fn);
+    printf( "Received %u 32-bit words into binary file %s in %.3f s (%.0f bytes/s, %.0f%% of the line rate)\n",
+            st.words, fn, st.seconds, st.seconds > 0  ?  st.bytes / st.seconds  :  0.0,
+            st.seconds > 0  ?  100.0 * st.bytes / st.seconds / rx.lineRate()  :  0.0 );
+}
+
+
+// Track the PL's Clock
+// Does a Timebase round every interval, and prints it, until Ctrl-C or a time limit; then prints the status.
+// in: seconds = time limit
+// throws: Exception if the DAP fails
+static void trackTimebase(double seconds) {
+    Timebase tb(peripherals.dap);
+    Stopwatch sw;
+    catchCtrlC(true);
+    try {
+        while (!ctrlC && (tb.stats().rounds == 0 || !sw.hasElapsed(seconds))) {
+            const Timebase::Round &r = tb.round();
+            printf( "%8.3f s:  PL %12llu us, error %+9.1f us, round trip %8.1f us, drift %+9.3f ppm, rms %7.1f us\n",
+                    sw.elapsed(), (unsigned long long) r.pl, r.error, r.rtt * 1e-3, tb.drift(), tb.stats().rms );
+            usleep(useconds_t(tb.interval * 1e6));
+        }
+    }
+    catch (...) { catchCtrlC(false);  throw; }
+    catchCtrlC(false);
+    putchar('\n');
+    tb.printStatus();
+}
+
+
+// Capture the DCM's Telemetry
+// With timebase, the capture and a Timebase share the DAP through a DapQueue:  the capture runs on this thread, and
+// a second thread polls the Timebase, so its rounds continue while the capture drains the buffer.
+// in: seconds = time limit (0 = until Ctrl-C)
+//     base = capture files' base name
+//     ring, archive = as DcmCapture's
+//     policy = adaptive decimation, if policy.fillSeconds > 0
+//     timebase = true to track the PL's clock concurrently
+// throws: Exception if the capture, or the Timebase's thread, fails
+static void capture(double seconds, const char *base, bool ring, bool archive, const DecimationPolicy &policy,
+                    bool timebase) {
+    if (!timebase) {
+        DcmCapture capture(peripherals.dap, peripherals.dcm, base, ring, archive);
+        if (policy.fillSeconds > 0)  capture.adapt(policy);
+        capture.run(seconds);
+        capture.printStatus();
+        return;
+    }
+    DapQueue queue(peripherals.dap);
+    QueuedTransport ct(queue), tt(queue);
+    Dap cdap, tdap;
+    cdap.init(&ct);
+    tdap.init(&tt);
+    DebugCaptureModule dcm(cdap);
+    Timebase tb(tdap);
+    std::atomic<bool> done(false);
+    std::exception_ptr failure;
+    std::thread poller([&]() {
+        try {
+            while (!done) {
+                tb.poll();
+                usleep(10000);
+            }
+        }
+        catch (...) { failure = std::current_exception(); }
+    });
+    try {
+        DcmCapture capture(cdap, dcm, base, ring, archive);
+        if (policy.fillSeconds > 0)  capture.adapt(policy);
+        capture.run(seconds);
+        capture.printStatus();
+    }
+    catch (...) { done = true;  poller.join();  throw; }
+    done = true;
+    poller.join();
+    if (failure)  std::rethrow_exception(failure);
+    tb.printStatus();
+    queue.printStatus();
+}
+
+
+// Write a Blob Record as a CSV Line
+// in: f = CSV file
+//     frame = frame's index
+//     r = record
+static void writeBlob(FILE *f, uint64_t frame, const BlobModel::Record &r) {
+    char hex[42];
+    r.toHex(hex);
+    fprintf( f, "%llu,%u,%u,%u,%u,%u,%u,%u,%llu,%llu,%s\n", (unsigned long long) frame, r.x0, r.y0, r.x1, r.y1,
+             r.count, r.maxI, r.sumI, (unsigned long long) r.sumXI, (unsigned long long) r.sumYI, hex );
+}
+
+
+// Find the Blobs in a File of Frames
+// Models each frame (128x128 uint16_t pixels, little endian, row by row) with BlobModel, and writes its records to a
+// CSV file, one per line, with the 162-bit blob_out word in hex.
+// in: fn = frame file's path
+//     csv = CSV file's path
+// throws: Exception if a file cannot be read or written, or the frame file ends with a partial frame
+static void findBlobs(const char *fn, const char *csv) {
+    FILE *src = fopen(fn, "rb");
+    if (src == nullptr)  throwException("Cannot open frame file: %s", fn);
+    FILE *dst = fopen(csv, "w");
+    if (dst == nullptr) { fclose(src);  throwException("Cannot open CSV file: %s", csv); }
+    BlobModel model;
+    std::vector<uint16_t> pixels(BlobModel::WIDTH * BlobModel::HEIGHT);
+    std::vector<BlobModel::Record> records;
+    fprintf(dst, "frame,x0,y0,x1,y1,count,max_i,sum_i,sum_xi,sum_yi,blob_out\n");
+    uint64_t frames = 0;
+    size_t got;
+    while ((got = fread(pixels.data(), sizeof(uint16_t), pixels.size(), src)) == pixels.size()) {
+        records.clear();
+        model.frame(pixels.data(), records);
+        for (const BlobModel::Record &r : records)  writeBlob(dst, frames, r);
+        frames++;
+    }
+    bool bad = ferror(src) != 0;
+    fclose(src);
+    if (ferror(dst) != 0 || fclose(dst) != 0)  throwException("Cannot write CSV file: %s", csv);
+    if (bad)  throwException("Cannot read frame file: %s", fn);
+    if (got != 0)  throwException("Frame file %s ends with a partial frame (%zu pixels)", fn, got);
+    printf( "Wrote %llu blobs of %llu frames to CSV file %s\n\n", (unsigned long long) model.stats().records,
+            (unsigned long long) frames, csv );
+    model.printStatus();
+}
+
+
+// Find the Blobs in the Spotter's Frame Buffer
+// The CPU fallback for the blob pipeline:  reads the frame, and prints the blobs found by BlobModel.
+// throws: Exception if the DAP fails
+static void spot() {
+    typedef regmap::spotter::frame F;
+    std::vector<uint32_t> words(F::size);
+    peripherals.dap.readBlock(F::mod, F::addr, words.size(), words.data());
+    std::vector<uint16_t> pixels(words.begin(), words.end());
+    BlobModel model;
+    std::vector<BlobModel::Record> records;
+    model.frame(pixels.data(), records);
+    printf("%zu blobs:\n", records.size());
+    for (const BlobModel::Record &r : records)
+        printf( "    (%3u, %3u) .. (%3u, %3u):  %5u pixels, max. %5u, centroid (%7.2f, %7.2f)\n",
+                r.x0, r.y0, r.x1, r.y1, r.count, r.maxI, double(r.sumXI) / r.sumI, double(r.sumYI) / r.sumI );
+    putchar('\n');
+}
+
+
+// Stream the Spotter's Frames through the Golden Model
+// Keeps the next frames' reads in flight (see DapExecutor) while the golden model finds the last frame's blobs, so
+// the DAP and the model overlap.  Stops at a time limit or Ctrl-C, and prints the rate and the blobs found.
+// in: seconds = time limit (0 = until Ctrl-C)
+// throws: Exception if the DAP fails
+static void spotStream(double seconds) {
+    typedef regmap::spotter::frame F;
+    static constexpr size_t DEPTH = 2;                  // frames in flight
+    BlobModel model;
+    std::vector<BlobModel::Record> records;
+    std::vector<uint16_t> pixels(F::size);
+    uint64_t frames = 0, blobs = 0;
+    DapQueue queue(peripherals.dap);
+    DapExecutor ex(queue);
+    Stopwatch sw;
+    catchCtrlC(true);
+    try {
+        while (!ctrlC && (seconds <= 0 || !sw.hasElapsed(seconds))) {
+            while (ex.inFlight() < DEPTH)
+                ex.readBlock(F::mod, F::addr, F::size).then([&](DapFuture &f) {
+                    const std::vector<uint32_t> &words = f.get();
+                    std::copy(words.begin(), words.end(), pixels.begin());
+                    records.clear();
+                    blobs += model.frame(pixels.data(), records);
+                    frames++;
+                });
+            ex.runOnce();
+        }
+        ex.run();
+    }
+    catch (...) { catchCtrlC(false);  throw; }
+    catchCtrlC(false);
+    double t = sw.elapsed();
+    printf( "Read %llu frames in %.3f s (%.1f frames/s), %.1f blobs per frame\n\n", (unsigned long long) frames, t,
+            t > 0  ?  frames / t  :  0.0,  frames != 0  ?  double(blobs) / frames  :  0.0 );
+    model.printStatus();
+    queue.printStatus();
+}
+
+
+// Print Compression Statistics
+// in: verb = "Compressed" or "Expanded"
+//     base = archive's path without extension
+//     st = statistics
+static void printCompressStats(const char *verb, const char *base, const CompressStats &st) {
+    printf( "%s %s:  %.1f MB <-> %.1f MB (%.1f : 1) in %.3f s (%.0f MB/s of segment data)\n",
+            verb, base, st.rawBytes * 1e-6, st.compressedBytes * 1e-6,
+            st.compressedBytes != 0  ?  double(st.rawBytes) / st.compressedBytes  :  0.0,
+            st.seconds, st.seconds > 0  ?  st.rawBytes * 1e-6 / st.seconds  :  0.0 );
+}
+
+
 // Main
 int main(int argc, char *argv[]) {
     if (argc == 1 || (argc == 2 && (strEq(argv[1], "-h") || strEq(argv[1], "--help"))))  { help();  return 0; }
-    const char *dev, *fn;
+    const char *dev, *fn, *csv;
     uint32_t u, z;
     int i, x, y;
     int errCode = 0;
+    std::vector<DapOp> ops;   // pending -r and -w operations
+    DecimationPolicy policy = { 0, {}, 0, 1.0 };            // adaptive decimation, if fillSeconds > 0
+    bool timebase = false;                                  // track the PL's clock during captures
     try {
-        peripherals.init();
         scan(argc, argv);
-        while (nArgs != 0)
-        if (chomp("-h"))  help();
-        else if (chomp("-r", x, y)) {
-            z = peripherals.dap.read(x, y);
-            printf("0x%08X = %u\n", z, z);
+        chomp("-t", dev);
+        while (nArgs != 0) {
+        if (usesDap(*vArg))  peripherals.init(dev);                     // (does nothing once initialized)
+        if (chomp("-r", x, y))  ops.push_back({DapOp::READ, x, y, 0, 0});
+        else if (chomp("-w", x, y, z))  ops.push_back({DapOp::WRITE, x, y, z, 0});
+        else {
+            execute(ops);
+            if (chomp("-h"))  help();
+            else if (chomp("-s")) { putchar('\n');  peripherals.printStatus(); }
+            else if (chomp("--cache"))  peripherals.dap.enableCache(true);
+            else if (chomp("--daemon")) {
+                fn = DAEMON_SOCKET;
+                if (nArgs != 0 && vArg[0][0] != '-') { fn = vArg[0];  skip(); }
+                DapDaemon(peripherals.dap, fn).run();
+            }
+            else if (chomp("--trace", fn))  peripherals.trace(fn);
+            else if (chomp("--replay", fn))  replay(fn, false);
+            else if (chomp("--replay-timed", fn))  replay(fn, true);
+            else if (chomp("--timebase", x))  trackTimebase(x);
+            else if (chomp("--spot"))  spot();
+            else if (chomp("--spot-stream", x))  spotStream(x);
+            else if (chomp("--blobs", fn, csv))  findBlobs(fn, csv);
+            else if (chomp("--dcm-clear"))  peripherals.dcm.clear();
+            else if (chomp("--dcm-dec", x, y))  peripherals.dcm.setDecimation(x, uint32_t(y));
+            else if (chomp("--dcm-dump", fn)) {
+                Stopwatch sw;
+                u = peripherals.dcm.dump(fn);
+                printf("Wrote %u 32-bit words to binary file %s in %.3f s\n", u, fn, sw.elapsed());
+            }
+            else if (chomp("--dcm-auto", x))  policy.fillSeconds = x;
+            else if (chomp("--dcm-share", x, y)) {
+                if (x < 0 || x >= DecimationController::PORTS)  throwException("DCM Port Out of Range 0..5");
+                if (y < 0)  throwException("Negative share for DCM port %d", x);
+                policy.share[x] = y;
+            }
+            else if (chomp("--dcm-interest", x)) {
+                if (x < 0 || x >= DecimationController::PORTS)  throwException("DCM Port Out of Range 0..5");
+                policy.interest |= 1u << x;
+            }
+            else if (chomp("--dcm-serial-dump", fn))  serialDump(fn);
+            else if (chomp("--dcm-timebase"))  timebase = true;
+            else if (chomp("--dcm-capture", x, fn))  capture(x, fn, false, false, policy, timebase);
+            else if (chomp("--dcm-stream", x, fn))  capture(x, fn, true, false, policy, timebase);
+            else if (chomp("--dcm-archive", x, fn))  capture(x, fn, true, true, policy, timebase);
+            else if (chomp("--dcm-decode", fn)) {
+                telemetry::Clock clock;
+                Stopwatch sw;
+                telemetry::DecodeStats st = telemetry::decodeFile(fn, clock);
+                double t = sw.elapsed();
+                telemetry::printStats(st);
+                printf("Decoded %llu packets from %s in %.3f s\n", (unsigned long long) st.packets, fn, t);
+            }
+            else if (chomp("--dcm-index", fn)) {
+                Stopwatch sw;
+                ArchiveReader archive(fn);
+                double t = sw.elapsed();
+                archive.printStatus();
+                printf("Opened %zu segments of %s in %.3f s\n", archive.segments(), fn, t);
+            }
+            else if (chomp("--dcm-compress", fn)) {
+                CompressStats st = compressArchive(fn, std::thread::hardware_concurrency());
+                printCompressStats("Compressed", fn, st);
+            }
+            else if (chomp("--dcm-expand", fn)) {
+                CompressStats st = expandArchive(fn, std::thread::hardware_concurrency());
+                printCompressStats("Expanded", fn, st);
+            }
+//          else if (chomp("-4", u))  peripherals.bio.setLedsLD03(u);
+//          else if (chomp("-3", u))  peripherals.bio.setRgbLedLD5(u);
+            else  throwException("Command-Line Syntax Error at \"%s\"", *vArg);
+        }
         }
-        else if (chomp("-w", x, y, z))  peripherals.dap.write(x, y, z);
-        else if (chomp("-s")) { putchar('\n');  peripherals.printStatus(); }
-//      else if (chomp("-4", u))  peripherals.bio.setLedsLD03(u);
-//      else if (chomp("-3", u))  peripherals.bio.setRgbLedLD5(u);
-        else  throwException("Command-Line Syntax Error at \"%s\"", *vArg);
+        execute(ops);
     }
     catch (const Exception &e) {
         printf("ERROR at %s:%d : %s\n", e.fileName, e.lineNo, e.what());
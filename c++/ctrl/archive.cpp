@@ -0,0 +1,669 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include "common.h"
+#include "archive.h"
+#include "codec.h"
+
+// Capture Archive
+//
+// Appends decoded telemetry to segment files, and makes it durable with group commits; reads and indexes them
+
+static_assert(sizeof(SegmentHeader) == 64, "segment header layout");
+static_assert(sizeof(IndexBlock) == 40, "index block layout");
+
+
+
+// Current Time
+// out: returns microseconds since the Unix epoch
+static uint64_t epochUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return uint64_t(ts.tv_sec) * 1000000u + uint64_t(ts.tv_nsec) / 1000u;
+}
+
+
+// Write All Bytes at an Offset
+// in: fd = file
+//     p, n = bytes to write
+//     off = file offset
+// out: returns true if success, else false (errno is set)
+static bool pwriteAll(int fd, const void *p, size_t n, off_t off) {
+    const uint8_t *q = static_cast<const uint8_t *>(p);
+    while (n != 0) {
+        ssize_t k = ::pwrite(fd, q, n, off);
+        if (k < 0 && errno == EINTR)  continue;
+        if (k <= 0)  return false;
+        q += k;
+        n -= size_t(k);
+        off += k;
+    }
+    return true;
+}
+
+
+// Decoder's Visitor:  archives well-formed packets, counts rejected words, and finds a cut-off packet
+struct ArchiveWriter::Visitor {
+    ArchiveWriter &a;
+    size_t end;                     // index of the cut-off packet's header word, or the buffer's length
+
+    template<class P>
+    void operator()(const telemetry::Record<P> &r) { a.put(r.words, P::length, r.time); }
+    void operator()(const telemetry::Record<telemetry::decimation::packet> &r) {
+        using namespace telemetry::decimation;
+        a.put(r.words, packet::length, r.time);
+        a.info.dec[0] = uint16_t(dec0::get(r.words));       // recorded in the following segments' headers
+        a.info.dec[1] = uint16_t(dec1::get(r.words));
+        a.info.dec[2] = uint16_t(dec2::get(r.words));
+        a.info.dec[3] = uint16_t(dec3::get(r.words));
+        a.info.dec[4] = uint16_t(dec4::get(r.words));
+        a.info.dec[5] = uint16_t(dec5::get(r.words));
+    }
+    void operator()(const telemetry::Error &e) {
+        if (e.kind == telemetry::Error::TRUNCATED)  end = e.offset;
+        else  a.st.rejected++;
+    }
+};
+
+
+
+// *******************
+// *  ArchiveWriter  *
+// *******************
+
+
+// Constructor
+// Starts the committer thread; the first segment is created by the first packet.
+// in: base = segments' path without extension, e.g. "/data/soak"
+//     info = capture's metadata for the segments' headers
+//     segmentBytes = segment files' size (a multiple of 4, at least 64 KiB)
+// throws: Exception if an argument is invalid
+ArchiveWriter::ArchiveWriter(const char *base, const ArchiveInfo &info, uint32_t segmentBytes)
+    : info(info), requested(0), completed(0), stopping(false), failed(false), error(0) {
+    if (!strCpy(this->base, sizeof this->base, base))  throwException("Archive path too long: %s", base);
+    if (segmentBytes < 65536 || segmentBytes % 4 != 0)  throwException("Invalid archive segment size %u", segmentBytes);
+    capacity = (segmentBytes - sizeof(SegmentHeader)) / 4;
+    memset(&st, 0, sizeof st);
+    cur.fd = pub.fd = -1;
+    written = packets = 0;
+    stage.reserve(STAGE_WORDS + 64);
+    committer = std::thread([this] { commitLoop(); });
+}
+
+
+// Destructor
+// Closes the current segment, and waits for the last commit.
+ArchiveWriter::~ArchiveWriter() {
+    try {
+        if (cur.fd >= 0)  closeSegment();
+    }
+    catch (const Exception &e) { logWarning("%s", e.what()); }
+    {
+        std::lock_guard<std::mutex> lk(m);
+        stopping = true;
+    }
+    cv.notify_one();
+    committer.join();
+    if (failed)  logWarning("Archive %s is incomplete: %s", base, strerror(error));
+}
+
+
+// Throw if the Committer Failed
+// throws: Exception if a write or sync failed
+void ArchiveWriter::check() {
+    if (failed)  throwException("Cannot write archive %s: %s", base, strerror(error));
+}
+
+
+// Start a New Segment
+// in: firstTime = unwrapped time of its first packet
+// throws: Exception if the segment cannot be created
+void ArchiveWriter::openSegment(uint64_t firstTime) {
+    uint32_t index = st.segments;
+    char fn[256];
+    snprintf(fn, sizeof fn, "%s.%04u.seg", base, index);
+    int fd = open(fn, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)  throwException("Cannot create archive segment %s: %s", fn, strerror(errno));
+    SegmentHeader &h = cur.h;
+    memset(&h, 0, sizeof h);
+    h.magic = ARCHIVE_MAGIC;
+    h.version = ARCHIVE_VERSION;
+    h.headerSize = sizeof h;
+    h.index = index;
+    h.state = SegmentHeader::OPEN;
+    h.creationDate = info.creationDate;
+    h.buildDate = info.buildDate;
+    memcpy(h.dec, info.dec, sizeof h.dec);
+    h.capacity = capacity;
+    h.startTime = epochUs();
+    h.firstTime = firstTime;
+    int e = posix_fallocate(fd, 0, off_t(sizeof h) + off_t(capacity) * 4);
+    if (e == 0 && !pwriteAll(fd, &h, sizeof h, 0))  e = errno;
+    if (e != 0) {
+        close(fd);
+        throwException("Cannot create archive segment %s: %s", fn, strerror(e));
+    }
+    cur.fd = fd;
+    written = packets = 0;
+    st.segments++;
+    std::lock_guard<std::mutex> lk(m);
+    pub = cur;
+}
+
+
+// Close the Current Segment
+// Hands it to the committer, which commits and closes it.
+// throws: Exception if a write fails
+void ArchiveWriter::closeSegment() {
+    flush();
+    cur.h.state = SegmentHeader::CLOSED;
+    {
+        std::lock_guard<std::mutex> lk(m);
+        closing.push_back(cur);
+        pub.fd = -1;
+    }
+    cv.notify_one();
+    cur.fd = -1;
+}
+
+
+// Write the Staged Packets to the Current Segment
+// They become durable at the committer's next commit.
+// throws: Exception if the write fails
+void ArchiveWriter::flush() {
+    if (stage.empty())  return;
+    off_t off = off_t(sizeof(SegmentHeader)) + off_t(written) * 4;
+    if (!pwriteAll(cur.fd, stage.data(), stage.size() * 4, off)) {
+        int e = errno;
+        throwException("Cannot write archive segment %s.%04u.seg: %s", base, cur.h.index, strerror(e));
+    }
+    written += uint32_t(stage.size());
+    stage.clear();
+    cur.h.words = written;
+    cur.h.packets = packets;
+    std::lock_guard<std::mutex> lk(m);
+    pub.h.words = written;
+    pub.h.packets = packets;
+}
+
+
+// Stage a Packet
+// in: w, n = packet's words
+//     time = packet's unwrapped time
+// throws: Exception if a segment cannot be created or written
+void ArchiveWriter::put(const uint32_t *w, unsigned n, uint64_t time) {
+    if (cur.fd >= 0 && written + stage.size() + n > capacity)  closeSegment();
+    if (cur.fd < 0)  openSegment(time);
+    stage.insert(stage.end(), w, w + n);
+    packets++;
+    st.packets++;
+    st.words += n;
+    if (stage.size() >= STAGE_WORDS)  flush();
+}
+
+
+// Decode and Stage Words
+// in: w, n = words, beginning at a packet's header
+// out: returns the number of words consumed (all but a packet cut off at the end)
+size_t ArchiveWriter::decodeWords(const uint32_t *w, size_t n) {
+    Visitor v = { *this, n };
+    telemetry::decode(w, n, clock, v);
+    return v.end;
+}
+
+
+// Append Telemetry
+// Decodes the words, stages the well-formed packets, and writes them to the current segment.
+// in: w, n = words captured from the DCM; the first call's must begin at a packet's header, and each following
+//            call's must continue the previous one's
+// throws: Exception if a segment cannot be created or written, or an earlier commit failed
+void ArchiveWriter::append(const uint32_t *w, size_t n) {
+    check();
+    if (carry.empty()) {
+        size_t k = decodeWords(w, n);
+        carry.assign(w + k, w + n);
+    }
+    else {
+        carry.insert(carry.end(), w, w + n);
+        size_t k = decodeWords(carry.data(), carry.size());
+        carry.erase(carry.begin(), carry.begin() + k);
+    }
+    flush();
+}
+
+
+// Commit Now
+// Writes the staged packets and waits for a group commit.
+// throws: Exception if a write or sync fails
+void ArchiveWriter::commit() {
+    check();
+    flush();
+    std::unique_lock<std::mutex> lk(m);
+    uint64_t r = ++requested;
+    cv.notify_one();
+    cvDone.wait(lk, [&] { return completed >= r; });
+    lk.unlock();
+    check();
+}
+
+
+// Commit a Segment (committer thread)
+// Syncs its data, then rewrites and syncs its header.
+// in: s = segment, with its header as of the data written
+// out: returns true if success, else false (error is set)
+bool ArchiveWriter::sync(Segment &s) {
+    if (fdatasync(s.fd) == 0 && pwriteAll(s.fd, &s.h, sizeof s.h, 0) && fdatasync(s.fd) == 0)  return true;
+    error = errno;
+    return false;
+}
+
+
+// Committer Thread
+// Commits every COMMIT_MS, and whenever a segment is closed or commit() is called.
+void ArchiveWriter::commitLoop() {
+    uint32_t index = ~0u, words = 0;                        // the last committed state of the current segment
+    std::unique_lock<std::mutex> lk(m);
+    for (;;) {
+        if (!stopping && closing.empty() && requested == completed)
+            cv.wait_for(lk, std::chrono::duration<double, std::milli>(COMMIT_MS));
+        Segment p = pub;
+        std::vector<Segment> c;
+        c.swap(closing);
+        uint64_t r = requested;
+        bool stop = stopping;
+        lk.unlock();
+
+        Stopwatch sw;
+        bool ok = true, busy = !c.empty();
+        for (Segment &s : c) {
+            ok = sync(s) && ok;
+            close(s.fd);
+        }
+        if (p.fd >= 0 && (p.h.index != index || p.h.words != words)) {
+            ok = sync(p) && ok;
+            busy = true;
+            index = p.h.index;
+            words = p.h.words;
+        }
+        double ms = sw.elapsed() * 1e3;
+
+        lk.lock();
+        if (!ok)  failed = true;
+        if (busy) {
+            st.commits++;
+            if (ms > st.maxCommitMs)  st.maxCommitMs = ms;
+        }
+        completed = r;
+        cvDone.notify_all();
+        if (stop)  return;
+    }
+}
+
+
+// Get Statistics
+ArchiveWriter::Stats ArchiveWriter::stats() {
+    std::lock_guard<std::mutex> lk(m);
+    return st;
+}
+
+
+// Print Status (for debugging)
+void ArchiveWriter::printStatus() {
+    Stats s = stats();
+    printf("Capture Archive (%s.*.seg)\n", base);
+    printf("    packets        =  %10llu   ; packets archived\n", (unsigned long long) s.packets);
+    printf("    words          =  %10llu   ; 32-bit words archived\n", (unsigned long long) s.words);
+    printf("    rejected       =  %10llu   ; words rejected by the decoder\n", (unsigned long long) s.rejected);
+    printf("    segments       =  %10u   ; segment files of %u words\n", s.segments, capacity);
+    printf("    commits        =  %10llu   ; group commits\n", (unsigned long long) s.commits);
+    printf("    maxCommit      =  %10.3f   ; longest group commit in ms\n", s.maxCommitMs);
+    if (failed)  printf("    (a write or sync failed; the archive is incomplete)\n");
+    putchar('\n');
+}
+
+
+
+// *******************
+// *  ArchiveReader  *
+// *******************
+
+
+// Index Builder's Visitor:  adds each packet to the last block, or starts a new block
+struct ArchiveReader::Indexer {
+    Segment &s;
+    uint64_t bad;                   // words the decoder rejected
+    size_t base;                    // offset in the segment's words of the words being decoded
+
+    template<class P>
+    void operator()(const telemetry::Record<P> &r) {
+        size_t offset = base + r.offset;
+        if (s.blocks.empty() || offset - s.blocks.back().offset >= BLOCK_WORDS)
+            s.blocks.push_back({ uint32_t(offset), 0, 0, 0, r.time, r.time, 0 });
+        IndexBlock &b = s.blocks.back();
+        b.words += P::length;
+        b.packets++;
+        b.last = r.time;
+        b.types |= typeMask(P::type);
+        s.ix.perType[P::type]++;
+    }
+    void operator()(const telemetry::Error &) { bad++; }
+};
+
+
+// Block Cache (one per thread):  the compressed blocks expand() expanded last
+struct BlockCache {
+    struct Entry {
+        uint64_t reader;            // reader's id, or 0 if unused
+        size_t seg, block;          // segment's and compressed block's indexes
+        uint64_t used;              // tick of the last use
+        std::vector<uint32_t> words;
+    };
+    Entry e[ArchiveReader::CACHE_BLOCKS] = {};
+    uint64_t tick = 0;
+};
+
+static thread_local BlockCache cache;
+static std::atomic<uint64_t> readers(0);        // readers constructed (their ids)
+
+
+// Constructor
+// Maps the archive's segments, and loads or builds their indexes.
+// in: base = segments' path without extension, e.g. "/data/soak"
+// throws: Exception if there are no segments, or one cannot be read or is not a valid segment
+ArchiveReader::ArchiveReader(const char *base) : id(++readers) {
+    if (!strCpy(this->base, sizeof this->base, base))  throwException("Archive path too long: %s", base);
+    try {
+        for (uint32_t i = 0;  ; i++) {
+            char seg[256], segz[260];
+            snprintf(seg, sizeof seg, "%s.%04u.seg", base, i);
+            snprintf(segz, sizeof segz, "%sz", seg);
+            if (access(seg, F_OK) == 0)  openSegment(i);
+            else if (access(segz, F_OK) == 0)  openCompressed(i);
+            else  break;
+        }
+    }
+    catch (...) {
+        unmap();
+        throw;
+    }
+    if (segs.empty())  throwException("No archive segments %s.NNNN.seg", base);
+}
+
+
+// Destructor
+ArchiveReader::~ArchiveReader() {
+    unmap();
+}
+
+
+// Unmap All Segments
+void ArchiveReader::unmap() {
+    for (Mapping &m : maps)
+        if (m.p != nullptr)  munmap(m.p, m.n);
+    maps.clear();
+    segs.clear();
+}
+
+
+// Map a Segment, and Load or Build its Index
+// in: index = segment's index (NNNN)
+// throws: Exception if the segment cannot be read or is not a valid segment
+void ArchiveReader::openSegment(uint32_t index) {
+    char fn[256];
+    snprintf(fn, sizeof fn, "%s.%04u.seg", base, index);
+    int fd = open(fn, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)  throwException("Cannot open archive segment %s: %s", fn, strerror(errno));
+    struct stat sb;
+    SegmentHeader h;
+    bool ok = fstat(fd, &sb) == 0 && pread(fd, &h, sizeof h, 0) == ssize_t(sizeof h);
+    if (!ok || h.magic != ARCHIVE_MAGIC || h.headerSize != sizeof h || h.index != index) {
+        close(fd);
+        throwException("%s is not an archive segment", fn);
+    }
+    if (h.version != ARCHIVE_VERSION) {
+        close(fd);
+        throwException("%s is archive version %u; only version %u is supported", fn, h.version, ARCHIVE_VERSION);
+    }
+    size_t n = sizeof h + size_t(h.words) * 4;
+    if (h.words > h.capacity || off_t(n) > sb.st_size) {
+        close(fd);
+        throwException("Archive segment %s is truncated", fn);
+    }
+    void *p = mmap(nullptr, n, PROT_READ, MAP_SHARED, fd, 0);
+    int e = errno;
+    close(fd);
+    if (p == MAP_FAILED)  throwException("Cannot map archive segment %s: %s", fn, strerror(e));
+    maps.push_back({ p, n, {} });
+    addSegment(h, reinterpret_cast<const uint32_t *>(static_cast<const uint8_t *>(p) + sizeof h), maps.back());
+}
+
+
+// Map a Compressed Segment, and Load or Build its Index
+// Only the header and directory are read; queryBlocks() expands the blocks it visits (see expand()).
+// in: index = segment's index (NNNN)
+// throws: Exception if the compressed segment cannot be read, or is corrupt
+void ArchiveReader::openCompressed(uint32_t index) {
+    char fn[256];
+    snprintf(fn, sizeof fn, "%s.%04u.segz", base, index);
+    int fd = open(fn, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)  throwException("Cannot open compressed segment %s: %s", fn, strerror(errno));
+    struct stat sb;
+    if (fstat(fd, &sb) != 0 || sb.st_size == 0) {
+        close(fd);
+        throwException("%s is not a compressed segment", fn);
+    }
+    void *p = mmap(nullptr, size_t(sb.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    int e = errno;
+    close(fd);
+    if (p == MAP_FAILED)  throwException("Cannot map compressed segment %s: %s", fn, strerror(e));
+    maps.push_back({ p, size_t(sb.st_size), {} });                 // (unmapped by unmap() if the checks fail)
+    Mapping &m = maps.back();
+    SegmentHeader h;
+    parseCompressedSegment(fn, static_cast<const uint8_t *>(p), m.n, h, m.dir);
+    if (h.index != index)  throwException("%s is not segment %u", fn, index);
+    addSegment(h, nullptr, m);
+}
+
+
+// Add a Segment, and Load or Build its Index
+// in: h = segment's header
+//     words = segment's committed words, or nullptr if compressed
+//     m = segment's mapping
+// throws: Exception if the index must be built, and the segment has words that do not match telemetry.def, or a
+//         compressed block is corrupt
+void ArchiveReader::addSegment(const SegmentHeader &h, const uint32_t *words, const Mapping &m) {
+    char fn[256];
+    Segment s;
+    s.h = h;
+    s.words = words;
+    s.built = false;
+    snprintf(fn, sizeof fn, "%s.%04u.idx", base, h.index);
+    if (!loadIndex(fn, s)) {
+        buildIndex(fn, s, m);
+        s.built = true;
+    }
+    segs.push_back(std::move(s));
+}
+
+
+// Load a Segment's Index from its Sidecar File
+// in: fn = sidecar's name
+// in out: s = segment; its index is loaded
+// out: returns true if success, or false if the sidecar is missing or does not match the segment
+bool ArchiveReader::loadIndex(const char *fn, Segment &s) {
+    FILE *src = fopen(fn, "rb");
+    if (src == nullptr)  return false;
+    IndexHeader &x = s.ix;
+    bool ok = fread(&x, sizeof x, 1, src) == 1 &&
+              x.magic == INDEX_MAGIC && x.version == INDEX_VERSION && x.headerSize == sizeof x &&
+              x.startTime == s.h.startTime && x.words == s.h.words && x.packets == s.h.packets &&
+              x.blockWords == BLOCK_WORDS && x.blocks <= x.words;
+    if (ok) {
+        s.blocks.resize(x.blocks);
+        ok = fread(s.blocks.data(), sizeof(IndexBlock), x.blocks, src) == x.blocks;
+    }
+    fclose(src);
+    for (const IndexBlock &b : s.blocks)
+        if (b.offset > x.words || b.words > x.words - b.offset)  ok = false;
+    if (!ok)  s.blocks.clear();
+    return ok;
+}
+
+
+// Build a Segment's Index, and Write its Sidecar File
+// A compressed segment is expanded one block at a time.  If the sidecar cannot be written (e.g. read-only media),
+// the index is kept in memory only.
+// in: fn = sidecar's name
+//     m = segment's mapping
+// in out: s = segment; its index is built
+// throws: Exception if the segment has words the decoder rejects (e.g. another telemetry.def's packets), or a
+//         compressed block is corrupt
+void ArchiveReader::buildIndex(const char *fn, Segment &s, const Mapping &m) {
+    IndexHeader &x = s.ix;
+    memset(&x, 0, sizeof x);
+    x.magic = INDEX_MAGIC;
+    x.version = INDEX_VERSION;
+    x.headerSize = sizeof x;
+    x.startTime = s.h.startTime;
+    x.words = s.h.words;
+    x.packets = s.h.packets;
+    x.blockWords = BLOCK_WORDS;
+    s.blocks.clear();
+    telemetry::Clock clock(s.h.firstTime);
+    Indexer v = { s, 0, 0 };
+    if (s.words != nullptr)  telemetry::decode(s.words, s.h.words, clock, v);
+    else {
+        std::vector<uint32_t> w;
+        for (const CompressedBlock &c : m.dir) {
+            w.resize(c.words);
+            codec::decodeBlock( reinterpret_cast<const uint32_t *>(static_cast<const uint8_t *>(m.p) + c.offset),
+                                c.bytes / 4, w.data(), c.words );
+            v.base = c.word;
+            telemetry::decode(w.data(), c.words, clock, v);
+        }
+    }
+    if (v.bad != 0)
+        throwException( "Archive segment %s.%04u.seg has %llu words that do not match telemetry.def",
+                        base, s.h.index, (unsigned long long) v.bad );
+    x.blocks = uint32_t(s.blocks.size());
+    for (const IndexBlock &b : s.blocks)  x.types |= b.types;
+
+    char tmp[264];
+    snprintf(tmp, sizeof tmp, "%s.tmp", fn);
+    FILE *dst = fopen(tmp, "wb");
+    bool ok = dst != nullptr &&
+              fwrite(&x, sizeof x, 1, dst) == 1 &&
+              fwrite(s.blocks.data(), sizeof(IndexBlock), x.blocks, dst) == x.blocks;
+    if (dst != nullptr && fclose(dst) != 0)  ok = false;
+    if (ok && rename(tmp, fn) == 0)  return;
+    if (dst != nullptr)  unlink(tmp);
+    logWarning("Cannot write archive index %s", fn);
+}
+
+
+// Expand a Compressed Segment's Words
+// Expands the compressed block that holds the word into this thread's cache, unless it is there already
+// (evicting the least recently used block).
+// in: i = segment's index (0..segments()-1; a compressed segment)
+//     word = index of a word in the segment's committed words
+// out: n = number of words from word to the end of its compressed block (at least 1)
+//      returns the word's address in the cache, valid until this thread's next call
+// throws: Exception if the compressed block is corrupt
+const uint32_t *ArchiveReader::expand(size_t i, uint32_t word, uint32_t &n) const {
+    const Mapping &m = maps[i];
+    size_t k = std::upper_bound( m.dir.begin(), m.dir.end(), word,
+                                 [](uint32_t w, const CompressedBlock &c) { return w < c.word; } ) - m.dir.begin() - 1;
+    const CompressedBlock &c = m.dir[k];
+    BlockCache::Entry *e = nullptr;
+    for (BlockCache::Entry &x : cache.e)
+        if (x.reader == id && x.seg == i && x.block == k) { e = &x;  break; }
+    if (e == nullptr) {
+        e = &cache.e[0];
+        for (BlockCache::Entry &x : cache.e)
+            if (x.used < e->used)  e = &x;
+        e->reader = 0;                                      // (unused if decodeBlock() throws)
+        e->words.resize(c.words);
+        codec::decodeBlock( reinterpret_cast<const uint32_t *>(static_cast<const uint8_t *>(m.p) + c.offset),
+                            c.bytes / 4, e->words.data(), c.words );
+        e->reader = id;
+        e->seg = i;
+        e->block = k;
+    }
+    e->used = ++cache.tick;
+    n = c.word + c.words - word;
+    return e->words.data() + (word - c.word);
+}
+
+
+// Find a Segment's Blocks in a Time Range
+// in: i = segment's index (0..segments()-1)
+//     t0, t1 = time range [t0, t1) in unwrapped microseconds
+// out: b0, b1 = the blocks [b0, b1) that may have packets in the range (b0 == b1 if none)
+void ArchiveReader::blockRange(size_t i, uint64_t t0, uint64_t t1, size_t &b0, size_t &b1) const {
+    const std::vector<IndexBlock> &b = segs[i].blocks;
+    b0 = std::partition_point(b.begin(), b.end(), [t0](const IndexBlock &k) { return k.last < t0; }) - b.begin();
+    b1 = std::partition_point(b.begin() + b0, b.end(), [t1](const IndexBlock &k) { return k.first < t1; }) - b.begin();
+}
+
+
+// Count the Packets
+uint64_t ArchiveReader::packets() const {
+    uint64_t n = 0;
+    for (const Segment &s : segs)  n += s.ix.packets;
+    return n;
+}
+
+
+// Count a Type's Packets
+// in: type = packet type (0..63)
+uint64_t ArchiveReader::packets(unsigned type) const {
+    uint64_t n = 0;
+    for (const Segment &s : segs)  n += s.ix.perType[type];
+    return n;
+}
+
+
+// Time of the First Packet (0 if none)
+uint64_t ArchiveReader::first() const {
+    for (const Segment &s : segs)
+        if (!s.blocks.empty())  return s.blocks.front().first;
+    return 0;
+}
+
+
+// Time of the Last Packet (0 if none)
+uint64_t ArchiveReader::last() const {
+    for (size_t i = segs.size(); i-- != 0;  )
+        if (!segs[i].blocks.empty())  return segs[i].blocks.back().last;
+    return 0;
+}
+
+
+// Print Status (for debugging)
+void ArchiveReader::printStatus() const {
+    size_t blocks = 0, built = 0, open = 0, compressed = 0;
+    for (const Segment &s : segs) {
+        blocks += s.blocks.size();
+        if (s.built)  built++;
+        if (s.h.state != SegmentHeader::CLOSED)  open++;
+        if (s.words == nullptr)  compressed++;
+    }
+    printf("Capture Archive (%s.*.seg)\n", base);
+    printf("    segments       =  %10zu   ; segment files (%zu open)\n", segs.size(), open);
+    printf("    compressed     =  %10zu   ; segments read from .segz files (blocks expanded as queries visit them)\n", compressed);
+    printf("    indexed        =  %10zu   ; indexes built now (the others were loaded from .idx files)\n", built);
+    printf("    blocks         =  %10zu   ; index blocks of about %u words\n", blocks, BLOCK_WORDS);
+    printf("    packets        =  %10llu   ; packets archived\n", (unsigned long long) packets());
+    for (const telemetry::Schema &t : telemetry::table)
+        printf( "    %-14s =  %10llu   ; type %u: %s\n",
+                t.name, (unsigned long long) packets(t.type), t.type, t.description );
+    if (packets() != 0)
+        printf("    span           =  %10.6f   ; seconds from the first packet to the last\n", 1e-6 * double(last() - first()));
+    putchar('\n');
+}
@@ -0,0 +1,343 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "telemetry.h"
+
+struct CompressedBlock;
+
+
+/* -----  Capture Archive  -----
+ *
+ * An archive is a sequence of segment files <base>.<NNNN>.seg (NNNN = 0000, 0001, ...), each of the same size
+ * (preallocated; SEGMENT_BYTES by default), little endian:
+ *
+ *   Offset  Size  Field          Description
+ *   ------  ----  -------------  ------------------------------------------------------------------------------------
+ *        0     4  magic          ARCHIVE_MAGIC ("DCMA")
+ *        4     2  version        ARCHIVE_VERSION; readers must reject other versions
+ *        6     2  headerSize     64:  the packets begin at this offset
+ *        8     4  index          segment's index in the archive (NNNN)
+ *       12     4  state          OPEN (being written, or the writer was interrupted) or CLOSED
+ *       16     4  creationDate   firmware's creation date (0xYYMMDDHH)
+ *       20     4  buildDate      firmware's build date (0xYYMMDDHH)
+ *       24    12  dec[6]         DCM ports' decimation when the segment started (uint16_t; see below)
+ *       36     4  capacity       segment's capacity in 32-bit words after the header
+ *       40     8  startTime      segment's creation time in microseconds since the Unix epoch
+ *       48     8  firstTime      unwrapped time of the segment's first packet in microseconds (see below)
+ *       56     4  words          number of committed 32-bit words after the header
+ *       60     4  packets        number of committed packets
+ *
+ * After the header are the words of well-formed telemetry packets (see telemetry.def), each beginning with its
+ * header word; a packet never spans two segments.  Only the first `words` words are valid:  the rest of the file
+ * is unspecified.  To get a packet's 64-bit time, unwrap its 26-bit timestamp with telemetry::Clock(firstTime)
+ * (t += (timestamp - t) mod 2**26), packet by packet; firstTime continues across segments, so the times of the
+ * whole archive increase monotonically.  Packets the decoder rejects (unknown type, malformed) are not archived.
+ * If the decimation changes during the capture (see DecimationController), a host-written `decimation` packet
+ * records the new values at that point, and the following segments' dec[] are the latest ones.
+ *
+ * Group commit:  append() only copies packets into the current segment with pwrite(), which does not wait for the
+ * disk.  A committer thread makes them durable every COMMIT_MS, and whenever a segment is closed:  fdatasync(),
+ * then the header's words, packets, and state are rewritten and synced again.  So an hours-long capture costs two
+ * syncs per COMMIT_MS, and a power loss loses at most the packets appended since the last commit (less than one
+ * segment).  After a crash, the last segment's state is OPEN, and its header counts only committed packets.
+ *
+ * append() accepts words in pieces of any size (e.g., DcmCapture's chunks):  a packet cut off at the end of a
+ * piece is carried over to the next one.
+ */
+struct SegmentHeader {
+    enum State: uint32_t { OPEN = 0, CLOSED = 1 };
+    uint32_t magic;             // ARCHIVE_MAGIC
+    uint16_t version;           // ARCHIVE_VERSION
+    uint16_t headerSize;        // sizeof(SegmentHeader)
+    uint32_t index;             // segment's index
+    uint32_t state;             // OPEN or CLOSED
+    uint32_t creationDate;      // firmware's creation date
+    uint32_t buildDate;         // firmware's build date
+    uint16_t dec[6];            // DCM ports' decimation
+    uint32_t capacity;          // capacity in words after the header
+    uint64_t startTime;         // creation time (us since the Unix epoch)
+    uint64_t firstTime;         // first packet's unwrapped time (us)
+    uint32_t words;             // committed words
+    uint32_t packets;           // committed packets
+};
+
+static constexpr uint32_t ARCHIVE_MAGIC   = 0x414D4344;     // "DCMA"
+static constexpr uint16_t ARCHIVE_VERSION = 1;
+
+
+// Capture's Metadata (recorded in each segment's header)
+struct ArchiveInfo {
+    uint32_t creationDate;      // firmware's creation date
+    uint32_t buildDate;         // firmware's build date
+    uint16_t dec[6];            // DCM ports' decimation
+};
+
+
+/* -----  Archive Writer  -----
+ *
+ * Appends telemetry to an archive (see SegmentHeader).  append() is called by one thread; a committer thread
+ * syncs the segments.  If a write or sync fails, the next append() or commit() throws.
+ */
+class ArchiveWriter {
+
+public:
+    struct Stats {
+        uint64_t packets;           // packets archived
+        uint64_t words;             // words archived
+        uint64_t rejected;          // words rejected by the decoder (unknown type or malformed)
+        uint64_t commits;           // group commits
+        double maxCommitMs;         // longest group commit
+        uint32_t segments;          // segments written
+    };
+
+private:
+    struct Visitor;
+    struct Segment {
+        int fd;
+        SegmentHeader h;            // header; words and packets are as of the last append()
+    };
+
+    char base[200];                 // segments' path without extension
+    ArchiveInfo info;
+    uint32_t capacity;              // segment's capacity in words
+    telemetry::Clock clock;
+    Segment cur;                    // current segment (fd < 0 before the first packet)
+    uint32_t written;               // words written to the current segment
+    uint32_t packets;               // packets written to the current segment
+    std::vector<uint32_t> stage;    // packets not yet written to the current segment
+    std::vector<uint32_t> carry;    // words of a packet cut off by the end of the previous append()
+    Stats st;                       // commits and maxCommitMs are guarded by m
+
+    // shared with the committer (guarded by m)
+    std::mutex m;
+    std::condition_variable cv, cvDone;
+    Segment pub;                    // current segment as of the last flush (fd < 0 if none)
+    std::vector<Segment> closing;   // closed segments not yet committed
+    uint64_t requested, completed;  // commit() requests and completed commits
+    bool stopping;
+    std::atomic<bool> failed;
+    int error;                      // errno of the failed write or sync
+    std::thread committer;
+
+    void openSegment(uint64_t firstTime);
+    void closeSegment();
+    void flush();
+    void put(const uint32_t *w, unsigned n, uint64_t time);
+    size_t decodeWords(const uint32_t *w, size_t n);
+    void commitLoop();
+    bool sync(Segment &s);
+    void check();
+
+public:
+    static constexpr uint32_t SEGMENT_BYTES = 64u << 20;    // default segment size
+    static constexpr double COMMIT_MS       = 1000;         // group commit interval in milliseconds
+    static constexpr size_t STAGE_WORDS     = 16384;        // words staged before they are written
+
+    ArchiveWriter(const char *base, const ArchiveInfo &info, uint32_t segmentBytes = SEGMENT_BYTES);
+    ArchiveWriter(const ArchiveWriter &) = delete;              // delete copy constructor
+    ArchiveWriter &operator=(const ArchiveWriter &) = delete;   // delete assignment operator
+    ~ArchiveWriter();
+    void append(const uint32_t *w, size_t n);
+    void commit();
+    Stats stats();
+    void printStatus();
+};
+
+
+/* -----  Archive Index  -----
+ *
+ * A sparse index of one segment, kept in a sidecar file <base>.<NNNN>.idx next to it (little endian):  an
+ * IndexHeader, then `blocks` IndexBlocks.  A block is a run of consecutive packets of about BLOCK_WORDS words
+ * (64 KiB); for each block the index records its offset, its time range (time -> offset), and a mask of the packet
+ * types in it (type -> blocks).  A query binary-searches the blocks by time, skips the blocks without the types
+ * wanted, and decodes only the others, so it touches only their pages of the mapped segment.
+ *
+ * The sidecar is rebuilt by ArchiveReader whenever it is missing, has another version, or does not match its
+ * segment's startTime and committed words (e.g. a segment that was still OPEN when it was indexed).  It is written
+ * to <base>.<NNNN>.idx.tmp and renamed, so a reader never sees a partial sidecar.
+ */
+struct IndexHeader {
+    uint32_t magic;             // INDEX_MAGIC
+    uint16_t version;           // INDEX_VERSION
+    uint16_t headerSize;        // sizeof(IndexHeader)
+    uint64_t startTime;         // segment's startTime
+    uint32_t words;             // segment's committed words when it was indexed
+    uint32_t packets;           // segment's committed packets when it was indexed
+    uint32_t blockWords;        // BLOCK_WORDS when it was indexed
+    uint32_t blocks;            // number of IndexBlocks after the header
+    uint64_t types;             // bit t is set if the segment has packets of type t
+    uint32_t perType[telemetry::TYPES];     // segment's packets of each type
+};
+
+struct IndexBlock {
+    uint32_t offset;            // index of the block's first word (after the segment's header)
+    uint32_t words;             // block's words
+    uint32_t packets;           // block's packets
+    uint32_t reserved;          // 0
+    uint64_t first, last;       // unwrapped times of the block's first and last packets (us)
+    uint64_t types;             // bit t is set if the block has packets of type t
+};
+
+static constexpr uint32_t INDEX_MAGIC   = 0x58434D44;       // "DCMX"
+static constexpr uint16_t INDEX_VERSION = 1;
+
+
+/* -----  Archive Reader  -----
+ *
+ * Reads an archive (see SegmentHeader) by mapping its segments read-only:  packets are decoded in place, without
+ * copying, and only the pages a query needs are read from the disk.  The constructor loads each segment's sidecar
+ * index, or builds it (one pass over the segment) and writes it.  For example, to count the type-0 packets between
+ * 10 s and 20 s:
+ *
+ *     ArchiveReader a("/data/soak");
+ *     uint64_t n = 0;
+ *     a.query(10000000, 20000000, ArchiveReader::typeMask(0), [&](const auto &r) { n++; });
+ *
+ * A compressed segment (<base>.<NNNN>.segz, see codec.h) is read instead of a missing <base>.<NNNN>.seg:  it is
+ * mapped too, and a query expands only the compressed blocks it visits, into a small per-thread cache of
+ * CACHE_BLOCKS blocks (the index's blocks and the codec's have the same boundaries, so queries of neighbouring
+ * time ranges reuse a block instead of expanding it again).  Opening it reads only its directory, unless its index
+ * must be built.  A visitor must not query a compressed segment itself (it could evict the block being decoded).
+ *
+ * The visitor is called as telemetry::decode()'s is, but only with the Records of the types and times wanted,
+ * in order; a Record's offset is its header's index in its segment's words.  Queries are const, and may run in
+ * parallel (e.g., one thread per segment with querySegment(), or per run of blocks with blockRange() and
+ * queryBlocks()).
+ */
+class ArchiveReader {
+
+public:
+    struct Segment {
+        SegmentHeader h;                    // header (as of opening)
+        const uint32_t *words;              // committed words (mapped), or nullptr if compressed
+        IndexHeader ix;                     // index
+        std::vector<IndexBlock> blocks;
+        bool built;                         // true if the index was built when the segment was opened
+    };
+
+private:
+    // Decoder's Visitor:  passes on the Records of the types and times wanted
+    template<class V>
+    struct Filter {
+        V &visit;
+        uint64_t t0, t1, types;
+        size_t offset;                      // block's offset in the segment's words
+
+        template<class P>
+        void operator()(const telemetry::Record<P> &r) {
+            if ((types >> P::type & 1) != 0 && r.time >= t0 && r.time < t1)
+                visit(telemetry::Record<P>{ r.time, r.offset + offset, r.words });
+        }
+        void operator()(const telemetry::Error &) {}        // (segments are checked when they are indexed)
+    };
+
+    struct Indexer;
+    struct Mapping {
+        void *p;                            // mapped segment or compressed segment
+        size_t n;
+        std::vector<CompressedBlock> dir;   // compressed segment's directory (empty if not compressed)
+    };
+
+    char base[200];                         // segments' path without extension
+    uint64_t id;                            // this reader's serial number (tags its blocks in the caches)
+    std::vector<Segment> segs;
+    std::vector<Mapping> maps;              // segs[i]'s mapping is maps[i]
+
+    void openSegment(uint32_t index);
+    void openCompressed(uint32_t index);
+    void addSegment(const SegmentHeader &h, const uint32_t *words, const Mapping &m);
+    bool loadIndex(const char *fn, Segment &s);
+    void buildIndex(const char *fn, Segment &s, const Mapping &m);
+    const uint32_t *expand(size_t i, uint32_t word, uint32_t &n) const;
+    void unmap();
+
+public:
+    static constexpr uint32_t BLOCK_WORDS = 16384;          // index's block size in words
+    static constexpr unsigned CACHE_BLOCKS = 4;             // expanded compressed blocks cached per thread
+
+    explicit ArchiveReader(const char *base);
+    ArchiveReader(const ArchiveReader &) = delete;              // delete copy constructor
+    ArchiveReader &operator=(const ArchiveReader &) = delete;   // delete assignment operator
+    ~ArchiveReader();
+
+    static uint64_t typeMask(unsigned type) { return 1ull << type; }
+    static constexpr uint64_t ALL_TYPES = ~0ull;
+
+    size_t segments() const { return segs.size(); }
+    const Segment &segment(size_t i) const { return segs[i]; }
+    uint64_t packets() const;
+    uint64_t packets(unsigned type) const;
+    uint64_t first() const;
+    uint64_t last() const;
+
+    void blockRange(size_t i, uint64_t t0, uint64_t t1, size_t &b0, size_t &b1) const;
+    template<class V>
+    void queryBlocks(size_t i, size_t b0, size_t b1, uint64_t t0, uint64_t t1, uint64_t types, V &&visit) const;
+    template<class V>
+    void querySegment(size_t i, uint64_t t0, uint64_t t1, uint64_t types, V &&visit) const;
+    template<class V>
+    void query(uint64_t t0, uint64_t t1, uint64_t types, V &&visit) const;
+
+    void printStatus() const;
+};
+
+
+// Query a Segment's Blocks
+// in: i = segment's index (0..segments()-1)
+//     b0, b1 = blocks [b0, b1) of the segment (see blockRange())
+//     t0, t1 = time range [t0, t1) in unwrapped microseconds
+//     types = mask of the packet types wanted (bit t for type t; see typeMask())
+// in out: visit = called with a const telemetry::Record<P> & for each packet wanted, in order
+template<class V>
+void ArchiveReader::queryBlocks(size_t i, size_t b0, size_t b1, uint64_t t0, uint64_t t1, uint64_t types, V &&visit) const {
+    const Segment &s = segs[i];
+    for (size_t k = b0; k < b1; k++) {
+        const IndexBlock &b = s.blocks[k];
+        if ((b.types & types) == 0)  continue;
+        telemetry::Clock clock(b.first);
+        Filter<V> f = { visit, t0, t1, types, b.offset };
+        if (s.words != nullptr) {
+            telemetry::decode(s.words + b.offset, b.words, clock, f);
+            continue;
+        }
+        for (uint32_t o = b.offset, end = b.offset + b.words;  o < end;  ) {      // compressed:  block by block
+            uint32_t n;
+            const uint32_t *w = expand(i, o, n);
+            n = std::min(n, end - o);
+            f.offset = o;
+            telemetry::decode(w, n, clock, f);
+            o += n;
+        }
+    }
+}
+
+
+// Query a Segment
+// in: i = segment's index (0..segments()-1)
+//     t0, t1 = time range [t0, t1) in unwrapped microseconds
+//     types = mask of the packet types wanted (bit t for type t; see typeMask())
+// in out: visit = called with a const telemetry::Record<P> & for each packet wanted, in order
+template<class V>
+void ArchiveReader::querySegment(size_t i, uint64_t t0, uint64_t t1, uint64_t types, V &&visit) const {
+    size_t b0, b1;
+    if ((segs[i].ix.types & types) == 0)  return;
+    blockRange(i, t0, t1, b0, b1);
+    queryBlocks(i, b0, b1, t0, t1, types, visit);
+}
+
+
+// Query the Archive
+// in: t0, t1 = time range [t0, t1) in unwrapped microseconds
+//     types = mask of the packet types wanted (bit t for type t; see typeMask())
+// in out: visit = called with a const telemetry::Record<P> & for each packet wanted, in order
+template<class V>
+void ArchiveReader::query(uint64_t t0, uint64_t t1, uint64_t types, V &&visit) const {
+    for (size_t i = 0; i < segs.size(); i++)  querySegment(i, t0, t1, types, visit);
+}
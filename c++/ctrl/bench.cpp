@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "common.h"
+#include "peripherals.h"
+#include "timebase.h"
+#include "app.h"
+
+// DAP Benchmark
+//
+// Measures the latency and throughput of DAP reads, writes, batches, and the DCM buffer's readout over any
+// transport, and prints them as CSV, one row per workload, so runs can be diffed between firmware and software
+// versions.  Run by "make bench" (set BENCH_ARGS for options; see help()).
+//
+// Each workload repeats one iteration (e.g., a single read, or a batch of 256 reads) for a time budget, after a
+// few untimed warm-up iterations.  Every iteration is timed with Stopwatch (CLOCK_MONOTONIC_RAW), giving the
+// latency percentiles; the whole run is also timed by the PL's usTime, unwrapped by a Timebase (so runs may exceed
+// its 67.1 s wrap), giving a second ops/s measured by the firmware's clock.  Slow iterations (e.g., a full DCM
+// readout over the serial port) get fewer warm-up and minimum iterations, so each workload keeps about its budget.
+
+
+
+// ******************
+// *  Measurements  *
+// ******************
+
+
+// Benchmark Result
+struct Result {
+    const char *workload;       // workload's name, e.g. "batch"
+    unsigned opsPerIter;        // DAP operations (words) per iteration
+    std::vector<double> lat;    // each iteration's latency in seconds
+    double wall;                // whole run's duration in seconds (host clock)
+    double pl;                  // whole run's duration in seconds (PL clock)
+};
+
+
+// Percentile of Sorted Samples
+// in: x = samples in ascending order (not empty)
+//     p = percentile (0..100)
+// out: returns the nearest-rank percentile
+static double percentile(const std::vector<double> &x, double p) {
+    size_t k = size_t(ceil(p / 100.0 * double(x.size())));
+    return x[k == 0  ?  0  :  std::min(k, x.size()) - 1];
+}
+
+
+// Run a Workload
+// Warms up for up to WARMUP iterations or WARMUP_SHARE of the budget (at least one iteration), then times at least
+// MIN_ITERS iterations, or as many as the warm-up's mean iteration time says fit the budget (at least one).
+// in: tb = timebase, for the PL's clock
+//     workload = workload's name
+//     opsPerIter = DAP operations per iteration
+//     budget = time budget in seconds
+//     iter = one iteration; called with the iteration's number
+// out: returns the measurements
+// throws: Exception if the DAP fails
+template<typename F>
+static Result run(Timebase &tb, const char *workload, unsigned opsPerIter, double budget, F iter) {
+    static constexpr int WARMUP = 8;                // max. untimed iterations
+    static constexpr double WARMUP_SHARE = 0.1;     // max. share of the budget spent warming up, after one iteration
+    static constexpr size_t MIN_ITERS = 16;         // min. timed iterations, if the budget allows them
+    Result r = { workload, opsPerIter, {}, 0, 0 };
+    tb.poll();                                      // (keeps the timebase's fit current, untimed)
+    Stopwatch warm;
+    int n = 0;
+    do  iter(n++);
+    while (n < WARMUP && warm.elapsed() < WARMUP_SHARE * budget && !ctrlC);
+    double t = warm.elapsed() / n;
+    size_t minIters = t > 0  ?  std::max(size_t(1), std::min(MIN_ITERS, size_t(budget / t)))  :  MIN_ITERS;
+    Stopwatch total;
+    uint64_t pl0 = tb.readPlTime();
+    Stopwatch sw;
+    for (size_t i = 0;  (i < minIters || total.elapsed() < budget) && !ctrlC;  i++) {
+        sw.reset();
+        iter(int(i));
+        r.lat.push_back(sw.elapsed());
+    }
+    r.wall = total.elapsed();
+    r.pl = double(tb.readPlTime() - pl0) * 1e-6;
+    std::sort(r.lat.begin(), r.lat.end());
+    return r;
+}
+
+
+// Print a Result as a CSV Row
+// in: r = measurements
+//     transport = transport's name
+static void print(const Result &r, const char *transport) {
+    double sum = 0;
+    for (double t : r.lat)  sum += t;
+    double ops = double(r.opsPerIter) * double(r.lat.size());
+    printf( "%s,%s,%08X,%08X,%u,%zu,%.2f,%.2f,%.2f,%.2f,%.2f,%.0f,%.0f\n",
+            r.workload, transport, APP_FW_BUILD, peripherals.dap.buildDate(), r.opsPerIter, r.lat.size(),
+            1e6 * percentile(r.lat, 50), 1e6 * percentile(r.lat, 99), 1e6 * percentile(r.lat, 99.9),
+            1e6 * sum / double(r.lat.size()), 1e6 * r.lat.back(),
+            ops / r.wall,  r.pl > 0  ?  ops / r.pl  :  0.0 );
+    fflush(stdout);
+}
+
+
+
+// **********
+// *  Main  *
+// **********
+
+
+// Print Help
+static void help() {
+    puts( "\n"
+        "usage:  sudo ./dapbench [-t <transport>] [-T <seconds>] [--no-dump]\n\n"
+        "    -t <transport>      -- DAP transport, as ./" APP_FILE " -t (default: DAP_TRANSPORT, else mmio)\n"
+        "    -T <seconds>        -- Time budget per workload (default: 0.5)\n"
+        "    --no-dump           -- Skip the full DCM buffer readout\n\n"
+        "Prints CSV:  workload, transport, app_fw_build, fw_build, ops_per_iter, iters, p50_us, p99_us, p999_us,\n"
+        "mean_us, max_us, ops_per_s (host clock), pl_ops_per_s (PL clock).  Latencies are per iteration.\n"
+    );
+}
+
+
+// Main
+int main(int argc, char *argv[]) {
+    using namespace regmap;
+    const char *spec = nullptr;
+    double budget = 0.5;
+    bool dump = true;
+    for (int i = 1; i < argc; i++) {
+        if (strEq(argv[i], "-t") && i + 1 < argc)  spec = argv[++i];
+        else if (strEq(argv[i], "-T") && i + 1 < argc)  budget = atof(argv[++i]);
+        else if (strEq(argv[i], "--no-dump"))  dump = false;
+        else { help();  return strEq(argv[i], "-h") || strEq(argv[i], "--help")  ?  0  :  1; }
+    }
+
+    int errCode = 0;
+    try {
+        catchCtrlC(true);
+        peripherals.init(spec);
+        Dap &dap = peripherals.dap;
+        const char *transport = dap.transport()->name();
+        uint32_t leds = dap.read<bio::leds>();
+        Timebase tb(dap);
+        tb.round();
+
+        puts("workload,transport,app_fw_build,fw_build,ops_per_iter,iters,p50_us,p99_us,p999_us,mean_us,max_us,ops_per_s,pl_ops_per_s");
+        print(run(tb, "read", 1, budget, [&](int) { dap.read(bio::MODULE, bio::buildDate::addr); }), transport);
+        print(run(tb, "write", 1, budget, [&](int i) { dap.write(bio::MODULE, bio::leds::addr, i & 0xF); }), transport);
+        print(run(tb, "typed_read", 1, budget, [&](int) { dap.read<bio::usTime>(); }), transport);
+        print(run(tb, "mixed", 2, budget, [&](int i) {
+            dap.write(bio::MODULE, bio::leds::addr, i & 0xF);
+            dap.read(bio::MODULE, bio::buildDate::addr);
+        }), transport);
+
+        std::vector<DapOp> ops;
+        std::vector<uint32_t> results(4096);
+        for (unsigned n = 1; n <= 4096; n *= 2) {
+            ops.clear();
+            for (unsigned k = 0; k < n; k++)  ops.push_back({ DapOp::READ, dcm::MODULE, int(dcm::data::addr + k), 0, 0 });
+            print(run(tb, "batch", n, budget, [&](int) { dap.execute(ops.data(), n, results.data()); }), transport);
+        }
+        for (unsigned n = 1; n <= 4096; n *= 2) {
+            ops.clear();
+            for (unsigned k = 0; k < n; k++)  ops.push_back(bio::leds::writeOp(k));
+            print(run(tb, "batch_write", n, budget, [&](int) { dap.execute(ops.data(), n, results.data()); }), transport);
+        }
+
+        if (dump) {
+            uint32_t size = peripherals.dcm.size();
+            std::vector<uint32_t> buf(size);
+            print(run(tb, "dcm_readout", size, budget, [&](int) { dap.readBlock(dcm::MODULE, dcm::data::addr, size, buf.data()); }), transport);
+        }
+        dap.write<bio::leds>(leds);
+    }
+    catch (const Exception &e) {
+        printf("ERROR at %s:%d : %s\n", e.fileName, e.lineNo, e.what());
+        errCode = 1;
+    }
+    return errCode;
+}
@@ -0,0 +1,233 @@
+#include <cstdio>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "blob.h"
+#include "common.h"
+
+// Blob Golden Model
+//
+// Models blob.v's chain of blob modules bit for bit, fed a 128x128 16-bit frame in raster order
+
+
+
+static_assert(BlobModel::WIDTH == 128, "rowMask() scans 128-pixel rows");
+
+static constexpr uint32_t MASK15 = 0x7FFF;                  // count's bits
+static constexpr uint32_t MASK23 = 0x7FFFFF;                // xi's and yi's bits
+static constexpr uint32_t MASK30 = 0x3FFFFFFF;              // sum_i's bits
+static constexpr uint64_t MASK36 = 0xFFFFFFFFFULL;          // sum_xi's and sum_yi's bits
+
+
+// Find a Row's Nonzero Pixels
+// in: row = WIDTH pixels
+// out: m = bit x of m[x / 64] is set iff row[x] is nonzero
+static inline void rowMask(const uint16_t *row, uint64_t m[2]) {
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    for (int h = 0; h < 2; h++) {
+        uint64_t bits = 0;
+        for (int i = 0; i < 64; i += 16) {
+            __m128i a = _mm_loadu_si128((const __m128i *) (row + 64 * h + i)),
+                    b = _mm_loadu_si128((const __m128i *) (row + 64 * h + i + 8));
+            __m128i z = _mm_packs_epi16(_mm_cmpeq_epi16(a, zero), _mm_cmpeq_epi16(b, zero));    // 0xFF per zero pixel
+            bits |= uint64_t(uint16_t(~_mm_movemask_epi8(z))) << i;
+        }
+        m[h] = bits;
+    }
+#else
+    m[0] = m[1] = 0;
+    for (int x = 0; x < BlobModel::WIDTH; x += 4) {
+        uint64_t q;
+        memcpy(&q, row + x, 8);
+        if (q == 0)  continue;                              // (most of a sparse frame)
+        for (int j = 0; j < 4; j++)
+            if (row[x + j] != 0)  m[x >> 6] |= 1ULL << ((x + j) & 63);
+    }
+#endif
+}
+
+
+// Put a Field into a Record's Words
+// in out: w = six 32-bit words, least significant first
+// in: lsb = field's lowest bit
+//     width = field's width in bits
+//     v = field's value (only its width bits are used)
+static void putBits(uint32_t w[6], unsigned lsb, unsigned width, uint64_t v) {
+    while (width != 0) {
+        unsigned off = lsb & 31, take = width < 32 - off  ?  width  :  32 - off;
+        w[lsb >> 5] |= uint32_t(v & ((1ULL << take) - 1)) << off;
+        v >>= take;
+        lsb += take;
+        width -= take;
+    }
+}
+
+
+// Get a Field from a Record's Words
+// in: w = six 32-bit words, least significant first
+//     lsb = field's lowest bit
+//     width = field's width in bits
+// out: returns the field's value
+static uint64_t getBits(const uint32_t w[6], unsigned lsb, unsigned width) {
+    uint64_t v = 0;
+    for (unsigned got = 0; got < width; ) {
+        unsigned off = lsb & 31, take = width - got < 32 - off  ?  width - got  :  32 - off;
+        v |= uint64_t(w[lsb >> 5] >> off & ((1ULL << take) - 1)) << got;
+        lsb += take;
+        got += take;
+    }
+    return v;
+}
+
+
+// Pack a Record into blob_out's 162 Bits
+// {valid, x0, y0, x1, y1, count, max_i, sum_i, sum_xi, sum_yi}, MSB first, so sum_yi's LSB is bit 0.
+// out: w = six 32-bit words, least significant first (bits 162 .. 191 are 0)
+void BlobModel::Record::pack(uint32_t w[6]) const {
+    memset(w, 0, 6 * sizeof(uint32_t));
+    putBits(w,   0, 36, sumYI);
+    putBits(w,  36, 36, sumXI);
+    putBits(w,  72, 30, sumI);
+    putBits(w, 102, 16, maxI);
+    putBits(w, 118, 15, count);
+    putBits(w, 133,  7, y1);
+    putBits(w, 140,  7, x1);
+    putBits(w, 147,  7, y0);
+    putBits(w, 154,  7, x0);
+    putBits(w, 161,  1, valid);
+}
+
+
+// Unpack a Record from blob_out's 162 Bits
+// in: w = six 32-bit words, least significant first (see pack())
+// out: returns the record
+BlobModel::Record BlobModel::Record::unpack(const uint32_t w[6]) {
+    Record r;
+    r.sumYI = getBits(w,   0, 36);
+    r.sumXI = getBits(w,  36, 36);
+    r.sumI  = uint32_t(getBits(w,  72, 30));
+    r.maxI  = uint16_t(getBits(w, 102, 16));
+    r.count = uint16_t(getBits(w, 118, 15));
+    r.y1    = uint8_t(getBits(w, 133, 7));
+    r.x1    = uint8_t(getBits(w, 140, 7));
+    r.y0    = uint8_t(getBits(w, 147, 7));
+    r.x0    = uint8_t(getBits(w, 154, 7));
+    r.valid = getBits(w, 161, 1) != 0;
+    return r;
+}
+
+
+// Format a Record as blob_out's 162 Bits in Hex
+// out: s = 41 hex digits, most significant first, and a terminating null
+void BlobModel::Record::toHex(char s[42]) const {
+    static const char digit[] = "0123456789ABCDEF";
+    uint32_t w[6];
+    pack(w);
+    for (int d = 0; d < 41; d++)  s[d] = digit[getBits(w, 4 * (40 - d), 4)];
+    s[41] = 0;
+}
+
+
+// Constructor
+// in: blobs = number of blob modules (1 .. MAX_BLOBS)
+// throws: Exception if blobs is out of range
+BlobModel::BlobModel(unsigned blobs) : n(blobs), valid(0) {
+    if (blobs < 1 || blobs > MAX_BLOBS)  throwException("Number of blobs out of range 1..%u", MAX_BLOBS);
+    memset(blob, 0, sizeof blob);
+    memset(&st, 0, sizeof st);
+}
+
+
+// Clock a Nonzero Pixel into the Blobs
+// in: x, y = pixel's coordinates
+//     i = its intensity (nonzero)
+void BlobModel::pixel(unsigned x, unsigned y, uint16_t i) {
+    uint32_t xi = x * i & MASK23, yi = y * i & MASK23;
+    unsigned captured = 0;
+    for (uint64_t m = valid; m != 0; m &= m - 1) {
+        Blob &b = blob[__builtin_ctzll(m)];
+        if (x + 1 < b.x0 || x > b.x1 + 1u || y + 1 < b.y0 || y > b.y1 + 1u)  continue;     // !absorb
+        b.x0 = b.x1 = uint8_t(x);                           // (blob.v sets the bounding box to the pixel)
+        b.y0 = b.y1 = uint8_t(y);
+        b.count = uint16_t((b.count + 1) & MASK15);
+        if (b.maxI < i)  b.maxI = i;
+        b.sumI = (b.sumI + i) & MASK30;
+        b.sumXI = (b.sumXI + xi) & MASK36;
+        b.sumYI = (b.sumYI + yi) & MASK36;
+        captured++;
+    }
+    if (captured > 1)  st.shared++;
+    if (captured != 0)  return;
+
+    // can_grab reaches the first empty blob
+    uint64_t empty = ~valid & (n == 64  ?  ~0ULL  :  (1ULL << n) - 1);
+    if (empty == 0) { st.lost++;  return; }
+    int k = __builtin_ctzll(empty);
+    Blob &b = blob[k];
+    b.x0 = b.x1 = uint8_t(x);
+    b.y0 = b.y1 = uint8_t(y);
+    b.count = 1;
+    b.maxI = i;
+    b.sumI = i;
+    b.sumXI = xi;
+    b.sumYI = yi;
+    valid |= 1ULL << k;
+}
+
+
+// Clock a Flush into the Blobs
+// in: flushY = flush_y, or < 0 for none
+// out: out = the flushed blobs' records are appended, in the order they leave the blob_out chain
+void BlobModel::flush(int flushY, std::vector<Record> &out) {
+    for (uint64_t m = valid; m != 0; ) {
+        int k = 63 - __builtin_clzll(m);
+        m &= ~(1ULL << k);
+        const Blob &b = blob[k];
+        if (b.y1 > flushY)  continue;
+        out.push_back({ true, b.x0, b.y0, b.x1, b.y1, b.count, b.maxI, b.sumI, b.sumXI, b.sumYI });
+        valid &= ~(1ULL << k);
+    }
+}
+
+
+// Model a Frame
+// in: pixels = WIDTH x HEIGHT pixels, row by row
+// out: out = the frame's blob records are appended, in blob_out's order
+//      returns the number of records appended
+size_t BlobModel::frame(const uint16_t *pixels, std::vector<Record> &out) {
+    Stopwatch sw;
+    size_t n0 = out.size();
+    for (int y = 0; y < HEIGHT; y++) {
+        const uint16_t *row = pixels + y * WIDTH;
+        uint64_t m[2];
+        rowMask(row, m);
+        for (int h = 0; h < 2; h++) {
+            st.pixels += __builtin_popcountll(m[h]);
+            for (uint64_t b = m[h]; b != 0; b &= b - 1) {
+                unsigned x = 64 * h + __builtin_ctzll(b);
+                pixel(x, y, row[x]);
+            }
+        }
+        if (valid != 0)  flush(y == HEIGHT - 1  ?  HEIGHT - 1  :  y - 1, out);
+    }
+    st.frames++;
+    st.records += out.size() - n0;
+    st.seconds += sw.elapsed();
+    return out.size() - n0;
+}
+
+
+// Print Status (for debugging)
+void BlobModel::printStatus() {
+    printf("Blob Golden Model (%u blobs)\n", n);
+    printf("    frames         =  %10llu   ; frames modelled\n", (unsigned long long) st.frames);
+    printf("    pixels         =  %10llu   ; nonzero pixels\n", (unsigned long long) st.pixels);
+    printf("    records        =  %10llu   ; blobs flushed\n", (unsigned long long) st.records);
+    printf("    shared         =  %10llu   ; nonzero pixels absorbed by more than one blob\n", (unsigned long long) st.shared);
+    printf("    lost           =  %10llu   ; nonzero pixels lost (no blob captured them, and none was empty)\n",
+           (unsigned long long) st.lost);
+    printf( "    throughput     =  %10.0f   ; frames per second\n", st.seconds > 0  ?  st.frames / st.seconds  :  0.0 );
+    putchar('\n');
+}
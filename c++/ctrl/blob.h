@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+/* -----  Blob Golden Model  -----
+ *
+ * Bit-exact model of blob.v, for validating the spotter against frames with known blobs, and for finding the
+ * blobs on the CPU when the PL is unavailable.  It models a chain of blob.v modules (16 by default), blob 0 at
+ * the head of the can_grab chain and the last at the blob_out end, fed a WIDTH x HEIGHT 16-bit frame in raster
+ * order, one pixel per clock.
+ *
+ * A blob module holds its registers at their widths:  bounding box x0, y0, x1, y1 (7 bits each), count (15),
+ * max_i (16), sum_i (30), sum_xi and sum_yi (36), where xi and yi are the 23-bit products x * i and y * i.  Each
+ * clock, with a nonzero pixel:
+ *
+ *     captured[k] = valid[k] && the pixel is within blob k's bounding box widened by 1 (clamped to 0 .. 127)
+ *     can_grab[0] = no blob captured the pixel;   can_grab[k+1] = can_grab[k] && !empty[k]
+ *
+ * Every blob that captures the pixel absorbs it (so overlapping blobs count it twice), and if none did, the first
+ * empty blob grabs it.  A pixel that no blob captures, when no blob is empty, is lost.  Like blob.v, absorbing a
+ * pixel SETS the bounding box to the pixel rather than extending it, so a blob only follows a chain of adjacent
+ * pixels; pixel() must change with blob.v when it does.
+ *
+ * Flush schedule (spotter.v does not chain the modules yet, so it is assumed):  a flush clock follows each row y,
+ * with flush_y = y - 1 (no later pixel can be adjacent to such a blob), and the last row's with flush_y = 127,
+ * which empties every blob at the end of the frame.  A flushed blob's record goes down the blob_out shift chain,
+ * which drains before the next flush (a row is WIDTH clocks), so each flush's records emerge in descending blob
+ * index; frame() returns them in that order.
+ *
+ * A record is blob_out's 162-bit struct; pack() gives it as six 32-bit words, least significant first, and
+ * toHex() as 41 hex digits, most significant first, to compare with an RTL simulation's dump.
+ *
+ * Speed:  frame() scans each row for nonzero pixels with SSE2 (or 8 bytes at a time without it), skipping empty
+ * rows, and only visits the valid blobs (a bit mask) for each nonzero pixel.  It does not allocate, except to grow
+ * the caller's vector.
+ */
+class BlobModel {
+
+public:
+    struct Record {
+        bool valid;                 // 1 for a flushed blob
+        uint8_t x0, y0, x1, y1;     // bounding box (7 bits each)
+        uint16_t count;             // number of nonzero pixels (15 bits)
+        uint16_t maxI;              // max. intensity
+        uint32_t sumI;              // sum of intensities (30 bits)
+        uint64_t sumXI;             // sum of x * intensity (36 bits)
+        uint64_t sumYI;             // sum of y * intensity (36 bits)
+
+        void pack(uint32_t w[6]) const;
+        static Record unpack(const uint32_t w[6]);
+        void toHex(char s[42]) const;
+    };
+
+    struct Stats {
+        uint64_t frames;            // frames modelled
+        uint64_t pixels;            // nonzero pixels
+        uint64_t shared;            // nonzero pixels absorbed by more than one blob
+        uint64_t lost;              // nonzero pixels neither captured nor grabbed (no blob empty)
+        uint64_t records;           // blobs flushed
+        double seconds;             // time in frame()
+    };
+
+private:
+    struct Blob {                   // one blob.v's registers
+        uint8_t x0, y0, x1, y1;
+        uint16_t count, maxI;
+        uint32_t sumI;
+        uint64_t sumXI, sumYI;
+    };
+
+    unsigned n;                     // number of blobs
+    uint64_t valid;                 // bit k = blob k is valid
+    Blob blob[64];                  // MAX_BLOBS blobs, the first n used
+    Stats st;
+
+    void pixel(unsigned x, unsigned y, uint16_t i);
+    void flush(int flushY, std::vector<Record> &out);
+
+public:
+    static constexpr int WIDTH      = 128;          // frame width in pixels (7-bit x)
+    static constexpr int HEIGHT     = 128;          // frame height in pixels (7-bit y)
+    static constexpr unsigned BLOBS = 16;           // default number of blobs
+    static constexpr unsigned MAX_BLOBS = 64;       // max. number of blobs
+
+    explicit BlobModel(unsigned blobs = BLOBS);
+    BlobModel(const BlobModel &) = delete;                  // delete copy constructor
+    BlobModel &operator=(const BlobModel &) = delete;       // delete assignment operator
+    size_t frame(const uint16_t *pixels, std::vector<Record> &out);
+    unsigned blobs() const { return n; }
+    const Stats &stats() const { return st; }
+    void printStatus();
+};
@@ -0,0 +1,320 @@
+#include <algorithm>
+#include <cstdarg>
+#include <cstring>
+#include <unistd.h>
+#include "common.h"
+#include "archive.h"
+#include "capture.h"
+#include "decimation.h"
+#include "peripherals.h"
+
+// Continuous DCM Capture
+//
+// Polls the Debug Capture Module, drains new words to rolling capture files, and re-arms the buffer (or streams
+// from its ring)
+
+
+
+// Constructor
+// Sets the DCM's buffer's mode, which clears it, and opens the log and the first capture file (or the archive).
+// in: dap, dcm = initialized DAP and DCM
+//     base = capture files' path without extension, e.g. "/data/soak"
+//     ring = true to stream from the DCM's ring, false to capture from its linear buffer with re-arms
+//     archive = true to write a capture archive, false to write capture files
+// throws: Exception if a file cannot be opened, or the DCM does not respond
+DcmCapture::DcmCapture(Dap &dap, DebugCaptureModule &dcm, const char *base, bool ring, bool archive)
+    : dap(dap), dcm(dcm), ring(ring) {
+    if (!strCpy(this->base, sizeof this->base, base))  throwException("Capture path too long: %s", base);
+    memset(&st, 0, sizeof st);
+    dst = nullptr;
+    fileBytes = 0;
+    droppedSeen = 0;
+    hurry = false;
+    size = dcm.size();
+    threshold = size / 4 * 3;
+    buf.resize(CHUNK);
+    char fn[256];
+    snprintf(fn, sizeof fn, "%s.log", base);
+    log = fopen(fn, "a");
+    if (log == nullptr)  throwException("Cannot open log file: %s", fn);
+    try {
+        dcm.setMode(ring  ?  DebugCaptureModule::RING  :  0);
+        Stopwatch sw;
+        while (dcm.control() & DebugCaptureModule::CLEAR)
+            if (sw.hasElapsed(1.0))  throwException("DCM's buffer did not clear");
+        pos = 0;
+        if (archive) {
+            ArchiveInfo info = { dap.creationDate(), dap.buildDate(), {} };
+            for (int p = 0; p < DebugCaptureModule::PORTS; p++)  info.dec[p] = uint16_t(dcm.decimation(p));
+            this->archive.reset(new ArchiveWriter(base, info));
+            logf("archive %s.*.seg", base);
+        }
+        else  openFile();
+    }
+    catch (...) { fclose(log);  throw; }
+    if (ring)  logf("streaming started; ring size %u words", size);
+    else  logf("capture started; buffer size %u words, re-arm threshold %u words", size, threshold);
+}
+
+
+// Destructor
+// Returns a ring to linear mode, and commits the archive.
+DcmCapture::~DcmCapture() {
+    archive.reset();
+    if (ring) {
+        try { dcm.setMode(0); }
+        catch (...) { logf("could not return the DCM's buffer to linear mode"); }
+    }
+    if (dst != nullptr)  fclose(dst);
+    fclose(log);
+}
+
+
+// Append a Line to the Log
+// in: fmt, ... = printf() format and arguments; the line is prefixed with the date and time
+void DcmCapture::logf(const char *fmt, ...) {
+    char t[32];
+    va_list args;
+    va_start(args, fmt);
+    fprintf(log, "%s  ", getDateTime(t, sizeof t));
+    vfprintf(log, fmt, args);
+    fputc('\n', log);
+    fflush(log);
+    va_end(args);
+}
+
+
+// Start a New Capture File
+// throws: Exception if the file cannot be opened
+void DcmCapture::openFile() {
+    if (dst != nullptr && fclose(dst) != 0)  logf("error closing capture file %u", st.files - 1);
+    char fn[256];
+    snprintf(fn, sizeof fn, "%s.%04u.bin", base, st.files);
+    dst = fopen(fn, "wb");
+    if (dst == nullptr)  throwException("Cannot open capture file: %s", fn);
+    st.files++;
+    fileBytes = 0;
+    logf("file %s", fn);
+}
+
+
+// Adapt the Ports' Decimation During the Capture
+// in: policy = target fill time, shares, ports of interest, and interval (see DecimationController)
+// throws: Exception if the policy is invalid, or the DAP fails
+void DcmCapture::adapt(const DecimationPolicy &policy) {
+    uint16_t dec[DecimationController::PORTS];
+    for (int p = 0; p < DecimationController::PORTS; p++)  dec[p] = uint16_t(dcm.decimation(p));
+    control.reset(new DecimationController(policy, size, dec));
+    logf( "adaptive decimation:  fill time %g s, interval %g s, ports of interest 0x%02X",
+          policy.fillSeconds, policy.interval, policy.interest );
+}
+
+
+// Append Words to the Capture File (or Archive)
+// in: w, n = words
+// throws: Exception if the capture file or archive cannot be written
+void DcmCapture::write(const uint32_t *w, size_t n) {
+    if (n == 0)  return;
+    if (archive) { archive->append(w, n);  return; }
+    if (fwrite(w, sizeof *w, n, dst) != n)  throwException("Cannot write capture file %s.%04u.bin", base, st.files - 1);
+    fileBytes += n * sizeof *w;
+}
+
+
+// Append buf's First n Words to the Capture File (or Archive)
+// With adaptive decimation, inserts the pending `decimation` packet where the controller places it.
+// throws: Exception if the capture file or archive cannot be written
+void DcmCapture::save(uint32_t n) {
+    st.words += n;
+    if (!control) { write(buf.data(), n);  return; }
+    const uint32_t *w = buf.data();
+    size_t left = n;
+    for (;;) {
+        bool insert;
+        size_t k = control->observe(w, left, insert);
+        write(w, k);
+        w += k;
+        left -= k;
+        if (!insert)  break;
+        write(control->packet(), DecimationController::ANNOTATION_WORDS);
+        control->placed();
+    }
+}
+
+
+// Capture the Buffer's Words from pos up to n
+// in: n = buffer's length (>= pos)
+// throws: Exception if the DAP fails or the capture file cannot be written
+void DcmCapture::drain(uint32_t n) {
+    while (pos < n) {
+        uint32_t k = std::min(n - pos, CHUNK);
+        dap.readBlock(DebugCaptureModule::MODULE, int(pos), k, buf.data());
+        save(k);
+        pos += k;
+    }
+}
+
+
+// Re-Arm the Buffer
+// Reads the length and clears the buffer in one batch, so that the lost window is as short as possible, then
+// drains the words up to that length.  Since the DCM refills the buffer from word 0, those words stay intact as
+// long as the refill has not reached pos, which is checked.
+// throws: Exception if the DAP fails, the clear times out, or the capture file cannot be written
+void DcmCapture::rearm() {
+    using namespace regmap;
+    static const DapOp ops[] = {
+        bio::usTime::readOp(),
+        dcm::length::readOp(),
+        dcm::control::writeOp(dcm::control_clear)
+    };
+    uint32_t x[3];
+    dap.execute(ops, 3, x);
+    Stopwatch sw;
+    while (dcm.control() & DebugCaptureModule::CLEAR)
+        if (sw.hasElapsed(1.0))  throwException("DCM's buffer did not clear");
+    uint32_t lost = (dap.read<bio::usTime>() - x[0]) & bio::usTime::mask;
+
+    uint32_t first = pos;
+    drain(x[1]);
+    bool overrun = x[1] > first && dcm.length() > first;        // the refill reached words read after the clear
+    st.rearms++;
+    st.lostUs += lost;
+    if (lost > st.maxLostUs)  st.maxLostUs = lost;
+    logf( "re-arm %llu at %u words; lost window %u us%s", (unsigned long long) st.rearms, x[1], lost,
+          overrun  ?  "; WARNING: refill overran the drain, last words may be corrupt"  :  "" );
+    pos = 0;
+    if (control)  control->resync();                       // the refill begins at a packet's header
+    if (fileBytes >= ROLL_BYTES)  openFile();
+}
+
+
+// Poll the Ring Once
+// Captures the words appended since the last poll, and returns their space to the DCM chunk by chunk.
+// throws: Exception if the DAP fails or a capture file cannot be written
+void DcmCapture::pollRing() {
+    using namespace regmap;
+    static const DapOp ops[] = { dcm::wrptr::readOp(), dcm::status::readOp(), dcm::dropped::readOp() };
+    uint32_t x[3];
+    dap.execute(ops, 3, x);
+    st.polls++;
+    uint32_t wr = x[0];
+    if (wr - pos > size) {
+        logf("ring was cleared by someone else at %u words; up to %u words lost", pos, size);
+        pos = 0;
+        droppedSeen = 0;
+        if (control)  control->resync();
+    }
+    if (x[2] != droppedSeen) {
+        st.overflows++;
+        st.dropped += x[2] - droppedSeen;
+        logf("overflow: ring was full; %u packets dropped since the previous poll", x[2] - droppedSeen);
+        droppedSeen = x[2];
+    }
+    hurry = x[1] & dcm::status_hwm;
+    while (pos != wr) {
+        uint32_t i = pos & (size - 1),
+                 k = std::min({ wr - pos, size - i, CHUNK });       // up to the end of the buffer
+        dap.readBlock(DebugCaptureModule::MODULE, int(i), k, buf.data());
+        save(k);
+        pos += k;
+        dap.write<dcm::rdptr>(pos);
+    }
+    if (fileBytes >= ROLL_BYTES)  openFile();
+}
+
+
+// Poll the Buffer Once
+// Captures the words appended since the last poll, and re-arms the buffer if its length reached the threshold.
+// throws: Exception if the DAP fails or a capture file cannot be written
+void DcmCapture::poll() {
+    using namespace regmap;
+    if (ring) { pollRing();  return; }
+    static const DapOp ops[] = { dcm::control::readOp(), dcm::length::readOp() };
+    uint32_t x[2];
+    dap.execute(ops, 2, x);
+    st.polls++;
+    if (x[0] & DebugCaptureModule::DUMP)  return;              // the buffer reads 0xDEADBEEF while dumping
+    uint32_t n = x[1];
+    if (n < pos) {
+        logf("buffer was cleared by someone else at %u words; up to %u words lost", pos, pos);
+        pos = 0;
+        if (control)  control->resync();
+    }
+    if (n >= size) {
+        st.overflows++;
+        logf("overflow: buffer was full; packets lost since the previous poll");
+    }
+    drain(n);
+    if (n >= threshold)  rearm();
+}
+
+
+// Retune the Ports' Decimation
+// Sets the controller's new decimations and reads the PL's usTime in one batch, and logs the change.
+// in: seconds = time since the previous retuning
+// throws: Exception if the DAP fails
+void DcmCapture::retune(double seconds) {
+    using namespace regmap;
+    constexpr int N = DecimationController::PORTS;
+    uint16_t next[N];
+    if (!control->retune(seconds, next))  return;
+    DapOp ops[N + 1];
+    for (int p = 0; p < N; p++)  ops[p] = dcm::dec::writeOp(p, next[p]);
+    ops[N] = bio::usTime::readOp();
+    uint32_t x[N + 1];
+    dap.execute(ops, N + 1, x);
+    control->changed(next, x[N]);
+    logf( "decimation %u %u %u %u %u %u; captured %.0f words/s%s", next[0], next[1], next[2], next[3], next[4],
+          next[5], control->rate(), control->bursting()  ?  "; burst"  :  "" );
+}
+
+
+// Capture Until Ctrl-C or a Time Limit
+// in: seconds = time limit, or 0 for no limit
+// throws: Exception if the DAP fails or a capture file cannot be written
+void DcmCapture::run(double seconds) {
+    Stopwatch total, sw, tune;
+    catchCtrlC(true);
+    try {
+        while (!ctrlC && (seconds <= 0 || !total.hasElapsed(seconds))) {
+            sw.reset();
+            poll();
+            if (control && tune.hasElapsed(control->interval())) {
+                double t = tune.elapsed();
+                tune.reset();
+                retune(t);
+            }
+            double idle = POLL_MS * 1e-3 - sw.elapsed();
+            if (idle > 0 && !hurry)  usleep(useconds_t(idle * 1e6));
+        }
+    }
+    catch (...) { catchCtrlC(false);  throw; }
+    catchCtrlC(false);
+    if (ring)
+        logf( "streaming stopped after %.1f s: %llu words in %u files, %llu overflows, %llu packets dropped",
+              total.elapsed(), (unsigned long long) st.words, st.files, (unsigned long long) st.overflows,
+              (unsigned long long) st.dropped );
+    else
+        logf( "capture stopped after %.1f s: %llu words in %u files, %llu re-arms, %llu overflows, lost windows %llu us "
+              "(max. %u us)", total.elapsed(), (unsigned long long) st.words, st.files, (unsigned long long) st.rearms,
+              (unsigned long long) st.overflows, (unsigned long long) st.lostUs, st.maxLostUs );
+}
+
+
+// Print Status (for debugging)
+void DcmCapture::printStatus() {
+    printf("DCM Capture (%s.*)\n", base);
+    printf("    words          =  %10llu   ; 32-bit words captured\n", (unsigned long long) st.words);
+    printf("    files          =  %10u   ; capture files\n", st.files);
+    printf("    polls          =  %10llu   ; polls of the buffer's length\n", (unsigned long long) st.polls);
+    if (!ring)  printf("    rearms         =  %10llu   ; buffer clears at %u words\n", (unsigned long long) st.rearms, threshold);
+    printf("    overflows      =  %10llu   ; polls that found the buffer full\n", (unsigned long long) st.overflows);
+    if (ring)  printf("    dropped        =  %10llu   ; packets dropped by the ring\n", (unsigned long long) st.dropped);
+    if (!ring) {
+        printf("    lost           =  %10llu   ; microseconds of lost windows\n", (unsigned long long) st.lostUs);
+        printf("    maxLost        =  %10u   ; longest lost window in microseconds\n", st.maxLostUs);
+    }
+    putchar('\n');
+    if (control)  control->printStatus();
+    if (archive)  archive->printStatus();
+}
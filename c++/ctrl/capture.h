@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+class ArchiveWriter;
+class Dap;
+class DebugCaptureModule;
+class DecimationController;
+struct DecimationPolicy;
+
+
+/* -----  Continuous DCM Capture  -----
+ *
+ * Captures the Debug Capture Module's telemetry for any length of time.  The DCM's buffer is linear:  once it is
+ * full, the DCM discards packets until the buffer is cleared.  This class polls the buffer's length, reads only
+ * the words appended since the last poll, and appends them to rolling capture files.  When the length reaches a
+ * threshold, it drains the buffer and clears it (re-arms), so the buffer never fills as long as the polls keep
+ * up.
+ *
+ * Packets appended between the last read of the length and the end of the clear are lost.  Each re-arm's lost
+ * window is measured with the PL's usTime and logged.  If the buffer was found full, packets were lost since the
+ * previous poll too (an overflow).  The DCM finishes the packet being appended before it clears, so a re-arm can
+ * truncate at most that packet; a clear also restarts the ports' decimation counters.
+ *
+ * Streaming:  with ring = true, the DCM's buffer is put in ring mode instead, and nothing is lost as long as the
+ * polls keep up.  Each poll reads the DCM's wrptr, reads the words from the host's read pointer up to it (in at
+ * most two block reads per CHUNK, as the words may wrap around the end of the buffer), and writes the read pointer
+ * back to the DCM's rdptr, which frees their space.  A packet that does not fit in the ring is dropped whole by
+ * the DCM and counted; polls that find packets dropped are logged as overflows.  A poll that finds the ring at its
+ * high watermark (half full) is followed immediately by the next poll.  The buffer is returned to linear mode (and
+ * cleared) by the destructor.
+ *
+ * Files:  <base>.<NNNN>.bin are the captured words, little endian, with no header (the same layout as
+ * --dcm-dump's).  A new file is started at the first re-arm after the current file reaches ROLL_BYTES, so each
+ * file begins at a packet boundary; when streaming, at the first poll after it reaches ROLL_BYTES, so a packet may
+ * span two files (the files concatenated are the stream).  <base>.log is a text log of the files, re-arms,
+ * overflows, and summaries.  With archive = true, the words are decoded and appended to a capture archive
+ * <base>.<NNNN>.seg instead (see archive.h), whose segments record the firmware's dates and the ports' decimation.
+ *
+ * Adaptive decimation:  after adapt(), a DecimationController watches the captured packets, and run() retunes the
+ * ports' decimation every policy interval.  Each change is written into the capture as a `decimation` packet
+ * (telemetry.def), inserted among the captured words in time order, and logged.
+ */
+class DcmCapture {
+
+public:
+    struct Stats {
+        uint64_t words;             // words captured
+        uint64_t polls;             // polls of the buffer's length
+        uint64_t rearms;            // buffer clears
+        uint64_t overflows;         // polls that found the buffer full (or packets dropped by the ring)
+        uint64_t dropped;           // packets dropped by the ring
+        uint64_t lostUs;            // sum of the re-arms' lost windows (us)
+        uint32_t maxLostUs;         // longest lost window (us)
+        uint32_t files;             // capture files written
+    };
+
+private:
+    Dap &dap;
+    DebugCaptureModule &dcm;
+    char base[200];                 // capture files' path without extension
+    FILE *dst;                      // current capture file, or nullptr
+    FILE *log;                      // log file
+    uint64_t fileBytes;             // bytes written to the current capture file
+    uint32_t pos;                   // number of buffer words already captured (ring: host's read pointer)
+    uint32_t droppedSeen;           // ring's dropped register at the previous poll
+    bool ring;                      // true if streaming from the DCM's ring
+    bool hurry;                     // true if the previous poll found the ring at its high watermark
+    uint32_t size;                  // buffer's capacity in words
+    std::vector<uint32_t> buf;
+    std::unique_ptr<ArchiveWriter> archive;     // capture archive, or nullptr to write capture files
+    std::unique_ptr<DecimationController> control;      // adaptive decimation, or nullptr
+    Stats st;
+
+    void openFile();
+    void logf(const char *fmt, ...);
+    void write(const uint32_t *w, size_t n);
+    void save(uint32_t n);
+    void drain(uint32_t n);
+    void rearm();
+    void pollRing();
+    void retune(double seconds);
+
+public:
+    static constexpr double POLL_MS        = 10;            // poll interval in milliseconds
+    static constexpr uint64_t ROLL_BYTES   = 256u << 20;    // capture file's size that starts a new file
+    static constexpr uint32_t CHUNK        = 16384;         // max. words per DAP block read
+
+    uint32_t threshold;             // buffer length that triggers a re-arm (default: 3/4 of the buffer)
+
+    DcmCapture(Dap &dap, DebugCaptureModule &dcm, const char *base, bool ring = false, bool archive = false);
+    DcmCapture(const DcmCapture &) = delete;                // delete copy constructor
+    DcmCapture &operator=(const DcmCapture &) = delete;     // delete assignment operator
+    ~DcmCapture();
+    void adapt(const DecimationPolicy &policy);
+    void poll();
+    void run(double seconds = 0);
+    const Stats &stats() const { return st; }
+    void printStatus();
+};
@@ -0,0 +1,534 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include "common.h"
+#include "pool.h"
+#include "telemetry.h"
+#include "codec.h"
+
+// Telemetry Codec
+//
+// Compresses telemetry packets by column with patched frame-of-reference and delta bit-packing, and compresses
+// and expands archive segments block by block on a WorkStealingPool
+
+static_assert(sizeof(CompressedHeader) == 16, "compressed header layout");
+static_assert(sizeof(CompressedBlock) == 24, "compressed block layout");
+
+namespace codec {
+
+enum Mode { FOR = 0, DELTA = 1 };
+
+
+
+// *************
+// *  Columns  *
+// *************
+
+
+// Number of Significant Bits
+static unsigned bitsOf(uint32_t x) {
+    return x == 0  ?  0  :  32 - __builtin_clz(x);
+}
+
+
+// Pack Values at a Width
+// in: u, n = values (each < 2**width)
+//     width = bits per value (1..32)
+// in out: out = the packed words are appended:  ceil(n * width / 32) + 1
+static void pack(const uint32_t *u, size_t n, unsigned width, std::vector<uint32_t> &out) {
+    size_t k = out.size();
+    out.resize(k + (n * width + 31) / 32 + 1, 0);
+    uint32_t *p = out.data() + k;
+    size_t pos = 0;
+    for (size_t i = 0; i < n; i++, pos += width) {
+        uint64_t x = uint64_t(u[i]) << (pos & 31);
+        p[pos >> 5] |= uint32_t(x);
+        p[(pos >> 5) + 1] |= uint32_t(x >> 32);
+    }
+}
+
+
+// Unpack Values at a Width, and Add a Reference
+// in: p = packed words (ceil(n * width / 32) + 1)
+//     n = number of values
+//     width = bits per value (1..32)
+//     ref = added to each value
+//     stride = distance between the values in x
+// out: x = n values
+static void unpack(const uint32_t *p, size_t n, unsigned width, uint32_t ref, uint32_t *x, size_t stride) {
+    const uint64_t mask = (uint64_t(1) << width) - 1;
+    size_t pos = 0;
+    for (size_t i = 0; i < n; i++, pos += width, x += stride) {
+        const uint32_t *q = p + (pos >> 5);
+        *x = uint32_t(((uint64_t(q[1]) << 32 | q[0]) >> (pos & 31)) & mask) + ref;
+    }
+}
+
+
+// Plan a Column's Coding
+// Chooses the width that minimizes the packed values' and the exceptions' size.
+// in: u, n = values to pack
+// out: width = chosen width
+//      returns the coded size in bits
+static uint64_t plan(const uint32_t *u, size_t n, unsigned &width) {
+    size_t hist[33] = {};
+    for (size_t i = 0; i < n; i++)  hist[bitsOf(u[i])]++;
+    uint64_t best = ~0ull;
+    size_t over = n;                                            // values wider than b
+    for (unsigned b = 0; b <= 32; b++) {
+        over -= hist[b];
+        uint64_t bits = (b != 0  ?  (uint64_t(n) * b + 31) / 32 * 32 + 32  :  0) + over * 48;
+        if (bits < best) { best = bits;  width = b; }
+    }
+    return best;
+}
+
+
+// Encode a Column
+// in: v, n = values (n >= 1, at most 65535)
+//     mask = values' bits (TIME_MASK for timestamps, whose deltas are taken modulo 2**26)
+// in out: out = the encoded column is appended
+static void encodeColumn(const uint32_t *v, size_t n, uint32_t mask, std::vector<uint32_t> &out) {
+    // frame of reference
+    uint32_t lo = *std::min_element(v, v + n);
+    std::vector<uint32_t> f(n), d(n);
+    for (size_t i = 0; i < n; i++)  f[i] = v[i] - lo;
+    unsigned fw, dw;
+    uint64_t fBits = plan(f.data(), n, fw);
+
+    // deltas, sign-extended from the mask's width; the first value is stored instead
+    const unsigned s = 32 - bitsOf(mask);
+    int32_t dlo = 0;
+    for (size_t i = 1; i < n; i++) {
+        d[i] = uint32_t(int32_t((v[i] - v[i-1]) << s) >> s);
+        if (i == 1 || int32_t(d[i]) < dlo)  dlo = int32_t(d[i]);
+    }
+    d[0] = uint32_t(dlo);
+    for (size_t i = 0; i < n; i++)  d[i] -= uint32_t(dlo);
+    uint64_t dBits = plan(d.data(), n, dw) + 32;
+
+    bool delta = n >= 2 && dBits < fBits;
+    const std::vector<uint32_t> &u = delta ? d : f;
+    unsigned width = delta ? dw : fw;
+    std::vector<uint16_t> exc;
+    std::vector<uint32_t> packed(u);
+    for (size_t i = 0; i < n; i++)
+        if (bitsOf(u[i]) > width) {
+            exc.push_back(uint16_t(i));
+            packed[i] &= uint32_t((uint64_t(1) << width) - 1);
+        }
+    out.push_back((delta ? DELTA : FOR) | width << 8 | uint32_t(exc.size()) << 16);
+    out.push_back(delta ? uint32_t(dlo) : lo);
+    out.push_back(delta ? v[0] : 0);
+    if (width != 0)  pack(packed.data(), n, width, out);
+    for (size_t k = 0; k < exc.size(); k += 2)
+        out.push_back(exc[k] | (k + 1 < exc.size()  ?  uint32_t(exc[k+1]) << 16  :  0));
+    for (uint16_t i : exc)  out.push_back(u[i]);
+}
+
+
+// Encoded Block Reader:  checks that the block's words are not overrun
+struct Input {
+    const uint32_t *p, *end;
+
+    const uint32_t *take(size_t k) {
+        if (size_t(end - p) < k)  throwException("Corrupt compressed block (overrun)");
+        const uint32_t *q = p;
+        p += k;
+        return q;
+    }
+};
+
+
+// Decode a Column
+// in: n = number of values
+//     mask = values' bits (as encoded)
+//     tag = ORed into each value (e.g. the packet type of a timestamp column; must be outside mask)
+//     stride = distance between the values in v
+// in out: in = the encoded column is consumed
+// out: v = n values
+static void decodeColumn(Input &in, size_t n, uint32_t mask, uint32_t tag, uint32_t *v, size_t stride) {
+    const uint32_t *h = in.take(3);
+    unsigned mode = h[0] & 0xFF, width = h[0] >> 8 & 0xFF, nExc = h[0] >> 16;
+    uint32_t ref = h[1];
+    if (mode > DELTA || width > 32 || nExc > n)  throwException("Corrupt compressed column");
+    const uint32_t *p = width != 0  ?  in.take((n * width + 31) / 32 + 1)  :  nullptr;
+    const uint32_t *idx = in.take((nExc + 1) / 2), *val = in.take(nExc);
+
+    if (p == nullptr && nExc == 0) {                        // constant, or constant steps (e.g. a steady rate)
+        uint32_t x = mode == DELTA  ?  h[2]  :  ref;
+        uint32_t dx = mode == DELTA  ?  ref  :  0;
+        for (size_t i = 0; i < n; i++, x = (x + dx) & mask)  v[i * stride] = x | tag;
+        return;
+    }
+    if (p != nullptr)  unpack(p, n, width, ref, v, stride);
+    else
+        for (size_t i = 0; i < n; i++)  v[i * stride] = ref;
+    for (unsigned k = 0; k < nExc; k++) {
+        unsigned i = idx[k / 2] >> (k % 2 * 16) & 0xFFFF;
+        if (i >= n)  throwException("Corrupt compressed column");
+        v[i * stride] = val[k] + ref;
+    }
+    if (mode == DELTA) {
+        uint32_t x = v[0] = h[2] | tag;
+        for (size_t i = 1; i < n; i++)  v[i * stride] = x = ((x + v[i * stride]) & mask) | tag;
+    }
+    else if (tag != 0)
+        for (size_t i = 0; i < n; i++)  v[i * stride] |= tag;
+}
+
+
+
+// ************
+// *  Blocks  *
+// ************
+
+
+// Encode a Block
+// in: w, n = packets (well formed, beginning at a packet's header)
+// in out: out = the encoded block is appended
+// out: returns the number of words encoded:  whole packets, up to the first packet boundary at or after BLOCK_WORDS
+// throws: Exception if a packet's type is not in telemetry.def, or a packet is cut off
+size_t encodeBlock(const uint32_t *w, size_t n, std::vector<uint32_t> &out) {
+    std::vector<uint32_t> seq, at[telemetry::TYPES];       // packets' types; each type's packets' offsets
+    size_t i = 0;
+    uint64_t types = 0;
+    while (i < n && i < BLOCK_WORDS) {
+        unsigned t = telemetry::typeOf(w[i]);
+        const telemetry::Schema *s = telemetry::lookup(t);
+        if (s == nullptr || n - i < s->length)  throwException("Bad packet (header 0x%08X) at word %zu", w[i], i);
+        seq.push_back(t);
+        at[t].push_back(uint32_t(i));
+        types |= 1ull << t;
+        i += s->length;
+    }
+    out.push_back(uint32_t(seq.size()));
+    out.push_back(uint32_t(i));
+    out.push_back(uint32_t(types));
+    out.push_back(uint32_t(types >> 32));
+    if ((types & (types - 1)) != 0)  encodeColumn(seq.data(), seq.size(), 0x3F, out);
+    std::vector<uint32_t> v;
+    for (unsigned t = 0; t < telemetry::TYPES; t++) {
+        if (at[t].empty())  continue;
+        unsigned length = telemetry::lookup(t)->length;
+        v.resize(at[t].size());
+        for (unsigned j = 0; j < length; j++) {
+            for (size_t k = 0; k < v.size(); k++)  v[k] = w[at[t][k] + j];
+            if (j == 0)
+                for (uint32_t &x : v)  x = telemetry::timeOf(x);
+            encodeColumn(v.data(), v.size(), j == 0  ?  telemetry::TIME_MASK  :  ~0u, out);
+        }
+    }
+    return i;
+}
+
+
+// Decode a Block
+// in: in, inWords = encoded block
+//     n = block's number of words
+// out: w = the block's n words
+// throws: Exception if the block is corrupt, or has a type not in telemetry.def
+void decodeBlock(const uint32_t *in, size_t inWords, uint32_t *w, size_t n) {
+    Input r = { in, in + inWords };
+    const uint32_t *h = r.take(4);
+    size_t packets = h[0];
+    uint64_t types = h[2] | uint64_t(h[3]) << 32;
+    if (h[1] != n || packets > n || types == 0)  throwException("Corrupt compressed block (header)");
+
+    // one type:  decode each column into its place in the packets
+    if ((types & (types - 1)) == 0) {
+        unsigned t = __builtin_ctzll(types);
+        const telemetry::Schema *s = telemetry::lookup(t);
+        if (s == nullptr)  throwException("Compressed block has packet type %u, which is not in telemetry.def", t);
+        if (packets * s->length != n)  throwException("Corrupt compressed block (length)");
+        for (unsigned j = 0; j < s->length; j++)
+            decodeColumn(r, packets, j == 0 ? telemetry::TIME_MASK : ~0u, j == 0 ? t << 26 : 0, w + j, s->length);
+        return;
+    }
+
+    // several types:  decode the types of the packets, and each type's columns, then interleave them
+    std::vector<uint32_t> seq(packets);
+    decodeColumn(r, packets, 0x3F, 0, seq.data(), 1);
+    size_t count[telemetry::TYPES] = {}, words = 0;
+    for (uint32_t t : seq) {
+        if (t >= telemetry::TYPES || (types >> t & 1) == 0)  throwException("Corrupt compressed block (types)");
+        count[t]++;
+    }
+    std::vector<uint32_t> cols;                             // each type's columns, one after the other
+    const uint32_t *col[telemetry::TYPES];                  // each type's first column in cols
+    unsigned length[telemetry::TYPES];
+    size_t base[telemetry::TYPES];
+    for (unsigned t = 0; t < telemetry::TYPES; t++) {
+        if ((types >> t & 1) == 0)  continue;
+        const telemetry::Schema *s = telemetry::lookup(t);
+        if (s == nullptr)  throwException("Compressed block has packet type %u, which is not in telemetry.def", t);
+        length[t] = s->length;
+        base[t] = cols.size();
+        words += count[t] * s->length;
+        cols.resize(cols.size() + count[t] * s->length);
+    }
+    if (words != n)  throwException("Corrupt compressed block (length)");
+    for (unsigned t = 0; t < telemetry::TYPES; t++) {
+        if ((types >> t & 1) == 0)  continue;
+        uint32_t *c = cols.data() + base[t];
+        for (unsigned j = 0; j < length[t]; j++)
+            decodeColumn(r, count[t], j == 0 ? telemetry::TIME_MASK : ~0u, j == 0 ? t << 26 : 0, c + j * count[t], 1);
+        col[t] = c;
+    }
+    size_t next[telemetry::TYPES] = {}, o = 0;
+    for (uint32_t t : seq) {
+        const uint32_t *c = col[t];
+        size_t k = next[t]++, m = count[t];
+        for (unsigned j = 0; j < length[t]; j++)  w[o + j] = c[j * m + k];
+        o += length[t];
+    }
+}
+
+}   // namespace codec
+
+
+
+// **************
+// *  Segments  *
+// **************
+
+
+// Read a Whole File
+// in: fn = file's name
+// out: data = file's bytes
+// throws: Exception if the file cannot be read
+static void readFile(const char *fn, std::vector<uint8_t> &data) {
+    FILE *src = fopen(fn, "rb");
+    if (src == nullptr)  throwException("Cannot open %s: %s", fn, strerror(errno));
+    bool ok = fseek(src, 0, SEEK_END) == 0;
+    long n = ok ? ftell(src) : -1;
+    ok = n >= 0 && fseek(src, 0, SEEK_SET) == 0;
+    if (ok) {
+        data.resize(size_t(n));
+        ok = fread(data.data(), 1, data.size(), src) == data.size();
+    }
+    fclose(src);
+    if (!ok)  throwException("Cannot read %s", fn);
+}
+
+
+// Write a Whole File
+// Writes it to <fn>.tmp, syncs it, and renames it, so the file is either complete or absent.
+// in: fn = file's name
+//     parts = (pointer, bytes) pairs, written in order
+// throws: Exception if the file cannot be written
+static void writeFile(const char *fn, const std::vector<std::pair<const void *, size_t>> &parts) {
+    char tmp[280];
+    snprintf(tmp, sizeof tmp, "%s.tmp", fn);
+    FILE *dst = fopen(tmp, "wb");
+    if (dst == nullptr)  throwException("Cannot create %s: %s", tmp, strerror(errno));
+    bool ok = true;
+    for (const auto &p : parts)
+        if (ok && p.second != 0)  ok = fwrite(p.first, 1, p.second, dst) == p.second;
+    ok = ok && fflush(dst) == 0 && fsync(fileno(dst)) == 0;
+    if (fclose(dst) != 0)  ok = false;
+    if (ok && rename(tmp, fn) == 0)  return;
+    int e = errno;
+    unlink(tmp);
+    throwException("Cannot write %s: %s", fn, strerror(e));
+}
+
+
+// Read a Segment File
+// in: fn = segment's name
+// out: h = segment's header
+//      words = segment's committed words
+// throws: Exception if the segment cannot be read or is not a valid segment
+static void readSegment(const char *fn, SegmentHeader &h, std::vector<uint32_t> &words) {
+    std::vector<uint8_t> data;
+    readFile(fn, data);
+    if (data.size() < sizeof h)  throwException("%s is not an archive segment", fn);
+    memcpy(&h, data.data(), sizeof h);
+    if (h.magic != ARCHIVE_MAGIC || h.version != ARCHIVE_VERSION || h.headerSize != sizeof h)
+        throwException("%s is not an archive segment (version %u)", fn, ARCHIVE_VERSION);
+    if (h.words > h.capacity || data.size() < sizeof h + size_t(h.words) * 4)
+        throwException("Archive segment %s is truncated", fn);
+    words.resize(h.words);
+    memcpy(words.data(), data.data() + sizeof h, size_t(h.words) * 4);
+}
+
+
+// Compress a Segment
+// in: src = segment's name (<base>.NNNN.seg)
+//     dst = compressed segment's name (<base>.NNNN.segz)
+//     threads = number of threads
+// out: returns the statistics
+// throws: Exception if a file cannot be read or written, or the segment has packets not in telemetry.def
+CompressStats compressSegment(const char *src, const char *dst, unsigned threads) {
+    SegmentHeader h;
+    std::vector<uint32_t> w;
+    readSegment(src, h, w);
+
+    // find the blocks' boundaries (packet lengths only), then encode them in parallel
+    Stopwatch sw;
+    std::vector<CompressedBlock> dir;
+    for (size_t i = 0; i < w.size();  ) {
+        CompressedBlock b = { 0, 0, uint32_t(i), 0, 0 };
+        while (i < w.size() && i - b.word < codec::BLOCK_WORDS) {
+            const telemetry::Schema *s = telemetry::lookup(telemetry::typeOf(w[i]));
+            if (s == nullptr)  throwException("%s has a packet type not in telemetry.def at word %zu", src, i);
+            i += s->length;
+            b.packets++;
+        }
+        if (i > w.size())  throwException("%s's last packet is cut off", src);
+        b.words = uint32_t(i - b.word);
+        dir.push_back(b);
+    }
+    std::vector<std::vector<uint32_t>> enc(dir.size());
+    WorkStealingPool pool(threads);
+    pool.run(dir.size(), [&](unsigned, size_t k) {
+        codec::encodeBlock(w.data() + dir[k].word, dir[k].words, enc[k]);
+    });
+    double t = sw.elapsed();
+
+    CompressedHeader x = { COMPRESSED_MAGIC, COMPRESSED_VERSION, sizeof x, uint32_t(dir.size()), 0 };
+    uint64_t offset = sizeof h + sizeof x + dir.size() * sizeof(CompressedBlock);
+    for (size_t k = 0; k < dir.size(); k++) {
+        dir[k].offset = offset;
+        dir[k].bytes = uint32_t(enc[k].size() * 4);
+        offset += dir[k].bytes;
+    }
+    std::vector<std::pair<const void *, size_t>> parts = {
+        { &h, sizeof h }, { &x, sizeof x }, { dir.data(), dir.size() * sizeof(CompressedBlock) }
+    };
+    for (const std::vector<uint32_t> &e : enc)  parts.push_back({ e.data(), e.size() * 4 });
+    writeFile(dst, parts);
+    return { sizeof h + uint64_t(h.words) * 4, offset, t };
+}
+
+
+// Parse a Compressed Segment's Header and Directory
+// in: src = compressed segment's name (for messages)
+//     data, size = the .segz file's bytes
+// out: h = segment's header
+//      dir = directory, checked:  the blocks cover the committed words in order, and lie within the file
+// throws: Exception if the file is not a compressed segment, or its directory is corrupt
+void parseCompressedSegment(const char *src, const uint8_t *data, size_t size, SegmentHeader &h,
+                            std::vector<CompressedBlock> &dir) {
+    CompressedHeader x;
+    if (size < sizeof h + sizeof x)  throwException("%s is not a compressed segment", src);
+    memcpy(&h, data, sizeof h);
+    memcpy(&x, data + sizeof h, sizeof x);
+    if (h.magic != ARCHIVE_MAGIC || x.magic != COMPRESSED_MAGIC || x.headerSize != sizeof x)
+        throwException("%s is not a compressed segment", src);
+    if (h.version != ARCHIVE_VERSION || x.version != COMPRESSED_VERSION)
+        throwException( "%s is compressed segment version %u/%u; only version %u/%u is supported",
+                        src, h.version, x.version, ARCHIVE_VERSION, COMPRESSED_VERSION );
+    size_t dirEnd = sizeof h + sizeof x + size_t(x.blocks) * sizeof(CompressedBlock);
+    if (x.blocks > h.words || size < dirEnd)  throwException("Compressed segment %s is truncated", src);
+    dir.resize(x.blocks);
+    memcpy(dir.data(), data + sizeof h + sizeof x, dir.size() * sizeof(CompressedBlock));
+    uint32_t next = 0;
+    for (const CompressedBlock &b : dir) {
+        if (b.word != next || b.words > h.words - next || b.words == 0 || b.offset < dirEnd || b.offset % 4 != 0 ||
+            b.offset > size || b.bytes > size - b.offset)
+            throwException("Corrupt compressed segment %s (directory)", src);
+        next += b.words;
+    }
+    if (next != h.words)  throwException("Corrupt compressed segment %s (directory)", src);
+}
+
+
+// Expand a Compressed Segment
+// in: src = compressed segment's name (<base>.NNNN.segz)
+//     threads = number of threads
+// out: h = segment's header
+//      words = segment's committed words
+//      returns the statistics
+// throws: Exception if the file cannot be read, or is corrupt
+CompressStats expandSegment(const char *src, SegmentHeader &h, std::vector<uint32_t> &words, unsigned threads) {
+    std::vector<uint8_t> data;
+    readFile(src, data);
+    std::vector<CompressedBlock> dir;
+    parseCompressedSegment(src, data.data(), data.size(), h, dir);
+
+    Stopwatch sw;
+    words.resize(h.words);
+    WorkStealingPool pool(threads);
+    pool.run(dir.size(), [&](unsigned, size_t k) {
+        const CompressedBlock &b = dir[k];
+        codec::decodeBlock( reinterpret_cast<const uint32_t *>(data.data() + b.offset), b.bytes / 4,
+                            words.data() + b.word, b.words );
+    });
+    return { sizeof h + uint64_t(h.words) * 4, data.size(), sw.elapsed() };
+}
+
+
+// Compress an Archive
+// Compresses each closed segment <base>.NNNN.seg to <base>.NNNN.segz, checks that it expands to the same words,
+// and deletes the segment.  Open segments (being written, or interrupted) are left as they are.
+// in: base = segments' path without extension
+//     threads = number of threads
+// out: returns the statistics
+// throws: Exception if there are no segments, a file cannot be read or written, or a check fails
+CompressStats compressArchive(const char *base, unsigned threads) {
+    CompressStats st = { 0, 0, 0 };
+    unsigned n = 0;
+    for (uint32_t i = 0;  ; i++) {
+        char seg[256], segz[260];
+        snprintf(seg, sizeof seg, "%s.%04u.seg", base, i);
+        snprintf(segz, sizeof segz, "%sz", seg);
+        bool raw = access(seg, F_OK) == 0;
+        if (!raw && access(segz, F_OK) != 0)  break;
+        n++;
+        if (!raw)  continue;                                // already compressed
+
+        SegmentHeader h, h2;
+        std::vector<uint32_t> w, w2;
+        readSegment(seg, h, w);
+        if (h.state != SegmentHeader::CLOSED) {
+            logWarning("Archive segment %s is open; it is not compressed", seg);
+            continue;
+        }
+        CompressStats s = compressSegment(seg, segz, threads);
+        expandSegment(segz, h2, w2, threads);
+        if (memcmp(&h, &h2, sizeof h) != 0 || w != w2) {
+            unlink(segz);
+            throwException("Compressed segment %s does not expand to %s; the segment is kept", segz, seg);
+        }
+        if (unlink(seg) != 0)  throwException("Cannot delete %s: %s", seg, strerror(errno));
+        st.rawBytes += s.rawBytes;
+        st.compressedBytes += s.compressedBytes;
+        st.seconds += s.seconds;
+    }
+    if (n == 0)  throwException("No archive segments %s.NNNN.seg", base);
+    return st;
+}
+
+
+// Expand an Archive
+// Expands each compressed segment <base>.NNNN.segz to <base>.NNNN.seg, and deletes it.
+// in: base = segments' path without extension
+//     threads = number of threads
+// out: returns the statistics
+// throws: Exception if there are no segments, or a file cannot be read or written
+CompressStats expandArchive(const char *base, unsigned threads) {
+    CompressStats st = { 0, 0, 0 };
+    unsigned n = 0;
+    for (uint32_t i = 0;  ; i++) {
+        char seg[256], segz[260];
+        snprintf(seg, sizeof seg, "%s.%04u.seg", base, i);
+        snprintf(segz, sizeof segz, "%sz", seg);
+        bool compressed = access(segz, F_OK) == 0;
+        if (!compressed && access(seg, F_OK) != 0)  break;
+        n++;
+        if (!compressed)  continue;
+
+        SegmentHeader h;
+        std::vector<uint32_t> w;
+        CompressStats s = expandSegment(segz, h, w, threads);
+        writeFile(seg, { { &h, sizeof h }, { w.data(), w.size() * 4 } });
+        if (unlink(segz) != 0)  throwException("Cannot delete %s: %s", segz, strerror(errno));
+        st.rawBytes += s.rawBytes;
+        st.compressedBytes += s.compressedBytes;
+        st.seconds += s.seconds;
+    }
+    if (n == 0)  throwException("No archive segments %s.NNNN.seg", base);
+    return st;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "archive.h"
+
+
+/* -----  Telemetry Codec  -----
+ *
+ * Lossless compression of telemetry packets (see telemetry.def), in blocks of whole packets that decode
+ * independently of each other.  A block is stored by column:
+ *
+ *   - the sequence of packet types (omitted if the block has one type), and for each type in the block,
+ *   - a column of its packets' 26-bit timestamps, and one column per payload word.
+ *
+ * Each column is coded as frame of reference (value - min) or as deltas (value - previous value - min delta),
+ * whichever is smaller, and bit-packed at the block's width for that column.  Values that do not fit the width
+ * (e.g. a counter's wrap-around) are patched from a list of exceptions, so one outlier does not widen the column.
+ * Timestamp deltas are taken modulo 2**26, so a type's steady rate packs into 0 bits, and so does a counter.
+ *
+ * Encoded column (32-bit words, little endian):
+ *
+ *   word 0        mode (bits 7:0; FOR or DELTA), width (bits 15:8; 0..32), exceptions (bits 31:16)
+ *   word 1        reference (FOR: the min; DELTA: the min delta)
+ *   word 2        first value (DELTA only; otherwise 0)
+ *   then          ceil(n * width / 32) + 1 words of bit-packed values, LSB first (none if width is 0)
+ *   then          ceil(exceptions / 2) words of exception indexes (uint16_t), and the exceptions' values
+ *
+ * Encoded block:  the numbers of packets and words, the 64-bit mask of the types in it, the type column (if more
+ * than one type), then each type's columns in ascending order of type.
+ */
+namespace codec {
+
+constexpr size_t BLOCK_WORDS = 16384;           // a block ends at the first packet boundary at or after this
+
+size_t encodeBlock(const uint32_t *w, size_t n, std::vector<uint32_t> &out);
+void decodeBlock(const uint32_t *in, size_t inWords, uint32_t *w, size_t n);
+
+}   // namespace codec
+
+
+/* -----  Compressed Segment  -----
+ *
+ * A closed archive segment compressed with the codec, <base>.<NNNN>.segz (see --dcm-compress):
+ *
+ *   Offset  Size        Field          Description
+ *   ------  ----------  -------------  ------------------------------------------------------------------------------
+ *        0          64  segment        the segment's SegmentHeader, unchanged
+ *       64          16  header         CompressedHeader
+ *       80  blocks * 24 directory      a CompressedBlock per block, in order
+ *        ?           ?  blocks         the encoded blocks, each at its directory entry's offset
+ *
+ * Because the directory gives each block's offset in both files, the blocks are compressed and expanded in parallel.
+ * Expanding gives back the segment's header and committed words exactly.
+ */
+struct CompressedHeader {
+    uint32_t magic;             // COMPRESSED_MAGIC
+    uint16_t version;           // COMPRESSED_VERSION; readers must reject other versions
+    uint16_t headerSize;        // sizeof(CompressedHeader)
+    uint32_t blocks;            // number of CompressedBlocks in the directory
+    uint32_t reserved;          // 0
+};
+
+struct CompressedBlock {
+    uint64_t offset;            // encoded block's offset in the .segz file (bytes)
+    uint32_t bytes;             // encoded block's size (bytes)
+    uint32_t word;              // index of the block's first word in the segment (after its header)
+    uint32_t words;             // block's words
+    uint32_t packets;           // block's packets
+};
+
+static constexpr uint32_t COMPRESSED_MAGIC   = 0x5A434D44;  // "DCMZ"
+static constexpr uint16_t COMPRESSED_VERSION = 1;
+
+
+struct CompressStats {
+    uint64_t rawBytes;          // segment files' bytes (header and committed words)
+    uint64_t compressedBytes;   // .segz files' bytes
+    double seconds;             // time to compress or expand (without file I/O)
+};
+
+void parseCompressedSegment(const char *src, const uint8_t *data, size_t size, SegmentHeader &h,
+                            std::vector<CompressedBlock> &dir);
+CompressStats compressSegment(const char *src, const char *dst, unsigned threads);
+CompressStats expandSegment(const char *src, SegmentHeader &h, std::vector<uint32_t> &words, unsigned threads);
+CompressStats compressArchive(const char *base, unsigned threads);
+CompressStats expandArchive(const char *base, unsigned threads);
@@ -554,7 +554,8 @@ double Stopwatch::elapsed() { return  now() - T0; }
 // *  High Resolution Stopwatch  *
 // *******************************
 //
-// Uses PL's Strobe Generator block to measure time to 10 ns resolution
+// Uses the PL's 1 MHz usTime to measure time to 1 us resolution.  usTime wraps every 2**26 us (67.1 s), so the
+// differences are taken modulo 2**26, and intervals must be shorter than that (see Timebase for longer ones).
 
 
 // Constructor
@@ -567,10 +568,10 @@ void Stopwatch2::reset() { T0 = peripherals.dap.usTime(); }
 
 // Get Elapsed Time
 // out: returns seconds since the last call to reset() or this class' constructor
-double Stopwatch2::elapsed() { return  (peripherals.dap.usTime() - T0) * 1e-6; }
+double Stopwatch2::elapsed() { return  ((peripherals.dap.usTime() - T0) & regmap::bio::usTime::mask) * 1e-6; }
 
 
 // Test of us Microseconds Has Elapsed
 // in: us = duration in microseconds
 // out: returns true if >=us microseconds has elapsed, else false
-bool Stopwatch2::hasElapsed(uint32_t us) { return  peripherals.dap.usTime() - T0 >= us; }
+bool Stopwatch2::hasElapsed(uint32_t us) { return  ((peripherals.dap.usTime() - T0) & regmap::bio::usTime::mask) >= us; }
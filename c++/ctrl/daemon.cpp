@@ -0,0 +1,354 @@
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "common.h"
+#include "daemon.h"
+#include "peripherals.h"
+
+// DAP Daemon
+//
+// Serves DAP requests over a Unix domain socket, and the client transport for it
+
+
+
+// Send All Bytes
+// in: fd = socket
+//     p = bytes to send
+//     n = number of bytes
+// out: returns true if success, else false
+static bool sendAll(int fd, const void *p, size_t n) {
+    const uint8_t *q = static_cast<const uint8_t *>(p);
+    while (n != 0) {
+        ssize_t k = send(fd, q, n, MSG_NOSIGNAL);
+        if (k < 0 && errno == EINTR)  continue;
+        if (k <= 0)  return false;
+        q += k;
+        n -= size_t(k);
+    }
+    return true;
+}
+
+
+// Receive Exactly N Bytes
+// in: fd = socket
+//     n = number of bytes
+// out: p = bytes received
+//      returns true if success, false if the connection was closed or failed
+static bool recvAll(int fd, void *p, size_t n) {
+    uint8_t *q = static_cast<uint8_t *>(p);
+    while (n != 0) {
+        ssize_t k = recv(fd, q, n, 0);
+        if (k < 0 && errno == EINTR)  continue;
+        if (k <= 0)  return false;
+        q += k;
+        n -= size_t(k);
+    }
+    return true;
+}
+
+
+// Fill in a Unix Socket Address
+// in: path = socket's path
+// out: sa = address
+// throws: Exception if path is too long
+static void unixAddress(const char *path, struct sockaddr_un &sa) {
+    memset(&sa, 0, sizeof sa);
+    sa.sun_family = AF_UNIX;
+    if (!strCpy(sa.sun_path, sizeof sa.sun_path, path))  throwException("Socket path is too long: %s", path);
+}
+
+
+static void termHandler(int) { ctrlC = true; }
+
+
+
+// ****************
+// *  DAP Daemon  *
+// ****************
+
+
+// Constructor
+// Create the listening socket.  A stale socket file left by a daemon that died is replaced.
+// in: dap = initialized DAP that requests are executed on
+//     path = socket's path, e.g. DAEMON_SOCKET
+// throws: Exception if the socket cannot be created, or if another daemon is listening on it
+DapDaemon::DapDaemon(Dap &dap, const char *path) : dap(dap) {
+    struct sockaddr_un sa;
+    unixAddress(path, sa);
+    strCpy(this->path, sizeof this->path, path);
+    requests = 0;
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)  throwException("Cannot create socket: %s", strerror(errno));
+    if (connect(fd, reinterpret_cast<struct sockaddr *>(&sa), sizeof sa) == 0) {
+        close(fd);
+        throwException("A daemon is already listening on %s", path);
+    }
+    close(fd);
+    unlink(path);
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)  throwException("Cannot create socket: %s", strerror(errno));
+    if (bind(fd, reinterpret_cast<struct sockaddr *>(&sa), sizeof sa) != 0  ||
+        chmod(path, 0660) != 0  ||
+        listen(fd, MAX_CLIENTS) != 0) {
+        int e = errno;
+        close(fd);
+        throwException("Cannot listen on %s: %s", path, strerror(e));
+    }
+}
+
+
+// Destructor
+// Close all connections and remove the socket.
+DapDaemon::~DapDaemon() {
+    for (Client &c : clients)  close(c.fd);
+    close(fd);
+    unlink(path);
+}
+
+
+// Execute a Request and Send Its Response
+// in out: c = client
+// in: req = the request's n operations
+//     n = number of operations (1 .. DAEMON_MAX_OPS)
+// out: returns false if the response could not be sent (the client should be disconnected)
+bool DapDaemon::respond(Client &c, const uint8_t *req, uint32_t n) {
+    uint32_t hdr[2] = { 0, 0 };
+    std::vector<uint32_t> results;
+    std::vector<DapOp> batch;
+    const char *err = nullptr;
+    char msg[256];
+    try {
+        // validate the whole request before executing any of it
+        std::vector<DaemonOp> ops(n);
+        memcpy(ops.data(), req, n * sizeof(DaemonOp));
+        size_t words = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            const DaemonOp &op = ops[i];
+            if (op.type > DaemonOp::BLOCK)  throwException("Operation %u: Unknown Type %d", i, int(op.type));
+            if (op.mod > 127)  throwException("Operation %u: Module Out of Range 0..127", i);
+            if (op.addr > 0x00FFFFFFu)  throwException("Operation %u: Address Out of Range 0..0x00FFFFFF", i);
+            if (op.type == DaemonOp::BLOCK && (op.data == 0 || op.data > 0x01000000u - op.addr))
+                throwException("Operation %u: Block Out of Range 0..0x00FFFFFF", i);
+            words += op.type == DaemonOp::BLOCK  ?  op.data  :  1;
+            if (words > DAEMON_MAX_WORDS)  throwException("Request's results exceed %u words", DAEMON_MAX_WORDS);
+        }
+        results.resize(words);
+        size_t first = 0;      // index in results of the batch's first result
+        for (uint32_t i = 0; i <= n; i++) {
+            if (i < n && ops[i].type != DaemonOp::BLOCK) {
+                const DaemonOp &op = ops[i];
+                batch.push_back({ DapOp::Type(op.type), op.mod, int(op.addr), op.data, op.mask });
+                continue;
+            }
+            if (!batch.empty()) {
+                dap.execute(batch.data(), batch.size(), results.data() + first);
+                first += batch.size();
+                batch.clear();
+            }
+            if (i < n) {
+                dap.readBlock(ops[i].mod, int(ops[i].addr), ops[i].data, results.data() + first);
+                first += ops[i].data;
+            }
+        }
+    }
+    catch (const std::exception &e) {        // (an Exception, or e.g. std::bad_alloc:  fail the request, not the daemon)
+        snprintf(msg, sizeof msg, "%s", e.what());
+        err = msg;
+    }
+    catch (...) {
+        err = "Unknown error";
+    }
+    requests++;
+    if (err != nullptr) {
+        hdr[0] = 1;
+        hdr[1] = uint32_t(strlen(err));
+        return sendAll(c.fd, hdr, sizeof hdr) && sendAll(c.fd, err, hdr[1]);
+    }
+    hdr[1] = uint32_t(results.size());
+    return sendAll(c.fd, hdr, sizeof hdr) && sendAll(c.fd, results.data(), results.size() * sizeof results[0]);
+}
+
+
+// Receive and Serve a Client's Requests
+// in out: c = client whose socket is readable
+// out: returns false if the client should be disconnected (closed connection, error, malformed request, or a
+//      response that could not be sent)
+bool DapDaemon::serve(Client &c) {
+    uint8_t buf[65536];
+    ssize_t k = recv(c.fd, buf, sizeof buf, 0);
+    if (k < 0 && errno == EINTR)  return true;
+    if (k <= 0)  return false;
+    c.rx.insert(c.rx.end(), buf, buf + k);
+    size_t i = 0;
+    while (c.rx.size() - i >= 8) {
+        uint32_t hdr[2];
+        memcpy(hdr, c.rx.data() + i, sizeof hdr);
+        if (hdr[0] != DAEMON_MAGIC || hdr[1] == 0 || hdr[1] > DAEMON_MAX_OPS) {
+            logWarning("Malformed request from a client; disconnecting it");
+            return false;
+        }
+        size_t len = 8 + size_t(hdr[1]) * sizeof(DaemonOp);
+        if (c.rx.size() - i < len)  break;
+        if (!respond(c, c.rx.data() + i + 8, hdr[1])) {
+            logWarning("Cannot send a response to a client; disconnecting it");
+            return false;
+        }
+        i += len;
+    }
+    c.rx.erase(c.rx.begin(), c.rx.begin() + i);
+    return true;
+}
+
+
+// Serve Clients Until SIGINT or SIGTERM
+void DapDaemon::run() {
+    catchCtrlC(true);
+    sighandler_t oldTerm = signal(SIGTERM, termHandler);
+    logInfo("Serving DAP requests on %s", path);
+    std::vector<struct pollfd> pfds;
+    while (!ctrlC) {
+        pfds.clear();
+        pfds.push_back({ fd, POLLIN, 0 });
+        for (Client &c : clients)  pfds.push_back({ c.fd, POLLIN, 0 });
+        int r = poll(pfds.data(), pfds.size(), 500);
+        if (r < 0 && errno != EINTR)  throwException("poll() failed: %s", strerror(errno));
+        if (r <= 0)  continue;
+        for (size_t i = pfds.size(); --i >= 1;  )
+            if (pfds[i].revents != 0  &&  !serve(clients[i - 1])) {
+                close(clients[i - 1].fd);
+                clients.erase(clients.begin() + (i - 1));
+            }
+        if (pfds[0].revents & POLLIN) {
+            int cfd = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (cfd >= 0 && clients.size() >= size_t(MAX_CLIENTS)) { close(cfd);  cfd = -1; }
+            if (cfd >= 0) {
+                struct timeval tv = { 1, 0 };       // don't let a client that stops reading stall the daemon
+                setsockopt(cfd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof tv);
+                clients.push_back({ cfd, {} });
+            }
+        }
+    }
+    signal(SIGTERM, oldTerm);
+    catchCtrlC(false);
+    logInfo("Served %llu requests", (unsigned long long) requests);
+}
+
+
+
+// ***************************
+// *  Unix Socket Transport  *
+// ***************************
+
+
+// Constructor
+// in: path = daemon's socket path
+// throws: Exception if the daemon cannot be reached
+UnixTransport::UnixTransport(const char *path) {
+    struct sockaddr_un sa;
+    unixAddress(path, sa);
+    strCpy(this->path, sizeof this->path, path);
+    ids[0] = ids[1] = 0;
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)  throwException("Cannot create socket: %s", strerror(errno));
+    if (connect(fd, reinterpret_cast<struct sockaddr *>(&sa), sizeof sa) != 0) {
+        int e = errno;
+        close(fd);
+        throwException("Cannot connect to the DAP daemon at %s: %s", path, strerror(e));
+    }
+}
+
+
+// Destructor
+UnixTransport::~UnixTransport() {
+    close(fd);
+}
+
+
+// Send a Request and Receive Its Response
+// in: ops = array of n operations
+//     n = number of operations (1 .. DAEMON_MAX_OPS)
+//     nResults = number of result words expected
+// out: results = array of nResults words
+// throws: Exception if the connection fails or the daemon reports an error
+void UnixTransport::request(const DaemonOp *ops, uint32_t n, uint32_t *results, uint32_t nResults) {
+    uint32_t hdr[2] = { DAEMON_MAGIC, n };
+    if (!sendAll(fd, hdr, sizeof hdr) || !sendAll(fd, ops, n * sizeof ops[0]) || !recvAll(fd, hdr, sizeof hdr))
+        throwException("Lost connection to the DAP daemon at %s", path);
+    if (hdr[0] != 0) {
+        char msg[256];
+        uint32_t len = hdr[1] < sizeof msg  ?  hdr[1]  :  sizeof msg - 1;
+        if (!recvAll(fd, msg, len))  throwException("Lost connection to the DAP daemon at %s", path);
+        msg[len] = 0;
+        throwException("DAP daemon: %s", msg);
+    }
+    if (hdr[1] != nResults)  throwException("DAP daemon sent %u result words but %u were expected", hdr[1], nResults);
+    if (!recvAll(fd, results, size_t(nResults) * sizeof results[0]))
+        throwException("Lost connection to the DAP daemon at %s", path);
+}
+
+
+// Read a 32-bit Word
+// in: mod, addr = module (0..127) and address (0..0x00FFFFFF) to read from
+// out: returns the value read
+uint32_t UnixTransport::read(int mod, int addr) {
+    DaemonOp op = { DaemonOp::READ, uint8_t(mod), 0, uint32_t(addr), 0, 0 };
+    uint32_t x;
+    request(&op, 1, &x, 1);
+    return x;
+}
+
+
+// Write a 32-bit Word
+// in: mod, addr = module (0..127) and address (0..0x00FFFFFF) to write to
+//     data = 32-bit word to write
+void UnixTransport::write(int mod, int addr, uint32_t data) {
+    DaemonOp op = { DaemonOp::WRITE, uint8_t(mod), 0, uint32_t(addr), data, 0 };
+    uint32_t x;
+    request(&op, 1, &x, 1);
+}
+
+
+// Execute a Batch of Operations (see Dap::execute())
+// The batch is sent as one request (or as several if it has more than DAEMON_MAX_OPS operations).
+void UnixTransport::execute(const DapOp *ops, size_t n, uint32_t *results) {
+    std::vector<DaemonOp> req;
+    std::vector<uint32_t> x;
+    for (size_t i = 0; i < n;  ) {
+        uint32_t m = uint32_t(std::min<size_t>(n - i, DAEMON_MAX_OPS));
+        req.resize(m);
+        x.resize(m);
+        for (uint32_t j = 0; j < m; j++) {
+            const DapOp &op = ops[i + j];
+            req[j] = { uint8_t(op.type), uint8_t(op.mod), 0, uint32_t(op.addr), op.data, op.mask };
+        }
+        request(req.data(), m, x.data(), m);
+        if (results != nullptr)  memcpy(results + i, x.data(), m * sizeof x[0]);
+        i += m;
+    }
+}
+
+
+// Read a Block of Consecutive 32-bit Words from a Module (see DapTransport::readBlock())
+void UnixTransport::readBlock(int mod, int addr, size_t n, uint32_t *dst) {
+    while (n != 0) {
+        uint32_t m = uint32_t(std::min<size_t>(n, DAEMON_MAX_WORDS));
+        DaemonOp op = { DaemonOp::BLOCK, uint8_t(mod), 0, uint32_t(addr), m, 0 };
+        request(&op, 1, dst, m);
+        addr += int(m);
+        dst += m;
+        n -= m;
+    }
+}
+
+
+// Print Status (for debugging)
+void UnixTransport::printStatus() {
+    printf("    socket         =  %s\n", path);
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "transport.h"
+
+class Dap;
+
+
+/* -----  DAP Daemon Protocol  -----
+ *
+ * A client sends requests on a Unix domain stream socket and the daemon answers each one, in order.  All words are
+ * little endian (the host's byte order).
+ *
+ * Request:   uint32_t magic         DAEMON_MAGIC
+ *            uint32_t n             number of operations (1 .. DAEMON_MAX_OPS)
+ *            DaemonOp op[n]         16 bytes each
+ *
+ * Response:  uint32_t status        0 = success, 1 = error
+ *            uint32_t n             success:  number of result words;  error:  length of the error message in bytes
+ *            uint32_t result[n]     success:  one word per READ, WRITE, or RMW (as Dap::execute()), and count words
+ *                                     per BLOCK, in the order of the operations
+ *            char message[n]        error:  error message (not null terminated); if the request was invalid (e.g., an
+ *                                     address out of range), none of its operations was executed
+ *
+ * The operations of a request are executed as one batch (Dap::execute()), except that a BLOCK is a
+ * Dap::readBlock() of data words starting at addr; BLOCK operations split the batch.
+ */
+struct DaemonOp {
+    enum Type: uint8_t {
+        READ  = DapOp::READ,
+        WRITE = DapOp::WRITE,
+        RMW   = DapOp::RMW,
+        BLOCK = 3               // read data consecutive words
+    };
+    uint8_t type;
+    uint8_t mod;                // module (0 .. 127)
+    uint16_t reserved;          // 0
+    uint32_t addr;              // address (0 .. 0x00FFFFFF)
+    uint32_t data;              // WRITE/RMW:  value;  BLOCK:  number of words (1 .. DAEMON_MAX_WORDS)
+    uint32_t mask;              // RMW:  bits to modify
+};
+
+static constexpr uint32_t DAEMON_MAGIC      = 0x31504144;       // "DAP1"
+static constexpr uint32_t DAEMON_MAX_OPS    = 65536;            // max. number of operations per request
+static constexpr uint32_t DAEMON_MAX_WORDS  = 1u << 20;         // max. number of result words per request
+static constexpr const char *DAEMON_SOCKET  = "/run/ctrl.sock"; // default socket's path
+
+
+/* -----  DAP Daemon  -----
+ *
+ * Serves DAP requests from any number of clients on a Unix domain socket, so that scripts that run many short
+ * operations pay for a socket round trip instead of a process start and Peripherals::init() (reading the FPGA
+ * manager's state, opening and mapping /dev/mem, and checking the firmware's dates) each time.
+ *
+ * Single threaded:  requests are executed one at a time in the order they arrive, so each request's operations
+ * are atomic with respect to other clients.  The socket is created with mode 0660; change its group to let other
+ * users connect.  run() returns when SIGINT or SIGTERM is received, and removes the socket.
+ */
+class DapDaemon {
+
+private:
+    struct Client {
+        int fd;
+        std::vector<uint8_t> rx;        // bytes received but not yet executed
+    };
+    Dap &dap;
+    char path[108];                     // socket's path
+    int fd;                             // listening socket, or -1
+    std::vector<Client> clients;
+    uint64_t requests;                  // number of requests served
+
+    bool serve(Client &c);
+    bool respond(Client &c, const uint8_t *req, uint32_t n);
+
+public:
+    static constexpr int MAX_CLIENTS = 64;
+
+    DapDaemon(Dap &dap, const char *path);
+    DapDaemon(const DapDaemon &) = delete;                  // delete copy constructor
+    DapDaemon &operator=(const DapDaemon &) = delete;       // delete assignment operator
+    ~DapDaemon();
+    void run();
+};
+
+
+// -----  Unix Socket Transport  -----
+// Thin client of a DapDaemon:  each read, write, batch, or block read is one request.  The firmware's dates are
+// read once and cached; usTime is read from module 0 (Basic I/O).
+class UnixTransport: public DapTransport {
+
+private:
+    int fd;                 // connected socket
+    char path[108];         // socket's path
+    uint32_t ids[2];        // cached creationDate and buildDate, or 0 if not yet read
+    void request(const DaemonOp *ops, uint32_t n, uint32_t *results, uint32_t nResults);
+
+public:
+    explicit UnixTransport(const char *path);
+    ~UnixTransport() override;
+    const char *name() override { return "unix"; }
+    uint32_t read(int mod, int addr) override;
+    void write(int mod, int addr, uint32_t data) override;
+    void execute(const DapOp *ops, size_t n, uint32_t *results) override;
+    void readBlock(int mod, int addr, size_t n, uint32_t *dst) override;
+    uint32_t usTime() override       { return read(0, 2); }
+    uint32_t creationDate() override { return  ids[0] != 0  ?  ids[0]  :  (ids[0] = read(0, 0)); }
+    uint32_t buildDate() override    { return  ids[1] != 0  ?  ids[1]  :  (ids[1] = read(0, 1)); }
+    void printStatus() override;
+};
@@ -0,0 +1,326 @@
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "common.h"
+#include "dapqueue.h"
+#include "peripherals.h"
+
+// DAP Command Queue
+//
+// Lock-free multi-producer, single-consumer queue of DAP requests, and the thread that issues them
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t) && std::atomic<uint32_t>::is_always_lock_free,
+              "futex words must be plain 32-bit words");
+
+
+
+// Current Time
+// out: returns CLOCK_MONOTONIC's time in nanoseconds
+static uint64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000u + uint64_t(ts.tv_nsec);
+}
+
+
+// Sleep Until a Futex Word Changes
+// Returns at once if *w != x.  May return spuriously, so the caller must check *w again.
+// in: w = futex word
+//     x = value *w had when the caller decided to sleep
+static void futexWait(std::atomic<uint32_t> &w, uint32_t x) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&w), FUTEX_WAIT_PRIVATE, x, nullptr, nullptr, 0);
+}
+
+
+// Wake All Threads Sleeping on a Futex Word
+// in: w = futex word
+static void futexWake(std::atomic<uint32_t> &w) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&w), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+}
+
+
+// Raise an Atomic Maximum
+// in out: m = maximum
+// in: x = new value
+template<typename T>
+static void raiseMax(std::atomic<T> &m, T x) {
+    T y = m.load(std::memory_order_relaxed);
+    while (x > y && !m.compare_exchange_weak(y, x, std::memory_order_relaxed))  { }
+}
+
+
+
+// **************
+// *  DapQueue  *
+// **************
+
+
+// Constructor
+// Starts the issuing thread.
+// in: dap = initialized DAP; from now on it must be used only through this object
+DapQueue::DapQueue(Dap &dap) : dap(dap), head(&stub), tail(&stub), pending(0), stopping(false),
+                               nRequests(0), depthSum(0), depthMax(0), waitSum(0), waitMax(0), serviceSum(0) {
+    stub.next.store(nullptr, std::memory_order_relaxed);
+    issuer = std::thread(&DapQueue::run, this);
+}
+
+
+// Destructor
+// Completes the requests already queued, then stops the issuing thread.
+DapQueue::~DapQueue() {
+    stopping.store(true, std::memory_order_release);
+    pending.fetch_add(1, std::memory_order_acq_rel);      // wake the issuing thread
+    futexWake(pending);
+    issuer.join();
+}
+
+
+// Push a Request (any thread)
+// in: r = request; r->next is overwritten
+void DapQueue::push(Request *r) {
+    r->next.store(nullptr, std::memory_order_relaxed);
+    Request *prev = head.exchange(r, std::memory_order_acq_rel);
+    prev->next.store(r, std::memory_order_release);
+}
+
+
+// Pop a Request (issuing thread only)
+// out: returns the oldest request, or nullptr if there is none or if a producer is midway through push()
+DapQueue::Request *DapQueue::pop() {
+    Request *t = tail,
+            *next = t->next.load(std::memory_order_acquire);
+    if (t == &stub) {
+        if (next == nullptr)  return nullptr;
+        tail = t = next;
+        next = t->next.load(std::memory_order_acquire);
+    }
+    if (next != nullptr) { tail = next;  return t; }
+    if (t != head.load(std::memory_order_acquire))  return nullptr;
+    push(&stub);
+    next = t->next.load(std::memory_order_acquire);
+    if (next != nullptr) { tail = next;  return t; }
+    return nullptr;
+}
+
+
+// Issuing Thread
+// Pops and executes requests until the destructor is called and the queue is empty.
+void DapQueue::run() {
+    for (;;) {
+        uint32_t n = pending.load(std::memory_order_acquire);
+        if (n == 0) { futexWait(pending, 0);  continue; }
+        Request *r = pop();
+        if (r == nullptr) {
+            if (stopping.load(std::memory_order_acquire) && n == 1)  return;
+            std::this_thread::yield();                      // a producer is midway through push()
+            continue;
+        }
+        uint64_t t0 = nowNs();
+        r->failed = false;
+        try {
+            if (r->kind == Request::EXECUTE)  dap.execute(r->ops, r->n, r->results);
+            else  dap.readBlock(r->mod, r->addr, r->n, r->results);
+        }
+        catch (const std::exception &e) {                  // (else it would terminate this thread's process)
+            r->failed = true;
+            strCpy(r->msg, sizeof r->msg, e.what());
+        }
+        catch (...) {
+            r->failed = true;
+            strCpy(r->msg, sizeof r->msg, "Unknown error");
+        }
+        uint64_t t1 = nowNs();
+        nRequests.fetch_add(1, std::memory_order_relaxed);
+        depthSum.fetch_add(n, std::memory_order_relaxed);
+        raiseMax(depthMax, n);
+        waitSum.fetch_add(t0 - r->tEnqueue, std::memory_order_relaxed);
+        raiseMax(waitMax, t0 - r->tEnqueue);
+        serviceSum.fetch_add(t1 - t0, std::memory_order_relaxed);
+        if (r->notify != nullptr) {
+            r->notify(r->ctx, r->failed, r->msg);
+            delete r;
+        }
+        else {
+            // r may be destroyed by its producer as soon as done is set
+            r->done.store(1, std::memory_order_release);
+            futexWake(r->done);
+        }
+        pending.fetch_sub(1, std::memory_order_acq_rel);
+    }
+}
+
+
+// Enqueue a Request (any thread)
+// in: r = request; its kind, operands, results pointer, notify, and ctx must be set
+// throws: Exception if this object is being destroyed
+void DapQueue::enqueue(Request *r) {
+    if (stopping.load(std::memory_order_acquire))  throwException("DAP queue is stopping");
+    r->done.store(0, std::memory_order_relaxed);
+    r->tEnqueue = nowNs();
+    push(r);
+    if (pending.fetch_add(1, std::memory_order_acq_rel) == 0)  futexWake(pending);
+}
+
+
+// Submit a Request and Wait for It to Complete (any thread)
+// in out: r = request; its kind, operands, and results pointer must be set
+// throws: Exception if the Dap threw one
+void DapQueue::submit(Request &r) {
+    r.notify = nullptr;
+    enqueue(&r);
+    while (r.done.load(std::memory_order_acquire) == 0)  futexWait(r.done, 0);
+    if (r.failed)  throwException("%s", r.msg);
+}
+
+
+// Execute a Batch of DAP Operations (any thread)
+// in: ops, n, results = as Dap::execute()
+// throws: Exception as Dap::execute()
+void DapQueue::execute(const DapOp *ops, size_t n, uint32_t *results) {
+    Request r;
+    r.kind = Request::EXECUTE;
+    r.ops = ops;
+    r.n = n;
+    r.results = results;
+    submit(r);
+}
+
+
+// Read a 32-bit Word (any thread)
+// in: mod, addr = module (0..127) and address (0..0x00FFFFFF)
+// out: returns the word read
+// throws: Exception as Dap::read()
+uint32_t DapQueue::read(int mod, int addr) {
+    DapOp op = { DapOp::READ, mod, addr, 0, 0 };
+    uint32_t x;
+    execute(&op, 1, &x);
+    return x;
+}
+
+
+// Write a 32-bit Word (any thread)
+// in: mod, addr = module (0..127) and address (0..0x00FFFFFF)
+//     data = word to write
+// throws: Exception as Dap::write()
+void DapQueue::write(int mod, int addr, uint32_t data) {
+    DapOp op = { DapOp::WRITE, mod, addr, data, 0 };
+    uint32_t x;
+    execute(&op, 1, &x);
+}
+
+
+// Read Consecutive 32-bit Words (any thread)
+// in: mod, addr = first word's module and address
+//     n = number of words
+// out: dst = words read
+// throws: Exception as Dap::readBlock()
+void DapQueue::readBlock(int mod, int addr, size_t n, uint32_t *dst) {
+    Request r;
+    r.kind = Request::BLOCK;
+    r.n = n;
+    r.mod = mod;
+    r.addr = addr;
+    r.results = dst;
+    submit(r);
+}
+
+
+// Post a Batch of DAP Operations Without Waiting (any thread)
+// in: ops, n = as Dap::execute(); must remain valid until notify is called
+//     notify, ctx = completion function and its argument
+// out: results = as Dap::execute(), once notify is called
+// throws: Exception if this object is being destroyed
+void DapQueue::post(const DapOp *ops, size_t n, uint32_t *results, Notify notify, void *ctx) {
+    Request *r = new Request;
+    r->kind = Request::EXECUTE;
+    r->ops = ops;
+    r->n = n;
+    r->results = results;
+    r->notify = notify;
+    r->ctx = ctx;
+    try { enqueue(r); }
+    catch (...) { delete r;  throw; }
+}
+
+
+// Post a Block Read Without Waiting (any thread)
+// in: mod, addr, n = as readBlock()
+//     notify, ctx = completion function and its argument
+// out: dst = words read, once notify is called
+// throws: Exception if this object is being destroyed
+void DapQueue::postBlock(int mod, int addr, size_t n, uint32_t *dst, Notify notify, void *ctx) {
+    Request *r = new Request;
+    r->kind = Request::BLOCK;
+    r->n = n;
+    r->mod = mod;
+    r->addr = addr;
+    r->results = dst;
+    r->notify = notify;
+    r->ctx = ctx;
+    try { enqueue(r); }
+    catch (...) { delete r;  throw; }
+}
+
+
+// Get Statistics (any thread)
+// out: returns a snapshot of the statistics (not necessarily consistent with one another while requests complete)
+DapQueue::Stats DapQueue::stats() const {
+    Stats s;
+    s.requests = nRequests.load(std::memory_order_relaxed);
+    double k = s.requests != 0  ?  1.0 / double(s.requests)  :  0.0;
+    s.meanDepth = k * double(depthSum.load(std::memory_order_relaxed));
+    s.maxDepth = depthMax.load(std::memory_order_relaxed);
+    s.meanWait = 1e-9 * k * double(waitSum.load(std::memory_order_relaxed));
+    s.maxWait = 1e-9 * double(waitMax.load(std::memory_order_relaxed));
+    s.meanService = 1e-9 * k * double(serviceSum.load(std::memory_order_relaxed));
+    return s;
+}
+
+
+// Print Status (for debugging)
+void DapQueue::printStatus() {
+    Stats s = stats();
+    printf("DAP Command Queue\n");
+    printf("    requests       =  %10llu   ; requests completed\n", (unsigned long long) s.requests);
+    printf("    depth          =  %10u   ; requests queued or executing now\n", depth());
+    printf("    meanDepth      =  %10.2f   ; requests queued or executing when a request was popped\n", s.meanDepth);
+    printf("    maxDepth       =  %10u   ; requests queued or executing when a request was popped\n", s.maxDepth);
+    printf("    meanWait       =  %10.1f   ; microseconds from push to pop\n", 1e6 * s.meanWait);
+    printf("    maxWait        =  %10.1f   ; microseconds from push to pop\n", 1e6 * s.maxWait);
+    printf("    meanService    =  %10.1f   ; microseconds executing on the DAP\n", 1e6 * s.meanService);
+    putchar('\n');
+}
+
+
+
+// *********************
+// *  QueuedTransport  *
+// *********************
+
+
+// Read usTime (any thread)
+// out: returns module 0's copy of the DAP's 1 MHz timer modulo 2**26
+// throws: Exception as Dap::read()
+uint32_t QueuedTransport::usTime() {
+    return q.read(regmap::bio::MODULE, regmap::bio::usTime::addr);
+}
+
+
+// Read the Firmware's Creation Date (any thread)
+// out: returns module 0's copy of the creation date in 0xYYMMDDHH format
+// throws: Exception as Dap::read()
+uint32_t QueuedTransport::creationDate() {
+    return q.read(regmap::bio::MODULE, regmap::bio::creationDate::addr);
+}
+
+
+// Read the Firmware's Build Date (any thread)
+// out: returns module 0's copy of the build date in 0xYYMMDDHH format
+// throws: Exception as Dap::read()
+uint32_t QueuedTransport::buildDate() {
+    return q.read(regmap::bio::MODULE, regmap::bio::buildDate::addr);
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include "transport.h"
+
+class Dap;
+
+
+/* -----  DAP Command Queue  -----
+ *
+ * Serializes DAP transactions from any number of threads.  A DAP transaction is a sequence of accesses to shared
+ * registers (wdata, then rwModAddr, then rdata), so two threads calling Dap directly can corrupt each other's
+ * transactions.  Instead, each thread calls this class' methods, which push a request onto a lock-free
+ * multi-producer, single-consumer queue and wait for it to complete.  One issuing thread, started by the
+ * constructor, pops the requests in order and executes them on the Dap, so the Dap (and its transport) is only
+ * ever used by that thread.  Each request's operations are atomic with respect to other threads' requests.
+ *
+ * Synchronous requests live on their callers' stacks, so pushing one allocates no memory:  the queue is intrusive
+ * (D. Vyukov's MPSC node queue) and each request is also its own completion slot.  A producer pushes with one
+ * atomic exchange; the issuing thread, and a producer waiting for its request to complete, sleep on a futex.
+ * If the Dap throws (an Exception, or any other exception, e.g. std::bad_alloc), the issuing thread stores its
+ * message in the request, and the caller's method throws an Exception with the same message.
+ *
+ * post() and postBlock() allocate a request and queue it without waiting; its Notify function is called on the
+ * issuing thread when it completes (see DapExecutor in executor.h, which builds futures on them).
+ *
+ * While a DapQueue exists, no other code may use its Dap:  classes built on a Dap (DcmCapture, Timebase, ...) reach
+ * the queue through a QueuedTransport.  The Logger is not thread safe, so producers should not log concurrently
+ * either.
+ */
+class DapQueue {
+
+private:
+    struct Request {
+        std::atomic<Request *> next;
+        enum Kind: uint8_t { EXECUTE, BLOCK } kind;
+        const DapOp *ops;           // EXECUTE:  operations
+        size_t n;                   // EXECUTE:  number of operations;  BLOCK:  number of words
+        int mod, addr;              // BLOCK:  first word's module and address
+        uint32_t *results;          // EXECUTE:  one result per operation (see Dap::execute());  BLOCK:  words
+        uint64_t tEnqueue;          // time pushed (ns, CLOCK_MONOTONIC)
+        void (*notify)(void *ctx, bool failed, const char *msg);    // posted:  completion function, else nullptr
+        void *ctx;                  // posted:  notify's argument
+        std::atomic<uint32_t> done; // completion slot:  0 = pending, 1 = done (futex word)
+        bool failed;                // true if the Dap threw
+        char msg[200];              // failed:  the exception's message
+    };
+
+    Dap &dap;
+    std::atomic<Request *> head;    // most recently pushed request (producers' end)
+    Request *tail;                  // next request to pop (issuing thread's end)
+    Request stub;                   // dummy node that keeps the queue non-empty
+    std::atomic<uint32_t> pending;  // number of requests pushed but not yet completed (futex word)
+    std::atomic<bool> stopping;
+    std::thread issuer;
+
+    // statistics (written by the issuing thread only)
+    std::atomic<uint64_t> nRequests;        // requests completed
+    std::atomic<uint64_t> depthSum;         // sum over requests of the queue's depth when popped
+    std::atomic<uint32_t> depthMax;         // max. queue depth when popped
+    std::atomic<uint64_t> waitSum;          // sum over requests of the time from push to pop (ns)
+    std::atomic<uint64_t> waitMax;          // max. time from push to pop (ns)
+    std::atomic<uint64_t> serviceSum;       // sum over requests of the time executing on the Dap (ns)
+
+    void push(Request *r);
+    Request *pop();
+    void enqueue(Request *r);
+    void submit(Request &r);
+    void run();
+
+public:
+    // Completion Function of a Posted Request
+    // Called on the issuing thread, once, when the request has been executed; it must not block.
+    // in: ctx = argument given to post() or postBlock()
+    //     failed = true if the Dap threw
+    //     msg = failed:  the exception's message (valid only during the call)
+    typedef void (*Notify)(void *ctx, bool failed, const char *msg);
+
+    struct Stats {
+        uint64_t requests;          // requests completed
+        double meanDepth;           // mean number of requests queued or executing when a request is popped
+        uint32_t maxDepth;          // max. number of requests queued or executing when a request is popped
+        double meanWait;            // mean time in the queue (s)
+        double maxWait;             // max. time in the queue (s)
+        double meanService;         // mean time executing on the Dap (s)
+    };
+
+    explicit DapQueue(Dap &dap);
+    DapQueue(const DapQueue &) = delete;                // delete copy constructor
+    DapQueue &operator=(const DapQueue &) = delete;     // delete assignment operator
+    ~DapQueue();
+    void execute(const DapOp *ops, size_t n, uint32_t *results);
+    uint32_t read(int mod, int addr);
+    void write(int mod, int addr, uint32_t data);
+    void readBlock(int mod, int addr, size_t n, uint32_t *dst);
+    void post(const DapOp *ops, size_t n, uint32_t *results, Notify notify, void *ctx);
+    void postBlock(int mod, int addr, size_t n, uint32_t *dst, Notify notify, void *ctx);
+    uint32_t depth() const { return pending.load(std::memory_order_relaxed); }
+    Stats stats() const;
+    void printStatus();
+};
+
+
+/* -----  Queued Transport  -----
+ *
+ * DapTransport that sends every access through a DapQueue, so any class built on a Dap can run on any thread:  give
+ * each thread its own Dap, initialized with its own QueuedTransport (a Dap's cache is not thread safe).  usTime,
+ * creationDate, and buildDate are read from their copies in module 0 (Basic I/O), as SerialTransport does.
+ */
+class QueuedTransport: public DapTransport {
+
+private:
+    DapQueue &q;
+
+public:
+    explicit QueuedTransport(DapQueue &q) : q(q) {}
+    const char *name() override { return "queued"; }
+    uint32_t read(int mod, int addr) override { return q.read(mod, addr); }
+    void write(int mod, int addr, uint32_t data) override { q.write(mod, addr, data); }
+    void execute(const DapOp *ops, size_t n, uint32_t *results) override { q.execute(ops, n, results); }
+    void readBlock(int mod, int addr, size_t n, uint32_t *dst) override { q.readBlock(mod, addr, n, dst); }
+    uint32_t usTime() override;
+    uint32_t creationDate() override;
+    uint32_t buildDate() override;
+};
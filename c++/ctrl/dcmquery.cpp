@@ -0,0 +1,287 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <map>
+#include <thread>
+#include <vector>
+#include "archive.h"
+#include "common.h"
+#include "pool.h"
+#include "telemetry.h"
+
+// Capture Archive Query Tool
+//
+// Aggregates a capture archive's packets (see archive.h) by packet type, and optionally by time bucket:  each
+// group's packet count and rate, the gaps between consecutive packets of its type, and the min/mean/max of each of
+// its type's fields (see telemetry.def).  Prints CSV, one row per group and field.  Built by "make dcmquery".
+//
+// The archive's blocks in the time range are split into ranges of RANGE_BLOCKS blocks that never cross a segment,
+// and a WorkStealingPool scans them.  Each range is aggregated into its own partial result, so no state is shared
+// while scanning; the partials are then merged in time order, which also joins the gaps that cross ranges.
+
+
+
+// ******************
+// *  Aggregations  *
+// ******************
+
+
+static constexpr size_t RANGE_BLOCKS = 16;      // index blocks per range (about 1 MiB of packets)
+
+
+// Query
+struct Query {
+    uint64_t t0, t1;                            // time range [t0, t1) in unwrapped microseconds
+    uint64_t origin;                            // archive's first packet's time; buckets and output are relative to it
+    uint64_t bucket;                            // bucket width in microseconds, or 0 for one bucket
+    uint64_t types;                             // mask of the packet types wanted
+    std::vector<unsigned> fields[telemetry::TYPES];     // each type's fields (indexes in telemetry::fields)
+
+    // Group Key:  bucket and type, in time order
+    uint64_t key(uint64_t t, unsigned type) const {
+        return (bucket != 0  ?  (t - origin) / bucket  :  0) * telemetry::TYPES + type;
+    }
+};
+
+
+// Field's Statistics
+struct FieldStats {
+    uint32_t min, max;
+    uint64_t sum;
+};
+
+
+// Group's Statistics (packets of one type in one bucket)
+struct Group {
+    uint64_t packets;
+    uint64_t gaps, gapMin, gapMax, gapSum;      // gaps (us) from the previous packet of the same type
+    std::vector<FieldStats> f;                  // Query::fields[type]'s statistics
+
+    explicit Group(size_t nFields) : packets(0), gaps(0), gapMin(~0ull), gapMax(0), gapSum(0), f(nFields, { ~0u, 0, 0 }) {}
+
+    void gap(uint64_t dt) {
+        gaps++;
+        gapSum += dt;
+        gapMin = std::min(gapMin, dt);
+        gapMax = std::max(gapMax, dt);
+    }
+
+    void merge(const Group &g) {
+        packets += g.packets;
+        gaps += g.gaps;
+        gapSum += g.gapSum;
+        gapMin = std::min(gapMin, g.gapMin);
+        gapMax = std::max(gapMax, g.gapMax);
+        for (size_t k = 0; k < f.size(); k++) {
+            f[k].min = std::min(f[k].min, g.f[k].min);
+            f[k].max = std::max(f[k].max, g.f[k].max);
+            f[k].sum += g.f[k].sum;
+        }
+    }
+};
+
+
+// Partial Result (of one range, or of the merged ranges)
+struct Partial {
+    std::map<uint64_t, Group> groups;           // by Query::key()
+    uint64_t seen;                              // mask of the types seen
+    uint64_t first[telemetry::TYPES];           // time of each type's first packet
+    uint64_t firstKey[telemetry::TYPES];        // group of each type's first packet
+    uint64_t last[telemetry::TYPES];            // time of each type's last packet
+
+    Partial() : seen(0) {}
+
+    Group &group(uint64_t key, const Query &q) {
+        auto g = groups.find(key);
+        if (g == groups.end())  g = groups.emplace(key, Group(q.fields[key % telemetry::TYPES].size())).first;
+        return g->second;
+    }
+
+    // Merge the Next Range's Partial Result (the ranges must be merged in time order)
+    void merge(const Partial &p, const Query &q) {
+        for (const auto &g : p.groups)  group(g.first, q).merge(g.second);
+        for (unsigned t = 0; t < telemetry::TYPES; t++) {
+            if ((p.seen >> t & 1) == 0)  continue;
+            if ((seen >> t & 1) != 0)  group(p.firstKey[t], q).gap(p.first[t] - last[t]);
+            else {
+                seen |= 1ull << t;
+                first[t] = p.first[t];
+                firstKey[t] = p.firstKey[t];
+            }
+            last[t] = p.last[t];
+        }
+    }
+};
+
+
+// Decoder's Visitor:  adds each packet to its group
+struct Scanner {
+    Partial &p;
+    const Query &q;
+    Group *cur[telemetry::TYPES];               // each type's current group, or nullptr
+    uint64_t curKey[telemetry::TYPES];
+
+    Scanner(Partial &p, const Query &q) : p(p), q(q) { std::fill(cur, cur + telemetry::TYPES, nullptr); }
+
+    template<class P>
+    void operator()(const telemetry::Record<P> &r) {
+        constexpr unsigned t = P::type;
+        uint64_t key = q.key(r.time, t);
+        if (cur[t] == nullptr || curKey[t] != key) {
+            cur[t] = &p.group(key, q);
+            curKey[t] = key;
+        }
+        Group &g = *cur[t];
+        g.packets++;
+        if ((p.seen >> t & 1) != 0)  g.gap(r.time - p.last[t]);
+        else {
+            p.seen |= 1ull << t;
+            p.first[t] = r.time;
+            p.firstKey[t] = key;
+        }
+        p.last[t] = r.time;
+        const std::vector<unsigned> &fl = q.fields[t];
+        for (size_t k = 0; k < fl.size(); k++) {
+            uint32_t x = telemetry::fields[fl[k]].get(r.words);
+            FieldStats &f = g.f[k];
+            f.min = std::min(f.min, x);
+            f.max = std::max(f.max, x);
+            f.sum += x;
+        }
+    }
+};
+
+
+// Range of Blocks (in one segment)
+struct Range {
+    size_t segment, b0, b1;
+};
+
+
+// Print the Result as CSV
+// in: total = merged result
+//     q = query
+//     first, last = times of the archive's first and last packets
+static void print(const Partial &total, const Query &q, uint64_t first, uint64_t last) {
+    puts("packet,type,bucket_s,packets,rate_hz,gap_min_us,gap_mean_us,gap_max_us,field,min,mean,max");
+    for (const auto &e : total.groups) {
+        unsigned type = unsigned(e.first % telemetry::TYPES);
+        uint64_t b = e.first / telemetry::TYPES;
+        const Group &g = e.second;
+
+        // the bucket's duration, within the query's range and the archive's span
+        uint64_t lo = std::max(q.t0, first), hi = std::min(q.t1, last + 1);
+        if (q.bucket != 0) {
+            lo = std::max(lo, q.origin + b * q.bucket);
+            hi = std::min(hi, q.origin + (b + 1) * q.bucket);
+        }
+        double rate = hi > lo  ?  g.packets / (1e-6 * double(hi - lo))  :  0.0;
+
+        char gaps[64] = ",,";
+        if (g.gaps != 0)
+            snprintf( gaps, sizeof gaps, "%llu,%.3f,%llu",
+                      (unsigned long long) g.gapMin, double(g.gapSum) / g.gaps, (unsigned long long) g.gapMax );
+        const telemetry::Schema *s = telemetry::lookup(type);
+        char prefix[160];
+        snprintf( prefix, sizeof prefix, "%s,%u,%.6f,%llu,%.3f,%s",
+                  s->name, type, 1e-6 * double(b * q.bucket), (unsigned long long) g.packets, rate, gaps );
+        const std::vector<unsigned> &fl = q.fields[type];
+        if (fl.empty())  printf("%s,,,,\n", prefix);
+        for (size_t k = 0; k < fl.size(); k++)
+            printf( "%s,%s,%u,%.3f,%u\n", prefix, telemetry::fields[fl[k]].name,
+                    g.f[k].min, double(g.f[k].sum) / g.packets, g.f[k].max );
+    }
+}
+
+
+
+// **********
+// *  Main  *
+// **********
+
+
+// Print Help
+static void help() {
+    puts( "\n"
+        "usage:  ./dcmquery <base> [-T <from> <to>] [-b <seconds>] [--type <name>]* [-j <threads>]\n\n"
+        "    <base>              -- Capture archive's path without extension (segments <base>.NNNN.seg)\n"
+        "    -T <from> <to>      -- Time range in seconds from the archive's first packet (default: all)\n"
+        "    -b <seconds>        -- Group by time buckets of this width too (default: one bucket)\n"
+        "    --type <name>       -- Only packets of this type (see telemetry.def); may be repeated (default: all)\n"
+        "    -j <threads>        -- Number of threads (default: the number of cores)\n\n"
+        "Prints CSV, one row per packet type, bucket, and field:  packet, type, bucket_s (bucket's start), packets,\n"
+        "rate_hz, gap_min_us, gap_mean_us, gap_max_us (gaps from the previous packet of the type), field, min, mean,\n"
+        "max.  Times are relative to the archive's first packet.\n"
+    );
+}
+
+
+// Main
+int main(int argc, char *argv[]) {
+    const char *base = nullptr;
+    double from = 0, to = INFINITY, bucket = 0;
+    uint64_t types = 0;
+    unsigned threads = std::thread::hardware_concurrency();
+    for (int i = 1; i < argc; i++) {
+        if (strEq(argv[i], "-T") && i + 2 < argc) { from = atof(argv[++i]);  to = atof(argv[++i]); }
+        else if (strEq(argv[i], "-b") && i + 1 < argc)  bucket = atof(argv[++i]);
+        else if (strEq(argv[i], "-j") && i + 1 < argc)  threads = unsigned(atoi(argv[++i]));
+        else if (strEq(argv[i], "--type") && i + 1 < argc) {
+            const char *name = argv[++i];
+            const telemetry::Schema *s = nullptr;
+            for (const telemetry::Schema &t : telemetry::table)
+                if (strEq(t.name, name))  s = &t;
+            if (s == nullptr) { printf("ERROR : Unknown packet type \"%s\" (see telemetry.def)\n", name);  return 1; }
+            types |= ArchiveReader::typeMask(s->type);
+        }
+        else if (base == nullptr && argv[i][0] != '-')  base = argv[i];
+        else { help();  return strEq(argv[i], "-h") || strEq(argv[i], "--help")  ?  0  :  1; }
+    }
+    if (base == nullptr) { help();  return 1; }
+
+    int errCode = 0;
+    try {
+        if (from < 0 || to < from || bucket < 0)  throwException("Invalid time range or bucket width");
+        ArchiveReader archive(base);
+        uint64_t first = archive.first(), last = archive.last();
+
+        Query q;
+        q.origin = first;
+        q.t0 = first + uint64_t(llround(from * 1e6));
+        q.t1 = std::isinf(to)  ?  ~0ull  :  first + uint64_t(llround(to * 1e6));
+        q.bucket = uint64_t(llround(bucket * 1e6));
+        q.types = types != 0  ?  types  :  ArchiveReader::ALL_TYPES;
+        for (unsigned k = 0; telemetry::fields[k].name != nullptr; k++)
+            q.fields[telemetry::fields[k].type].push_back(k);
+
+        std::vector<Range> ranges;
+        for (size_t i = 0; i < archive.segments(); i++) {
+            size_t b0, b1;
+            archive.blockRange(i, q.t0, q.t1, b0, b1);
+            for (size_t b = b0; b < b1; b += RANGE_BLOCKS)  ranges.push_back({ i, b, std::min(b + RANGE_BLOCKS, b1) });
+        }
+
+        Stopwatch sw;
+        std::vector<Partial> partial(ranges.size());
+        WorkStealingPool pool(threads);
+        pool.run(ranges.size(), [&](unsigned, size_t k) {
+            const Range &r = ranges[k];
+            archive.queryBlocks(r.segment, r.b0, r.b1, q.t0, q.t1, q.types, Scanner(partial[k], q));
+        });
+        Partial total;
+        for (const Partial &p : partial)  total.merge(p, q);
+        double t = sw.elapsed();
+
+        print(total, q, first, last);
+        uint64_t packets = 0;
+        for (const auto &g : total.groups)  packets += g.second.packets;
+        fprintf( stderr, "Scanned %zu ranges of %s in %.3f s (%llu packets, %.0f packets/s) on %u threads (%zu steals)\n",
+                 ranges.size(), base, t, (unsigned long long) packets, t > 0  ?  packets / t  :  0.0,
+                 pool.threads(), pool.steals() );
+    }
+    catch (const Exception &e) {
+        printf("ERROR at %s:%d : %s\n", e.fileName, e.lineNo, e.what());
+        errCode = 1;
+    }
+    return errCode;
+}
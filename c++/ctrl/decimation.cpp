@@ -0,0 +1,179 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "common.h"
+#include "telemetry.h"
+#include "decimation.h"
+
+// Adaptive Decimation Controller
+//
+// Estimates the DCM ports' offered packet rates from the captured packets, and retunes their decimation
+
+
+
+// Constructor
+// in: policy = target fill time, shares, ports of interest, and interval
+//     bufferWords = DCM buffer's capacity in words
+//     dec = ports' decimations in the DCM now
+// throws: Exception if the policy is invalid
+DecimationController::DecimationController(const DecimationPolicy &policy, uint32_t bufferWords, const uint16_t dec[PORTS])
+    : policy(policy), bufferWords(bufferWords) {
+    if (!(policy.fillSeconds > 0) || !(policy.interval > 0))  throwException("Invalid decimation policy");
+    for (int p = 0; p < PORTS; p++)
+        if (!(policy.share[p] >= 0))  throwException("Invalid share for DCM port %d", p);
+    memcpy(this->dec, dec, sizeof this->dec);
+    memcpy(decIn, dec, sizeof decIn);
+    memcpy(base, dec, sizeof base);
+    memset(offered, 0, sizeof offered);
+    memset(offeredWords, 0, sizeof offeredWords);
+    memset(got, 0, sizeof got);
+    memset(ps, 0, sizeof ps);
+    memset(annotation, 0, sizeof annotation);
+    captured = changes = 0;
+    started = pending = flushing = false;
+    elapsed = burstUntil = fillRate = 0;
+    skip = 0;
+}
+
+
+// Is a Packet at or after the Pending Change?
+// in: header = packet's header word
+// out: returns true if its timestamp is at or after the `decimation` packet's (modulo 2**26)
+bool DecimationController::after(uint32_t header) const {
+    return ((header - annotation[0]) & telemetry::TIME_MASK) < (telemetry::TIME_MASK + 1) / 2;
+}
+
+
+// Observe Captured Words
+// Attributes their packets to their ports.  If a `decimation` packet is pending, stops where it must be inserted.
+// in: w, n = words captured, continuing the previous call's (a packet may span two calls)
+// out: insert = true if the pending `decimation` packet must be inserted after the words observed
+//      returns the number of words observed (n, unless insert)
+size_t DecimationController::observe(const uint32_t *w, size_t n, bool &insert) {
+    size_t i = std::min(skip, n);
+    skip -= i;
+    insert = false;
+    for (;;) {
+        if (pending && skip == 0 && (flushing || (i < n && after(w[i])))) {
+            insert = true;
+            break;
+        }
+        if (i >= n)  break;
+        unsigned type = telemetry::typeOf(w[i]);
+        const telemetry::Schema *s = telemetry::lookup(type);
+        size_t length = s != nullptr  ?  s->length  :  1;    // (an unknown type is skipped word by word)
+        int p = telemetry::portOf(type);
+        if (p >= 0) {
+            got[p]++;
+            ps[p].packets++;
+            offered[p] += decIn[p];
+            offeredWords[p] += double(decIn[p]) * length;
+        }
+        i += length;
+        if (i > n) {
+            skip = i - n;
+            i = n;
+        }
+    }
+    captured += i;
+    return i;
+}
+
+
+// The Pending `decimation` Packet Was Inserted
+// The words observed from now on were captured at the new decimations.
+void DecimationController::placed() {
+    pending = flushing = false;
+    memcpy(decIn, dec, sizeof decIn);
+}
+
+
+// Retune the Decimations
+// Call every policy.interval.  If the previous change's `decimation` packet is still pending, no change is made,
+// and it is placed at the next packet boundary instead.
+// in: seconds = time since the previous call (or since the capture started)
+// out: next = ports' new decimations
+//      returns true if they differ from the DCM's; then call changed() once they are set
+bool DecimationController::retune(double seconds, uint16_t next[PORTS]) {
+    memcpy(next, dec, sizeof dec);
+    if (!(seconds > 0))  return false;
+    elapsed += seconds;
+    fillRate = captured / seconds;
+    captured = 0;
+    bool burst = false;
+    for (int p = 0; p < PORTS; p++) {
+        PortStats &s = ps[p];
+        s.rate = offered[p] / seconds;
+        s.words = offeredWords[p] / seconds;
+        if (started && s.rate > BURST_FACTOR * s.average && got[p] >= BURST_MIN)  burst = true;
+        s.average = started  ?  s.average + SMOOTHING * (s.rate - s.average)  :  s.rate;
+        s.averageWords = started  ?  s.averageWords + SMOOTHING * (s.words - s.averageWords)  :  s.words;
+    }
+    started = true;
+    if (burst)  burstUntil = elapsed + BURST_HOLD;
+    uint64_t seen[PORTS];
+    memcpy(seen, got, sizeof seen);
+    memset(offered, 0, sizeof offered);
+    memset(offeredWords, 0, sizeof offeredWords);
+    memset(got, 0, sizeof got);
+    if (pending) {
+        flushing = true;
+        return false;
+    }
+
+    double shares = 0;
+    for (int p = 0; p < PORTS; p++)
+        if (dec[p] != 0)  shares += policy.share[p] > 0  ?  policy.share[p]  :  1;
+    double budget = bufferWords / policy.fillSeconds;                   // words per second
+    bool changing = false;
+    for (int p = 0; p < PORTS; p++) {
+        if (dec[p] == 0)  continue;
+        double share = (policy.share[p] > 0  ?  policy.share[p]  :  1) / shares;
+        double words = std::max(ps[p].words, ps[p].averageWords);
+        unsigned d = seen[p] != 0  ?  unsigned(clamp(std::ceil(words / (budget * share)), 1.0, 65535.0))
+                                   :  std::max(1u, base[p] / 2u);
+        if (d * HYSTERESIS > base[p] && d < base[p] * HYSTERESIS)  d = base[p];
+        base[p] = uint16_t(d);
+        if (bursting() && (policy.interest >> p & 1) != 0)  d = std::max(1u, d / BURST_GAIN);
+        next[p] = uint16_t(d);
+        if (next[p] != dec[p])  changing = true;
+    }
+    return changing;
+}
+
+
+// The Decimations Were Changed
+// Prepares the `decimation` packet, which observe() then places.
+// in: next = ports' new decimations (as set in the DCM)
+//     usTime = PL's usTime just after they were set
+void DecimationController::changed(const uint16_t next[PORTS], uint32_t usTime) {
+    using namespace telemetry::decimation;
+    memcpy(dec, next, sizeof dec);
+    memset(annotation, 0, sizeof annotation);
+    annotation[0] = packet::type << 26 | telemetry::timeOf(usTime);
+    annotation[dec0::word] |= uint32_t(next[0]) << dec0::lsb;
+    annotation[dec1::word] |= uint32_t(next[1]) << dec1::lsb;
+    annotation[dec2::word] |= uint32_t(next[2]) << dec2::lsb;
+    annotation[dec3::word] |= uint32_t(next[3]) << dec3::lsb;
+    annotation[dec4::word] |= uint32_t(next[4]) << dec4::lsb;
+    annotation[dec5::word] |= uint32_t(next[5]) << dec5::lsb;
+    pending = true;
+    flushing = false;
+    changes++;
+}
+
+
+// Print Status (for debugging)
+void DecimationController::printStatus() const {
+    printf("Adaptive Decimation (fill time %g s, interval %g s)\n", policy.fillSeconds, policy.interval);
+    printf("    changes        =  %10llu   ; decimation changes\n", (unsigned long long) changes);
+    printf( "    fillRate       =  %10.0f   ; words captured per second (target %.0f)\n",
+            fillRate, bufferWords / policy.fillSeconds );
+    printf("    burst          =  %10d   ; 1 if the ports of interest (0x%02X) are raised\n", int(bursting()), policy.interest);
+    for (int p = 0; p < PORTS; p++)
+        if (dec[p] != 0 || ps[p].packets != 0)
+            printf( "    dec%d           =  %10u   ; offered %.0f packets/s (average %.0f), %llu captured\n",
+                    p, dec[p], ps[p].rate, ps[p].average, (unsigned long long) ps[p].packets );
+    putchar('\n');
+}
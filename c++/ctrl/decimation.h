@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+// Adaptive Decimation Policy (see DecimationController)
+struct DecimationPolicy {
+    double fillSeconds;             // target time for the captured telemetry to fill the DCM's buffer (> 0)
+    double share[6];                // ports' relative shares of the bandwidth (enabled ports with share 0 get 1)
+    uint32_t interest;              // ports of interest (bit p for port p), whose rate is raised during bursts
+    double interval;                // seconds between retunings
+};
+
+
+/* -----  Adaptive Decimation Controller  -----
+ *
+ * Retunes the DCM ports' decimation (dec0 .. dec5) during a capture, so that the captured telemetry fills the
+ * DCM's buffer in about DecimationPolicy::fillSeconds, shared among the ports by DecimationPolicy::share.  Used by
+ * DcmCapture (see DcmCapture::adapt()), which passes it every word it captures and calls retune() every interval.
+ *
+ * Rates:  observe() walks the captured packets' headers, and attributes each packet to its port with telemetry.def's
+ * PSOURCE.  A packet captured at decimation d stands for d packets offered by its port, so each port's offered
+ * rate (packets and words per second) is estimated as if its decimation were 1; the words captured per interval
+ * (the buffer's length growth) are measured too.  Each interval, a port's decimation is set to
+ *
+ *     ceil(offered words/s  /  (buffer words / fillSeconds  *  port's share / enabled ports' shares))
+ *
+ * clamped to 1..65535, using the larger of the interval's rate and its smoothed average (so the controller
+ * reacts to a rising rate at once, and to a falling one gradually).  A port with no packets in an interval has its
+ * decimation halved, to find its rate.  Changes smaller than a factor of HYSTERESIS are not made, and disabled
+ * ports (decimation 0) are left disabled.
+ *
+ * Bursts:  when any port's rate exceeds BURST_FACTOR times its average, the ports of interest are captured at
+ * BURST_GAIN times their normal rate (their decimation divided by BURST_GAIN) until BURST_HOLD seconds after the
+ * last such interval.  The buffer then fills faster than fillSeconds, for the duration of the event.
+ *
+ * Logging:  each change is logged into the capture itself, as a host-written `decimation` packet (telemetry.def)
+ * holding the six new decimations.  Its timestamp is the PL's usTime just after the change, and it is inserted
+ * into the captured words just before the first packet at or after that time (by save(), with observe() and
+ * placed()), so the capture's timestamps stay in order.  If no such packet has arrived by the next retuning, the
+ * packet is inserted at the end of the captured words (at a packet boundary) instead:  every packet captured
+ * until then precedes the change.
+ */
+class DecimationController {
+
+public:
+    static constexpr int PORTS          = 6;
+    static constexpr double HYSTERESIS  = 1.25;     // min. factor of a decimation change
+    static constexpr double SMOOTHING   = 0.25;     // weight of the latest interval in a port's average rate
+    static constexpr double BURST_FACTOR = 4;       // a port's rate this many times its average starts a burst
+    static constexpr double BURST_HOLD  = 5;        // seconds a burst lasts after the last interval that started it
+    static constexpr unsigned BURST_GAIN = 8;       // ports of interest's rate is raised this many times in a burst
+    static constexpr uint64_t BURST_MIN = 10;       // min. packets captured in an interval to start a burst
+    static constexpr unsigned ANNOTATION_WORDS = 4; // length of a `decimation` packet
+
+    struct PortStats {
+        uint64_t packets;           // packets captured
+        double rate;                // offered packets per second in the last interval
+        double average;             // smoothed offered packets per second
+        double words;               // offered words per second in the last interval
+        double averageWords;        // smoothed offered words per second
+    };
+
+private:
+    DecimationPolicy policy;
+    uint32_t bufferWords;           // DCM buffer's capacity in words
+    uint16_t dec[PORTS];            // decimations in the DCM
+    uint16_t decIn[PORTS];          // decimations of the words being observed (dec, until the annotation is placed)
+    uint16_t base[PORTS];           // decimations without the burst's gain
+    double offered[PORTS];          // this interval's offered packets per port
+    double offeredWords[PORTS];     // this interval's offered words per port
+    uint64_t got[PORTS];            // this interval's packets captured per port
+    uint64_t captured;              // this interval's words captured
+    PortStats ps[PORTS];
+    bool started;                   // true after the first interval
+    double elapsed;                 // seconds since the first observe()
+    double burstUntil;              // elapsed time when the burst ends (0 if none)
+    size_t skip;                    // words of a packet cut off by the end of the previous observe()
+    bool pending;                   // true if a `decimation` packet has not been placed yet
+    bool flushing;                  // true to place it at the next packet boundary
+    uint32_t annotation[ANNOTATION_WORDS];      // the `decimation` packet
+    uint64_t changes;               // decimation changes
+    double fillRate;                // words captured per second in the last interval
+
+    bool after(uint32_t header) const;
+
+public:
+    DecimationController(const DecimationPolicy &policy, uint32_t bufferWords, const uint16_t dec[PORTS]);
+    size_t observe(const uint32_t *w, size_t n, bool &insert);
+    const uint32_t *packet() const { return annotation; }
+    void placed();
+    void resync() { skip = 0; }
+    bool retune(double seconds, uint16_t next[PORTS]);
+    void changed(const uint16_t next[PORTS], uint32_t usTime);
+    bool bursting() const { return burstUntil > elapsed; }
+    double interval() const { return policy.interval; }
+    double rate() const { return fillRate; }
+    uint64_t count() const { return changes; }
+    const PortStats &stats(int p) const { return ps[p]; }
+    const uint16_t *decimation() const { return dec; }
+    void printStatus() const;
+};
@@ -0,0 +1,238 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#include "common.h"
+#include "dump.h"
+
+// Serial Dump Receiver
+//
+// Receives a Debug Capture Module dump from the Debug Serial Port with a reader thread, checks its checksum, and
+// writes it to a binary file as it arrives
+
+
+
+// Constructor
+// in: fd = serial port's file descriptor, in raw mode (see SerialTransport::open()); any readable file works
+//     baud = its baud rate
+DumpReceiver::DumpReceiver(int fd, unsigned baud) : fd(fd), baud(baud), chunk(RING_CHUNKS), progress(true) {
+    for (Chunk &c : chunk) {
+        c.b.resize(CHUNK_BYTES);
+        c.n = 0;
+        c.ready = false;
+        c.t = 0;
+    }
+    memset(&st, 0, sizeof st);
+    stopping = false;
+    ended = false;
+    error = 0;
+}
+
+
+// Reader Thread
+// Fills the ring's buffers in turn, and hands each one over when it is full or HANDOFF_MS after its first byte.
+// Stops when stopping is set, or when the stream stalls, ends, or fails (its last buffer is then handed over with
+// ended set).
+void DumpReceiver::readLoop() {
+    Stopwatch sw;
+    double last = -1;                                       // time of the last byte (s), or -1 before the first
+    double quiet = 0;                                       // start of the pause:  the last byte, or the end of a
+                                                            // wait for a free buffer (s)
+    for (size_t k = 0; ; k = (k + 1) % RING_CHUNKS) {
+        Chunk &c = chunk[k];
+        {
+            std::unique_lock<std::mutex> lk(m);
+            if (c.ready && !stopping) {                     // the calling thread lags:  the ring is full
+                double w0 = sw.elapsed();
+                cv.wait(lk, [&] { return !c.ready || stopping; });
+                quiet = sw.elapsed();
+                st.waitMs += (quiet - w0) * 1e3;
+            }
+            if (stopping)  break;
+        }
+        c.n = 0;
+        double t0 = -1;                                     // time of the buffer's first byte (s)
+        bool end = false;
+        int e = 0;
+        while (c.n < CHUNK_BYTES && !stopping) {
+            double now = sw.elapsed();
+            if (t0 >= 0 && now - t0 >= HANDOFF_MS * 1e-3)  break;
+            double idle = last < 0  ?  TIMEOUT_MS * 1e-3 - now  :  STALL_MS * 1e-3 - (now - quiet);
+            if (idle <= 0) { end = true;  break; }
+            struct pollfd pfd = { fd, POLLIN, 0 };
+            int r = poll(&pfd, 1, int(std::min(idle, 0.01) * 1e3) + 1);
+            if (r < 0 && errno != EINTR) { e = errno;  end = true;  break; }
+            if (r <= 0)  continue;
+            ssize_t n = ::read(fd, c.b.data() + c.n, CHUNK_BYTES - c.n);
+            if (n < 0) {
+                if (errno == EINTR || errno == EAGAIN)  continue;
+                e = errno;
+                end = true;
+                break;
+            }
+            if (n == 0) { end = true;  break; }             // end of file (or the port hung up)
+            now = sw.elapsed();
+            if (last < 0)  st.firstByteMs = now * 1e3;
+            else  st.maxGapMs = std::max(st.maxGapMs, (now - quiet) * 1e3);
+            if (t0 < 0)  t0 = now;
+            last = quiet = now;
+            c.n += size_t(n);
+        }
+        c.t = last;
+        std::lock_guard<std::mutex> lk(m);
+        if (c.n != 0) {
+            c.ready = true;
+            uint32_t queued = 0;
+            for (const Chunk &x : chunk)  queued += x.ready;
+            st.maxQueued = std::max(st.maxQueued, queued);
+        }
+        if (end) {
+            ended = true;
+            error = e;
+            cv.notify_all();
+            return;
+        }
+        cv.notify_all();
+        if (stopping)  break;
+    }
+    std::lock_guard<std::mutex> lk(m);
+    ended = true;
+    cv.notify_all();
+}
+
+
+// Stop the Reader Thread
+// in: reader = the thread running readLoop()
+void DumpReceiver::stop(std::thread &reader) {
+    {
+        std::lock_guard<std::mutex> lk(m);
+        stopping = true;
+    }
+    cv.notify_all();
+    reader.join();
+}
+
+
+// Receive a Dump
+// Call right after the dump was started (by writing the DCM's control register's dump bit).  The file is the data
+// words, little endian, with no header; it is left partly written if the dump is corrupt or truncated.
+// in: fn = binary file's path
+// out: returns the statistics
+// throws: Exception if the file cannot be written, the port cannot be read, or the dump is late, stalls, is
+//         truncated, has an invalid length, or fails its checksum
+const DumpReceiver::Stats &DumpReceiver::receive(const char *fn) {
+    memset(&st, 0, sizeof st);
+    for (Chunk &c : chunk)  c.ready = false;
+    stopping = false;
+    ended = false;
+    error = 0;
+    FILE *dst = fopen(fn, "wb");
+    if (dst == nullptr)  throwException("Cannot open binary file: %s", fn);
+
+    std::thread reader(&DumpReceiver::readLoop, this);
+    uint64_t pos = 0;               // bytes of the stream processed
+    uint64_t total = 0;             // bytes of the whole dump, once its length is known (else 0)
+    uint32_t n = 0;                 // data words
+    uint32_t sum = 0;               // sum of the data words and the checksum (modulo 2**32)
+    uint32_t word = 0;              // word being assembled
+    unsigned have = 0;              // its bytes received
+    double tEnd = 0;                // reader's time of the checksum's last buffer (s)
+    bool printed = false;
+    Stopwatch sw, pr;
+    try {
+        for (size_t k = 0; total == 0 || pos < total; k = (k + 1) % RING_CHUNKS) {
+            Chunk &c = chunk[k];
+            {
+                std::unique_lock<std::mutex> lk(m);
+                cv.wait(lk, [&] { return c.ready || ended; });
+                if (!c.ready) {
+                    if (error != 0)  throwException("Cannot read the Debug Serial Port: %s", strerror(error));
+                    if (pos == 0)  throwException("No Debug Capture Module dump received within %d ms", TIMEOUT_MS);
+                    throwException( "Debug Capture Module dump truncated:  %llu of %llu bytes received, then none for "
+                                    "%d ms", (unsigned long long) pos, (unsigned long long) total, STALL_MS );
+                }
+            }
+            st.chunks++;
+            uint64_t p0 = pos;
+            const uint8_t *b = c.b.data();
+            size_t i = 0;
+            while (i < c.n && (total == 0 || pos < total)) {
+                if (have == 0 && total != 0 && c.n - i >= 4) {             // whole words after the length
+                    size_t words = std::min(size_t(c.n - i) / 4, size_t(total - pos) / 4);
+                    for (size_t j = 0; j < words; j++) {
+                        uint32_t x;
+                        memcpy(&x, b + i + 4 * j, 4);
+                        sum += x;
+                    }
+                    i += 4 * words;
+                    pos += 4 * words;
+                    continue;
+                }
+                word |= uint32_t(b[i++]) << 8 * have;
+                pos++;
+                if (++have < 4)  continue;
+                if (pos == 4) {
+                    n = word;
+                    if (n > MAX_WORDS)  throwException("Corrupt Debug Capture Module dump (invalid length field %u)", n);
+                    total = 4 * (uint64_t(n) + 2);
+                }
+                else  sum += word;
+                word = have = 0;
+            }
+            st.extra += c.n - i;
+            st.bytes += c.n;
+            tEnd = c.t;
+
+            // the buffer's data bytes
+            uint64_t lo = std::max<uint64_t>(p0, 4), hi = std::min<uint64_t>(pos, 4 + 4 * uint64_t(n));
+            if (total != 0 && hi > lo && fwrite(b + (lo - p0), 1, hi - lo, dst) != hi - lo)
+                throwException("Cannot write binary file: %s", fn);
+            {
+                std::lock_guard<std::mutex> lk(m);
+                c.ready = false;
+            }
+            cv.notify_all();
+
+            if (progress && total != 0 && pr.hasElapsed(0.25)) {
+                pr.reset();
+                double t = sw.elapsed();
+                printf( "\rReceiving dump:  %u of %u words (%.0f%%), %.1f kB/s ", uint32_t(pos / 4), n + 2,
+                        100.0 * pos / total, t > 0  ?  pos * 1e-3 / t  :  0.0 );
+                fflush(stdout);
+                printed = true;
+            }
+        }
+        if (sum != 0xFFFFFFFF)  throwException("Corrupt Debug Capture Module dump (invalid checksum)");
+    }
+    catch (...) {
+        stop(reader);
+        fclose(dst);
+        if (printed)  putchar('\n');
+        throw;
+    }
+    stop(reader);
+    if (printed)  printf("\rReceiving dump:  %u of %u words (100%%)%20s\n", n + 2, n + 2, "");
+    if (fclose(dst) != 0)  throwException("Cannot write binary file: %s", fn);
+    st.words = n;
+    st.seconds = tEnd - st.firstByteMs * 1e-3;
+    return st;
+}
+
+
+// Print Status (for debugging)
+void DumpReceiver::printStatus() {
+    printf("Serial Dump Receiver (%u baud)\n", baud);
+    printf("    words          =  %10u   ; data words received\n", st.words);
+    printf("    bytes          =  %10llu   ; bytes received\n", (unsigned long long) st.bytes);
+    printf("    extra          =  %10llu   ; bytes received after the checksum\n", (unsigned long long) st.extra);
+    printf("    chunks         =  %10u   ; buffers handed over by the reader thread\n", st.chunks);
+    printf("    maxQueued      =  %10u   ; most buffers waiting for this thread (of %zu)\n", st.maxQueued, RING_CHUNKS);
+    printf("    readerWait     =  %10.3f   ; milliseconds the reader waited for a free buffer\n", st.waitMs);
+    printf("    firstByte      =  %10.3f   ; milliseconds to the first byte\n", st.firstByteMs);
+    printf("    maxGap         =  %10.3f   ; longest pause between bytes in milliseconds\n", st.maxGapMs);
+    printf( "    throughput     =  %10.0f   ; bytes per second (%.0f%% of the line rate)\n",
+            st.seconds > 0  ?  st.bytes / st.seconds  :  0.0,
+            st.seconds > 0  ?  100.0 * st.bytes / st.seconds / lineRate()  :  0.0 );
+    putchar('\n');
+}
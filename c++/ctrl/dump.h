@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+/* -----  Serial Dump Receiver  -----
+ *
+ * Receives a Debug Capture Module dump from the Debug Serial Port, and writes it to a binary file as it arrives.
+ * Writing the DCM's control register's dump bit makes the firmware send, at the port's baud rate (8N1):
+ *
+ *     N                    32-bit number of data words, little endian
+ *     data[0 .. N-1]       the buffer's first N words, little endian
+ *     checksum             0xFFFFFFFF - (sum of the data words modulo 2**32)
+ *
+ * A reader thread reads the port into a ring of RING_CHUNKS buffers of CHUNK_BYTES:  it hands a buffer over when
+ * it is full, or HANDOFF_MS after its first byte, and goes on with the next one.  The calling thread adds each
+ * buffer's words to the checksum, appends its data bytes to the file (the same layout as --dcm-dump's), and prints
+ * the progress, so nothing waits for the whole dump.  The ring holds 256 KiB (2.8 s at 921600 baud), so the reader
+ * keeps reading while a slow write (e.g. to an SD card) holds up the calling thread.
+ *
+ * The stream must start within TIMEOUT_MS, and then must not pause for longer than STALL_MS (a few USB-serial
+ * latency-timer periods, much less than a dump's duration).  Only the time the reader spends polling the port
+ * counts:  if the ring is full, the reader waits for a buffer, and the bytes meanwhile wait in the port's buffer.
+ * A stream that stalls before its checksum is reported as truncated at once, with the number of bytes received.
+ * Bytes after the checksum are counted and ignored.
+ */
+class DumpReceiver {
+
+public:
+    struct Stats {
+        uint32_t words;             // data words received
+        uint64_t bytes;             // bytes received (including the length, checksum, and extra bytes)
+        uint64_t extra;             // bytes received after the checksum
+        uint32_t chunks;            // buffers handed over by the reader thread
+        uint32_t maxQueued;         // most buffers waiting for the calling thread
+        double waitMs;              // reader's time waiting for a free buffer (ms)
+        double firstByteMs;         // time to the first byte (ms)
+        double maxGapMs;            // longest pause between bytes (ms)
+        double seconds;             // time from the first byte to the checksum
+    };
+
+private:
+    struct Chunk {
+        std::vector<uint8_t> b;
+        size_t n;                   // bytes in b
+        bool ready;                 // true if handed to the calling thread
+        double t;                   // reader's time of its last byte (s)
+    };
+
+    int fd;                         // serial port's file descriptor
+    unsigned baud;                  // baud rate, for the line rate
+    std::vector<Chunk> chunk;       // ring of RING_CHUNKS buffers
+    Stats st;
+
+    // shared with the reader thread (guarded by m)
+    std::mutex m;
+    std::condition_variable cv;
+    std::atomic<bool> stopping;     // true to stop the reader thread
+    bool ended;                     // true if the reader thread stopped (after handing over its last buffer)
+    int error;                      // errno of a failed read, or 0
+
+    void readLoop();
+    void stop(std::thread &reader);
+
+public:
+    static constexpr size_t CHUNK_BYTES  = 16384;           // reader thread's buffer size
+    static constexpr size_t RING_CHUNKS  = 16;              // reader thread's buffers
+    static constexpr int HANDOFF_MS      = 50;              // max. time a buffer's bytes wait for the calling thread
+    static constexpr int TIMEOUT_MS      = 500;             // max. time to the first byte
+    static constexpr int STALL_MS        = 50;              // max. pause between bytes
+    static constexpr uint32_t MAX_WORDS  = 10000000;        // max. valid length field
+
+    bool progress;                  // true to print the progress to stdout (default)
+
+    DumpReceiver(int fd, unsigned baud);
+    DumpReceiver(const DumpReceiver &) = delete;                // delete copy constructor
+    DumpReceiver &operator=(const DumpReceiver &) = delete;     // delete assignment operator
+    const Stats &receive(const char *fn);
+    double lineRate() const { return baud / 10.0; }             // bytes per second (8N1)
+    const Stats &stats() const { return st; }
+    void printStatus();
+};
@@ -0,0 +1,260 @@
+#include <cerrno>
+#include <cstring>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "common.h"
+#include "dapqueue.h"
+#include "executor.h"
+
+// DAP Executor
+//
+// Futures for asynchronous DAP requests, and the epoll loop that completes them
+
+
+
+// ***************
+// *  DapFuture  *
+// ***************
+
+
+// Get the Result
+// If not ready, runs the executor until it is.
+// out: returns one result per operation (as Dap::execute()), or the words of a block read
+// throws: Exception if this future is invalid, or if the Dap threw one
+const std::vector<uint32_t> &DapFuture::get() {
+    if (s == nullptr)  throwException("Invalid DAP future");
+    if (!s->done)  s->ex->runUntil(*this);
+    if (s->failed)  throwException("%s", s->msg);
+    return s->results;
+}
+
+
+// Set the Continuation
+// in: f = function called with this future once it is ready (at once if it is already ready); replaces any
+//         previous continuation
+// throws: Exception if this future is invalid
+void DapFuture::then(std::function<void(DapFuture &)> f) {
+    if (s == nullptr)  throwException("Invalid DAP future");
+    if (s->done)  f(*this);
+    else  s->then = std::move(f);
+}
+
+
+
+// *****************
+// *  DapExecutor  *
+// *****************
+
+
+// Constructor
+// in: q = DAP queue that executes the requests; it must outlive this object
+// throws: Exception if epoll or eventfd cannot be created
+DapExecutor::DapExecutor(DapQueue &q) : q(q), completed(nullptr), nInFlight(0) {
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0)  throwException("epoll_create1() failed: %s", strerror(errno));
+    evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (evfd < 0) {
+        close(epfd);
+        throwException("eventfd() failed: %s", strerror(errno));
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = evfd;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, evfd, &ev) != 0) {
+        close(evfd);
+        close(epfd);
+        throwException("epoll_ctl() failed: %s", strerror(errno));
+    }
+}
+
+
+// Destructor
+// Waits for the requests in flight to complete (their continuations run), since the issuing thread will notify
+// this object of them.
+DapExecutor::~DapExecutor() {
+    while (nInFlight != 0) {
+        try { runOnce(); }
+        catch (const std::exception &e) { logError("%s", e.what()); }
+    }
+    close(evfd);
+    close(epfd);
+}
+
+
+// Completion Function (issuing thread)
+// in: ctx = completed request's DapFuture::State
+//     failed, msg = see DapQueue::Notify
+void DapExecutor::notify(void *ctx, bool failed, const char *msg) {
+    DapFuture::State *s = static_cast<DapFuture::State *>(ctx);
+    DapExecutor *ex = s->ex;
+    s->failed = failed;
+    if (failed)  strCpy(s->msg, sizeof s->msg, msg);
+    s->nextDone = ex->completed.load(std::memory_order_relaxed);
+    while (!ex->completed.compare_exchange_weak(s->nextDone, s, std::memory_order_release, std::memory_order_relaxed))  { }
+    uint64_t one = 1;
+    while (::write(ex->evfd, &one, sizeof one) < 0 && errno == EINTR)  { }
+}
+
+
+// Start a Request
+// out: returns a new future, kept alive until the request completes
+DapFuture DapExecutor::start() {
+    DapFuture f;
+    f.s = std::make_shared<DapFuture::State>();
+    f.s->ex = this;
+    f.s->done = f.s->failed = false;
+    f.s->msg[0] = 0;
+    f.s->nextDone = nullptr;
+    f.s->self = f.s;
+    nInFlight++;
+    return f;
+}
+
+
+// Finish the Completed Requests
+// Marks them ready in the order they completed, then runs their continuations.  If a continuation throws, the
+// first exception's message propagates as an Exception; the continuations of the other requests still run.
+void DapExecutor::finish() {
+    DapFuture::State *list = completed.exchange(nullptr, std::memory_order_acquire),
+                     *fifo = nullptr;
+    while (list != nullptr) {                           // reverse the stack into completion order
+        DapFuture::State *next = list->nextDone;
+        list->nextDone = fifo;
+        fifo = list;
+        list = next;
+    }
+    std::vector<DapFuture> done;
+    for (DapFuture::State *s = fifo;  s != nullptr;  s = s->nextDone) {
+        DapFuture f;
+        f.s = std::move(s->self);
+        f.s->done = true;
+        nInFlight--;
+        done.push_back(f);
+    }
+    const char *err = nullptr;
+    char msg[200];
+    for (DapFuture &f : done) {
+        if (!f.s->then)  continue;
+        std::function<void(DapFuture &)> g = std::move(f.s->then);
+        f.s->then = nullptr;
+        try { g(f); }
+        catch (const std::exception &e) {
+            if (err == nullptr) { strCpy(msg, sizeof msg, e.what());  err = msg; }
+        }
+    }
+    if (err != nullptr)  throwException("%s", err);
+}
+
+
+// Execute a Batch of DAP Operations Asynchronously
+// in: ops, n = as Dap::execute(); they are copied
+// out: returns a future of one result per operation (as Dap::execute())
+// throws: Exception if the DAP queue is being destroyed
+DapFuture DapExecutor::execute(const DapOp *ops, size_t n) {
+    DapFuture f = start();
+    f.s->ops.assign(ops, ops + n);
+    f.s->results.resize(n);
+    try { q.post(f.s->ops.data(), n, f.s->results.data(), notify, f.s.get()); }
+    catch (...) { f.s->self = nullptr;  nInFlight--;  throw; }
+    return f;
+}
+
+
+// Read a 32-bit Word Asynchronously
+// in: mod, addr = module (0..127) and address (0..0x00FFFFFF)
+// out: returns a future of the word read (see DapFuture::value())
+DapFuture DapExecutor::read(int mod, int addr) {
+    DapOp op = { DapOp::READ, mod, addr, 0, 0 };
+    return execute(&op, 1);
+}
+
+
+// Write a 32-bit Word Asynchronously
+// in: mod, addr = module (0..127) and address (0..0x00FFFFFF)
+//     data = word to write
+// out: returns a future that is ready when the word has been written
+DapFuture DapExecutor::write(int mod, int addr, uint32_t data) {
+    DapOp op = { DapOp::WRITE, mod, addr, data, 0 };
+    return execute(&op, 1);
+}
+
+
+// Read Consecutive 32-bit Words Asynchronously
+// in: mod, addr = first word's module and address
+//     n = number of words
+// out: returns a future of the words read
+// throws: Exception if the DAP queue is being destroyed
+DapFuture DapExecutor::readBlock(int mod, int addr, size_t n) {
+    DapFuture f = start();
+    f.s->results.resize(n);
+    try { q.postBlock(mod, addr, n, f.s->results.data(), notify, f.s.get()); }
+    catch (...) { f.s->self = nullptr;  nInFlight--;  throw; }
+    return f;
+}
+
+
+// Watch a File Descriptor
+// in: fd = file descriptor (not already watched)
+//     events = epoll events, e.g. EPOLLIN
+//     handler = function called by runOnce() with the events that occurred
+// throws: Exception if epoll_ctl() fails
+void DapExecutor::watch(int fd, uint32_t events, std::function<void(uint32_t)> handler) {
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.fd = fd;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) != 0)  throwException("epoll_ctl() failed: %s", strerror(errno));
+    handlers[fd] = std::move(handler);
+}
+
+
+// Stop Watching a File Descriptor
+// in: fd = file descriptor
+void DapExecutor::unwatch(int fd) {
+    if (handlers.erase(fd) != 0)  epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+
+// Wait for and Handle Events Once
+// in: timeoutMs = max. time to wait in milliseconds, or -1 to wait indefinitely
+// out: returns true if any request completed or any watched fd had events, false if timed out or interrupted
+// throws: Exception if a continuation or handler throws one
+bool DapExecutor::runOnce(int timeoutMs) {
+    struct epoll_event evs[16];
+    int n = epoll_wait(epfd, evs, sizeof evs / sizeof evs[0], timeoutMs);
+    if (n < 0) {
+        if (errno == EINTR)  return false;
+        throwException("epoll_wait() failed: %s", strerror(errno));
+    }
+    for (int i = 0; i < n; i++) {
+        int fd = evs[i].data.fd;
+        if (fd == evfd) {
+            uint64_t k;
+            while (::read(evfd, &k, sizeof k) < 0 && errno == EINTR)  { }
+            finish();
+        }
+        else {
+            auto h = handlers.find(fd);
+            if (h == handlers.end())  continue;             // unwatched by an earlier handler
+            std::function<void(uint32_t)> f = h->second;    // the handler may unwatch itself
+            f(evs[i].events);
+        }
+    }
+    return n > 0;
+}
+
+
+// Run Until No Request Is in Flight, or Until Ctrl-C
+// Watched fds are handled meanwhile.
+void DapExecutor::run() {
+    while (nInFlight != 0 && !ctrlC)  runOnce();
+}
+
+
+// Run Until a Future Is Ready
+// in: f = future of a request posted to this executor
+// throws: Exception if f is invalid or belongs to another executor
+void DapExecutor::runUntil(const DapFuture &f) {
+    if (!f.valid() || f.s->ex != this)  throwException("Future does not belong to this executor");
+    while (!f.ready())  runOnce();
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "transport.h"
+
+class DapExecutor;
+class DapQueue;
+
+
+// -----  DAP Future  -----
+// Result of an asynchronous DAP request (see DapExecutor).  Copies share the same result.  The result becomes
+// ready on the executor's thread, inside DapExecutor::runOnce(), never concurrently with the caller.
+class DapFuture {
+
+private:
+    friend class DapExecutor;
+    struct State {
+        DapExecutor *ex;
+        std::vector<DapOp> ops;                 // operations (empty for a block read)
+        std::vector<uint32_t> results;          // one result per operation, or the words of a block read
+        bool done;                              // true if ready (written on the executor's thread)
+        bool failed;                            // done:  true if the Dap threw
+        char msg[200];                          // failed:  the exception's message
+        std::function<void(DapFuture &)> then;  // continuation, or empty
+        State *nextDone;                        // next state in the executor's completion stack
+        std::shared_ptr<State> self;            // keeps this state alive while in flight
+    };
+    std::shared_ptr<State> s;
+
+public:
+    bool valid() const { return s != nullptr; }
+    bool ready() const { return s != nullptr && s->done; }
+    const std::vector<uint32_t> &get();
+    uint32_t value() { return get().at(0); }
+    void then(std::function<void(DapFuture &)> f);
+};
+
+
+/* -----  DAP Executor  -----
+ *
+ * Asynchronous DAP API.  read(), write(), execute(), and readBlock() post a request to a DapQueue and return a
+ * DapFuture at once, so one thread can keep any number of requests in flight, e.g.
+ *
+ *     DapExecutor ex(queue);
+ *     std::vector<DapFuture> f;
+ *     for (int i = 0; i < 16384; i += 256)  f.push_back(ex.readBlock(2, i, 256));     // whole spotter frame
+ *     f.back().then([](DapFuture &r) { ... });    // runs on this thread when the last block has arrived
+ *     ex.run();                                   // until all requests have completed
+ *
+ * The DapQueue's issuing thread executes the requests in order (on the serial transport, each batch is itself
+ * pipelined; see SerialPipeline).  When one completes, the issuing thread pushes its DapFuture onto a lock-free
+ * completion stack and signals an eventfd.  runOnce() waits with epoll for that eventfd and for any file
+ * descriptors registered with watch() (sockets, pipes, timerfds, ...), so a single thread can serve DAP results
+ * and other I/O together.  The Debug Serial Port's fd belongs to the issuing thread and must not be watched.
+ *
+ * Continuations (then()) and watch handlers run on the thread calling runOnce(), one at a time.  This class,
+ * like Dap, is not thread safe; the synchronous Dap and DapQueue calls remain available alongside it.
+ */
+class DapExecutor {
+
+private:
+    DapQueue &q;
+    int epfd;                                       // epoll instance
+    int evfd;                                       // eventfd signaled by the issuing thread
+    std::atomic<DapFuture::State *> completed;      // completion stack (pushed by the issuing thread)
+    size_t nInFlight;                               // number of requests posted but not yet ready
+    std::unordered_map<int, std::function<void(uint32_t)>> handlers;    // watched fd -> handler
+    static void notify(void *ctx, bool failed, const char *msg);
+    DapFuture start();
+    void finish();
+
+public:
+    explicit DapExecutor(DapQueue &q);
+    DapExecutor(const DapExecutor &) = delete;              // delete copy constructor
+    DapExecutor &operator=(const DapExecutor &) = delete;   // delete assignment operator
+    ~DapExecutor();
+    DapFuture execute(const DapOp *ops, size_t n);
+    DapFuture read(int mod, int addr);
+    DapFuture write(int mod, int addr, uint32_t data);
+    DapFuture readBlock(int mod, int addr, size_t n);
+    void watch(int fd, uint32_t events, std::function<void(uint32_t)> handler);
+    void unwatch(int fd);
+    size_t inFlight() const { return nInFlight; }
+    bool runOnce(int timeoutMs = -1);
+    void run();
+    void runUntil(const DapFuture &f);
+};
@@ -1,10 +1,15 @@
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
+#include <vector>
 #include <fcntl.h>
 #include <unistd.h>
 #include "app.h"
 #include "common.h"
+#include "daemon.h"
 #include "peripherals.h"
+#include "simulator.h"
+#include "trace.h"
 
 
 Peripherals peripherals;
@@ -18,20 +23,69 @@ Peripherals peripherals;
 
 // Constructor
 Dap::Dap() {
-    io = nullptr;
+    t = nullptr;
+    mmio = nullptr;
+    caching = false;
+    cst = { 0, 0 };
 }
 
 
 // Initialize
-// in: io = pointer to peripheral's memory region
-void Dap::init(volatile void *io) {
-    this->io = reinterpret_cast<volatile IO *>(io);
+// in: t = transport to the DAP
+void Dap::init(DapTransport *t) {
+    this->t = t;
+    mmio = dynamic_cast<MmioTransport *>(t);
+    shadow.clear();
 }
 
 
 // Deinitialize
 void Dap::deinit() {
-    io = nullptr;
+    t = nullptr;
+    mmio = nullptr;
+    shadow.clear();
+}
+
+
+// Enable or Disable the Shadow-Register Cache
+// The cache is emptied either way.
+// in: enable = true to enable the cache, false to disable it
+void Dap::enableCache(bool enable) {
+    caching = enable;
+    shadow.clear();
+}
+
+
+// Read a Cacheable Register
+// in: mod, addr = module (0..127) and address (0..0x00FFFFFF) of a CONST or CONFIG register
+// out: returns the register's cached value, or its value read from the firmware (which is then cached)
+uint32_t Dap::shadowRead(int mod, int addr) {
+    uint32_t key = uint32_t(mod) << 24 | uint32_t(addr);
+    auto p = shadow.find(key);
+    if (p != shadow.end()) {
+        cst.hits++;
+        return p->second;
+    }
+    uint32_t x = t->read(mod, addr);
+    shadow[key] = x;
+    return x;
+}
+
+
+// Write a Cacheable Register
+// A CONFIG register's write is suppressed if the register is known to hold the value already.
+// in: mod, addr = module (0..127) and address (0..0x00FFFFFF) of a CONST or CONFIG register
+//     data = 32-bit value to write
+//     cache = register's cache policy
+//     mask = register's implemented bits
+void Dap::shadowWrite(int mod, int addr, uint32_t data, regmap::Cache cache, uint32_t mask) {
+    data &= mask;
+    if (cache != regmap::CONFIG) { t->write(mod, addr, data);  return; }
+    uint32_t key = uint32_t(mod) << 24 | uint32_t(addr);
+    auto p = shadow.find(key);
+    if (p != shadow.end() && p->second == data) { cst.elided++;  return; }
+    t->write(mod, addr, data);
+    shadow[key] = data;
 }
 
 
@@ -42,10 +96,11 @@ void Dap::deinit() {
 uint32_t Dap::read(int mod, int addr) {
     if (unsigned(mod) > 127u)  throwException("Module Out of Range 0..127");
     if (unsigned(addr) > 0x00FFFFFFu)  throwException("Address Out of Range 0..0x00FFFFFF");
-    io->rwModAddr = (1 << 31) | (mod << 24) | addr;
-// !!!TEST  Is extra delay needed here to read the correct value?
-    usleep(10);   // !!!TEST
-    return io->rdata;
+    if (caching) {
+        const regmap::RegInfo *r = regmap::lookup(mod, addr);
+        if (r != nullptr && r->cache != regmap::VOLATILE)  return shadowRead(mod, addr);
+    }
+    return t->read(mod, addr);
 }
 
 
@@ -56,21 +111,271 @@ uint32_t Dap::read(int mod, int addr) {
 void Dap::write(int mod, int addr, uint32_t data) {
     if (unsigned(mod) > 127u)  throwException("Module Out of Range 0..127");
     if (unsigned(addr) > 0x00FFFFFFu)  throwException("Address Out of Range 0..0x00FFFFFF");
-    io->wdata = data;
-    io->rwModAddr = (mod << 24) | addr;
+    if (caching) {
+        const regmap::RegInfo *r = regmap::lookup(mod, addr);
+        if (r != nullptr && r->cache != regmap::VOLATILE) { shadowWrite(mod, addr, data, r->cache, r->mask);  return; }
+    }
+    t->write(mod, addr, data);
+}
+
+
+// Execute a Batch of Operations
+// All operations are range checked before any is executed, so either the whole batch runs or none of it does.
+// in: ops = array of n operations, which are executed in order
+//     n = number of operations (>=0)
+// out: results = array of n 32-bit words: results[i] is the value read by ops[i] if a READ, or the value
+//                written by ops[i] if a WRITE or RMW; may be nullptr if not wanted
+void Dap::execute(const DapOp *ops, size_t n, uint32_t *results) {
+    for (size_t i = 0; i < n; i++) {
+        const DapOp &op = ops[i];
+        if (unsigned(op.type) > DapOp::RMW)  throwException("Operation %u: Unknown Type %d", unsigned(i), int(op.type));
+        if (unsigned(op.mod) > 127u)  throwException("Operation %u: Module Out of Range 0..127", unsigned(i));
+        if (unsigned(op.addr) > 0x00FFFFFFu)  throwException("Operation %u: Address Out of Range 0..0x00FFFFFF", unsigned(i));
+    }
+    if (caching)  executeCached(ops, n, results);
+    else  t->execute(ops, n, results);
+}
+
+
+// Execute a Batch of Operations Through the Shadow-Register Cache
+// Operations the cache can complete (reads of known registers, writes that would not change a CONFIG register) are
+// completed here; the rest are forwarded, in order, to the transport as one batch.  A read-modify-write of a known
+// CONFIG register is forwarded as a plain write.  Forwarded reads fill the cache unless a later operation in the
+// batch already set the register's value.  The cache is updated only after the transport's batch succeeds, so a
+// batch that throws leaves it as it was.
+// in: ops = array of n range-checked operations, which are executed in order
+//     n = number of operations (>=0)
+// out: results = see execute()
+void Dap::executeCached(const DapOp *ops, size_t n, uint32_t *results) {
+    std::vector<DapOp> fwd;             // operations forwarded to the transport
+    std::vector<size_t> idx;            // fwd[j] is ops[idx[j]]
+    std::vector<uint32_t> x(n);         // results
+    std::unordered_map<uint32_t, uint32_t> set;     // registers the batch writes:  key -> value (as shadow)
+    uint64_t hits = 0, elided = 0;
+    fwd.reserve(n);
+    idx.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        const DapOp &op = ops[i];
+        const regmap::RegInfo *r = regmap::lookup(op.mod, op.addr);
+        if (r == nullptr || r->cache == regmap::VOLATILE || (op.type != DapOp::READ && r->cache != regmap::CONFIG)) {
+            fwd.push_back(op);
+            idx.push_back(i);
+            continue;
+        }
+        uint32_t key = uint32_t(op.mod) << 24 | uint32_t(op.addr);
+        auto s = set.find(key);
+        auto p = shadow.find(key);
+        bool known = s != set.end() || p != shadow.end();
+        uint32_t old = s != set.end()  ?  s->second  :  known  ?  p->second  :  0;
+        uint32_t v;
+        switch (op.type) {
+            case DapOp::READ:
+                if (known) { hits++;  x[i] = old;  continue; }
+                break;
+            case DapOp::WRITE:
+                v = op.data & r->mask;
+                x[i] = op.data;
+                if (known && old == v) { elided++;  continue; }
+                set[key] = v;
+                break;
+            default:
+                if (!known)  break;
+                v = ((old & ~op.mask) | (op.data & op.mask)) & r->mask;
+                x[i] = v;
+                if (old == v) { elided++;  continue; }
+                set[key] = v;
+                fwd.push_back({ DapOp::WRITE, op.mod, op.addr, v, 0 });
+                idx.push_back(i);
+                continue;
+        }
+        fwd.push_back(op);
+        idx.push_back(i);
+    }
+    std::vector<uint32_t> y(fwd.size());
+    t->execute(fwd.data(), fwd.size(), y.data());
+    cst.hits += hits;
+    cst.elided += elided;
+    for (const auto &kv : set)  shadow[kv.first] = kv.second;
+    for (size_t j = 0; j < fwd.size(); j++) {
+        size_t i = idx[j];
+        x[i] = y[j];
+        if (fwd[j].type != DapOp::WRITE) {
+            const regmap::RegInfo *r = regmap::lookup(fwd[j].mod, fwd[j].addr);
+            if (r != nullptr && r->cache != regmap::VOLATILE)
+                shadow.emplace(uint32_t(fwd[j].mod) << 24 | uint32_t(fwd[j].addr), fwd[j].type == DapOp::RMW ? y[j] & r->mask : y[j]);
+        }
+    }
+    if (results != nullptr)  memcpy(results, x.data(), n * sizeof x[0]);
+}
+
+
+// Read a Block of Consecutive 32-bit Words from a Module
+// The range is checked once for the whole block.
+// in: mod  = module (0 .. 127)
+//     addr = address (0 .. 0x00FFFFFF) of the first word in the module's address space
+//     n    = number of words (0 .. 0x01000000 - addr)
+// out: dst = array of n 32-bit words read from addresses addr .. addr+n-1
+void Dap::readBlock(int mod, int addr, size_t n, uint32_t *dst) {
+    if (unsigned(mod) > 127u)  throwException("Module Out of Range 0..127");
+    if (unsigned(addr) > 0x00FFFFFFu || n > 0x01000000u - addr)  throwException("Address Range Out of Range 0..0x00FFFFFF");
+    t->readBlock(mod, addr, n, dst);
+}
+
+
+// Calibrate a Module's Read Completion Delay (see MmioTransport::calibrate())
+// in: mod   = module (0 .. 127)
+//     addrA = address of a constant 32-bit word in the module's address space
+//     addrB = address of another constant 32-bit word, whose value differs from addrA's
+// out: returns true if success or if the transport needs no calibration, else false
+bool Dap::calibrate(int mod, int addrA, int addrB) {
+    if (unsigned(mod) > 127u)  throwException("Module Out of Range 0..127");
+    if (unsigned(addrA) > 0x00FFFFFFu || unsigned(addrB) > 0x00FFFFFFu)  throwException("Address Out of Range 0..0x00FFFFFF");
+    return t->calibrate(mod, addrA, addrB);
 }
 
 
 // Print Status (for debugging)
 void Dap::printStatus() {
+    printf("Debug Access Port (%s transport)\n", t->name());
+    t->printStatus();
+    if (caching) {
+        printf("    cache          =  %10u   ; registers in the shadow-register cache\n", unsigned(shadow.size()));
+        printf("    cacheHits      =  %10llu   ; reads served from the cache\n", (unsigned long long) cst.hits);
+        printf("    cacheElided    =  %10llu   ; writes suppressed\n", (unsigned long long) cst.elided);
+    }
+    putchar('\n');
+}
+
+
+
+// ***************
+// *  Basic I/O  *
+// ***************
+
+
+// Print Status (for debugging)
+void BasicIO::printStatus() {
+    static const DapOp ops[] = {
+        regmap::bio::creationDate::readOp(),
+        regmap::bio::buildDate::readOp(),
+        regmap::bio::usTime::readOp(),
+        regmap::bio::leds::readOp(),
+        regmap::bio::LD4::readOp(),
+        regmap::bio::LD5::readOp(),
+        regmap::bio::sw::readOp()
+    };
+    uint32_t x[sizeof ops / sizeof ops[0]];
     char buf[16];
-    puts("Debug Access Port");
-    printf("    wdata          =  0x%08X   ; 32-bit word to write\n", io->wdata);
-    printf("    rwModAddr      =  0x%08X   ; command: rw (bit 31 - 0=write 1=read), module (bits 30:24), address (bits 23:0)\n", io->rwModAddr);
-    printf("    rdata          =  0x%08X   ; last 32-bit word read\n", io->rdata);
-    printf("    usTime         =  %10u   ; 1 MHz free-running 32-bit counter\n", io->usTime);
-    printf("    creationDate   =  0x%08X  =  %s  ; 0xYYMMDDHH timestamp\n", io->creationDate, timestampToStr(io->creationDate, buf));
-    printf("    buildDate      =  0x%08X  =  %s  ; 0xYYMMDDHH timestamp\n", io->buildDate, timestampToStr(io->buildDate, buf));
+    dap.execute(ops, sizeof ops / sizeof ops[0], x);
+    printf("Basic I/O (Firmware Module %d)\n", MODULE);
+    printf("    creationDate   =  0x%08X  =  %s  ; 0xYYMMDDHH timestamp\n", x[0], timestampToStr(x[0], buf));
+    printf("    buildDate      =  0x%08X  =  %s  ; 0xYYMMDDHH timestamp\n", x[1], timestampToStr(x[1], buf));
+    printf("    usTime         =  %10u   ; microseconds modulo 2**26\n", x[2]);
+    printf("    leds           =  0x%08X   ; LED3..LED0\n", x[3]);
+    printf("    LD4            =  0x%08X   ; red/green/blue\n", x[4]);
+    printf("    LD5            =  0x%08X   ; red/green/blue\n", x[5]);
+    printf("    sw             =  0x%08X   ; SW1/SW0/BTN3/BTN2/BTN1/BTN0\n", x[6]);
+    putchar('\n');
+}
+
+
+
+// **************************
+// *  Debug Capture Module  *
+// **************************
+
+
+// Get a Telemetry Port's Decimation
+// in: p = telemetry port (0 .. PORTS-1)
+// out: returns decimation (1..65535, or 0 if the port's packets are all discarded)
+uint32_t DebugCaptureModule::decimation(int p) {
+    if (unsigned(p) >= unsigned(PORTS))  throwException("Telemetry Port Out of Range 0..%d", PORTS - 1);
+    return dap.read<regmap::dcm::dec>(p);
+}
+
+
+// Set a Telemetry Port's Decimation
+// in: p = telemetry port (0 .. PORTS-1)
+//     d = decimation: every d'th packet is captured (1..65535), or 0 to discard all the port's packets
+void DebugCaptureModule::setDecimation(int p, uint32_t d) {
+    if (unsigned(p) >= unsigned(PORTS))  throwException("Telemetry Port Out of Range 0..%d", PORTS - 1);
+    if (d > 0xFFFF)  throwException("Decimation Out of Range 0..65535");
+    dap.write<regmap::dcm::dec>(p, d);
+}
+
+
+// Read a Block of the Buffer
+// The buffer is read over the memory-mapped DAP, not the Debug Serial Port.
+// in: first = index of the first 32-bit word to read
+//     count = number of words to read (0 reads nothing); first + count must not exceed the buffer's length
+// out: dst = array of count 32-bit words
+void DebugCaptureModule::readBlock(uint32_t first, uint32_t count, uint32_t *dst) {
+    if (count == 0)  return;
+    uint32_t n = length();
+    if (first > n || count > n - first)
+        throwException("Words %u..%u are not in the buffer, whose length is %u", first, first + count - 1, n);
+    if (control() & DUMP)  throwException("Cannot read the buffer while it is being dumped");
+    dap.readBlock(MODULE, int(first), count, dst);
+}
+
+
+// Dump the Buffer to a Binary File
+// The file is the buffer's first length() 32-bit words, little endian, with no header (the same layout
+// written by the Python utility's DCM.dump()).
+// in: fn = binary file's path
+// out: returns the number of 32-bit words written
+uint32_t DebugCaptureModule::dump(const char *fn) {
+    uint32_t n = length();
+    uint32_t *buf = new uint32_t[n + 1];
+    try { readBlock(0, n, buf); }
+    catch (...) { delete[] buf;  throw; }
+    FILE *dst = fopen(fn, "wb");
+    bool ok = dst != nullptr  &&  fwrite(buf, sizeof buf[0], n, dst) == n;
+    if (dst != nullptr  &&  fclose(dst) != 0)  ok = false;
+    delete[] buf;
+    if (!ok)  throwException("Cannot write binary file: %s", fn);
+    return n;
+}
+
+
+// Print Status (for debugging)
+void DebugCaptureModule::printStatus() {
+    static const DapOp ops[] = {
+        regmap::dcm::control::readOp(),
+        regmap::dcm::length::readOp(),
+        regmap::dcm::size::readOp(),
+        regmap::dcm::dec::readOp(0),
+        regmap::dcm::dec::readOp(1),
+        regmap::dcm::dec::readOp(2),
+        regmap::dcm::dec::readOp(3),
+        regmap::dcm::dec::readOp(4),
+        regmap::dcm::dec::readOp(5),
+        regmap::dcm::mode::readOp(),
+        regmap::dcm::wrptr::readOp(),
+        regmap::dcm::rdptr::readOp(),
+        regmap::dcm::hwm::readOp(),
+        regmap::dcm::status::readOp(),
+        regmap::dcm::dropped::readOp()
+    };
+    uint32_t x[sizeof ops / sizeof ops[0]];
+    dap.execute(ops, sizeof ops / sizeof ops[0], x);
+    printf("Debug Capture Module (Firmware Module %d)\n", MODULE);
+    printf("    control        =  0x%08X   ; dump (bit 1) = %u, clear (bit 0) = %u\n", x[0], x[0] >> 1 & 1, x[0] & 1);
+    printf("    length         =  %10u   ; 32-bit words\n", x[1]);
+    printf("    size           =  %10u   ; 32-bit words\n", x[2]);
+    for (int p = 0; p < PORTS; p++) {
+        uint32_t d = x[3 + p];
+        printf("    dec%d           =  %10u   ; ", p, d);
+        if (d == 0)  printf("port %d is disabled\n", p);
+        else if (d == 1)  printf("port %d is not decimated\n", p);
+        else  printf("port %d's decimation is %u:1\n", p, d);
+    }
+    printf("    mode           =  %10u   ; %s buffer\n", x[9], x[9] & RING  ?  "ring"  :  "linear");
+    printf("    wrptr          =  %10u   ; ring's words appended since the clear\n", x[10]);
+    printf("    rdptr          =  %10u   ; ring's words drained since the clear\n", x[11]);
+    printf("    hwm            =  %10u   ; high watermark in 32-bit words\n", x[12]);
+    printf("    status         =  0x%08X   ; drop (bit 1) = %u, hwm (bit 0) = %u\n", x[13], x[13] >> 1 & 1, x[13] & 1);
+    printf("    dropped        =  %10u   ; packets dropped because the ring was full\n", x[14]);
     putchar('\n');
 }
 
@@ -95,54 +400,221 @@ bool Peripherals::progDone() {
 }
 
 
+// Read This Boot's ID
+// in: n = size of id[] in bytes (at least 37)
+// out: id = boot's ID (a UUID), null terminated
+//      returns true if success, else false
+bool Peripherals::bootId(char *id, size_t n) {
+    FILE *src = fopen("/proc/sys/kernel/random/boot_id", "r");
+    bool ok = false;
+    if (src != nullptr) {
+        if (fgets(id, n, src) != nullptr) {
+            id[strcspn(id, "\n")] = 0;
+            ok = *id != 0;
+        }
+        fclose(src);
+    }
+    return ok;
+}
+
+
+// Load the Fast Start's State
+// The state file is one line:  "ctrl-state 1 <boot ID> <creation date> <build date> {<mod>:<spins>}*".
+// in: mmio = mapped DAP, not yet calibrated
+// out: returns true if the state file is valid for this boot and the running firmware, and mmio's calibration
+//      was restored from it; else false, and the state file is deleted if it exists
+bool Peripherals::loadState(MmioTransport &mmio) {
+    FILE *src = fopen(STATE_FILE, "r");
+    if (src == nullptr)  return false;
+    char line[512], id[64], fileId[64];
+    unsigned version, creation, build;
+    int k = 0;
+    bool ok = fgets(line, sizeof line, src) != nullptr &&
+              sscanf(line, "ctrl-state %u %63s %x %x%n", &version, fileId, &creation, &build, &k) == 4 &&
+              version == 1 &&
+              bootId(id, sizeof id) && strEq(id, fileId) &&
+              creation == APP_FW_CREATION && build == APP_FW_BUILD &&
+              mmio.creationDate() == creation && mmio.buildDate() == build;
+    fclose(src);
+    if (ok) {
+        int mod, n, m;
+        for (const char *p = line + k;  sscanf(p, " %d:%d%n", &mod, &n, &m) == 2;  p += m)
+            if (unsigned(mod) <= 127u)  mmio.setSpinCount(mod, n);
+    }
+    else {
+        logDebug("Stale fast start state %s", STATE_FILE);
+        unlink(STATE_FILE);
+    }
+    return ok;
+}
+
+
+// Save the Fast Start's State
+// Written to a temporary file that is then renamed, so a concurrent loadState() never sees a partial file.
+// Failures (e.g., if not root) are ignored:  the next init() will just take the full path again.
+// in: mmio = mapped and calibrated DAP
+void Peripherals::saveState(MmioTransport &mmio) {
+    char id[64], tmp[64];
+    if (!bootId(id, sizeof id))  return;
+    snprintf(tmp, sizeof tmp, "%s.%d", STATE_FILE, int(getpid()));
+    FILE *dst = fopen(tmp, "w");
+    if (dst == nullptr)  return;
+    fprintf(dst, "ctrl-state 1 %s %08X %08X", id, mmio.creationDate(), mmio.buildDate());
+    for (int mod = 0; mod <= 127; mod++)
+        if (mmio.spinCount(mod) >= 0)  fprintf(dst, " %d:%d", mod, mmio.spinCount(mod));
+    fputc('\n', dst);
+    bool ok = fclose(dst) == 0;
+    if (!ok || rename(tmp, STATE_FILE) != 0)  unlink(tmp);
+}
+
+
+// Record a Phase of init()
+// in: name = phase's name (a string literal)
+//     sw = stopwatch started at the phase's beginning; it is reset
+void Peripherals::phase(const char *name, Stopwatch &sw) {
+    if (nPhases < MAX_PHASES)  phases[nPhases++] = { name, sw.elapsed() };
+    sw.reset();
+}
+
+
 // Constructor
-Peripherals::Peripherals() {
+Peripherals::Peripherals() : bio(dap), dcm(dap) {
     initialized = false;
     devMem = nullptr;
+    transport = nullptr;
+    nPhases = 0;
+    fastStart = false;
 }
 
 
 // Destructor
 Peripherals::~Peripherals() {
     dap.deinit();
-    if (initialized && munmap((void *) devMem, ramSize))  perror("Peripherals::~Peripherals(): munmap() failed");
+    delete transport;
+    if (devMem != nullptr && munmap((void *) devMem, ramSize))  perror("Peripherals::~Peripherals(): munmap() failed");
 }
 
 
 // Initializer
 // If not already initialized, initialize this object and if the PL is not already configured with the
 // correct firmware, configure it.  This method can be called any number of times.
-void Peripherals::init() {
+// in: spec = DAP transport:  "mmio" (default) for the memory-mapped registers, "serial:<device>[:<baud>]"
+//            (e.g., "serial:/dev/ttyUSB0:921600") for the Debug Serial Port, or "sim[:<options>]" for the
+//            firmware simulator (e.g., "sim:speed=100,rate0=1000"; see simulator.h), or "unix[:<path>]" for a
+//            DAP daemon (see daemon.h);
+//            if nullptr or "", environment variable DAP_TRANSPORT is used, if set
+void Peripherals::init(const char *spec) {
     if (initialized)  return;
-
-    if (!progDone()) throwException("The PL is not configured");
-    int fdDevMem = open("/dev/mem", O_RDWR | O_SYNC);
-    if (fdDevMem < 0) {
-        int id = geteuid();
-        if (id == 0)  throwException("Failed to open /dev/mem");
-        throwException("Failed to open /dev/mem because not root (try sudo)");
+    if (spec == nullptr || *spec == 0)  spec = getEnv("DAP_TRANSPORT");
+    Stopwatch sw;
+    MmioTransport *mmio = nullptr;
+    nPhases = 0;
+
+    if (strStartsWith(spec, "serial:")) {
+        char dev[64];
+        unsigned baud = 921600;
+        strCpy(dev, sizeof dev, spec + 7);
+        char *p = strrchr(dev, ':');
+        if (p != nullptr) {
+            uint32_t x;
+            if (!strToUInt32(p + 1, x))  throwException("Invalid baud rate in DAP transport \"%s\"", spec);
+            baud = x;
+            *p = 0;
+        }
+        transport = new SerialTransport(dev, baud);
+    }
+    else if (strEq(spec, "unix") || strStartsWith(spec, "unix:"))
+        transport = new UnixTransport(spec[4] == ':'  ?  spec + 5  :  DAEMON_SOCKET);
+    else if (strEq(spec, "sim") || strStartsWith(spec, "sim:"))
+        transport = new FirmwareSim(spec[3] == ':'  ?  spec + 4  :  "");
+    else if (*spec == 0 || strEq(spec, "mmio")) {
+        // the PL may be unconfigured (or being reconfigured by anything, not only config_pl), and an AXI access to
+        // an unconfigured PL can hang the bus, so its registers must not be touched before progDone(), even with a
+        // state file
+        if (!progDone()) throwException("The PL is not configured");
+        phase("fpga state", sw);
+        int fdDevMem = open("/dev/mem", O_RDWR | O_SYNC);
+        if (fdDevMem < 0) {
+            int id = geteuid();
+            if (id == 0)  throwException("Failed to open /dev/mem");
+            throwException("Failed to open /dev/mem because not root (try sudo)");
+        }
+        devMem = reinterpret_cast<volatile uint8_t *>(mmap(nullptr, ramSize, PROT_READ | PROT_WRITE, MAP_SHARED, fdDevMem, ramPhysAddr));
+        close(fdDevMem);
+        if (devMem == reinterpret_cast<volatile uint8_t *>(MAP_FAILED)) {
+            devMem = nullptr;
+            throwException("mmap() Failed");
+        }
+        transport = mmio = new MmioTransport( devMem + (MmioTransport::ramPhysAddr - ramPhysAddr) );
+        phase("map", sw);
+        fastStart = loadState(*mmio);
+        phase("state file", sw);
     }
-    devMem = reinterpret_cast<volatile uint8_t *>(mmap(nullptr, ramSize, PROT_READ | PROT_WRITE, MAP_SHARED, fdDevMem, ramPhysAddr));
-    close(fdDevMem);
-    if (devMem == reinterpret_cast<volatile uint8_t *>(MAP_FAILED)) {
-        devMem = nullptr;
-        throwException("mmap() Failed");
+    else  throwException("Unknown DAP transport \"%s\"", spec);
+    if (mmio == nullptr)  phase("open", sw);
+
+    dap.init(transport);
+
+    if (!fastStart) {
+        if (dap.creationDate() != APP_FW_CREATION) {
+            // try configuring the PL with the correct firmware (possible only if the PL is local)
+            if (devMem != nullptr) {
+                unlink(STATE_FILE);
+                FILE *dst = fopen("/sys/class/fpga_manager/fpga0/firmware", "w");
+                if (dst != nullptr) {
+                    fprintf(dst, "%s\n", APP_FW_BIN);
+                    fclose(dst);
+                }
+                dap.invalidate();
+            }
+            // check again if the correct firmware is running in the PL
+            if (dap.creationDate() != APP_FW_CREATION)  throwException("Incorrect PL firmware");
+        }
+        if (dap.buildDate() != APP_FW_BUILD)
+            throwException("PL firmware build date is 0x%08X but this utility was built for 0x%08X", dap.buildDate(), APP_FW_BUILD);
+        phase("verify", sw);
+
+        if (mmio != nullptr) {
+            calibrate(*mmio);
+            phase("calibrate", sw);
+            saveState(*mmio);
+            phase("save state", sw);
+        }
     }
+    initialized = true;
+    const char *fn = getEnv("DAP_TRACE");
+    if (*fn != 0)  trace(fn);
+}
 
-    dap.init( devMem + (Dap::ramPhysAddr - ramPhysAddr) );
 
-    if (dap.creationDate() != APP_FW_CREATION) {
-        // try configuring the PL with the correct firmware
-        FILE *dst = fopen("/sys/class/fpga_manager/fpga0/firmware", "w");
-        if (dst != nullptr) {
-            fprintf(dst, "%s\n", APP_FW_BIN);
-            fclose(dst);
-        }
-        // check again if the correct firmware is running in the PL
-        if (dap.creationDate() != APP_FW_CREATION)  throwException("Incorrect PL firmware");
-    }
-    if (dap.buildDate() != APP_FW_BUILD)
-        throwException("PL firmware build date is 0x%08X but this utility was built for 0x%08X", dap.buildDate(), APP_FW_BUILD);
+// Start Tracing
+// Records all DAP transactions from now on to a trace file, until this object is destroyed.
+// in: fn = trace file's name; an existing file is overwritten
+// throws: Exception if not initialized, already tracing, or the file cannot be created
+void Peripherals::trace(const char *fn) {
+    if (!initialized)  throwException("Peripherals not initialized");
+    if (dynamic_cast<TraceRecorder *>(transport) != nullptr)  throwException("Already tracing");
+    transport = new TraceRecorder(transport, fn);
+    dap.init(transport);
+}
+
+
+// Calibrate the Read Completion Delay of Each Firmware Module
+// Module 0 (Basic I/O) alternates its creation and build dates.  Module 1 (Debug Capture Module) alternates
+// its size register and an unimplemented register (0xDEADBEEF).  Module 2 (Spotter) has no constant registers,
+// and its frame buffer must not be written while the image pipeline runs, so it is not measured:  it gets the
+// larger of module 0's and module 1's delays plus one dummy read, which covers its block RAM's 3 extra clk cycles
+// (a dummy read is a whole AXI round trip).
+// in: mmio = DAP's transport
+void Peripherals::calibrate(MmioTransport &mmio) {
+    using namespace regmap;
+    static constexpr int UNIMPLEMENTED = 0x80000F;      // DCM address that reads 0xDEADBEEF
+    if (!dap.calibrate(bio::MODULE, bio::creationDate::addr, bio::buildDate::addr))
+        logWarning("Cannot calibrate module %d's read delay", bio::MODULE);
+    if (!dap.calibrate(dcm::MODULE, dcm::size::addr, UNIMPLEMENTED))
+        logWarning("Cannot calibrate module %d's read delay", dcm::MODULE);
+    int n = std::max(mmio.spinCount(bio::MODULE), mmio.spinCount(dcm::MODULE));
+    mmio.setSpinCount(spotter::MODULE, n < 0  ?  -1  :  n + 1);
 }
 
 
@@ -151,4 +623,15 @@ void Peripherals::printStatus() {
     puts( "AXI4-Lite Peripherals Implemented in Xilinx Zynq 7020's Programmable Logic (PL)\n"
           "-------------------------------------------------------------------------------\n" );
     dap.printStatus();
+    if (nPhases != 0) {
+        double total = 0;
+        printf("Startup (%s path)\n", fastStart ? "fast" : "full");
+        for (int i = 0; i < nPhases; i++) {
+            printf("    %-14s =  %10.3f   ; ms\n", phases[i].name, 1e3 * phases[i].seconds);
+            total += phases[i].seconds;
+        }
+        printf("    total          =  %10.3f   ; ms\n\n", 1e3 * total);
+    }
+    bio.printStatus();
+    dcm.printStatus();
 }
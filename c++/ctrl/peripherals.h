@@ -1,68 +1,211 @@
 #pragma once
 
 #include <cstdint>
+#include <unordered_map>
 #include <sys/mman.h>   // for mmap() and off_t
+#include "common.h"
+#include "regmap.h"
+#include "transport.h"
 
 
 /* -----  Debug Access Port (DAP)  -----
  *
- * Class for controlling the Debug Access Port (DAP) peripheral.
+ * Class for reading and writing 32-bit words in the firmware modules' address spaces through the Debug Access Port
+ * (DAP).  The DAP is reached over a DapTransport (see transport.h):  its memory-mapped AXI4-Lite registers, the
+ * Debug Serial Port, or a simulator.  This class range checks all arguments before passing them to the transport.
+ * The templated read() and write() take a register type from regmap.h instead, which was range checked when it
+ * was compiled, so they do no run-time checks.  This class is not thread safe:  threads that share a Dap must
+ * go through a DapQueue (see dapqueue.h).
  *
- * Peripheral's AXI4-Lite Register Map
- * ===================================
+ * Shadow-Register Cache
+ * =====================
  *
- * Note, Index (below) is a 32-bit register's index; its byte offset from this peripheral's base address is Index * 4.
+ * If enabled by enableCache(), reads and writes (including batches) are filtered by a cache of register values,
+ * according to each register's cache policy in regmap.def:  CONST registers are read from the firmware once;
+ * CONFIG registers are read once or learned from the values written, and writes that would not change them are
+ * suppressed; VOLATILE registers, and addresses not in regmap.def, always go to the firmware.  readBlock() is not
+ * cached.  The cache assumes this process is the only one changing CONFIG registers; call invalidate() if the
+ * firmware may have changed them otherwise (e.g., after the PL is reconfigured).
+ */
+class Dap {
+
+public:
+    struct CacheStats {
+        uint64_t hits;          // number of reads served from the cache
+        uint64_t elided;        // number of writes suppressed because the register already held the value
+    };
+
+private:
+    DapTransport *t;                                    // transport, or nullptr if not initialized
+    MmioTransport *mmio;                                // t if it is an MmioTransport, else nullptr
+    bool caching;                                       // true if the shadow-register cache is enabled
+    std::unordered_map<uint32_t, uint32_t> shadow;      // cached registers:  (mod << 24 | addr) -> value
+    CacheStats cst;
+    uint32_t shadowRead(int mod, int addr);
+    void shadowWrite(int mod, int addr, uint32_t data, regmap::Cache cache, uint32_t mask);
+    void executeCached(const DapOp *ops, size_t n, uint32_t *results);
+
+public:
+    Dap();
+    Dap(const Dap &) = delete;                          // delete copy constructor
+    Dap &operator=(const Dap &) = delete;               // delete assignment operator
+    void init(DapTransport *t);
+    void deinit();
+    DapTransport *transport() { return t; }
+    uint32_t usTime()       { return t->usTime();       }
+    uint32_t creationDate() { return t->creationDate(); }
+    uint32_t buildDate()    { return t->buildDate();    }
+    uint32_t read(int mod, int addr);
+    void write(int mod, int addr, uint32_t data);
+    template<class R> uint32_t read();                  // R is a regmap::Reg
+    template<class R> uint32_t read(int i);             // R is a regmap::RegArray
+    template<class R> void write(uint32_t data);        // R is a regmap::Reg
+    template<class R> void write(int i, uint32_t data); // R is a regmap::RegArray
+    void execute(const DapOp *ops, size_t n, uint32_t *results);
+    void readBlock(int mod, int addr, size_t n, uint32_t *dst);
+    bool calibrate(int mod, int addrA, int addrB);
+    void enableCache(bool enable);
+    bool cacheEnabled() { return caching; }
+    void invalidate() { shadow.clear(); }
+    const CacheStats &cacheStats() { return cst; }
+    void printStatus();
+};
+
+
+// Typed Register Accessors (see regmap.h)
+// Registers whose cache policy is VOLATILE compile to a direct transport access:  over MMIO, the inline volatile
+// stores and loads of MmioTransport (the policy is a compile-time constant, so there is no cache test).
+
+template<class R> inline uint32_t Dap::read() {
+    if (R::cache == regmap::VOLATILE || !caching)  return mmio != nullptr  ?  R::read(*mmio)  :  R::read(*t);
+    return shadowRead(R::mod, R::addr) & R::mask;
+}
+
+template<class R> inline uint32_t Dap::read(int i) {
+    if (R::cache == regmap::VOLATILE || !caching)  return mmio != nullptr  ?  R::read(*mmio, i)  :  R::read(*t, i);
+    return shadowRead(R::mod, R::addr + i) & R::mask;
+}
+
+template<class R> inline void Dap::write(uint32_t data) {
+    static_assert(R::access != regmap::RO, "register is read only");
+    if (R::cache != regmap::VOLATILE && caching)  shadowWrite(R::mod, R::addr, data, R::cache, R::mask);
+    else if (mmio != nullptr)  R::write(*mmio, data);
+    else  R::write(*t, data);
+}
+
+template<class R> inline void Dap::write(int i, uint32_t data) {
+    static_assert(R::access != regmap::RO, "register is read only");
+    if (R::cache != regmap::VOLATILE && caching)  shadowWrite(R::mod, R::addr + i, data, R::cache, R::mask);
+    else if (mmio != nullptr)  R::write(*mmio, i, data);
+    else  R::write(*t, i, data);
+}
+
+
+/* -----  Basic I/O  -----
+ *
+ * Class for firmware module 0, which controls the LEDs and switches on the PYNQ-Z2 board.
  *
- * Index   Name           Access   Description
+ * Module's Register Map (see basic_io.v; regmap.def is the machine-readable copy)
+ * ===============================================================================
+ *
+ * Addr    Name           Access   Description
  * -----   ------------   ------   ----------------------------------------------------------------------------------------------------------
  *
- *   0     wdata            rw     The 32-bit word that will be written if cmd is a write command
+ *   0     creationDate     ro     Firmware's creation date in 0xYYMMDDHH format
+ *   1     buildDate        ro     Firmware's build date in 0xYYMMDDHH format
+ *   2     usTime           ro     Current time in microseconds modulo 2**26
+ *   3     leds             rw     LEDs' enables LED3..LED0 (bits 3:0)
+ *   4     LD4              rw     RGB LED LD4's red/green/blue enables (bits 2:0)
+ *   5     LD5              rw     RGB LED LD5's red/green/blue enables (bits 2:0)
+ *   6     sw               ro     Switches SW1, SW0 (bits 5:4) and pushbuttons BTN3..BTN0 (bits 3:0)
+ */
+class BasicIO {
+
+private:
+    Dap &dap;
+
+public:
+    static constexpr int MODULE = regmap::bio::MODULE;  // firmware module's ID
+
+    explicit BasicIO(Dap &dap) : dap(dap) {}
+    BasicIO(const BasicIO &) = delete;                  // delete copy constructor
+    BasicIO &operator=(const BasicIO &) = delete;       // delete assignment operator
+    void printStatus();
+};
+
+
+/* -----  Debug Capture Module (DCM)  -----
+ *
+ * Class for firmware module 1, which captures telemetry packets from up to six telemetry ports into a 64K x 32b
+ * buffer.  Each packet begins with a 32-bit word in which bits 31:26 is the packet type (which indicates the
+ * packet's source and length; see telemetry.def) and bits 25:0 is a timestamp in microseconds modulo 2**26.  The
+ * buffer is linear, or a ring drained by the host through rdptr (see DcmCapture).
+ *
+ * Module's Register Map (see debug_capture_module.v; regmap.def is the machine-readable copy)
+ * ===========================================================================================
+ *
+ * Addr       Name       Access   Description
+ * --------   --------   ------   --------------------------------------------------------------------------------------------------------
+ *
+ * 0..FFFF    data         ro     Buffer, an array of 2**16 uint32_t words (reads return 0xDEADBEEF while the buffer is being dumped)
+ *
+ * 800000     control      rw     Control register
+ *                                  Bits   Name           Description
+ *                                  -----  -------------  ---------------------------------------------------------------------------
+ *                                  1      dump           write 1 to dump the buffer out the Debug Serial Port; reads 1 until done
+ *                                  0      clear          write 1 to clear the buffer; reads 1 until done
+ *
+ * 800001     length       ro     Number of 32-bit words in the buffer (0 .. size); in ring mode, words not yet drained (wrptr - rdptr)
  *
- *   1     rwModAddr        rw     Read/write command
- *                                   Bits   Name           Description
- *                                   -----  -------------  ---------------------------------------------------------------------------
- *                                   31     rw             operation: 0 = write, 1 = read
- *                                   30:24  mod            the module being addressed (0..127)
- *                                   23:0   addr           address (i.e., index) of a 32-bit word in the module's address space
+ * 800002     size         ro     Buffer's capacity in 32-bit words
  *
- *   2     rdata            ro     The last 32-bit word read (initially 0)
+ * 800003+p   dec<p>       rw     Telemetry port p's decimation (1..65535, or 0 to discard all packets; initially 0), where p = 0..5
  *
- *   3     usTime           ro     32-bit free-running timer incrementing at 1 MHz (read only) 
+ * 800009     mode         rw     Buffer's mode; a write also clears the buffer, and the new mode takes effect with the clear
+ *                                  Bits   Name           Description
+ *                                  -----  -------------  ---------------------------------------------------------------------------
+ *                                  0      ring           0 = linear buffer (initially), 1 = ring
  *
- *   4     creationDate     ro     PL firmware's creation date in 32'hYYMMDDHH format (can be used as a globally unique ID for this firmware)
+ * 80000A     wrptr        ro     Ring mode:  words appended since the clear (free running); the next word goes to wrptr % size
  *
- *   5     buildDate        ro     PL firmware's build date in 32'hYYMMDDHH format
+ * 80000B     rdptr        rw     Ring mode:  words drained by the host since the clear (free running; wrptr-size .. wrptr)
  *
+ * 80000C     hwm          rw     High watermark in 32-bit words (initially size/2)
+ *
+ * 80000D     status       ro     Status register
+ *                                  Bits   Name           Description
+ *                                  -----  -------------  ---------------------------------------------------------------------------
+ *                                  1      drop           1 if a packet was dropped because the ring was full since the clear
+ *                                  0      hwm            1 if the length is at least hwm
+ *
+ * 80000E     dropped      ro     Ring mode:  packets dropped because the ring was full since the clear (a ring grants a packet
+ *                                only if it has room for 64 words, so packets are dropped whole)
  */
-class Dap {
+class DebugCaptureModule {
 
 private:
-    struct IO {
-        uint32_t wdata;
-        uint32_t rwModAddr;
-        uint32_t rdata;
-        uint32_t usTime;
-        uint32_t creationDate;
-        uint32_t buildDate;
-    };
-    volatile IO *io;
-    
+    Dap &dap;
+
 public:
-    static constexpr off_t ramPhysAddr = 0x43C00000;    // physical memory address of struct IO
-    
-    Dap();
-    Dap(const Dap &) = delete;                          // delete copy constructor
-    Dap &operator=(const Dap &) = delete;               // delete assignment operator
-    void init(volatile void *io);
-    void deinit();
-    uint32_t wdata()        { return io->wdata;        }
-    uint32_t rwModAddr()    { return io->rwModAddr;    }
-    uint32_t rdata()        { return io->rdata;        }
-    uint32_t usTime()       { return io->usTime;       }
-    uint32_t creationDate() { return io->creationDate; }
-    uint32_t buildDate()    { return io->buildDate;    }
-    uint32_t read(int mod, int addr);
-    void write(int mod, int addr, uint32_t data);
+    static constexpr int MODULE       = regmap::dcm::MODULE;        // firmware module's ID
+    static constexpr int PORTS        = regmap::dcm::dec::size;     // number of telemetry ports
+    static constexpr uint32_t CLEAR   = regmap::dcm::control_clear; // control register's clear bit
+    static constexpr uint32_t DUMP    = regmap::dcm::control_dump;  // control register's dump bit
+    static constexpr uint32_t RING    = regmap::dcm::mode_ring;     // mode register's ring bit
+
+    explicit DebugCaptureModule(Dap &dap) : dap(dap) {}
+    DebugCaptureModule(const DebugCaptureModule &) = delete;              // delete copy constructor
+    DebugCaptureModule &operator=(const DebugCaptureModule &) = delete;   // delete assignment operator
+    uint32_t control() { return dap.read<regmap::dcm::control>(); }
+    uint32_t length()  { return dap.read<regmap::dcm::length>();  }
+    uint32_t size()    { return dap.read<regmap::dcm::size>();    }
+    uint32_t decimation(int p);
+    void clear() { dap.write<regmap::dcm::control>(CLEAR); }
+    uint32_t mode() { return dap.read<regmap::dcm::mode>(); }
+    void setMode(uint32_t m) { dap.write<regmap::dcm::mode>(m); }      // also clears the buffer
+    void setDecimation(int p, uint32_t d);
+    void readBlock(uint32_t first, uint32_t count, uint32_t *dst);
+    uint32_t dump(const char *fn);
     void printStatus();
 };
 
@@ -70,25 +213,56 @@ public:
 // -----  Peripherals  -----
 // This class is for a singleton object that provides access to all the Zynq peripherals implemented in the PL.
 // It maps their physical address spaces into this Linux process' virtual address space.
+//
+// Fast Start:  after a full mmio initialization (checking the FPGA manager's state, verifying and if needed
+// configuring the firmware, and calibrating the read delays), init() records the boot's ID, the firmware's dates,
+// and the calibration in STATE_FILE.  A later init() in the same boot, for the same firmware, skips the
+// calibration:  it checks the FPGA manager's sysfs state (always, since any tool may have reconfigured the PL, and
+// touching an unconfigured PL's registers can hang the AXI bus), maps the DAP, checks the two date registers, and
+// restores the calibration.  If the state file is missing, malformed, from an earlier boot, or its dates do not match the
+// firmware's, the state file is deleted and the full initialization is done.  config_pl and init() delete the
+// state file before configuring the PL.  printStatus() lists the time spent in each phase of init().
+//
+// Tracing:  trace(), or environment variable DAP_TRACE, records all DAP transactions from then on to a trace file
+// (see trace.h).
 class Peripherals {
 
 private:
     static constexpr off_t ramPhysAddr = 0x43C00000;  // mmap a block of physical memory from ramPhysAddr to ramPhysAddr+ramSize-1
-    static constexpr size_t ramSize    = 0x00080000;  // mmap block's size in bytes
+    static constexpr size_t ramSize    = 0x00001000;  // mmap block's size in bytes (one page:  the DAP's registers)
+    static constexpr int MAX_PHASES    = 8;
+    struct Phase {
+        const char *name;
+        double seconds;
+    };
     volatile uint8_t *devMem;                         // pointer to memory mapped region (=0 iff fdDevMem<0)
+    DapTransport *transport;                          // DAP's transport, or nullptr if not initialized
+    Phase phases[MAX_PHASES];                         // init()'s phases and their durations
+    int nPhases;                                      // number of phases in phases[]
+    bool fastStart;                                   // true if init() took the fast path
     static bool progDone();
+    static bool bootId(char *id, size_t n);
+    bool loadState(MmioTransport &mmio);
+    void saveState(MmioTransport &mmio);
+    void phase(const char *name, Stopwatch &sw);
+    void calibrate(MmioTransport &mmio);
 
 protected:
     bool initialized;       // true if this object is fully initialized, i.e. if init() was called
 
 public:
+    static constexpr const char *STATE_FILE = "/run/ctrl.state";  // fast start's state file
+
     Dap dap;
+    BasicIO bio;
+    DebugCaptureModule dcm;
 
     Peripherals();
     Peripherals(const Peripherals &) = delete;              // delete copy constructor
     Peripherals &operator=(const Peripherals &) = delete;   // delete assignment operator
     ~Peripherals();
-    void init();
+    void init(const char *spec = nullptr);
+    void trace(const char *fn);
     void shutdown();
     void printStatus();
 };
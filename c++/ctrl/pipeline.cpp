@@ -0,0 +1,254 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "common.h"
+#include "pipeline.h"
+
+// Pipelined Serial DAP Client
+
+
+
+// Get Current Time
+// out: returns Linux' monotonic clock in seconds
+double SerialPipeline::now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return  static_cast<double>(ts.tv_sec) + 1e-9 * static_cast<double>(ts.tv_nsec);
+}
+
+
+// Constructor
+// in: port = open serial transport
+//     window = max. number of reads awaiting responses (1 .. 1024)
+SerialPipeline::SerialPipeline(SerialTransport &port, unsigned window) : port(port) {
+    rxN = 0;
+    nReceived = 0;
+    sinceSentinel = 0;
+    sentinels = 0;
+    ids[0] = port.creationDate();
+    ids[1] = port.buildDate();
+    maxInFlight = curInFlight = clamp(window, 1u, 1024u);
+    retries = 0;
+    lastProgress = now();
+    memset(&st, 0, sizeof st);
+}
+
+
+// Destructor
+// Any operations not yet sent are discarded without calling their callbacks.
+SerialPipeline::~SerialPipeline() {}
+
+
+// Queue a Read
+// in: mod, addr = module (0..127) and address (0..0x00FFFFFF) to read from
+//     cb = callback called with the value read and ok=true, or with 0 and ok=false if the read failed
+void SerialPipeline::read(int mod, int addr, Callback cb) {
+    queued.push_back({true, false, mod, addr, 0, std::move(cb)});
+}
+
+
+// Queue a Read and Get a Future for Its Result
+// The future becomes ready during a later call to poll() or drain().
+// in: mod, addr = module (0..127) and address (0..0x00FFFFFF) to read from
+// out: returns a future for the value read; its get() throws an Exception if the read failed
+std::future<uint32_t> SerialPipeline::read(int mod, int addr) {
+    auto pr = std::make_shared<std::promise<uint32_t>>();
+    std::future<uint32_t> f = pr->get_future();
+    read(mod, addr, [pr, mod, addr](uint32_t data, bool ok) {
+        if (ok)  pr->set_value(data);
+        else  pr->set_exception(std::make_exception_ptr(
+                Exception(__FILE__, __FUNCTION__, __LINE__, "No valid response from module %d, address 0x%06X", mod, addr)));
+    });
+    return f;
+}
+
+
+// Queue a Write
+// in: mod, addr = module (0..127) and address (0..0x00FFFFFF) to write to
+//     data = 32-bit word to write
+void SerialPipeline::write(int mod, int addr, uint32_t data) {
+    queued.push_back({false, false, mod, addr, data, nullptr});
+}
+
+
+// Send a Sentinel Read
+// in out: tx = transmit buffer, which must have room for 7 more bytes
+//         n = number of bytes in tx
+void SerialPipeline::sendSentinel(uint8_t *tx, size_t &n) {
+    int i = sentinels++ & 1;
+    SerialTransport::encodeRead(tx + n, 0, i);
+    tx[n + 6] = 0x00;
+    n += 7;
+    st.reads++;
+    inFlight.push_back({true, true, 0, i, ids[i], nullptr});
+    sinceSentinel = 0;
+}
+
+
+// Send Queued Operations
+// Reads are sent while fewer than maxInFlight reads await responses.  A write is sent when it reaches the front of
+// the queue and no read awaits a response or a sentinel's confirmation, so it cannot overtake a read that
+// recover() may resend.  Each read command is followed by a filler byte (see class description).  A sentinel is
+// sent after every GROUP reads, when the window is full, before a write that must wait, and after the last read
+// queued.
+void SerialPipeline::pump() {
+    uint8_t tx[1024];
+    size_t n = 0;
+    while (!queued.empty()) {
+        Op &op = queued.front();
+        if (n + 2*7 > sizeof tx) { port.send(tx, n);  n = 0; }
+        if (op.read  ?  inFlight.size() >= curInFlight  :  !inFlight.empty()) {
+            if (sinceSentinel != 0)  sendSentinel(tx, n);
+            break;
+        }
+        if (op.read) {
+            SerialTransport::encodeRead(tx + n, op.mod, op.addr);
+            tx[n + 6] = 0x00;
+            n += 7;
+            st.reads++;
+            if (inFlight.empty())  lastProgress = now();
+            sinceSentinel++;
+            inFlight.push_back(std::move(op));
+            if (sinceSentinel >= GROUP)  sendSentinel(tx, n);
+        }
+        else {
+            SerialTransport::encodeWrite(tx + n, op.mod, op.addr, op.data);
+            n += 10;
+            st.writes++;
+        }
+        queued.pop_front();
+    }
+    if (queued.empty() && sinceSentinel != 0) {
+        if (n + 7 > sizeof tx) { port.send(tx, n);  n = 0; }
+        sendSentinel(tx, n);
+    }
+    if (n != 0)  port.send(tx, n);
+}
+
+
+// Parse Received Bytes
+// Store complete response packets in the oldest reads in flight.  When a sentinel's response is correct, complete
+// the reads before it.  If a packet is corrupt or a sentinel's response is wrong, resynchronize.
+void SerialPipeline::parse() {
+    size_t i = 0;
+    while (rxN - i >= 6) {
+        if (nReceived >= inFlight.size()) { i = rxN;  break; }  // discard unexpected bytes
+        uint32_t data;
+        if (!SerialTransport::decodeResponse(rx + i, data)) { recover();  return; }
+        i += 6;
+        lastProgress = now();
+        Op &op = inFlight[nReceived++];
+        if (!op.sentinel) { op.data = data;  continue; }
+        if (data != op.data) { recover();  return; }
+        retries = 0;
+        curInFlight = std::min(2 * curInFlight, maxInFlight);
+        while (nReceived != 0) {
+            Op done = std::move(inFlight.front());
+            inFlight.pop_front();
+            nReceived--;
+            if (!done.sentinel) {
+                st.responses++;
+                done.cb(done.data, true);
+            }
+        }
+    }
+    memmove(rx, rx + i, rxN - i);
+    rxN -= i;
+}
+
+
+// Resynchronize After a Corrupt, Wrong, or Missing Response
+// Wait for the line to go quiet, discard all bytes received, and requeue every read in flight (oldest first) so it
+// will be resent.  No write was sent after them (see pump()), so the resent reads see the same values.  Sentinels
+// are not requeued; pump() sends new ones, so consecutive sentinels always differ.
+// After MAX_RETRIES consecutive resynchronizations, fail the reads in flight instead.
+void SerialPipeline::recover() {
+    uint8_t trash[256];
+    st.resyncs++;
+    while (port.receive(trash, sizeof trash, QUIET_MS) != 0) ;
+    tcflush(port.fileDescriptor(), TCIFLUSH);
+    rxN = 0;
+    nReceived = 0;
+    sinceSentinel = 0;
+    lastProgress = now();
+    curInFlight = std::max(curInFlight / 2, 1u);
+    if (++retries <= MAX_RETRIES) {
+        while (!inFlight.empty()) {
+            if (!inFlight.back().sentinel)  queued.push_front(std::move(inFlight.back()));
+            inFlight.pop_back();
+        }
+        return;
+    }
+    retries = 0;
+    std::deque<Op> failed;
+    failed.swap(inFlight);
+    for (Op &op : failed)
+        if (!op.sentinel) {
+            st.failures++;
+            op.cb(0, false);
+        }
+}
+
+
+// Send and Receive
+// in: timeoutMs = max. time to wait for a response in milliseconds (>=0)
+// out: returns true if operations are still outstanding, else false
+// throws: Exception
+bool SerialPipeline::poll(int timeoutMs) {
+    pump();
+    if (inFlight.empty())  return !queued.empty();
+    struct pollfd pfd = { port.fileDescriptor(), POLLIN, 0 };
+    int r = ::poll(&pfd, 1, timeoutMs);
+    if (r < 0 && errno != EINTR)  throwException("poll() failed on serial port: %s", strerror(errno));
+    if (r > 0) {
+        ssize_t k = ::read(port.fileDescriptor(), rx + rxN, sizeof rx - rxN);
+        if (k < 0 && errno != EINTR && errno != EAGAIN)  throwException("Cannot read from serial port: %s", strerror(errno));
+        if (k > 0) { rxN += size_t(k);  parse(); }
+    }
+    if (!inFlight.empty() && now() - lastProgress > 1e-3 * SerialTransport::TIMEOUT_MS)  recover();
+    pump();
+    return outstanding() != 0;
+}
+
+
+// Complete All Outstanding Operations
+// throws: Exception
+void SerialPipeline::drain() {
+    while (poll(SerialTransport::TIMEOUT_MS)) ;
+}
+
+
+// Execute a Batch of Operations (see Dap::execute())
+// Reads and writes are pipelined.  A read-modify-write waits for all earlier operations to complete.
+// in: ops = array of n operations, which are executed in order
+//     n = number of operations (>=0)
+// out: results = array of n 32-bit words (value read, or value written), or nullptr if not wanted
+// throws: Exception if any read failed
+void SerialPipeline::execute(const DapOp *ops, size_t n, uint32_t *results) {
+    uint64_t failures = st.failures;
+    for (size_t i = 0; i < n; i++) {
+        const DapOp &op = ops[i];
+        uint32_t *p = results == nullptr ? nullptr : results + i;
+        switch (op.type) {
+            case DapOp::READ:   read(op.mod, op.addr, [p](uint32_t data, bool /*ok*/) { if (p != nullptr)  *p = data; });
+                                break;
+            case DapOp::WRITE:  write(op.mod, op.addr, op.data);
+                                if (p != nullptr)  *p = op.data;
+                                break;
+            default: {          drain();
+                                uint32_t x = (port.read(op.mod, op.addr) & ~op.mask) | (op.data & op.mask);
+                                port.write(op.mod, op.addr, x);
+                                if (p != nullptr)  *p = x;
+                                break;
+                     }
+        }
+    }
+    drain();
+    if (st.failures != failures)
+        throwException("%u of the batch's reads failed", unsigned(st.failures - failures));
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include "transport.h"
+
+
+/* -----  Pipelined Serial DAP Client  -----
+ *
+ * Keeps many read commands in flight on the Debug Serial Port, so a batch of reads is bounded by the line rate
+ * rather than by one UART + USB-serial round trip per read.
+ *
+ * Operations are queued by read() and write() and are sent in order.  Up to window() reads may await responses at
+ * once.  A write waits until every read sent before it is confirmed (see below), because a read that must be resent
+ * would otherwise see the write's value; so runs of reads and runs of writes are pipelined, but each change from
+ * reading to writing costs a round trip.  The firmware answers reads in order, so responses are matched to the
+ * oldest read in flight.  Each read command is followed by one filler byte, which the firmware's receiver discards;
+ * it paces commands slightly slower than the firmware can send responses, so a response is never dropped because
+ * the previous one is still being transmitted.
+ *
+ * Responses carry no tag, so a dropped response would shift every later response onto the wrong read.  To detect
+ * that, a sentinel read of module 0's creationDate or buildDate (alternately) is sent after every GROUP reads and
+ * after the last read queued.  A read's callback is called only after the next sentinel's response is correct.
+ *
+ * If a response is corrupt (invalid header or checksum), a sentinel's response is wrong, or a response does not
+ * arrive in time, the client waits for the line to go quiet, discards any received bytes, and resends every read
+ * still in flight.  Reads are retried up to MAX_RETRIES times before their callbacks are called with ok=false.
+ * Each resynchronization halves the number of reads allowed in flight, so a noisy line degrades gracefully.
+ *
+ * Nothing happens in the background:  the caller must call poll() or drain() to send commands and to receive
+ * responses; callbacks are called from those methods.  Not thread safe.
+ */
+class SerialPipeline {
+
+public:
+    typedef std::function<void(uint32_t data, bool ok)> Callback;   // read's completion callback
+
+    struct Stats {
+        uint64_t reads;         // number of read commands sent, including retries
+        uint64_t writes;        // number of write commands sent
+        uint64_t responses;     // number of reads completed successfully
+        uint64_t resyncs;       // number of times the link was resynchronized
+        uint64_t failures;      // number of reads that failed after MAX_RETRIES retries
+    };
+
+private:
+    struct Op {
+        bool read;              // true if a read, false if a write
+        bool sentinel;          // true if a sentinel read
+        int mod, addr;          // module and address
+        uint32_t data;          // value to write (writes), or expected value (sentinels), or value read (other reads)
+        Callback cb;            // completion callback (reads only)
+    };
+    SerialTransport &port;
+    std::deque<Op> queued;      // operations not yet sent
+    std::deque<Op> inFlight;    // reads sent and awaiting responses or a sentinel's confirmation, oldest first
+    size_t nReceived;           // number of reads in inFlight whose responses were received
+    unsigned sinceSentinel;     // number of reads sent since the last sentinel
+    unsigned sentinels;         // number of sentinels sent
+    uint32_t ids[2];            // module 0's creationDate and buildDate, the sentinels' expected values
+    uint8_t rx[512];            // bytes received but not yet parsed
+    size_t rxN;                 // number of bytes in rx
+    unsigned maxInFlight;       // max. number of reads awaiting responses
+    unsigned curInFlight;       // present max. number of reads awaiting responses, which is halved by each
+                                //   resynchronization and doubled by each correct sentinel (1 .. maxInFlight)
+    int retries;                // number of consecutive resynchronizations without a valid response
+    double lastProgress;        // time (CLOCK_MONOTONIC_RAW seconds) when a response last arrived or reads were
+                                //   last sent
+    Stats st;
+
+    static double now();
+    void pump();
+    void sendSentinel(uint8_t *tx, size_t &n);
+    void parse();
+    void recover();
+
+public:
+    static constexpr int MAX_RETRIES = 6;       // max. number of retries of a read
+    static constexpr int GROUP       = 16;      // number of reads per sentinel
+    static constexpr int QUIET_MS    = 20;      // line is quiet if no byte is received for this many milliseconds
+
+    explicit SerialPipeline(SerialTransport &port, unsigned window = 64);
+    SerialPipeline(const SerialPipeline &) = delete;                // delete copy constructor
+    SerialPipeline &operator=(const SerialPipeline &) = delete;     // delete assignment operator
+    ~SerialPipeline();
+    unsigned window() { return maxInFlight; }
+    size_t outstanding() { return queued.size() + inFlight.size(); }
+    const Stats &stats() { return st; }
+    int fileDescriptor() { return port.fileDescriptor(); }
+    void read(int mod, int addr, Callback cb);
+    std::future<uint32_t> read(int mod, int addr);
+    void write(int mod, int addr, uint32_t data);
+    bool poll(int timeoutMs);
+    void drain();
+    void execute(const DapOp *ops, size_t n, uint32_t *results);
+};
@@ -0,0 +1,104 @@
+#include <atomic>
+#include <exception>
+#include <thread>
+#include <vector>
+#include "common.h"
+#include "pool.h"
+
+// Work-Stealing Pool
+//
+// Runs independent tasks on several threads; idle threads steal half of a busy thread's remaining tasks
+
+
+
+// Constructor
+// in: threads = number of worker threads (0 is taken as 1)
+WorkStealingPool::WorkStealingPool(unsigned threads)
+    : nThreads(threads != 0 ? threads : 1), queues(new Queue[nThreads]) {
+    for (unsigned w = 0; w < nThreads; w++)  queues[w].lo = queues[w].hi = queues[w].steals = 0;
+}
+
+
+// Take a Task from a Worker's Own Queue
+// in: w = worker
+// out: task = task taken
+//      returns true if success, or false if the queue is empty
+bool WorkStealingPool::take(unsigned w, size_t &task) {
+    Queue &q = queues[w];
+    std::lock_guard<std::mutex> lk(q.m);
+    if (q.lo == q.hi)  return false;
+    task = q.lo++;
+    return true;
+}
+
+
+// Steal Tasks from Another Worker
+// Moves the back half of the first non-empty queue after w's into w's queue, and takes one of them.
+// in: w = worker (its queue is empty)
+// out: task = task taken
+//      returns true if success, or false if all queues are empty
+bool WorkStealingPool::steal(unsigned w, size_t &task) {
+    for (unsigned k = 1; k < nThreads; k++) {
+        Queue &v = queues[(w + k) % nThreads];
+        size_t lo, hi;
+        {
+            std::lock_guard<std::mutex> lk(v.m);
+            if (v.lo == v.hi)  continue;
+            hi = v.hi;
+            lo = v.hi -= (v.hi - v.lo + 1) / 2;
+        }
+        Queue &q = queues[w];
+        std::lock_guard<std::mutex> lk(q.m);
+        q.lo = lo + 1;
+        q.hi = hi;
+        q.steals++;
+        task = lo;
+        return true;
+    }
+    return false;
+}
+
+
+// Run Tasks
+// Returns when all tasks have run.
+// in: n = number of tasks
+//     f = called with (worker, task) for each task 0..n-1, concurrently from threads() threads
+// throws: the first exception thrown by f (of any type), or std::system_error if a thread cannot be started
+void WorkStealingPool::run(size_t n, const std::function<void(unsigned worker, size_t task)> &f) {
+    for (unsigned w = 0; w < nThreads; w++) {
+        Queue &q = queues[w];
+        q.lo = n * w / nThreads;
+        q.hi = n * (w + 1) / nThreads;
+        q.steals = 0;
+    }
+    std::atomic<bool> failed(false);
+    std::exception_ptr first;
+    std::mutex firstLock;
+    auto fail = [&]() {
+        std::lock_guard<std::mutex> lk(firstLock);
+        if (!failed.exchange(true))  first = std::current_exception();
+    };
+    auto work = [&](unsigned w) {
+        size_t task;
+        while (!failed && (take(w, task) || steal(w, task))) {
+            try { f(w, task); }
+            catch (...) { fail(); }                     // (an exception leaving a thread would terminate)
+        }
+    };
+    std::vector<std::thread> threads;
+    try {
+        for (unsigned w = 1; w < nThreads; w++)  threads.emplace_back(work, w);
+    }
+    catch (...) { fail(); }                             // (the started workers still need joining)
+    work(0);
+    for (std::thread &t : threads)  t.join();
+    if (failed)  std::rethrow_exception(first);
+}
+
+
+// Count the Steals of the Last run()
+size_t WorkStealingPool::steals() const {
+    size_t n = 0;
+    for (unsigned w = 0; w < nThreads; w++)  n += queues[w].steals;
+    return n;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+
+/* -----  Work-Stealing Pool  -----
+ *
+ * Runs tasks 0..n-1 on a number of threads, e.g. one task per range of a capture archive:
+ *
+ *     WorkStealingPool pool(std::thread::hardware_concurrency());
+ *     std::vector<Partial> partial(n);
+ *     pool.run(n, [&](unsigned worker, size_t task) { scan(task, partial[task]); });
+ *
+ * Each worker starts with a contiguous share of the tasks (so neighbouring ranges stay on one core), and takes
+ * them from the front.  A worker that runs out steals the back half of another worker's remaining tasks, so a
+ * slow range (a dense stretch of a capture, or a segment whose pages must come from the disk) does not leave the
+ * other cores idle.  The calling thread is worker 0.
+ *
+ * If a task throws (an Exception or anything else), the workers stop taking tasks, and run() rethrows the first
+ * exception as it was thrown.
+ */
+class WorkStealingPool {
+
+private:
+    struct Queue {
+        std::mutex m;
+        size_t lo, hi;              // tasks [lo, hi) not yet taken
+        size_t steals;              // steals by this queue's worker
+    };
+
+    unsigned nThreads;
+    std::unique_ptr<Queue[]> queues;
+    bool take(unsigned w, size_t &task);
+    bool steal(unsigned w, size_t &task);
+
+public:
+    explicit WorkStealingPool(unsigned threads);
+    WorkStealingPool(const WorkStealingPool &) = delete;              // delete copy constructor
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;   // delete assignment operator
+    unsigned threads() const { return nThreads; }
+    void run(size_t n, const std::function<void(unsigned worker, size_t task)> &f);
+    size_t steals() const;
+};
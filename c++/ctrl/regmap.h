@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "transport.h"
+
+
+/* -----  Typed Register Map  -----
+ *
+ * Compile-time register accessors generated from regmap.def.  For example,
+ *
+ *     uint32_t n = regmap::dcm::length::read(t);               // t is a DapTransport or an MmioTransport
+ *     regmap::dcm::control::write(t, regmap::dcm::control_clear);
+ *     uint32_t d = regmap::dcm::dec::at<2>::read(t);
+ *     uint32_t x = regmap::dcm::data::read(t, i);             // i is not range checked
+ *
+ * Each register is a type Reg<Mod, Addr, Mask, Access>, so its module and address are range checked when this
+ * header is compiled, and reading a write-only register or writing a read-only one fails the build.  The accessors
+ * do no run-time checks.  Given an MmioTransport, they call its inline read() and write() directly (bypassing
+ * the virtual call), so they compile down to the raw volatile stores and loads of the DAP's AXI registers (plus
+ * the read-completion wait; see MmioTransport); Dap's typed accessors take that path whenever its transport is
+ * an MmioTransport.  Given any other DapTransport, each is one virtual call.
+ *
+ * Reads are masked with the register's implemented bits, and so are the values written.
+ */
+namespace regmap {
+
+enum Access { RO, RW, WO };                 // read only, read/write, write only
+enum Cache  { VOLATILE, CONST, CONFIG };    // shadow-register cache policy (see regmap.def)
+
+
+// -----  Register  -----
+template<int Mod, int Addr, uint32_t Mask, Access A, Cache C = VOLATILE>
+struct Reg {
+    static_assert(Mod >= 0 && Mod <= 127, "module out of range 0..127");
+    static_assert(Addr >= 0 && Addr <= 0x00FFFFFF, "address out of range 0..0x00FFFFFF");
+
+    static constexpr int      mod    = Mod;
+    static constexpr int      addr   = Addr;
+    static constexpr uint32_t mask   = Mask;
+    static constexpr Access   access = A;
+    static constexpr Cache    cache  = C;
+
+    static uint32_t read(DapTransport &t) {
+        static_assert(A != WO, "register is write only");
+        return t.read(Mod, Addr) & Mask;
+    }
+    static uint32_t read(MmioTransport &t) {
+        static_assert(A != WO, "register is write only");
+        return t.MmioTransport::read(Mod, Addr) & Mask;
+    }
+    static void write(DapTransport &t, uint32_t x) {
+        static_assert(A != RO, "register is read only");
+        t.write(Mod, Addr, x & Mask);
+    }
+    static void write(MmioTransport &t, uint32_t x) {
+        static_assert(A != RO, "register is read only");
+        t.MmioTransport::write(Mod, Addr, x & Mask);
+    }
+    static constexpr DapOp readOp()            { return { DapOp::READ,  Mod, Addr, 0, 0 }; }
+    static constexpr DapOp writeOp(uint32_t x) { return { DapOp::WRITE, Mod, Addr, x & Mask, 0 }; }
+};
+
+
+// -----  Register Array  -----
+// Count consecutive registers.  at<I> is register I's type; its index is checked at compile time.  The accessors
+// taking a run-time index i do not check it:  the caller must ensure i < size.
+template<int Mod, int Addr, int Count, uint32_t Mask, Access A, Cache C = VOLATILE>
+struct RegArray {
+    static_assert(Count >= 1 && Addr >= 0 && Count - 1 <= 0x00FFFFFF - Addr, "array out of range 0..0x00FFFFFF");
+
+    template<int I>
+    struct Index {
+        static_assert(I >= 0 && I < Count, "array index out of range");
+        typedef Reg<Mod, Addr + I, Mask, A, C> type;
+    };
+
+    template<int I> using at = typename Index<I>::type;
+
+    static constexpr int      mod    = Mod;
+    static constexpr int      addr   = Addr;
+    static constexpr int      size   = Count;
+    static constexpr uint32_t mask   = Mask;
+    static constexpr Access   access = A;
+    static constexpr Cache    cache  = C;
+
+    static uint32_t read(DapTransport &t, int i) {
+        static_assert(A != WO, "register is write only");
+        return t.read(Mod, Addr + i) & Mask;
+    }
+    static uint32_t read(MmioTransport &t, int i) {
+        static_assert(A != WO, "register is write only");
+        return t.MmioTransport::read(Mod, Addr + i) & Mask;
+    }
+    static void write(DapTransport &t, int i, uint32_t x) {
+        static_assert(A != RO, "register is read only");
+        t.write(Mod, Addr + i, x & Mask);
+    }
+    static void write(MmioTransport &t, int i, uint32_t x) {
+        static_assert(A != RO, "register is read only");
+        t.MmioTransport::write(Mod, Addr + i, x & Mask);
+    }
+    static constexpr DapOp readOp(int i)             { return { DapOp::READ,  Mod, Addr + i, 0, 0 }; }
+    static constexpr DapOp writeOp(int i, uint32_t x) { return { DapOp::WRITE, Mod, Addr + i, x & Mask, 0 }; }
+};
+
+
+// -----  Generated Registers  -----
+// regmap::axi::<name> is an AXI register's index; regmap::<module>::MODULE is a module's ID;
+// regmap::<module>::<reg> is a register's type; regmap::<module>::<reg>_<field> is a field's mask.
+
+#define AXI_REG(name, index, access, description)                   \
+    namespace axi { constexpr int name = index; }
+#define MODULE(module, id, description)                             \
+    namespace module { constexpr int MODULE = id; }
+#define REG(module, name, addr, mask, access, cache, description)           \
+    namespace module { typedef Reg<MODULE, addr, mask, access, cache> name; }
+#define ARRAY(module, name, addr, count, mask, access, cache, description)  \
+    namespace module { typedef RegArray<MODULE, addr, count, mask, access, cache> name; }
+#define FIELD(module, reg, name, lsb, width, description)           \
+    namespace module {                                              \
+        constexpr uint32_t reg##_##name = uint32_t(((1ull << (width)) - 1) << (lsb));           \
+        static_assert((reg##_##name & ~reg::mask) == 0, "field is outside its register's implemented bits"); \
+    }
+#include "regmap.def"
+
+
+// -----  Register Table  -----
+// Every register and register array, for looking up a run-time module and address.
+
+struct RegInfo {
+    int mod, addr, count;       // module, first address, and number of registers (1 if not an array)
+    uint32_t mask;              // implemented bits
+    Access access;
+    Cache cache;
+    const char *name;           // "<module>.<name>", e.g. "dcm.length"
+    const char *description;
+};
+
+#define REG(module, name, addr, mask, access, cache, description)           \
+    { module::MODULE, addr, 1, mask, access, cache, #module "." #name, description },
+#define ARRAY(module, name, addr, count, mask, access, cache, description)  \
+    { module::MODULE, addr, count, mask, access, cache, #module "." #name, description },
+inline constexpr RegInfo table[] = {
+#include "regmap.def"
+};
+
+
+// Look Up a Register
+// in: mod, addr = module (0..127) and address (0..0x00FFFFFF)
+// out: returns the register's entry in table, or nullptr if mod/addr is not in regmap.def
+inline const RegInfo *lookup(int mod, int addr) {
+    for (const RegInfo &r : table)
+        if (r.mod == mod && addr >= r.addr && addr - r.addr < r.count)  return &r;
+    return nullptr;
+}
+
+}   // namespace regmap
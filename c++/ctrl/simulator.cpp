@@ -0,0 +1,314 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <time.h>
+#include "app.h"
+#include "common.h"
+#include "simulator.h"
+
+// Firmware Simulator
+//
+// In-process model of the PL firmware's DAP modules (see simulator.h)
+
+
+
+// Get Real Time
+// out: returns Linux' monotonic clock in seconds
+double FirmwareSim::realTime() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return  static_cast<double>(ts.tv_sec) + 1e-9 * static_cast<double>(ts.tv_nsec);
+}
+
+
+// Constructor
+// in: options = comma-separated key=value pairs (see class description), or "" for the defaults
+// throws: Exception if an option is invalid
+FirmwareSim::FirmwareSim(const char *options) {
+    speed = 1.0;
+    lat = 0.0;
+    baud = 921600;
+    now = 0.0;
+    rdata0 = rdata1 = rdata2 = 0;
+    leds = ld4 = ld5 = sw = 0;
+    count = 0;
+    ringMode = ring = false;
+    wrptr = rdptr = dropped = 0;
+    hwm = BUFFER_SIZE / 2;
+    dumpEnd = 0.0;
+    for (int p = 0; p < PORTS; p++)
+        ports[p] = { p == 0 ? 1.0 : 0.0, 2, 0, 1, 0, 0.0 };
+    memset(&st, 0, sizeof st);
+    parse(options != nullptr ? options : "");
+    for (Port &port : ports)
+        port.next = port.rate > 0  ?  1e6 / port.rate  :  std::numeric_limits<double>::infinity();
+    buffer = new uint32_t[BUFFER_SIZE]();
+    frame = new uint16_t[FRAME_SIZE]();
+    t0 = realTime();
+}
+
+
+// Destructor
+FirmwareSim::~FirmwareSim() {
+    delete[] buffer;
+    delete[] frame;
+}
+
+
+// Parse Options
+// in: options = comma-separated key=value pairs (see class description)
+// throws: Exception if an option is invalid
+void FirmwareSim::parse(const char *options) {
+    char buf[256];
+    if (!strCpy(buf, sizeof buf, options))  throwException("Simulator options are too long");
+    for (char *save, *key = strtok_r(buf, ",", &save);  key != nullptr;  key = strtok_r(nullptr, ",", &save)) {
+        char *value = strchr(key, '=');
+        if (value == nullptr)  throwException("Simulator option \"%s\" has no value", key);
+        *value++ = 0;
+        uint32_t u = 0;
+        double x = 0;
+        int p = key[0] != 0  ?  key[strlen(key) - 1] - '0'  :  -1;
+        bool ok;
+        if (strEq(key, "speed")) {
+            ok = strToDbl(value, x) && x > 0;
+            speed = x;
+        }
+        else if (strEq(key, "lat")) {
+            ok = strToDbl(value, x) && x >= 0 && x <= 1e6;
+            lat = 1e-6 * x;
+        }
+        else if (strEq(key, "baud")) {
+            ok = strToUInt32(value, u) && u >= 1200 && u <= 10000000;
+            baud = u;
+        }
+        else if (strEq(key, "sw")) {
+            ok = strToUInt32(value, u) && u <= 63;
+            sw = uint8_t(u);
+        }
+        else if (strlen(key) == 5 && strStartsWith(key, "rate") && p >= 0 && p < PORTS) {
+            ok = strToDbl(value, x) && x >= 0 && x <= 1e6;
+            ports[p].rate = x;
+        }
+        else if (strlen(key) == 4 && strStartsWith(key, "len") && p >= 0 && p < PORTS) {
+            ok = strToUInt32(value, u) && u >= 1 && u <= MAX_LEN;
+            ports[p].len = int(u);
+        }
+        else  throwException("Unknown simulator option \"%s\"", key);
+        if (!ok)  throwException("Invalid value \"%s\" for simulator option \"%s\"", value, key);
+    }
+}
+
+
+// Clear the DCM's Buffer
+// As in the RTL, the buffer's contents are kept, but its length, the ring's pointers, and the decimation counters
+// are reset, and the requested mode takes effect.
+void FirmwareSim::clear() {
+    count = 0;
+    ring = ringMode;
+    wrptr = rdptr = dropped = 0;
+    for (Port &port : ports)  port.decCnt = 1;
+}
+
+
+// Can No Packet Be Appended?
+// out: returns true if the linear buffer is full, or the ring has no room for a packet of MAX_LEN words
+bool FirmwareSim::blocked() const {
+    return ring  ?  wrptr - rdptr > uint32_t(BUFFER_SIZE - MAX_LEN)  :  count >= BUFFER_SIZE;
+}
+
+
+// Offer a Telemetry Packet to the DCM
+// in out: port = the telemetry port
+// in: p = port's number (0 .. PORTS-1)
+//     t = simulated time in microseconds
+void FirmwareSim::request(Port &port, int p, double t) {
+    st.requests++;
+    bool ack = port.decCnt == 1 && port.dec != 0;
+    port.decCnt = port.decCnt >= port.dec  ?  1  :  port.decCnt + 1;
+    if (!ack)  return;
+    if (ring && blocked()) {
+        dropped++;
+        port.iter++;
+        st.overflows += uint64_t(port.len);
+        return;
+    }
+    st.accepted++;
+    uint32_t words[MAX_LEN];
+    words[0] = uint32_t(p) << 26 | (uint64_t(t) & 0x03FFFFFF);
+    for (int k = 1; k < port.len; k++)
+        words[k] = uint32_t(0xABCD + k - 1) << 16 | port.iter;
+    port.iter++;
+    for (int k = 0; k < port.len; k++) {
+        if (ring) {
+            buffer[wrptr++ & (BUFFER_SIZE - 1)] = words[k];
+            st.words++;
+        }
+        else if (count < BUFFER_SIZE) {
+            buffer[count++] = words[k];
+            st.words++;
+        }
+        else  st.overflows++;
+    }
+}
+
+
+// Advance the Model to the Present Simulated Time
+// Packets are offered in time order.  Once the buffer is full (or the ring has no room), appends have no effect
+// other than on the decimation, packet, and dropped counters, which are then advanced arithmetically, so a long
+// idle period at high rates is cheap.  (Only the host's accesses can unblock the buffer.)
+void FirmwareSim::update() {
+    double target = (realTime() - t0) * speed * 1e6;
+    if (target <= now)  return;
+    for (;;) {
+        if (blocked()) {
+            for (Port &port : ports) {
+                if (port.next > target)  continue;
+                uint64_t k = uint64_t(std::floor((target - port.next) * port.rate * 1e-6)) + 1;
+                uint64_t d = port.dec > 1  ?  port.dec  :  1;
+                uint64_t i0 = (d - (port.decCnt - 1)) % d;                  // first request that is granted
+                uint64_t acks = port.dec != 0 && i0 < k  ?  (k - 1 - i0) / d + 1  :  0;
+                port.decCnt = uint16_t((port.decCnt - 1 + k) % d + 1);
+                port.iter = uint16_t(port.iter + acks);
+                port.next += double(k) * 1e6 / port.rate;
+                st.requests += k;
+                if (ring)  dropped += uint32_t(acks);
+                else  st.accepted += acks;
+                st.overflows += acks * uint64_t(port.len);
+            }
+            break;
+        }
+        int p = 0;
+        for (int i = 1; i < PORTS; i++)
+            if (ports[i].next < ports[p].next)  p = i;
+        Port &port = ports[p];
+        if (port.next > target)  break;
+        request(port, p, port.next);
+        port.next += 1e6 / port.rate;
+    }
+    now = target;
+    if (dumpEnd != 0.0 && dumpEnd <= now)  dumpEnd = 0.0;
+}
+
+
+// Read a 32-bit Word
+// in: mod, addr = module (0..127) and address (0..0x00FFFFFF) to read from
+// out: returns the value the firmware would return
+uint32_t FirmwareSim::read(int mod, int addr) {
+    if (lat > 0) {
+        double t = realTime() + lat;
+        while (realTime() < t) ;
+    }
+    update();
+    switch (mod) {
+        case 0:
+            switch (addr & 7) {
+                case 0:   rdata0 = APP_FW_CREATION;            break;
+                case 1:   rdata0 = APP_FW_BUILD;               break;
+                case 2:   rdata0 = uint64_t(now) & 0x03FFFFFF; break;
+                case 3:   rdata0 = leds;                       break;
+                case 4:   rdata0 = ld4;                        break;
+                case 5:   rdata0 = ld5;                        break;
+                case 6:   rdata0 = sw;                         break;
+                default:  rdata0 = 0xDEADBEEF;                 break;
+            }
+            return rdata0;
+        case 1:
+            if ((addr & 0x800000) == 0)
+                rdata1 = dumpEnd != 0.0  ?  0xDEADBEEF  :  buffer[addr & (BUFFER_SIZE - 1)];
+            else
+                switch (addr & 15) {
+                    case 0:   rdata1 = dumpEnd != 0.0  ?  2  :  0;           break;
+                    case 1:   rdata1 = length();                            break;
+                    case 2:   rdata1 = BUFFER_SIZE;                         break;
+                    case 3: case 4: case 5: case 6: case 7: case 8:
+                              rdata1 = ports[(addr & 15) - 3].dec;          break;
+                    case 9:   rdata1 = ringMode;                            break;
+                    case 10:  rdata1 = wrptr;                               break;
+                    case 11:  rdata1 = rdptr;                               break;
+                    case 12:  rdata1 = hwm;                                 break;
+                    case 13:  rdata1 = uint32_t(dropped != 0) << 1 | uint32_t(length() >= hwm);  break;
+                    case 14:  rdata1 = dropped;                             break;
+                    default:  rdata1 = 0xDEADBEEF;                          break;
+                }
+            return rdata1;
+        case 2:
+            if ((addr & 0xC000) == 0)  rdata2 = frame[addr & (FRAME_SIZE - 1)];
+            return rdata2;
+    }
+    return 0;
+}
+
+
+// Write a 32-bit Word
+// in: mod, addr = module (0..127) and address (0..0x00FFFFFF) to write to
+//     data = 32-bit word to write
+void FirmwareSim::write(int mod, int addr, uint32_t data) {
+    update();
+    switch (mod) {
+        case 0:
+            switch (addr & 7) {
+                case 3:  leds = data & 15;  break;
+                case 4:  ld4  = data & 7;   break;
+                case 5:  ld5  = data & 7;   break;
+            }
+            break;
+        case 1:
+            if ((addr & 0x800000) == 0)  break;
+            switch (addr & 15) {
+                case 0:
+                    if (data & 1)  clear();
+                    if (data & 2) {
+                        dumpEnd = now + (double(count) + 2.0) * 40.0 * 1e6 / baud;   // N+2 words of 4 bytes of 10 bits
+                        st.dumps++;
+                    }
+                    break;
+                case 3: case 4: case 5: case 6: case 7: case 8:
+                    ports[(addr & 15) - 3].dec = uint16_t(data);
+                    break;
+                case 9:
+                    ringMode = data & 1;
+                    clear();
+                    break;
+                case 11:  rdptr = data;  break;
+                case 12:  hwm = data & 0x1FFFF;  break;
+            }
+            break;
+        case 2:
+            if ((addr & 0xC000) == 0)  frame[addr & (FRAME_SIZE - 1)] = uint16_t(data);
+            break;
+    }
+}
+
+
+// Get Current Time
+// out: returns simulated time in microseconds modulo 2**26
+uint32_t FirmwareSim::usTime() {
+    update();
+    return  uint64_t(now) & 0x03FFFFFF;
+}
+
+
+// Get Firmware's Creation Date
+// out: returns the creation date of the firmware this utility was built for
+uint32_t FirmwareSim::creationDate() { return APP_FW_CREATION; }
+
+
+// Get Firmware's Build Date
+// out: returns the build date of the firmware this utility was built for
+uint32_t FirmwareSim::buildDate() { return APP_FW_BUILD; }
+
+
+// Print Status (for debugging)
+void FirmwareSim::printStatus() {
+    update();
+    printf("    speed          =  %10g   ; simulated time's speed relative to real time\n", speed);
+    printf("    simTime        =  %10.0f   ; simulated microseconds since start\n", now);
+    for (int p = 0; p < PORTS; p++)
+        if (ports[p].rate > 0)
+            printf("    port %d         =  %10g   ; packets/s of %d words\n", p, ports[p].rate, ports[p].len);
+    printf("    requests       =  %10llu   ; packets offered\n", (unsigned long long) st.requests);
+    printf("    accepted       =  %10llu   ; packets granted by the decimation counters\n", (unsigned long long) st.accepted);
+    printf("    words          =  %10llu   ; words appended to the buffer\n", (unsigned long long) st.words);
+    printf("    overflows      =  %10llu   ; words discarded because the buffer was full\n", (unsigned long long) st.overflows);
+}
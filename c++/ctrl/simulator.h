@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "transport.h"
+
+
+/* -----  Firmware Simulator  -----
+ *
+ * DAP transport to an in-process model of the PL firmware, for running the control utility, capture tools, and
+ * benchmarks without a PYNQ-Z2.  It models the register maps of
+ *
+ *   Module 0   basic_io.v               creationDate, buildDate, usTime, leds, LD4, LD5, sw (addr[2:0] decoded;
+ *                                         7 reads 0xDEADBEEF)
+ *   Module 1   debug_capture_module.v   64K x 32b buffer, control (clear, dump), length, size, dec0 .. dec5, and
+ *                                         the ring mode's mode, wrptr, rdptr, hwm, status, and dropped
+ *   Module 2   spotter.v                128x128 16b frame buffer at addr[15:14] == 0
+ *
+ * plus the DAP's usTime, creationDate, and buildDate registers.  Reads of undecoded addresses return the module's
+ * previous rdata, as the RTL does.  Modules 3 .. 127 read as 0 and ignore writes.
+ *
+ * Time is simulated in microseconds:  usTime advances SPEED times as fast as Linux' monotonic clock, so a capture
+ * that takes minutes on the board can run in seconds.  The model is updated lazily whenever it is accessed.
+ *
+ * Telemetry:  Each of the DCM's six ports may be fed a synthetic stream of packets at a fixed rate.  A packet is
+ * LEN 32-bit words:  a header word {6'(port), 26'(usTime)} followed by LEN-1 data words {16'(0xABCD + k - 1),
+ * 16'(packet counter)}, k = 1 .. LEN-1; so port 0 at 1 Hz with LEN 2 matches dcm_tester.v.  Each packet request is
+ * granted or refused by the port's decimation counter exactly as the RTL's arbiter does, and words are appended
+ * until the buffer is full (so the last packet may be truncated).  In ring mode, a packet is also refused (and
+ * counted as dropped) unless the ring has room for MAX_LEN words, as the RTL's MAX_PACKET.  Clearing the buffer
+ * also resets the decimation counters and the ring's pointers.  A dump takes as long as sending N+2 words at BAUD
+ * (8N1) would take, during which the buffer reads as 0xDEADBEEF; the words themselves are discarded.
+ *
+ * Options are a comma-separated list of key=value pairs, e.g. "speed=100,rate0=1000,len0=4":
+ *
+ *   Key       Default   Description
+ *   --------  --------  --------------------------------------------------------------------------------------------
+ *   speed     1         simulated time's speed relative to real time (>0)
+ *   rate<p>   1, 0..    port p's packet rate in packets per simulated second (0 .. 1000000; 0 disables the port);
+ *                         port 0 defaults to 1 (dcm_tester.v), the other ports to 0 (tied off in top.v)
+ *   len<p>    2         port p's packet length in 32-bit words (1 .. 64)
+ *   sw        0         switches and pushbuttons read by basic_io's sw register (0 .. 63)
+ *   baud      921600    Debug Serial Port's baud rate, which sets how long a dump takes
+ *   lat       0         extra latency of each read in real microseconds, busy-waited to mimic a physical link
+ */
+class FirmwareSim: public DapTransport {
+
+public:
+    static constexpr int PORTS       = 6;           // number of DCM telemetry ports
+    static constexpr int BUFFER_SIZE = 1 << 16;     // DCM buffer's capacity in 32-bit words
+    static constexpr int FRAME_SIZE  = 128 * 128;   // spotter's frame buffer size in pixels
+    static constexpr int MAX_LEN     = 64;          // max. packet length in 32-bit words
+
+    struct Stats {
+        uint64_t requests;      // number of packets offered on the telemetry ports
+        uint64_t accepted;      // number of packets granted by the decimation counters
+        uint64_t words;         // number of words appended to the buffer
+        uint64_t overflows;     // number of words discarded because the buffer was full (or the ring had no room)
+        uint64_t dumps;         // number of dumps
+    };
+
+private:
+    struct Port {
+        double rate;            // packets per simulated second, or 0 if disabled
+        int len;                // packet length in 32-bit words
+        uint16_t dec;           // decimation (1..65535, or 0 to discard all packets)
+        uint16_t decCnt;        // decimation counter (1 .. max(dec, 1))
+        uint16_t iter;          // packet counter
+        double next;            // simulated time (us) of the next packet, or infinity if disabled
+    };
+
+    double speed;               // simulated time's speed relative to real time
+    double t0;                  // real time (CLOCK_MONOTONIC_RAW seconds) when the simulation started
+    double lat;                 // extra latency of each read in real seconds
+    unsigned baud;              // Debug Serial Port's baud rate
+    double now;                 // simulated time in microseconds when the model was last updated
+
+    // basic_io.v
+    uint32_t rdata0;
+    uint8_t leds, ld4, ld5, sw;
+
+    // debug_capture_module.v
+    uint32_t rdata1;
+    uint32_t *buffer;           // BUFFER_SIZE words
+    uint32_t count;             // number of words in the buffer (0 .. BUFFER_SIZE)
+    bool ringMode;              // mode register:  ring mode requested
+    bool ring;                  // ring mode in effect (latched from ringMode by a clear)
+    uint32_t wrptr, rdptr;      // ring's words appended and drained since the clear
+    uint32_t hwm;               // high watermark in words
+    uint32_t dropped;           // packets dropped because the ring had no room
+    double dumpEnd;             // simulated time (us) when the dump in progress ends, or 0 if not dumping
+    Port ports[PORTS];
+
+    // spotter.v
+    uint32_t rdata2;
+    uint16_t *frame;            // FRAME_SIZE pixels
+
+    Stats st;
+
+    static double realTime();
+    void update();
+    void clear();
+    uint32_t length() const { return ring  ?  wrptr - rdptr  :  count; }
+    bool blocked() const;
+    void request(Port &port, int p, double t);
+    void parse(const char *options);
+
+public:
+    explicit FirmwareSim(const char *options = "");
+    ~FirmwareSim() override;
+    const char *name() override { return "sim"; }
+    uint32_t read(int mod, int addr) override;
+    void write(int mod, int addr, uint32_t data) override;
+    uint32_t usTime() override;
+    uint32_t creationDate() override;
+    uint32_t buildDate() override;
+    const Stats &stats() { return st; }
+    void printStatus() override;
+};
@@ -0,0 +1,67 @@
+#include <cstdio>
+#include <vector>
+#include "common.h"
+#include "telemetry.h"
+
+// Telemetry Packet Decoder
+//
+// Decodes capture files (DCM dumps and DcmCapture's files) with the schemas in telemetry.def
+
+namespace telemetry {
+
+
+
+// Visitor that Prints Bad Packets
+struct ErrorPrinter {
+    const char *fn;
+    int reports, maxReports;
+    void operator()(const Error &e) {
+        static const char *const kinds[] = { "unknown type", "malformed", "truncated" };
+        if (reports++ < maxReports)
+            printf("%s: %s packet (header 0x%08X) at word %zu\n", fn, kinds[e.kind], (unsigned) e.header, e.offset);
+    }
+    template<class R> void operator()(const R &) {}
+};
+
+
+// Decode a Capture File
+// Counts the file's packets and prints its bad packets.  A packet that spans two files (which DcmCapture's
+// streaming can write) is reported as truncated, and its rest in the next file as bad packets; decode the
+// concatenated files instead.
+// in: fn = file of little-endian 32-bit words, beginning at a packet's header
+//     maxReports = max. number of bad packets to print
+// in out: clock = unwraps the timestamps; carry it over from the previous file of the same capture
+// out: returns the statistics
+// throws: Exception if the file cannot be read
+DecodeStats decodeFile(const char *fn, Clock &clock, int maxReports) {
+    FILE *src = fopen(fn, "rb");
+    if (src == nullptr)  throwException("Cannot open capture file %s", fn);
+    std::vector<uint32_t> w;
+    uint32_t buf[16384];
+    size_t k;
+    while ((k = fread(buf, sizeof buf[0], sizeof buf / sizeof buf[0], src)) != 0)  w.insert(w.end(), buf, buf + k);
+    bool ok = ferror(src) == 0;
+    fclose(src);
+    if (!ok)  throwException("Cannot read capture file %s", fn);
+    return decode(w.data(), w.size(), clock, ErrorPrinter{ fn, 0, maxReports });
+}
+
+
+// Print Decode Statistics
+void printStats(const DecodeStats &st) {
+    printf("Telemetry\n");
+    printf("    packets        =  %10llu   ; well-formed packets\n", (unsigned long long) st.packets);
+    for (const Schema &s : table)
+        printf( "    %-14s =  %10llu   ; type %u: %s\n",
+                s.name, (unsigned long long) st.perType[s.type], s.type, s.description );
+    printf("    words          =  %10llu   ; 32-bit words in well-formed packets\n", (unsigned long long) st.words);
+    printf("    unknown        =  %10llu   ; words skipped (type not in telemetry.def)\n", (unsigned long long) st.unknown);
+    printf("    malformed      =  %10llu   ; packets that failed a check\n", (unsigned long long) st.malformed);
+    printf("    truncated      =  %10llu   ; packets cut off by the end of the buffer\n", (unsigned long long) st.truncated);
+    if (st.packets != 0)
+        printf( "    span           =  %10.6f   ; seconds from the first packet to the last\n",
+                1e-6 * double(st.last - st.first) );
+    putchar('\n');
+}
+
+}   // namespace telemetry
@@ -0,0 +1,285 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+/* -----  Telemetry Packet Decoder  -----
+ *
+ * Compile-time packet schemas and a decoder generated from telemetry.def.  For example,
+ *
+ *     struct Printer {
+ *         void operator()(const telemetry::Record<telemetry::tester::packet> &r) {
+ *             printf("%llu us: iter %u\n", (unsigned long long) r.time, telemetry::tester::iter::get(r));
+ *         }
+ *         void operator()(const telemetry::Error &e) { printf("bad packet at word %zu\n", e.offset); }
+ *         template<class R> void operator()(const R &) {}          // the other packet types
+ *     };
+ *     telemetry::Clock clock;
+ *     telemetry::DecodeStats st = telemetry::decode(words, n, clock, Printer());
+ *
+ * Each packet is a type Packet<Type, Length>, and each of its fields a type Field<Word, Lsb, Width>, so a field's
+ * word is checked against its packet's length when this header is compiled.  decode() walks a buffer of words
+ * (a DCM dump or capture file) with a switch on the header's type, generated from telemetry.def, and calls the
+ * visitor with a Record<P> for each packet:  there are no virtual calls, and the visitor is inlined.
+ *
+ * Timestamps:  a header's 26-bit timestamp wraps every 67 s.  A Clock unwraps successive timestamps into 64-bit
+ * microseconds, which never decrease (the first timestamp is taken as is), so packets more than 2**26 us apart
+ * cannot be told from packets fewer than 2**26 us apart.  Keep the Clock across the files of one capture.
+ *
+ * Errors:  a packet whose type is not in telemetry.def (UNKNOWN) or that fails one of its PCHECKs (MALFORMED) is
+ * reported, and decoding resumes at the next word, until a valid packet resynchronizes it.  A packet that runs
+ * past the end of the buffer (TRUNCATED, e.g. the last packet of a full linear buffer) is reported and ends the
+ * decode.  Errors do not advance the Clock.
+ *
+ * TELEMETRY_DEF names the schema file; a test program may define it to build the decoder with its own schemas
+ * (see test/codec_test.def).
+ */
+#ifndef TELEMETRY_DEF
+#define TELEMETRY_DEF  "telemetry.def"
+#endif
+
+namespace telemetry {
+
+constexpr unsigned TYPES      = 64;             // number of packet types
+constexpr uint32_t TIME_MASK  = 0x03FFFFFF;     // header's timestamp bits
+
+inline unsigned typeOf(uint32_t header) { return header >> 26;        }
+inline uint32_t timeOf(uint32_t header) { return header & TIME_MASK;  }
+
+
+// -----  Packet  -----
+template<unsigned Type, unsigned Length>
+struct Packet {
+    static_assert(Type < TYPES, "packet type out of range 0..63");
+    static_assert(Length >= 1 && Length <= 64, "packet length out of range 1..64");
+
+    static constexpr unsigned type   = Type;
+    static constexpr unsigned length = Length;
+};
+
+
+// -----  Record  -----
+// A decoded packet of type P:  its unwrapped time, and its words in the decoded buffer (valid only while the
+// buffer is).
+template<class P>
+struct Record {
+    typedef P packet;
+    uint64_t time;              // microseconds (unwrapped header timestamp)
+    size_t offset;              // index of the header word in the buffer
+    const uint32_t *words;      // P::length words, header first
+};
+
+
+// -----  Field  -----
+// Bits Lsb+Width-1 .. Lsb of word Word.
+template<unsigned Word, unsigned Lsb, unsigned Width>
+struct Field {
+    static_assert(Word >= 1 && Word <= 63, "field's word out of range 1..63");
+    static_assert(Width >= 1 && Lsb + Width <= 32, "field is outside its 32-bit word");
+
+    static constexpr unsigned word   = Word;
+    static constexpr unsigned lsb    = Lsb;
+    static constexpr unsigned width  = Width;
+    static constexpr uint32_t mask   = uint32_t((1ull << Width) - 1);
+
+    static uint32_t get(const uint32_t *w) { return w[Word] >> Lsb & mask; }
+    template<class P>
+    static uint32_t get(const Record<P> &r) {
+        static_assert(Word < P::length, "field is outside its packet");
+        return get(r.words);
+    }
+};
+
+
+// -----  Generated Schemas  -----
+// telemetry::<packet>::packet is a packet's type; telemetry::<packet>::<field> is a field's type.
+
+#define PACKET(name, type, length, description)                     \
+    namespace name { typedef Packet<type, length> packet; }
+#define PFIELD(packet_, name, word, lsb, width, description)        \
+    namespace packet_ {                                             \
+        typedef Field<word, lsb, width> name;                       \
+        static_assert(word < packet::length, "field is outside its packet");   \
+    }
+#include TELEMETRY_DEF
+
+
+// -----  Schema Table  -----
+// Every packet type, for looking up a run-time type.
+
+struct Schema {
+    unsigned type, length;
+    const char *name;
+    const char *description;
+};
+
+#define PACKET(name, type, length, description)  { type, length, #name, description },
+inline constexpr Schema table[] = {
+#include TELEMETRY_DEF
+};
+
+
+// Every packet field, for reading fields whose type is known only at run time.
+struct FieldSchema {
+    unsigned type, word, lsb, width;
+    const char *name;
+    const char *description;
+
+    uint32_t get(const uint32_t *w) const { return w[word] >> lsb & uint32_t((1ull << width) - 1); }
+};
+
+#define PFIELD(packet_, name, word, lsb, width, description)  { packet_::packet::type, word, lsb, width, #name, description },
+inline constexpr FieldSchema fields[] = {
+#include TELEMETRY_DEF
+    { TYPES, 0, 0, 1, nullptr, nullptr }    // sentinel (matches no type)
+};
+
+
+// Look Up a Packet Type
+// in: type = packet type (0..63)
+// out: returns the type's entry in table, or nullptr if it is not in telemetry.def
+inline const Schema *lookup(unsigned type) {
+    for (const Schema &s : table)
+        if (s.type == type)  return &s;
+    return nullptr;
+}
+
+
+// Port of a Packet Type
+// in: type = packet type (0..63)
+// out: returns the DCM telemetry port (0..5) the type arrives on, or -1 if it has no PSOURCE (or is unknown)
+inline int portOf(unsigned type) {
+    switch (type) {
+#define PSOURCE(packet_, port)  case packet_::packet::type:  return port;
+#include TELEMETRY_DEF
+    }
+    return -1;
+}
+
+
+// -----  Checks  -----
+
+struct Check {
+    unsigned type, word;
+    uint32_t mask, value;
+};
+
+#define PCHECK(packet_, word, mask, value)  { packet_::packet::type, word, mask, value },
+inline constexpr Check checks[] = {
+#include TELEMETRY_DEF
+    { TYPES, 0, 0, 0 }          // sentinel (matches no type)
+};
+
+
+// Is a Packet Well Formed?
+// in: w = the packet's P::length words
+// out: returns true if all of P's checks pass
+template<class P>
+inline bool valid(const uint32_t *w) {
+    for (const Check &c : checks)
+        if (c.type == P::type && (w[c.word] & c.mask) != c.value)  return false;
+    return true;
+}
+
+
+// -----  Clock  -----
+// Unwraps 26-bit header timestamps into 64-bit microseconds.
+
+class Clock {
+
+private:
+    uint64_t t;                 // last unwrapped time (us)
+    bool started;
+
+public:
+    Clock() : t(0), started(false) {}
+    explicit Clock(uint64_t t) : t(t), started(true) {}       // continue from time t (e.g., a segment's firstTime)
+    uint64_t now() const { return t; }
+    uint64_t operator()(uint32_t us) {
+        if (started)  t += (us - uint32_t(t)) & TIME_MASK;
+        else { t = us & TIME_MASK;  started = true; }
+        return t;
+    }
+};
+
+
+// -----  Decoder  -----
+
+// Error Record (passed to the visitor instead of a Record)
+struct Error {
+    enum Kind { UNKNOWN, MALFORMED, TRUNCATED };
+    Kind kind;
+    size_t offset;              // index of the bad header word in the buffer
+    uint32_t header;            // the bad header word
+};
+
+struct DecodeStats {
+    uint64_t packets;           // well-formed packets
+    uint64_t words;             // words in well-formed packets
+    uint64_t unknown;           // words skipped because their type is not in telemetry.def
+    uint64_t malformed;         // packets that failed a check
+    uint64_t truncated;         // packets cut off by the end of the buffer (0 or 1)
+    uint64_t perType[TYPES];    // well-formed packets of each type
+    uint64_t first, last;       // unwrapped times of the first and last well-formed packets (us)
+};
+
+
+// Decode One Packet of Type P
+// in: w, n = buffer
+//     i = index of the packet's header word (< n)
+// in out: clock, visit, st = as decode()'s
+// out: returns the number of words consumed
+template<class P, class V>
+inline size_t decodePacket(const uint32_t *w, size_t n, size_t i, Clock &clock, V &visit, DecodeStats &st) {
+    if (n - i < P::length) {
+        st.truncated++;
+        visit(Error{ Error::TRUNCATED, i, w[i] });
+        return n - i;
+    }
+    if (!valid<P>(w + i)) {
+        st.malformed++;
+        visit(Error{ Error::MALFORMED, i, w[i] });
+        return 1;
+    }
+    uint64_t t = clock(timeOf(w[i]));
+    if (st.packets == 0)  st.first = t;
+    st.last = t;
+    visit(Record<P>{ t, i, w + i });
+    st.packets++;
+    st.words += P::length;
+    st.perType[P::type]++;
+    return P::length;
+}
+
+
+// Decode a Buffer of Packets
+// in: w, n = buffer of n 32-bit words, which must begin at a packet's header
+// in out: clock = unwraps the timestamps; carry it over from the previous buffer of the same capture
+//         visit = called with a const Record<P> & for each well-formed packet, in order, and a const Error & for
+//                 each bad one (e.g. a generic lambda)
+// out: returns the statistics
+template<class V>
+DecodeStats decode(const uint32_t *w, size_t n, Clock &clock, V &&visit) {
+    DecodeStats st = {};
+    size_t i = 0;
+    while (i < n) {
+        switch (typeOf(w[i])) {
+#define PACKET(name, type, length, description)                                 \
+            case type:  i += decodePacket<name::packet>(w, n, i, clock, visit, st);  continue;
+#include TELEMETRY_DEF
+        }
+        st.unknown++;
+        visit(Error{ Error::UNKNOWN, i, w[i] });
+        i++;
+    }
+    return st;
+}
+
+
+// -----  Capture Files  -----
+
+DecodeStats decodeFile(const char *fn, Clock &clock, int maxReports = 10);
+void printStats(const DecodeStats &st);
+
+}   // namespace telemetry
@@ -0,0 +1,140 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "common.h"
+#include "blob.h"
+#include "test.h"
+
+// Blob Golden Model Test
+//
+// Feeds BlobModel small frames whose records were worked out by hand from blob.v's rules (see blob.h):  which
+// blob can_grab gives a pixel, the one-pixel margin at the frame's edges, and the order of the flushed records;
+// then round-trips records through pack(), unpack(), and toHex(), with fields at and beyond their widths
+
+
+
+typedef BlobModel::Record Record;
+
+static constexpr int W = BlobModel::WIDTH;
+
+
+// A Blank Frame
+static std::vector<uint16_t> blank() { return std::vector<uint16_t>(W * BlobModel::HEIGHT, 0); }
+
+
+// Compare Two Records Field by Field
+static bool same(const Record &a, const Record &b) {
+    return a.valid == b.valid && a.x0 == b.x0 && a.y0 == b.y0 && a.x1 == b.x1 && a.y1 == b.y1 && a.count == b.count
+        && a.maxI == b.maxI && a.sumI == b.sumI && a.sumXI == b.sumXI && a.sumYI == b.sumYI;
+}
+
+
+// can_grab Gives a Pixel to the First Empty Blob, and Flushes Emerge in Descending Blob Index
+// Three blobs.  Row 5:  (10,5) -> blob 0, (20,5) -> blob 1.  Row 6:  (21,6) is adjacent to blob 1, which absorbs
+// it.  The flush after row 6 (flush_y = 5) empties blob 0.  Row 7:  (50,7) -> blob 0 (empty again, and first),
+// (60,7) -> blob 2, and (70,7) is lost.  The flush after row 7 (flush_y = 6) empties blob 1; the one after row 8
+// (flush_y = 7) empties blobs 2 and 0, in that order.
+static void canGrab() {
+    std::vector<uint16_t> f = blank();
+    f[5 * W + 10] = 100;
+    f[5 * W + 20] = 200;
+    f[6 * W + 21] = 300;
+    f[7 * W + 50] = 7;
+    f[7 * W + 60] = 9;
+    f[7 * W + 70] = 11;
+    const Record expect[] = {
+        { true, 10, 5, 10, 5, 1, 100, 100, 1000, 500 },
+        { true, 21, 6, 21, 6, 2, 300, 500, 20 * 200 + 21 * 300, 5 * 200 + 6 * 300 },
+        { true, 60, 7, 60, 7, 1, 9, 9, 540, 63 },
+        { true, 50, 7, 50, 7, 1, 7, 7, 350, 49 },
+    };
+    BlobModel m(3);
+    std::vector<Record> out;
+    CHECK(m.frame(f.data(), out) == 4);
+    CHECK(out.size() == 4);
+    for (size_t k = 0; k < out.size() && k < 4; k++)  CHECK(same(out[k], expect[k]));
+    CHECK(m.stats().pixels == 6 && m.stats().lost == 1 && m.stats().shared == 0 && m.stats().records == 4);
+
+    // a blank frame has no records, and the model starts it with every blob empty
+    out.clear();
+    std::vector<uint16_t> b = blank();
+    CHECK(m.frame(b.data(), out) == 0 && out.empty());
+    CHECK(m.frame(f.data(), out) == 4);
+    for (size_t k = 0; k < out.size() && k < 4; k++)  CHECK(same(out[k], expect[k]));
+    CHECK(m.stats().frames == 3);
+}
+
+
+// The Bounding Box's Margin is Clamped at x and y = 0 and 127, not Wrapped
+// Row 0:  (127,0) -> blob 0.  Row 1:  (0,1) is not adjacent to blob 0 (so blob 1 grabs it), but (126,1) is.
+// Row 2:  (1,2) is adjacent to blob 1.  A 7-bit wrap of x1 + 1 or x0 - 1 would reject (126,1) or (1,2), and give
+// them new blobs.  Row 127:  (0,127) -> blob 0, and (127,127) is not adjacent to it, so -> blob 1.
+static void edges() {
+    std::vector<uint16_t> f = blank();
+    f[0 * W + 127] = 1;
+    f[1 * W + 0] = 2;
+    f[1 * W + 126] = 3;
+    f[2 * W + 1] = 4;
+    f[127 * W + 0] = 6;
+    f[127 * W + 127] = 7;
+    const Record expect[] = {
+        { true, 126, 1, 126, 1, 2, 3, 4, 127 * 1 + 126 * 3, 0 * 1 + 1 * 3 },      // flushed after row 2
+        { true, 1, 2, 1, 2, 2, 4, 6, 0 * 2 + 1 * 4, 1 * 2 + 2 * 4 },                 // flushed after row 3
+        { true, 127, 127, 127, 127, 1, 7, 7, 127 * 7, 127 * 7 },                     // the frame's last flush
+        { true, 0, 127, 0, 127, 1, 6, 6, 0, 127 * 6 },
+    };
+    BlobModel m(4);
+    std::vector<Record> out;
+    CHECK(m.frame(f.data(), out) == 4);
+    CHECK(out.size() == 4);
+    for (size_t k = 0; k < out.size() && k < 4; k++)  CHECK(same(out[k], expect[k]));
+    CHECK(m.stats().lost == 0 && m.stats().shared == 0);
+}
+
+
+// pack(), unpack(), and toHex() Round-Trip, and Fields Wrap at their Widths
+// The expected words and digits were laid out by hand from blob_out's field order (see pack()).
+static void records() {
+    const Record r = { true, 10, 5, 10, 5, 1, 100, 100, 1000, 500 };
+    const uint32_t words[6] = { 0x000001F4, 0x00003E80, 0x00006400, 0x00401900, 0x2828A0A0, 0x00000002 };
+    uint32_t w[6];
+    char hex[42];
+    r.pack(w);
+    CHECK(memcmp(w, words, sizeof w) == 0);
+    CHECK(same(Record::unpack(w), r));
+    r.toHex(hex);
+    CHECK(strEq(hex, "22828A0A0004019000000640000003E80000001F4"));
+
+    // every field at its maximum:  162 one bits, and none past them
+    const Record ones = { true, 127, 127, 127, 127, 0x7FFF, 0xFFFF, 0x3FFFFFFF, 0xFFFFFFFFFULL, 0xFFFFFFFFFULL };
+    ones.pack(w);
+    CHECK(w[0] == 0xFFFFFFFF && w[4] == 0xFFFFFFFF && w[5] == 0x00000003);
+    CHECK(same(Record::unpack(w), ones));
+    ones.toHex(hex);
+    CHECK(strlen(hex) == 41 && hex[0] == '3' && strspn(hex + 1, "F") == 40);
+
+    // count, sum_i, and sum_xi / sum_yi keep only their 15, 30, and 36 bits, without touching their neighbours (a
+    // 128x128 frame cannot carry a blob's sums past their widths, so the wraps are checked on records)
+    const Record wide    = { true, 127, 0, 1, 126, 0xFFFF, 0xFFFF, 0xFFFFFFFF, (1ULL << 36) + 3,
+                             1ULL << 37 | 0x123456789 };
+    const Record wrapped = { true, 127, 0, 1, 126, 0x7FFF, 0xFFFF, 0x3FFFFFFF, 3, 0x123456789 };
+    wide.pack(w);
+    CHECK(same(Record::unpack(w), wrapped));
+    wide.toHex(hex);
+    CHECK(strEq(hex, "3FC001FDFFFFFFFFFFFFFFF000000003123456789"));
+}
+
+
+// Main
+int main() {
+    try {
+        canGrab();
+        edges();
+        records();
+    }
+    catch (Exception &e) {
+        printf("%s\n", e.what());
+        failures++;
+    }
+    return report("blob_test");
+}
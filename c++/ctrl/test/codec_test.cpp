@@ -0,0 +1,256 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "common.h"
+#include "archive.h"
+#include "codec.h"
+#include "test.h"
+
+// Telemetry Codec Test
+//
+// Round-trips random blocks of packets through the codec, with the 1- and 64-word packets of codec_test.def,
+// outliers that must be patched as exceptions, and timestamps that wrap at 2**26; then compresses an archive and
+// checks that queries of its compressed segments, expanded on demand, match queries of the original segments.
+// Built with TELEMETRY_DEF = test/codec_test.def (see the Makefile).
+
+
+
+using namespace telemetry;
+
+static constexpr uint32_t WRAP_START = (1u << 26) - 300000;     // first timestamp:  wraps 0.3 s into a stream
+
+static std::mt19937 rng(20250728);
+
+
+// Random Packet Stream
+// Appends packets of the types in the mask to w, at each type's steady period, with rare outliers in the times
+// and payloads.
+// in: words = about how many words to append
+//     types = mask of the types to use (bit t for type t)
+// in out: w = the packets are appended
+//         time = unwrapped time of the last packet
+static void generate(size_t words, uint64_t types, std::vector<uint32_t> &w, uint64_t &time) {
+    std::vector<unsigned> use;
+    for (const Schema &s : table)
+        if (types >> s.type & 1)  use.push_back(s.type);
+    uint32_t count = 0;
+    for (size_t end = w.size() + words; w.size() < end; count++) {
+        unsigned t = use[rng() % use.size()];
+        time += 10 + (rng() % 200 == 0  ?  1000000  :  0);                 // (an outlier in the deltas)
+        bool outlier = rng() % 100 == 0;
+        w.push_back(t << 26 | (uint32_t(time) & TIME_MASK));
+        switch (t) {
+            case tester::packet::type:
+                w.push_back(0xABCD0000 | (count & 0xFFFF));
+                break;
+            case 7:                                                         // sample
+                w.push_back(count);
+                w.push_back(1000 + count / 1000);
+                w.push_back(outlier  ?  0xFFFFFFFF  :  500 + rng() % 16);
+                w.push_back(uint32_t(rng()));
+                break;
+            case 40:                                                        // frame
+                w.push_back(count);
+                for (int j = 0; j < 62; j++)  w.push_back(outlier && j == 30  ?  0x80000000  :  rng() % 256);
+                break;
+            case decimation::packet::type:
+                w.insert(w.end(), { 0x00020001, 0x00040003, 0x00060005 });
+                break;
+        }
+    }
+}
+
+
+// Round-Trip a Run of Packets Block by Block
+// in: w = packets
+// out: returns the number of blocks
+static size_t roundTrip(const std::vector<uint32_t> &w) {
+    std::vector<uint32_t> out, back;
+    size_t blocks = 0;
+    for (size_t i = 0; i < w.size(); blocks++) {
+        out.clear();
+        size_t n = codec::encodeBlock(w.data() + i, w.size() - i, out);
+        CHECK(n == w.size() - i || (n >= codec::BLOCK_WORDS && n < codec::BLOCK_WORDS + 64));
+        back.assign(n + 1, 0xDEADBEEF);
+        codec::decodeBlock(out.data(), out.size(), back.data(), n);
+        CHECK(memcmp(back.data(), w.data() + i, n * 4) == 0);
+        CHECK(back[n] == 0xDEADBEEF);
+        i += n;
+    }
+    return blocks;
+}
+
+
+// Random Blocks of One or Several Types Round-Trip
+static void blocks() {
+    const uint64_t TICK = 1ull << 1, TESTER = 1ull << 0, SAMPLE = 1ull << 7, FRAME = 1ull << 40, DEC = 1ull << 62;
+    const uint64_t mixes[] = { TICK, FRAME, SAMPLE, TICK | FRAME, TICK | TESTER | SAMPLE | FRAME | DEC };
+    for (uint64_t types : mixes)
+        for (int trial = 0; trial < 4; trial++) {
+            std::vector<uint32_t> w;
+            uint64_t time = WRAP_START;
+            generate(3 * codec::BLOCK_WORDS + rng() % codec::BLOCK_WORDS, types, w, time);
+            CHECK(time > 1u << 26);
+            CHECK(roundTrip(w) >= 3);
+        }
+
+    // one packet, of the shortest and the longest type
+    std::vector<uint32_t> w;
+    uint64_t time = WRAP_START;
+    generate(1, TICK, w, time);
+    CHECK(w.size() == 1 && roundTrip(w) == 1);
+    w.clear();
+    generate(1, FRAME, w, time);
+    CHECK(w.size() == 64 && roundTrip(w) == 1);
+
+    // a corrupt block is rejected
+    std::vector<uint32_t> out, back(64);
+    codec::encodeBlock(w.data(), w.size(), out);
+    bool threw = false;
+    try { codec::decodeBlock(out.data(), out.size() - 1, back.data(), 64); }
+    catch (Exception &) { threw = true; }
+    CHECK(threw);
+}
+
+
+// Steady Timestamps Pack into 0 Bits across the Wrap, and a Gap is an Exception
+// A block of one type has no type column, so its first column (the timestamps) begins at word 4.
+static void columns() {
+    std::vector<uint32_t> w, out;
+    uint32_t t = WRAP_START;
+    for (int i = 0; i < 10000; i++, t += 50)  w.push_back(1u << 26 | (t & TIME_MASK));
+    CHECK(codec::encodeBlock(w.data(), w.size(), out) == w.size());
+    CHECK((out[4] >> 8 & 0xFF) == 0);                   // width
+    CHECK(out[4] >> 16 == 0);                           // exceptions
+    CHECK(roundTrip(w) == 1);
+
+    for (size_t i = 5000; i < w.size(); i++)            // (a gap of 12 s in the middle)
+        w[i] = 1u << 26 | ((w[i] + 12345678) & TIME_MASK);
+    out.clear();
+    codec::encodeBlock(w.data(), w.size(), out);
+    CHECK((out[4] >> 8 & 0xFF) == 0);
+    CHECK(out[4] >> 16 == 1);
+    CHECK(out.size() < 16);
+    CHECK(roundTrip(w) == 1);
+}
+
+
+// A Query's Packets
+struct Collector {
+    struct Packet {
+        uint64_t time;
+        size_t offset;
+        std::vector<uint32_t> words;
+        bool operator==(const Packet &p) const { return time == p.time && offset == p.offset && words == p.words; }
+    };
+    std::vector<Packet> packets;
+
+    template<class P>
+    void operator()(const Record<P> &r) { packets.push_back({ r.time, r.offset, { r.words, r.words + P::length } }); }
+};
+
+
+// Remove an Archive's Files
+static void removeArchive(const char *base) {
+    static const char *const ext[] = { "seg", "segz", "idx" };
+    for (uint32_t i = 0; i < 100; i++)
+        for (const char *e : ext) {
+            char fn[300];
+            snprintf(fn, sizeof fn, "%s.%04u.%s", base, i, e);
+            unlink(fn);
+        }
+}
+
+
+// Queries of a Compressed Archive Match the Original's
+// The compressed segments' indexes are loaded from the original's sidecars, then rebuilt from the compressed
+// blocks; readers share a thread's cache, and threads query in parallel.
+static void archive() {
+    char dir[] = "/tmp/codec_testXXXXXX", base[100];
+    CHECK(mkdtemp(dir) != nullptr);
+    snprintf(base, sizeof base, "%s/a", dir);
+    std::vector<uint32_t> w;
+    uint64_t time = WRAP_START;
+    generate(600000, ArchiveReader::ALL_TYPES, w, time);
+    {
+        ArchiveWriter aw(base, ArchiveInfo{}, 1u << 20);
+        aw.append(w.data(), w.size());
+    }
+
+    uint64_t t0, t1;
+    const uint64_t some = ArchiveReader::typeMask(1) | ArchiveReader::typeMask(40);
+    Collector all, part;
+    std::vector<IndexBlock> index;
+    size_t segments;
+    {
+        ArchiveReader raw(base);
+        segments = raw.segments();
+        t0 = raw.first() + (raw.last() - raw.first()) / 3;
+        t1 = raw.first() + (raw.last() - raw.first()) * 2 / 3;
+        raw.query(0, ~0ull, ArchiveReader::ALL_TYPES, all);
+        raw.query(t0, t1, some, part);
+        for (size_t i = 0; i < segments; i++)
+            for (const IndexBlock &b : raw.segment(i).blocks)  index.push_back(b);
+    }
+    CHECK(segments >= 2);
+    CHECK(all.packets.size() > 10000 && part.packets.size() > 1000);
+
+    compressArchive(base, 2);
+    ArchiveReader loaded(base);
+    for (size_t i = 0; i < segments; i++) {
+        char fn[300];
+        snprintf(fn, sizeof fn, "%s.%04zu.idx", base, i);
+        CHECK(unlink(fn) == 0);
+    }
+    ArchiveReader built(base);
+    CHECK(loaded.segments() == segments && built.segments() == segments);
+    std::vector<IndexBlock> rebuilt;
+    for (size_t i = 0; i < segments; i++) {
+        CHECK(loaded.segment(i).words == nullptr && !loaded.segment(i).built);
+        CHECK(built.segment(i).built);
+        for (const IndexBlock &b : built.segment(i).blocks)  rebuilt.push_back(b);
+    }
+    CHECK(rebuilt.size() == index.size());
+    for (size_t k = 0; k < index.size() && k < rebuilt.size(); k++)
+        CHECK(memcmp(&index[k], &rebuilt[k], sizeof(IndexBlock)) == 0);
+
+    for (ArchiveReader *r : { &loaded, &built, &loaded }) {
+        Collector a, p;
+        r->query(0, ~0ull, ArchiveReader::ALL_TYPES, a);
+        r->query(t0, t1, some, p);
+        CHECK(a.packets == all.packets);
+        CHECK(p.packets == part.packets);
+    }
+
+    std::vector<Collector> perSegment(segments);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < segments; i++)
+        threads.emplace_back([&, i]() { built.querySegment(i, t0, t1, some, perSegment[i]); });
+    for (auto &t : threads)  t.join();
+    Collector joined;
+    for (const Collector &c : perSegment)
+        joined.packets.insert(joined.packets.end(), c.packets.begin(), c.packets.end());
+    CHECK(joined.packets == part.packets);
+
+    removeArchive(base);
+    rmdir(dir);
+}
+
+
+// Main
+int main() {
+    try {
+        blocks();
+        columns();
+        archive();
+    }
+    catch (Exception &e) {
+        printf("%s\n", e.what());
+        failures++;
+    }
+    return report("codec_test");
+}
@@ -0,0 +1,153 @@
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "common.h"
+#include "dapqueue.h"
+#include "peripherals.h"
+#include "simulator.h"
+#include "test.h"
+
+// DapQueue Test
+//
+// Runs several producer threads against one DapQueue on a FirmwareSim, and checks that each producer's requests
+// execute in its order, that each request is atomic, and that the Dap's failures reach the right caller
+
+
+
+static constexpr int SPOTTER   = 2;    // module whose frame buffer is used as plain 16-bit memory
+static constexpr int SHARED    = 100;  // address every producer writes then reads in one request
+static constexpr int PRODUCERS = 6;
+static constexpr int ROUNDS    = 2000;
+
+
+// Transport that Fails with a Non-Exception on a Chosen Address
+class FaultyTransport: public DapTransport {
+    DapTransport &t;
+public:
+    static constexpr int BAD = 200;     // address whose access throws std::runtime_error
+
+    explicit FaultyTransport(DapTransport &t) : t(t) {}
+    const char *name() override { return "faulty"; }
+    uint32_t read(int mod, int addr) override {
+        if (addr == BAD)  throw std::runtime_error("faulty read");
+        return t.read(mod, addr);
+    }
+    void write(int mod, int addr, uint32_t data) override {
+        if (addr == BAD)  throw std::runtime_error("faulty write");
+        t.write(mod, addr, data);
+    }
+    uint32_t usTime() override { return t.usTime(); }
+    uint32_t creationDate() override { return t.creationDate(); }
+    uint32_t buildDate() override { return t.buildDate(); }
+};
+
+
+// Each Producer's Requests Execute in Order, and Each Request is Atomic
+// Producer k counts up at its private address, reading each value back, and writes its id to a shared address
+// and reads it back in one request.
+static void producers() {
+    FirmwareSim sim("");
+    Dap dap;
+    dap.init(&sim);
+    DapQueue queue(dap);
+    std::atomic<int> wrongOrder(0), torn(0), failed(0);
+    std::vector<std::thread> threads;
+    for (int k = 0; k < PRODUCERS; k++)
+        threads.emplace_back([&, k]() {
+            try {
+                for (int i = 1; i <= ROUNDS; i++) {
+                    queue.write(SPOTTER, k, uint32_t(i));
+                    if (queue.read(SPOTTER, k) != uint32_t(i))  wrongOrder++;
+                    DapOp ops[] = { {DapOp::WRITE, SPOTTER, SHARED, uint32_t(k + 1), 0},
+                                    {DapOp::READ, SPOTTER, SHARED, 0, 0} };
+                    uint32_t results[2];
+                    queue.execute(ops, 2, results);
+                    if (results[1] != uint32_t(k + 1))  torn++;
+                }
+            }
+            catch (Exception &) { failed++; }
+        });
+    for (auto &t : threads)  t.join();
+    CHECK(wrongOrder == 0);
+    CHECK(torn == 0);
+    CHECK(failed == 0);
+    for (int k = 0; k < PRODUCERS; k++)  CHECK(sim.read(SPOTTER, k) == ROUNDS);
+    DapQueue::Stats st = queue.stats();
+    CHECK(st.requests == uint64_t(PRODUCERS) * ROUNDS * 3);
+    CHECK(st.maxDepth >= 1);
+}
+
+
+// Completion Function that Records a Posted Request's Result
+struct Posted {
+    std::atomic<int> calls;
+    bool failed;
+    char msg[200];
+};
+
+static void notify(void *ctx, bool failed, const char *msg) {
+    Posted *p = (Posted *) ctx;
+    p->failed = failed;
+    strCpy(p->msg, sizeof p->msg, failed  ?  msg  :  "");
+    p->calls++;
+}
+
+
+// A Failure Reaches Only its Caller, and the Queue Keeps Working
+// Covers an Exception (module out of range), a std::runtime_error from the transport, and a posted request's
+// failure.
+static void failurePropagation() {
+    FirmwareSim sim("");
+    FaultyTransport faulty(sim);
+    Dap dap;
+    dap.init(&faulty);
+    DapQueue queue(dap);
+    std::atomic<int> good(0), wrongMsg(0);
+    std::vector<std::thread> threads;
+    for (int k = 0; k < PRODUCERS; k++)
+        threads.emplace_back([&, k]() {
+            for (int i = 0; i < 200; i++) {
+                int kind = (k + i) % 3;
+                try {
+                    if (kind == 0)  queue.read(200, 0);
+                    else if (kind == 1)  queue.write(SPOTTER, FaultyTransport::BAD, 1);
+                    else { queue.write(SPOTTER, k, uint32_t(i));  good += queue.read(SPOTTER, k) == uint32_t(i);  continue; }
+                    wrongMsg++;                     // (no exception)
+                }
+                catch (Exception &e) {
+                    if (kind == 0 && strstr(e.what(), "Module Out of Range") == nullptr)  wrongMsg++;
+                    if (kind == 1 && strcmp(e.what(), "faulty write") != 0)  wrongMsg++;
+                }
+            }
+        });
+    for (auto &t : threads)  t.join();
+    CHECK(wrongMsg == 0);
+    CHECK(good > 0);
+
+    Posted ok = {}, bad = {};
+    DapOp good1[] = { {DapOp::READ, SPOTTER, 0, 0, 0} };
+    DapOp bad1[] = { {DapOp::READ, SPOTTER, FaultyTransport::BAD, 0, 0} };
+    uint32_t r1, r2;
+    queue.post(good1, 1, &r1, notify, &ok);
+    queue.post(bad1, 1, &r2, notify, &bad);
+    queue.read(SPOTTER, 0);                 // (completes after both posted requests)
+    CHECK(ok.calls == 1 && !ok.failed);
+    CHECK(bad.calls == 1 && bad.failed && strcmp(bad.msg, "faulty read") == 0);
+}
+
+
+// Main
+int main() {
+    try {
+        producers();
+        failurePropagation();
+    }
+    catch (Exception &e) {
+        printf("%s\n", e.what());
+        failures++;
+    }
+    return report("dapqueue_test");
+}
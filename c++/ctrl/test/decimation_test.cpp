@@ -0,0 +1,252 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "common.h"
+#include "decimation.h"
+#include "telemetry.h"
+#include "test.h"
+
+// Adaptive Decimation Controller Test
+//
+// Feeds DecimationController synthetic streams of captured packets, and checks the decimations retune() computes
+// from them (the shares' arithmetic, hysteresis, halving, and bursts), and where observe() and placed() put the
+// `decimation` packet, including after a packet split between two observe() calls.  Built with TELEMETRY_DEF =
+// test/codec_test.def (see the Makefile), whose packets arrive on ports 0 (tester, 2 words), 1 (tick, 1 word),
+// 2 (sample, 5 words), and 5 (frame, 64 words).
+
+
+
+using namespace telemetry;
+
+typedef DecimationController DC;
+
+static constexpr uint32_t BUFFER = 65536;          // DCM buffer's words
+
+
+// Append Packets
+// in: count = number of packets
+//     time = their timestamp (usTime)
+// in out: w = count packets of type P are appended
+template<class P> static void add(std::vector<uint32_t> &w, int count, uint32_t time) {
+    for (int k = 0; k < count; k++) {
+        w.push_back(P::type << 26 | (time & TIME_MASK));
+        w.insert(w.end(), P::length - 1, 0);
+    }
+}
+
+
+// Observe Words that Need No Insertion
+static void feed(DC &c, const std::vector<uint32_t> &w) {
+    bool insert;
+    CHECK(c.observe(w.data(), w.size(), insert) == w.size());
+    CHECK(!insert);
+}
+
+
+// Retune after a 1 s Interval, and Apply the Change at once
+// out: next = new decimations
+//      returns retune()'s result
+static bool retune(DC &c, uint16_t next[DC::PORTS], uint32_t usTime = 0) {
+    bool changing = c.retune(1.0, next);
+    if (changing) {
+        c.changed(next, usTime);
+        c.placed();
+    }
+    return changing;
+}
+
+
+// A Policy
+static DecimationPolicy policy(double fillSeconds, double s0, double s1, double s2, double s5, uint32_t interest) {
+    return { fillSeconds, { s0, s1, s2, 0, 0, s5 }, interest, 1.0 };
+}
+
+
+// Each Port's Decimation is its Offered Words over its Share of the Budget
+// fillSeconds = 8.192 s is a budget of 8000 words/s; ports 0, 1, 2, and 5 have shares 1, 0 (as 1), 2, and 4 of 8,
+// i.e. 1000, 1000, 2000, and 4000 words/s.  They offer 6000, 1000, 10000, and 32000 words/s:  decimations 6, 1
+// (unchanged), 5, and 8.  Ports 3 and 4 are disabled and stay so.
+static void shares() {
+    const uint16_t dec[DC::PORTS] = { 1, 1, 1, 0, 0, 1 };
+    DC c(policy(8.192, 1, 0, 2, 4, 0), BUFFER, dec);
+    std::vector<uint32_t> w;
+    add<tester::packet>(w, 3000, 100);
+    add<tick::packet>(w, 1000, 200);
+    add<sample::packet>(w, 2000, 300);
+    add<frame::packet>(w, 500, 400);
+    feed(c, w);
+    uint16_t next[DC::PORTS];
+    CHECK(c.retune(1.0, next));
+    const uint16_t expect[DC::PORTS] = { 6, 1, 5, 0, 0, 8 };
+    CHECK(memcmp(next, expect, sizeof next) == 0);
+    CHECK(c.rate() == 49000);
+    CHECK(c.stats(0).rate == 3000 && c.stats(0).words == 6000 && c.stats(5).words == 32000);
+    CHECK(c.stats(3).packets == 0 && c.stats(5).packets == 500);
+
+    // the `decimation` packet holds the new decimations, and its timestamp is usTime's
+    c.changed(next, 0x04000123);
+    const uint32_t *a = c.packet();
+    CHECK(a[0] == (decimation::packet::type << 26 | 0x123));
+    CHECK(a[1] == (1u << 16 | 6) && a[2] == 5 && a[3] == 8u << 16);
+    CHECK(memcmp(c.decimation(), expect, sizeof expect) == 0);
+    CHECK(c.count() == 1);
+}
+
+
+// Small Changes are not Made, Large Ones are, a Falling Rate Lowers the Decimation Gradually, and a Silent Port's
+// Decimation is Halved
+// Only port 0 is enabled, with a budget of 1000 words/s.  Packets are counted at the decimation they were
+// captured at (so 583 packets at decimation 6 offer 3498 packets/s, i.e. 6996 words/s).
+static void hysteresis() {
+    const uint16_t dec[DC::PORTS] = { 1, 0, 0, 0, 0, 0 };
+    DC c(policy(65.536, 1, 0, 0, 0, 0), BUFFER, dec);
+    uint16_t next[DC::PORTS];
+    std::vector<uint32_t> w;
+
+    add<tester::packet>(w, 3000, 0);                            // 6000 words/s:  1 -> 6
+    feed(c, w);
+    CHECK(retune(c, next) && next[0] == 6);
+
+    w.clear();
+    add<tester::packet>(w, 583, 0);                             // 6996 words/s:  7 is within 1.25 of 6
+    feed(c, w);
+    CHECK(!retune(c, next) && next[0] == 6);
+    CHECK(c.stats(0).words == 6996);
+
+    w.clear();
+    add<tester::packet>(w, 700, 0);                             // 8400 words/s:  9 is not
+    feed(c, w);
+    CHECK(retune(c, next) && next[0] == 9);
+
+    // the average is 6000, 6249, 6786.75, then 5540.06 words/s:  the decimation falls to 6, not 2
+    w.clear();
+    add<tester::packet>(w, 100, 0);                             // 1800 words/s
+    feed(c, w);
+    CHECK(retune(c, next) && next[0] == 6);
+    CHECK(c.stats(0).averageWords > 5540 && c.stats(0).averageWords < 5541);
+
+    CHECK(retune(c, next) && next[0] == 3);                     // no packets:  halved
+    CHECK(retune(c, next) && next[0] == 1);
+    CHECK(!retune(c, next) && next[0] == 1);
+}
+
+
+// A Burst Raises the Ports of Interest's Rate, until BURST_HOLD s after its Last Interval
+// Ports 0 and 1 share a budget of 2000 words/s; port 1 is of interest.  Normally they take decimations 2 and 8.
+// Then port 0 offers 5000 packets/s, more than BURST_FACTOR times its 1000 packets/s average:  port 0 is retuned to
+// 10, and port 1 to 8 / BURST_GAIN = 1, until the burst ends 5 intervals later.
+static void burst() {
+    const uint16_t dec[DC::PORTS] = { 1, 1, 0, 0, 0, 0 };
+    DC c(policy(32.768, 1, 1, 0, 0, 1u << 1), BUFFER, dec);
+    uint16_t next[DC::PORTS];
+    std::vector<uint32_t> w;
+    add<tester::packet>(w, 1000, 0);
+    add<tick::packet>(w, 8000, 0);
+    feed(c, w);
+    CHECK(retune(c, next) && next[0] == 2 && next[1] == 8);
+    CHECK(!c.bursting());
+
+    w.clear();                                                  // a few more packets than usual do not start one
+    add<tester::packet>(w, 500, 0);
+    add<tick::packet>(w, 1000, 0);
+    feed(c, w);
+    CHECK(!retune(c, next) && !c.bursting());
+
+    w.clear();
+    add<tester::packet>(w, 2500, 0);                            // 5000 offered packets/s
+    add<tick::packet>(w, 1000, 0);
+    feed(c, w);
+    CHECK(retune(c, next) && next[0] == 10 && next[1] == 1);
+    CHECK(c.bursting());
+
+    for (int k = 1; k <= DC::BURST_HOLD; k++) {                // steady rates at the new decimations
+        w.clear();
+        add<tester::packet>(w, 500, 0);
+        add<tick::packet>(w, 8000, 0);
+        feed(c, w);
+        bool changing = retune(c, next);
+        if (k < DC::BURST_HOLD) {
+            CHECK(!changing && c.bursting());
+        }
+        else {
+            CHECK(changing && next[0] == 10 && next[1] == 8);
+            CHECK(!c.bursting());
+        }
+    }
+}
+
+
+// The `decimation` Packet is Inserted before the First Packet at or after its Time
+// in: T = its timestamp
+static void placement() {
+    const uint32_t T = 0x03FFFFF0;                              // (the packets' times wrap at 2**26)
+    const uint16_t dec[DC::PORTS] = { 1, 1, 1, 0, 0, 1 };
+    DC c(policy(8.192, 1, 1, 1, 1, 0), BUFFER, dec);
+    uint16_t next[DC::PORTS] = { 4, 1, 1, 0, 0, 1 };
+    bool insert;
+
+    // in one call:  stops at the packet at T, and observes the rest at the new decimation
+    c.changed(next, T);
+    std::vector<uint32_t> w;
+    add<tester::packet>(w, 3, T - 20);
+    add<tick::packet>(w, 1, T - 1);
+    size_t before = w.size();
+    add<tester::packet>(w, 2, T);
+    add<tester::packet>(w, 1, T + 0x20);                        // (after the wrap)
+    CHECK(c.observe(w.data(), w.size(), insert) == before);
+    CHECK(insert);
+    CHECK(c.observe(w.data() + before, w.size() - before, insert) == 0 && insert);     // (until placed())
+    c.placed();
+    CHECK(c.observe(w.data() + before, w.size() - before, insert) == w.size() - before && !insert);
+    uint16_t got[DC::PORTS];
+    c.retune(1.0, got);
+    CHECK(c.stats(0).rate == 3 * 1 + 3 * 4);                    // tester packets weighted by their decimation
+
+    // across two calls:  a frame packet before T is cut off by the first; the second stops just after the frame
+    c.changed(next, T + 100);
+    w.clear();
+    add<frame::packet>(w, 1, T + 90);
+    add<tick::packet>(w, 1, T + 100);
+    CHECK(c.observe(w.data(), 30, insert) == 30 && !insert);
+    CHECK(c.observe(w.data() + 30, w.size() - 30, insert) == 34 && insert);
+    c.placed();
+    CHECK(c.observe(w.data() + 64, 1, insert) == 1 && !insert);
+
+    // a packet at T begins the second call:  insert before any of its words
+    c.changed(next, T + 200);
+    w.clear();
+    add<sample::packet>(w, 1, T + 150);
+    add<sample::packet>(w, 1, T + 200);
+    CHECK(c.observe(w.data(), 5, insert) == 5 && !insert);
+    CHECK(c.observe(w.data() + 5, 5, insert) == 0 && insert);
+    c.placed();
+
+    // no packet at or after T by the next retuning:  no change is made, and the packet goes at the next boundary
+    c.changed(next, T + 1000);
+    w.clear();
+    add<frame::packet>(w, 2, T + 300);
+    CHECK(c.observe(w.data(), 100, insert) == 100 && !insert);
+    CHECK(!c.retune(1.0, got));
+    CHECK(memcmp(got, c.decimation(), sizeof got) == 0);
+    CHECK(c.observe(w.data() + 100, 10, insert) == 10 && !insert);   // (the rest of the second frame first)
+    CHECK(c.observe(w.data() + 110, 18, insert) == 18 && insert);
+    c.placed();
+    CHECK(c.observe(w.data() + 128, 0, insert) == 0 && !insert);
+    CHECK(c.count() == 4);
+}
+
+
+// Main
+int main() {
+    try {
+        shares();
+        hysteresis();
+        burst();
+        placement();
+    }
+    catch (Exception &e) {
+        printf("%s\n", e.what());
+        failures++;
+    }
+    return report("decimation_test");
+}
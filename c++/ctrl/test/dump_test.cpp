@@ -0,0 +1,203 @@
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "common.h"
+#include "dump.h"
+#include "test.h"
+
+// Serial Dump Receiver Test
+//
+// Feeds DCM dumps to a DumpReceiver through a pipe (standing in for the serial port), and checks the files it
+// writes, that it keeps reading while its file's writes lag, and that it reports late, stalled, truncated, and
+// corrupt dumps
+
+
+
+static constexpr unsigned BAUD = 921600;
+
+static char dir[] = "/tmp/dump_testXXXXXX";
+
+
+// A Dump's Bytes
+// in: words = data words
+// out: returns the length field, the words, and the checksum
+static std::vector<uint8_t> dumpOf(const std::vector<uint32_t> &words) {
+    std::vector<uint32_t> w = { uint32_t(words.size()) };
+    uint32_t sum = 0;
+    for (uint32_t x : words) { w.push_back(x);  sum += x; }
+    w.push_back(0xFFFFFFFF - sum);
+    std::vector<uint8_t> b(w.size() * 4);
+    memcpy(b.data(), w.data(), b.size());
+    return b;
+}
+
+
+// Random Data Words
+static std::vector<uint32_t> randomWords(size_t n) {
+    std::vector<uint32_t> w(n);
+    for (size_t i = 0; i < n; i++)  w[i] = uint32_t(rand()) << 16 ^ uint32_t(rand());
+    return w;
+}
+
+
+// Port Writer Thread:  writes bytes to the pipe in pieces, with a pause between them, then a pause, and closes it
+struct PortWriter {
+    std::thread t;
+
+    PortWriter(int fd, std::vector<uint8_t> b, size_t piece, int pauseUs, int holdUs) {
+        t = std::thread([fd, b, piece, pauseUs, holdUs]() {
+            for (size_t i = 0; i < b.size(); i += piece) {
+                if (::write(fd, b.data() + i, std::min(piece, b.size() - i)) < 0)  break;   // (the receiver quit)
+                if (pauseUs > 0)  usleep(pauseUs);
+            }
+            usleep(holdUs);
+            close(fd);
+        });
+    }
+    ~PortWriter() { t.join(); }
+};
+
+
+// Read a File
+static std::vector<uint8_t> readAll(const char *fn) {
+    std::vector<uint8_t> b;
+    FILE *f = fopen(fn, "rb");
+    if (f == nullptr)  return b;
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof buf, f)) > 0)  b.insert(b.end(), buf, buf + n);
+    fclose(f);
+    return b;
+}
+
+
+// Receive a Dump through a Pipe
+// in: b = the port's bytes
+//     piece, pauseUs, holdUs = as PortWriter's
+//     fn = file to write
+// out: st = the statistics, if it succeeds
+//      returns the exception's message, or "" if it succeeds
+static std::string receive(const std::vector<uint8_t> &b, size_t piece, int pauseUs, int holdUs, const char *fn,
+                           DumpReceiver::Stats &st) {
+    int fds[2];
+    if (pipe(fds) != 0)  throwException("Cannot create a pipe: %s", strerror(errno));
+    std::string msg;
+    {
+        PortWriter w(fds[1], b, piece, pauseUs, holdUs);
+        DumpReceiver rx(fds[0], BAUD);
+        rx.progress = false;
+        try { st = rx.receive(fn); }
+        catch (Exception &e) { msg = e.what(); }
+        close(fds[0]);                                      // (so a writer still writing fails)
+    }
+    return msg;
+}
+
+
+// A Dump Arrives in Pieces, and Bytes after its Checksum are Ignored
+static void pieces() {
+    char fn[100];
+    snprintf(fn, sizeof fn, "%s/a.bin", dir);
+    for (size_t piece : { size_t(1), size_t(3), size_t(4096), size_t(100000) }) {
+        std::vector<uint32_t> words = randomWords(piece < 4096  ?  2000  :  50000);
+        std::vector<uint8_t> b = dumpOf(words);
+        b.insert(b.end(), { 1, 2, 3 });
+        DumpReceiver::Stats st;
+        std::string msg = receive(b, piece, piece == 1  ?  0  :  100, 0, fn, st);
+        CHECK(msg == "");
+        if (msg != "")  printf("%s\n", msg.c_str());
+        CHECK(st.words == words.size());
+        CHECK(st.bytes == b.size() && st.extra == 3);
+        std::vector<uint8_t> f = readAll(fn);
+        CHECK(f.size() == words.size() * 4 && memcmp(f.data(), words.data(), f.size()) == 0);
+    }
+    unlink(fn);
+}
+
+
+// The Receiver Keeps Reading while its File's Writes Lag
+// The file is a FIFO whose reader does not read for LAG_MS, so the receiver's writes block, and the dump (longer
+// than the ring and both pipes' buffers) must wait in the ring and the port's pipe meanwhile, without a stall.
+static void lag() {
+    static constexpr int LAG_MS = 400;
+    char fn[100];
+    snprintf(fn, sizeof fn, "%s/fifo", dir);
+    CHECK(mkfifo(fn, 0600) == 0);
+    std::vector<uint32_t> words = randomWords(200000);      // (800 KB)
+    std::vector<uint8_t> got;
+    std::thread slow([&]() {
+        int fd = open(fn, O_RDONLY);
+        usleep(LAG_MS * 1000);
+        uint8_t buf[65536];
+        ssize_t n;
+        while ((n = ::read(fd, buf, sizeof buf)) > 0)  got.insert(got.end(), buf, buf + n);
+        close(fd);
+    });
+    DumpReceiver::Stats st;
+    std::string msg = receive(dumpOf(words), 4096, 200, 0, fn, st);
+    slow.join();
+    CHECK(msg == "");
+    if (msg != "")  printf("%s\n", msg.c_str());
+    CHECK(st.words == words.size());
+    CHECK(st.maxQueued == DumpReceiver::RING_CHUNKS);
+    CHECK(st.waitMs > LAG_MS / 4);
+    CHECK(st.maxGapMs < DumpReceiver::STALL_MS);
+    CHECK(got.size() == words.size() * 4 && memcmp(got.data(), words.data(), got.size()) == 0);
+    unlink(fn);
+}
+
+
+// Late, Stalled, Truncated, and Corrupt Dumps are Reported
+static void badDumps() {
+    char fn[100];
+    snprintf(fn, sizeof fn, "%s/b.bin", dir);
+    std::vector<uint8_t> b = dumpOf(randomWords(10000));
+    DumpReceiver::Stats st;
+
+    std::string msg = receive({}, 1, 0, (DumpReceiver::TIMEOUT_MS + 200) * 1000, fn, st);
+    CHECK(msg.find("No Debug Capture Module dump received") != std::string::npos);
+
+    std::vector<uint8_t> half(b.begin(), b.begin() + b.size() / 2);
+    msg = receive(half, 4096, 0, (DumpReceiver::STALL_MS + 200) * 1000, fn, st);
+    CHECK(msg.find("truncated") != std::string::npos);
+    CHECK(msg.find("then none for") != std::string::npos);
+    msg = receive(half, 4096, 0, 0, fn, st);                        // (end of file)
+    CHECK(msg.find("truncated") != std::string::npos);
+
+    std::vector<uint8_t> bad = b;
+    bad[100] ^= 1;
+    msg = receive(bad, 4096, 0, 0, fn, st);
+    CHECK(msg.find("invalid checksum") != std::string::npos);
+
+    std::vector<uint8_t> huge = { 0xFF, 0xFF, 0xFF, 0xFF };
+    msg = receive(huge, 4, 0, 0, fn, st);
+    CHECK(msg.find("invalid length field") != std::string::npos);
+    unlink(fn);
+}
+
+
+// Main
+int main() {
+    signal(SIGPIPE, SIG_IGN);                               // (a PortWriter may outlive its receiver)
+    try {
+        if (mkdtemp(dir) == nullptr)  throwException("Cannot create %s: %s", dir, strerror(errno));
+        pieces();
+        lag();
+        badDumps();
+        rmdir(dir);
+    }
+    catch (Exception &e) {
+        printf("%s\n", e.what());
+        failures++;
+    }
+    return report("dump_test");
+}
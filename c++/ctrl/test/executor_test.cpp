@@ -0,0 +1,154 @@
+#include <cstdio>
+#include <cstring>
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <vector>
+#include "common.h"
+#include "dapqueue.h"
+#include "executor.h"
+#include "peripherals.h"
+#include "simulator.h"
+#include "test.h"
+
+// DapExecutor Test
+//
+// Posts requests through a DapExecutor to a DapQueue on a FirmwareSim, and checks the futures' results, when
+// they become ready, their continuations, and how failures surface
+
+
+
+static constexpr int SPOTTER = 2;      // module whose frame buffer is used as plain 16-bit memory
+static constexpr int BAD_MOD = 200;    // module out of range:  the Dap throws an Exception
+
+
+// Results, ready(), and then()
+// A future becomes ready only inside the executor's loop; then() on a pending future runs there, in completion
+// order, and then() on a ready future runs at once.
+static void results() {
+    FirmwareSim sim("");
+    for (int a = 0; a < 1024; a++)  sim.write(SPOTTER, a, uint32_t(a * 7) & 0xFFFF);
+    Dap dap;
+    dap.init(&sim);
+    DapQueue queue(dap);
+    DapExecutor ex(queue);
+
+    DapFuture none;
+    CHECK(!none.valid() && !none.ready());
+
+    DapFuture w = ex.write(SPOTTER, 5, 1234);
+    DapFuture r = ex.read(SPOTTER, 5);
+    DapFuture b = ex.readBlock(SPOTTER, 0, 1024);
+    CHECK(w.valid() && !w.ready() && !r.ready() && !b.ready());
+    CHECK(ex.inFlight() == 3);
+
+    std::vector<int> order;
+    w.then([&order](DapFuture &f) { CHECK(f.ready());  order.push_back(0); });
+    r.then([&order](DapFuture &f) { CHECK(f.value() == 1234);  order.push_back(1); });
+    b.then([&order](DapFuture &)  { order.push_back(2); });
+    usleep(20000);                          // (the issuing thread has completed them, but nobody ran the loop)
+    CHECK(!w.ready() && order.empty());
+    ex.run();
+    CHECK(ex.inFlight() == 0);
+    CHECK(w.ready() && r.ready() && b.ready());
+    CHECK((order == std::vector<int>{0, 1, 2}));
+    CHECK(r.value() == 1234);
+    const std::vector<uint32_t> &words = b.get();
+    CHECK(words.size() == 1024 && words[5] == 1234 && words[1000] == (1000 * 7 & 0xFFFF));
+
+    bool now = false;
+    r.then([&now](DapFuture &) { now = true; });
+    CHECK(now);
+
+    DapOp ops[] = { {DapOp::WRITE, SPOTTER, 9, 99, 0}, {DapOp::READ, SPOTTER, 9, 0, 0} };
+    DapFuture e = ex.execute(ops, 2);
+    CHECK(e.get().size() == 2 && e.get()[1] == 99);      // (get() runs the loop until ready)
+}
+
+
+// Failure Paths
+// A failed request's get() throws the Dap's message, its continuation still runs, a continuation's exception
+// propagates out of the loop without losing the other continuations, and misuse of a future throws.
+static void failurePaths() {
+    FirmwareSim sim("");
+    Dap dap;
+    dap.init(&sim);
+    DapQueue queue(dap);
+    DapExecutor ex(queue), other(queue);
+
+    DapFuture bad = ex.read(BAD_MOD, 0);
+    bool sawFailure = false;
+    bad.then([&sawFailure](DapFuture &f) {
+        try { f.get(); }
+        catch (Exception &e) { sawFailure = strstr(e.what(), "Module Out of Range") != nullptr; }
+    });
+    ex.run();
+    CHECK(bad.ready() && sawFailure);
+    bool threw = false;
+    try { bad.value(); }
+    catch (Exception &) { threw = true; }
+    CHECK(threw);
+
+    DapFuture r1 = ex.read(SPOTTER, 0), r2 = ex.read(SPOTTER, 1);
+    bool second = false;
+    r1.then([](DapFuture &) { throwException("continuation failed"); });
+    r2.then([&second](DapFuture &) { second = true; });
+    threw = false;
+    try { while (ex.inFlight() != 0)  ex.runOnce(); }
+    catch (Exception &e) { threw = strcmp(e.what(), "continuation failed") == 0; }
+    CHECK(threw);
+    if (ex.inFlight() != 0)  ex.run();
+    CHECK(second);
+
+    DapFuture none;
+    threw = false;
+    try { none.get(); }
+    catch (Exception &) { threw = true; }
+    CHECK(threw);
+    threw = false;
+    try { other.runUntil(r1); }
+    catch (Exception &) { threw = true; }
+    CHECK(threw);
+
+    DapFuture good = ex.read(SPOTTER, 2);
+    CHECK(good.value() == 0);                            // (the queue and executor still work)
+}
+
+
+// Watched File Descriptors Are Served with the Futures
+static void watch() {
+    FirmwareSim sim("");
+    Dap dap;
+    dap.init(&sim);
+    DapQueue queue(dap);
+    DapExecutor ex(queue);
+    int fds[2];
+    CHECK(pipe(fds) == 0);
+    char c = 0;
+    int calls = 0;
+    ex.watch(fds[0], EPOLLIN, [&](uint32_t events) {
+        if (events & EPOLLIN)  CHECK(::read(fds[0], &c, 1) == 1);
+        calls++;
+        ex.unwatch(fds[0]);
+    });
+    CHECK(::write(fds[1], "x", 1) == 1);
+    DapFuture r = ex.read(SPOTTER, 0);
+    while (calls == 0 || !r.ready())  ex.runOnce(1000);
+    CHECK(calls == 1 && c == 'x');
+    close(fds[0]);
+    close(fds[1]);
+}
+
+
+// Main
+int main() {
+    try {
+        results();
+        failurePaths();
+        watch();
+    }
+    catch (Exception &e) {
+        printf("%s\n", e.what());
+        failures++;
+    }
+    return report("executor_test");
+}
@@ -0,0 +1,69 @@
+#include <atomic>
+#include <cstdio>
+#include <stdexcept>
+#include <unistd.h>
+#include <vector>
+#include "common.h"
+#include "pool.h"
+#include "test.h"
+
+// WorkStealingPool Test
+//
+// Checks that every task runs exactly once, on any number of threads, and that the first exception a task throws,
+// of any type, comes out of run()
+
+
+
+// Every Task Runs Once
+static void allTasks() {
+    for (unsigned threads : {1u, 3u, 8u}) {
+        WorkStealingPool pool(threads);
+        std::vector<std::atomic<int>> runs(1000);
+        pool.run(runs.size(), [&](unsigned, size_t task) {
+            if (task % 97 == 0)  usleep(1000);                  // (slow tasks, so idle workers steal)
+            runs[task]++;
+        });
+        bool once = true;
+        for (auto &r : runs)  once = once && r == 1;
+        CHECK(once);
+        pool.run(0, [](unsigned, size_t) { CHECK(false); });
+    }
+}
+
+
+// A Task's Exception Reaches run()'s Caller
+static void exceptions() {
+    WorkStealingPool pool(4);
+    bool caught = false;
+    try { pool.run(100, [](unsigned, size_t task) { if (task == 42)  throwException("task %zu failed", task); }); }
+    catch (const Exception &e) { caught = strEq(e.what(), "task 42 failed"); }
+    CHECK(caught);
+
+    caught = false;
+    try { pool.run(100, [](unsigned, size_t task) { if (task == 7)  throw std::runtime_error("not an Exception"); }); }
+    catch (const std::runtime_error &e) { caught = strEq(e.what(), "not an Exception"); }
+    CHECK(caught);
+
+    caught = false;
+    try { pool.run(100, [](unsigned, size_t) { throw 5; }); }
+    catch (int x) { caught = x == 5; }
+    CHECK(caught);
+
+    std::atomic<size_t> n(0);
+    pool.run(100, [&n](unsigned, size_t) { n++; });             // (the pool is still usable)
+    CHECK(n == 100);
+}
+
+
+// Main
+int main() {
+    try {
+        allTasks();
+        exceptions();
+    }
+    catch (Exception &e) {
+        printf("%s\n", e.what());
+        failures++;
+    }
+    return report("pool_test");
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <poll.h>
+#include <thread>
+#include <unistd.h>
+#include "common.h"
+#include "simulator.h"
+#include "transport.h"
+
+
+/* -----  Serial Firmware Stand-In  -----
+ *
+ * Serves the Debug Serial Port's protocol (see SerialTransport) on a pseudo-terminal, with a FirmwareSim as the
+ * firmware's registers, so SerialTransport and SerialPipeline can be tested without a board.  A thread parses
+ * command packets from the pty's master side, executes them in order, and answers reads; corrupt commands and filler
+ * bytes are discarded, as the firmware does.  drop, if set, is asked before each read's response is sent, and the
+ * response is not sent if it returns true (the read still executes), which forces the client to resynchronize.
+ */
+class SerialFirmware {
+
+private:
+    FirmwareSim &sim;
+    int master;                     // pty's master side
+    char slave[64];                 // pty's slave side's device
+    std::atomic<bool> stopping;
+    std::thread thread;
+
+    void serve() {
+        uint8_t b[4096];
+        size_t n = 0;
+        while (!stopping) {
+            struct pollfd pfd = { master, POLLIN, 0 };
+            if (::poll(&pfd, 1, 10) <= 0)  continue;
+            ssize_t k = ::read(master, b + n, sizeof b - n);
+            if (k <= 0)  continue;
+            n += size_t(k);
+            size_t i = 0;
+            while (i < n) {
+                if (b[i] != SerialTransport::COMMAND_HEADER) { i++;  continue; }
+                if (n - i < 5)  break;
+                uint32_t cmd = b[i+1] | b[i+2] << 8 | b[i+3] << 16 | uint32_t(b[i+4]) << 24;
+                size_t len = cmd >> 31  ?  6  :  10;
+                if (n - i < len)  break;
+                if (b[i + len - 1] != SerialTransport::checksum(b + i + 1, len - 2)) { i++;  continue; }
+                int mod = cmd >> 24 & 127, addr = cmd & 0xFFFFFF;
+                if (cmd >> 31) {
+                    uint32_t x = sim.read(mod, addr);
+                    if (!(drop && drop(mod, addr))) {
+                        uint8_t r[6] = { SerialTransport::RESPONSE_HEADER, uint8_t(x), uint8_t(x >> 8), uint8_t(x >> 16),
+                                         uint8_t(x >> 24), 0 };
+                        r[5] = SerialTransport::checksum(r + 1, 4);
+                        if (::write(master, r, 6) != 6)  return;
+                    }
+                    else  dropped++;
+                }
+                else  sim.write(mod, addr, b[i+5] | b[i+6] << 8 | b[i+7] << 16 | uint32_t(b[i+8]) << 24);
+                i += len;
+            }
+            memmove(b, b + i, n - i);
+            n -= i;
+        }
+    }
+
+public:
+    std::function<bool(int mod, int addr)> drop;    // returns true to drop a read's response (set before start())
+    std::atomic<int> dropped;                       // number of responses dropped
+
+    explicit SerialFirmware(FirmwareSim &sim) : sim(sim), stopping(false), dropped(0) {
+        master = posix_openpt(O_RDWR | O_NOCTTY);
+        if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)  throwException("Cannot open a pty");
+        strCpy(slave, sizeof slave, ptsname(master));
+    }
+    ~SerialFirmware() {
+        stopping = true;
+        if (thread.joinable())  thread.join();
+        close(master);
+    }
+    const char *device() { return slave; }
+    void start() { thread = std::thread(&SerialFirmware::serve, this); }
+};
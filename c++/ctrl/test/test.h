@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdio>
+
+// Unit Test Helpers
+//
+// Each test program checks its conditions with CHECK(), and returns report()'s value from main(), so "make test"
+// stops at the first program with a failure.
+
+
+
+static int failures = 0;        // number of failed checks
+
+
+// Check a Condition
+// Prints the condition and its location if it is false, and counts the failure.
+#define CHECK(cond)  do { if (!(cond)) { printf("FAILED at %s:%d:  %s\n", __FILE__, __LINE__, #cond);  failures++; } } while (0)
+
+
+// Report the Test Program's Result
+// in: name = test program's name
+// out: returns main()'s exit code (0 if every check passed)
+static int report(const char *name) {
+    if (failures == 0)  printf("%-24s passed\n", name);
+    else  printf("%-24s %d checks FAILED\n", name, failures);
+    return failures == 0  ?  0  :  1;
+}
@@ -0,0 +1,163 @@
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <time.h>
+#include "common.h"
+#include "peripherals.h"
+#include "timebase.h"
+
+// PL/Host Timebase
+//
+// Samples the PL's usTime against the host's CLOCK_MONOTONIC_RAW, and fits their offset and drift
+
+
+
+static constexpr uint32_t MASK = regmap::bio::usTime::mask;     // usTime's bits (modulo 2**26)
+
+
+// Constructor
+// in: dap = initialized DAP
+Timebase::Timebase(Dap &dap) : dap(dap), host0(0), pl0(0), a(0), b(1), last(0), interval(INTERVAL) {
+    memset(&st, 0, sizeof st);
+    window.reserve(WINDOW);
+}
+
+
+// Get the Host's Time
+// out: returns CLOCK_MONOTONIC_RAW in nanoseconds
+int64_t Timebase::hostNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+
+// Fit the Model to the Window's Rounds
+void Timebase::fit() {
+    size_t n = window.size();
+    double mx = 0, my = 0;
+    for (const Round &r : window) {
+        mx += double(r.host - host0) * 1e-3;
+        my += double(r.pl - pl0);
+    }
+    mx /= n;
+    my /= n;
+    double sxx = 0, sxy = 0;
+    for (const Round &r : window) {
+        double x = double(r.host - host0) * 1e-3 - mx, y = double(r.pl - pl0) - my;
+        sxx += x * x;
+        sxy += x * y;
+    }
+    b = sxx >= 1  ?  sxy / sxx  :  1.0;                    // (rounds less than 1 us apart give no slope)
+    a = my - b * mx;
+    double ss = 0;
+    for (const Round &r : window) {
+        double e = double(r.pl - pl0) - a - b * double(r.host - host0) * 1e-3;
+        ss += e * e;
+    }
+    st.rms = std::sqrt(ss / n);
+}
+
+
+// Do a Round
+// Samples usTime SAMPLES times, keeps the sample with the shortest round trip, and refits the model.
+// out: returns the round
+// throws: Exception if the DAP fails
+const Timebase::Round &Timebase::round() {
+    int64_t best = LLONG_MAX, host = 0;
+    uint32_t x = 0;
+    for (int i = 0; i < SAMPLES; i++) {
+        int64_t t0 = hostNow();
+        uint32_t u = dap.usTime();
+        int64_t t1 = hostNow();
+        if (t1 - t0 < best) {
+            best = t1 - t0;
+            host = t0 + (t1 - t0) / 2;
+            x = u & MASK;
+        }
+    }
+    Round r = { host, x, best, 0.0 };
+    if (st.rounds == 0) {
+        host0 = host;
+        pl0 = x;
+        st.minRtt = st.maxRtt = best;
+    }
+    else {
+        r.pl = unwrap(x, host);
+        r.error = double(int64_t(r.pl - hostTimeToPl(host)));
+        if (best < st.minRtt)  st.minRtt = best;
+        if (best > st.maxRtt)  st.maxRtt = best;
+    }
+    if (window.size() == WINDOW)  window.erase(window.begin());
+    window.push_back(r);
+    st.rounds++;
+    st.samples += SAMPLES;
+    last = host;
+    fit();
+    return window.back();
+}
+
+
+// Do a Round if Due
+// out: returns true if a round was done (the first call always does one)
+// throws: Exception if the DAP fails
+bool Timebase::poll() {
+    if (st.rounds != 0 && hostNow() - last < int64_t(interval * 1e9))  return false;
+    round();
+    return true;
+}
+
+
+// Convert a Host Time to PL Time
+// in: host = host time (ns, CLOCK_MONOTONIC_RAW; see hostNow())
+// out: returns the PL's 64-bit time then (us)
+uint64_t Timebase::hostTimeToPl(int64_t host) const {
+    return pl0 + uint64_t(llround(a + b * double(host - host0) * 1e-3));
+}
+
+
+// Convert a PL Time to Host Time
+// in: pl = PL's 64-bit time (us)
+// out: returns the host time then (ns, CLOCK_MONOTONIC_RAW)
+int64_t Timebase::plTimeToHost(uint64_t pl) const {
+    return host0 + llround((double(int64_t(pl - pl0)) - a) / b * 1e3);
+}
+
+
+// Unwrap a usTime Reading (or a Telemetry Packet's 26-bit Timestamp)
+// in: usTime = PL's time modulo 2**26 (us)
+//     host = host time at about that time (ns; within 33 s)
+// out: returns the PL's 64-bit time (us)
+uint64_t Timebase::unwrap(uint32_t usTime, int64_t host) const {
+    uint64_t p = hostTimeToPl(host);
+    uint32_t d = (usTime - uint32_t(p)) & MASK;            // usTime - p modulo 2**26, in -2**25 .. 2**25 - 1
+    return d < (MASK + 1) / 2  ?  p + d  :  p - ((MASK + 1) - d);
+}
+
+
+// Read the PL's 64-bit Time
+// Does a round first if none was done.
+// out: returns the PL's time (us)
+// throws: Exception if the DAP fails
+uint64_t Timebase::readPlTime() {
+    if (st.rounds == 0)  round();
+    int64_t t0 = hostNow();
+    uint32_t u = dap.usTime();
+    int64_t t1 = hostNow();
+    return unwrap(u & MASK, t0 + (t1 - t0) / 2);
+}
+
+
+// Print Status (for debugging)
+void Timebase::printStatus() {
+    printf("PL/Host Timebase\n");
+    printf("    rounds         =  %10llu   ; rounds of %d usTime samples\n", (unsigned long long) st.rounds, SAMPLES);
+    printf("    drift          =  %10.3f   ; PL's drift relative to the host in ppm\n", drift());
+    printf("    rms            =  %10.3f   ; fit's RMS residual in microseconds (last %zu rounds)\n", st.rms, window.size());
+    printf("    minRtt         =  %10.3f   ; shortest round trip kept in microseconds\n", st.minRtt * 1e-3);
+    printf("    maxRtt         =  %10.3f   ; longest round trip kept in microseconds\n", st.maxRtt * 1e-3);
+    if (st.rounds != 0)
+        printf("    plTime         =  %10llu   ; PL's 64-bit time now in microseconds\n", (unsigned long long) plNow());
+    putchar('\n');
+}
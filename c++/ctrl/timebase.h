@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class Dap;
+
+
+/* -----  PL/Host Timebase  -----
+ *
+ * Relates the PL's usTime (a 1 MHz counter modulo 2**26, which wraps every 67.1 s) to the host's
+ * CLOCK_MONOTONIC_RAW, so that PL timestamps (telemetry packets, usTime reads) and host times convert both ways
+ * without a DAP read each, and gives a wrap-free 64-bit PL clock.
+ *
+ * Sampling:  a sample reads usTime between two reads of the host clock, and takes the PL's reading to be at the
+ * midpoint, which is correct to within half the round trip.  A round takes SAMPLES samples and keeps the one
+ * with the shortest round trip (the least delayed by the transport and the scheduler), as NTP does.  Each round's
+ * reading is unwrapped to 64 bits with the model's prediction, which only needs to be within 33 s (half a wrap)
+ * of the truth, so rounds may be any time apart.  The 64-bit PL clock continues the first round's usTime reading;
+ * the conversions are valid after the first round, for times after it.
+ *
+ * Model:  pl = a + b * (host - host0), fitted by least squares to the last WINDOW rounds (host0 is the first
+ * round's host time), where b is 1 plus the PL oscillator's drift relative to the host's.  With one round, b = 1.
+ * The fit's RMS residual estimates the conversions' error.
+ *
+ * Dap is not thread safe, so no thread samples in the background:  call poll() from the host's loop, which does a
+ * round once every interval seconds.
+ */
+class Timebase {
+
+public:
+    struct Round {
+        int64_t host;               // host time at the sample's midpoint (ns, CLOCK_MONOTONIC_RAW)
+        uint64_t pl;                // PL's unwrapped usTime (us)
+        int64_t rtt;                // sample's round trip (ns)
+        double error;               // pl minus the model's prediction before this round (us; 0 for the first)
+    };
+
+    struct Stats {
+        uint64_t rounds;            // rounds done
+        uint64_t samples;           // usTime reads
+        int64_t minRtt;             // shortest round trip kept (ns)
+        int64_t maxRtt;             // longest round trip kept (ns)
+        double rms;                 // fit's RMS residual (us)
+    };
+
+private:
+    Dap &dap;
+    std::vector<Round> window;      // the last WINDOW rounds, oldest first
+    int64_t host0;                  // first round's host time (ns)
+    uint64_t pl0;                   // first round's PL time (us)
+    double a, b;                    // model:  pl - pl0 = a + b * (host - host0) * 1e-3
+    int64_t last;                   // host time of the last round (ns)
+    Stats st;
+
+    void fit();
+
+public:
+    static constexpr int SAMPLES       = 8;         // samples per round
+    static constexpr size_t WINDOW     = 64;        // rounds in the fit
+    static constexpr double INTERVAL   = 1.0;       // default seconds between rounds
+
+    double interval;                // seconds between poll()'s rounds
+
+    explicit Timebase(Dap &dap);
+    Timebase(const Timebase &) = delete;                // delete copy constructor
+    Timebase &operator=(const Timebase &) = delete;     // delete assignment operator
+    static int64_t hostNow();
+    const Round &round();
+    bool poll();
+    uint64_t hostTimeToPl(int64_t host) const;
+    int64_t plTimeToHost(uint64_t pl) const;
+    uint64_t unwrap(uint32_t usTime, int64_t host) const;
+    uint64_t plNow() const { return hostTimeToPl(hostNow()); }
+    uint64_t readPlTime();
+    double drift() const { return (b - 1) * 1e6; }      // PL's drift relative to the host (ppm)
+    const Stats &stats() const { return st; }
+    void printStatus();
+};
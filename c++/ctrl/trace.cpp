@@ -0,0 +1,335 @@
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "common.h"
+#include "peripherals.h"
+#include "trace.h"
+
+// DAP Trace
+//
+// Records DAP transactions to a trace file, and replays trace files
+
+static_assert(sizeof(TraceHeader) == 32 && sizeof(TraceRecord) == 16, "trace file layout");
+
+
+
+// Current Time
+// in: clock = CLOCK_MONOTONIC or CLOCK_REALTIME
+// out: returns the clock's time in microseconds
+static uint64_t nowUs(clockid_t clock = CLOCK_MONOTONIC) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return uint64_t(ts.tv_sec) * 1000000u + uint64_t(ts.tv_nsec) / 1000u;
+}
+
+
+// Write All Bytes
+// in: fd = file
+//     p, n = bytes to write
+// out: returns true if success, else false
+static bool writeAll(int fd, const void *p, size_t n) {
+    const uint8_t *q = static_cast<const uint8_t *>(p);
+    while (n != 0) {
+        ssize_t k = ::write(fd, q, n);
+        if (k < 0 && errno == EINTR)  continue;
+        if (k <= 0)  return false;
+        q += k;
+        n -= size_t(k);
+    }
+    return true;
+}
+
+
+
+// *******************
+// *  TraceRecorder  *
+// *******************
+
+
+// Constructor
+// Creates the trace file and starts the flusher thread.
+// in: t = transport to trace; this object takes ownership of it, unless it throws
+//     fn = trace file's name; an existing file is overwritten
+// throws: Exception if the file cannot be created
+TraceRecorder::TraceRecorder(DapTransport *t, const char *fn) : t(t), head(0), tail(0), stopping(false) {
+    strCpy(this->fn, sizeof this->fn, fn);
+    fd = open(fn, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    TraceHeader h;
+    memset(&h, 0, sizeof h);
+    h.magic = TRACE_MAGIC;
+    h.version = TRACE_VERSION;
+    h.creationDate = t->creationDate();
+    h.buildDate = t->buildDate();
+    h.startTime = nowUs(CLOCK_REALTIME);
+    const char *name = t->name();
+    memcpy(h.transport, name, strnlen(name, sizeof h.transport));      // (null padded by the memset)
+    if (fd < 0 || !writeAll(fd, &h, sizeof h)) {
+        int e = errno;
+        if (fd >= 0)  close(fd);
+        throwException("Cannot write trace file %s: %s", fn, strerror(e));
+    }
+    ring = new TraceRecord[RING];
+    t0 = nowUs();
+    stalls = 0;
+    failed = false;
+    flusher = std::thread([this] {
+        for (;;) {
+            bool stop = stopping.load(std::memory_order_acquire);
+            {
+                std::unique_lock<std::mutex> lk(m);
+                if (!stop)  cv.wait_for(lk, std::chrono::milliseconds(100));
+            }
+            flush();
+            if (stop)  return;
+        }
+    });
+}
+
+
+// Destructor
+// Writes the remaining records, closes the trace file, and deletes the traced transport.
+TraceRecorder::~TraceRecorder() {
+    stopping.store(true, std::memory_order_release);
+    cv.notify_one();
+    flusher.join();
+    if (close(fd) != 0)  failed = true;
+    if (failed)  logWarning("Trace file %s is incomplete (write failed)", fn);
+    delete[] ring;
+    delete t;
+}
+
+
+// Write the Ring's Records to the File (flusher thread)
+// If a write fails, the records are discarded, so that the recording thread never blocks forever.
+void TraceRecorder::flush() {
+    uint64_t h = head.load(std::memory_order_acquire),
+             k = tail.load(std::memory_order_relaxed);
+    while (k != h) {
+        size_t i = size_t(k & (RING - 1)),
+               n = size_t(std::min<uint64_t>(h - k, RING - i));      // contiguous records
+        if (!failed && !writeAll(fd, ring + i, n * sizeof(TraceRecord)))  failed = true;
+        k += n;
+        tail.store(k, std::memory_order_release);
+    }
+}
+
+
+// Reserve the Next Record (recording thread)
+// Blocks while the ring is full.  The record is written to the file only after commit().
+// out: returns the record
+TraceRecord &TraceRecorder::reserve() {
+    uint64_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) >= RING) {
+        stalls++;
+        do {
+            cv.notify_one();
+            std::this_thread::yield();
+        } while (h - tail.load(std::memory_order_acquire) >= RING);
+    }
+    return ring[h & (RING - 1)];
+}
+
+
+// Commit the Reserved Record (recording thread)
+void TraceRecorder::commit() {
+    uint64_t h = head.load(std::memory_order_relaxed) + 1;
+    head.store(h, std::memory_order_release);
+    if (h - tail.load(std::memory_order_relaxed) == RING / 2)  cv.notify_one();
+}
+
+
+// Append a Record (recording thread)
+// in: type, mod, addr, value = record's fields
+void TraceRecorder::append(uint8_t type, int mod, int addr, uint32_t value) {
+    TraceRecord &r = reserve();
+    r.time = uint32_t(nowUs() - t0);
+    r.type = type;
+    r.mod = uint8_t(mod);
+    r.reserved = 0;
+    r.addr = uint32_t(addr);
+    r.value = value;
+    commit();
+}
+
+
+// Append Words as Records (recording thread)
+// in: w = words
+//     n = number of words; the last record is padded with zeros
+void TraceRecorder::appendWords(const uint32_t *w, size_t n) {
+    static constexpr size_t K = sizeof(TraceRecord) / sizeof(uint32_t);     // words per record
+    for (size_t i = 0; i < n; i += K) {
+        TraceRecord &r = reserve();
+        memset(&r, 0, sizeof r);
+        memcpy(&r, w + i, std::min(K, n - i) * sizeof(uint32_t));
+        commit();
+    }
+}
+
+
+// Read a 32-bit Word
+uint32_t TraceRecorder::read(int mod, int addr) {
+    uint32_t x = t->read(mod, addr);
+    append(TraceRecord::READ, mod, addr, x);
+    return x;
+}
+
+
+// Write a 32-bit Word
+void TraceRecorder::write(int mod, int addr, uint32_t data) {
+    t->write(mod, addr, data);
+    append(TraceRecord::WRITE, mod, addr, data);
+}
+
+
+// Execute a Batch of Operations
+void TraceRecorder::execute(const DapOp *ops, size_t n, uint32_t *results) {
+    std::vector<uint32_t> tmp;
+    if (results == nullptr) {
+        tmp.resize(n);
+        results = tmp.data();
+    }
+    t->execute(ops, n, results);
+    for (size_t i = 0; i < n; i++) {
+        uint8_t cont = i != 0  ?  TraceRecord::CONT  :  0;
+        if (ops[i].type == DapOp::RMW) {
+            append(TraceRecord::MASK | cont, ops[i].mod, ops[i].addr, ops[i].mask);
+            cont = TraceRecord::CONT;
+        }
+        append(uint8_t(ops[i].type) | cont, ops[i].mod, ops[i].addr, results[i]);
+    }
+}
+
+
+// Read a Block of Consecutive 32-bit Words
+void TraceRecorder::readBlock(int mod, int addr, size_t n, uint32_t *dst) {
+    t->readBlock(mod, addr, n, dst);
+    append(TraceRecord::BLOCK, mod, addr, uint32_t(n));
+    appendWords(dst, n);
+}
+
+
+// Print Status (for debugging)
+void TraceRecorder::printStatus() {
+    t->printStatus();
+    printf("    trace          =  %s\n", fn);
+    printf("    records        =  %10llu   ; 16-byte records traced\n", (unsigned long long) head.load());
+    printf("    stalls         =  %10llu   ; times the trace's ring buffer was full\n", (unsigned long long) stalls);
+    if (failed)  printf("    (a write to the trace file failed; the trace is incomplete)\n");
+}
+
+
+
+// ******************
+// *  Trace Replay  *
+// ******************
+
+
+// Replay a Trace File
+// Re-issues the trace's operations, batched as they were recorded, and compares the words read with the trace's.
+// in: dap = DAP to replay on
+//     fn = trace file's name
+//     timed = true to issue each batch at its recorded time (relative to the replay's start), false to replay at
+//             full speed
+//     maxReports = max. number of mismatches to print
+// out: returns the replay's statistics
+// throws: Exception if the file cannot be read or is not a valid trace, or if the DAP throws one
+ReplayStats replayTrace(Dap &dap, const char *fn, bool timed, int maxReports) {
+    FILE *src = fopen(fn, "rb");
+    if (src == nullptr)  throwException("Cannot open trace file %s", fn);
+    TraceHeader h;
+    std::vector<TraceRecord> recs;
+    bool ok = fread(&h, sizeof h, 1, src) == 1;
+    if (ok) {
+        TraceRecord buf[4096];
+        size_t k;
+        while ((k = fread(buf, sizeof buf[0], sizeof buf / sizeof buf[0], src)) != 0)  recs.insert(recs.end(), buf, buf + k);
+        ok = ferror(src) == 0;
+    }
+    fclose(src);
+    if (!ok || h.magic != TRACE_MAGIC || h.version != TRACE_VERSION)  throwException("%s is not a DAP trace file", fn);
+    if (h.creationDate != dap.creationDate() || h.buildDate != dap.buildDate())
+        logWarning("Trace was recorded with firmware %08X/%08X, but %08X/%08X is running",
+                   h.creationDate, h.buildDate, dap.creationDate(), dap.buildDate());
+
+    ReplayStats st = { 0, 0, 0, 0 };
+    std::vector<DapOp> ops;
+    std::vector<uint32_t> expected, results;
+    std::vector<size_t> index;              // record index of each operation in ops
+    uint64_t time = 0;                      // unwrapped time of the current record (us)
+    uint32_t prev = recs.empty()  ?  0  :  recs[0].time;
+    uint64_t start = nowUs();
+
+    // report a mismatch (usTime is a clock, so its reads are not compared)
+    auto mismatch = [&](size_t i, int mod, int addr, uint32_t traced, uint32_t replayed) {
+        if (mod == regmap::bio::MODULE && addr == regmap::bio::usTime::addr) { st.reads--;  return; }
+        if (st.mismatches++ < uint64_t(maxReports))
+            printf( "Mismatch at record %zu: module %d, address 0x%06X: traced 0x%08X, replayed 0x%08X\n",
+                    i, mod, addr, traced, replayed );
+    };
+
+    // wait until the replay's clock reaches the current record's time
+    auto wait = [&]() {
+        if (!timed)  return;
+        uint64_t now = nowUs() - start;
+        if (time > now)  usleep(useconds_t(time - now));
+    };
+
+    // issue the pending batch and compare its results
+    auto issue = [&]() {
+        if (ops.empty())  return;
+        results.resize(ops.size());
+        dap.execute(ops.data(), ops.size(), results.data());
+        for (size_t j = 0; j < ops.size(); j++) {
+            if (ops[j].type == DapOp::WRITE)  continue;
+            st.reads++;
+            if (results[j] != expected[j])  mismatch(index[j], ops[j].mod, ops[j].addr, expected[j], results[j]);
+        }
+        st.ops += ops.size();
+        ops.clear();
+        expected.clear();
+        index.clear();
+    };
+
+    uint32_t mask = 0;
+    for (size_t i = 0; i < recs.size() && !ctrlC; i++) {
+        const TraceRecord &r = recs[i];
+        time += uint32_t(r.time - prev);
+        prev = r.time;
+        uint8_t type = r.type & ~TraceRecord::CONT;
+        if (!(r.type & TraceRecord::CONT)) { issue();  wait(); }
+        switch (type) {
+            case TraceRecord::READ:
+            case TraceRecord::WRITE:
+            case TraceRecord::RMW:
+                ops.push_back({ DapOp::Type(type), r.mod, int(r.addr), r.value, type == TraceRecord::RMW  ?  mask  :  0 });
+                expected.push_back(r.value);
+                index.push_back(i);
+                break;
+            case TraceRecord::MASK:
+                mask = r.value;
+                break;
+            case TraceRecord::BLOCK: {
+                size_t n = r.value,
+                       m = (n + 3) / 4;             // records of words that follow
+                if (m > recs.size() - i - 1)  throwException("Trace file %s is truncated", fn);
+                const uint32_t *w = reinterpret_cast<const uint32_t *>(&recs[i + 1]);
+                results.resize(n);
+                dap.readBlock(r.mod, int(r.addr), n, results.data());
+                for (size_t j = 0; j < n; j++)
+                    if (results[j] != w[j])  mismatch(i, r.mod, int(r.addr + j), w[j], results[j]);
+                st.reads += n;
+                st.ops++;
+                i += m;
+                break;
+            }
+            default:
+                throwException("Trace file %s has an invalid record %zu", fn, i);
+        }
+    }
+    issue();
+    st.seconds = 1e-6 * double(nowUs() - start);
+    return st;
+}
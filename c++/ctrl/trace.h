@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include "transport.h"
+
+class Dap;
+
+
+/* -----  DAP Trace File  -----
+ *
+ * Binary file of DAP transactions, little endian:  a TraceHeader followed by TraceRecords.
+ *
+ * Each READ, WRITE, or RMW operation is one record.  An RMW record is preceded by a MASK record holding its mask.
+ * A block read is a BLOCK record (value = number of words) followed by the words read, padded with zeros to a
+ * multiple of 16 bytes.  A record whose type has the CONT bit set continues the previous record's batch (i.e.,
+ * both were in the same DapTransport::execute() call).
+ */
+struct TraceHeader {
+    uint32_t magic;             // TRACE_MAGIC
+    uint32_t version;           // TRACE_VERSION
+    uint32_t creationDate;      // firmware's creation date
+    uint32_t buildDate;         // firmware's build date
+    uint64_t startTime;         // trace's start time in microseconds since the Unix epoch
+    char transport[8];          // recording transport's name, null padded
+};
+
+struct TraceRecord {
+    enum Type: uint8_t {
+        READ  = DapOp::READ,    // value = word read
+        WRITE = DapOp::WRITE,   // value = word written
+        RMW   = DapOp::RMW,     // value = word written (the preceding MASK record has the mask)
+        BLOCK = 3,              // value = number of words that follow
+        MASK  = 4,              // value = the following RMW's mask
+        CONT  = 0x80            // flag:  same batch as the previous record
+    };
+    uint32_t time;              // microseconds since the trace started, modulo 2**32
+    uint8_t type;
+    uint8_t mod;                // module (0 .. 127)
+    uint16_t reserved;          // 0
+    uint32_t addr;              // address (0 .. 0x00FFFFFF)
+    uint32_t value;
+};
+
+static constexpr uint32_t TRACE_MAGIC   = 0x54504144;   // "DAPT"
+static constexpr uint32_t TRACE_VERSION = 1;
+
+
+/* -----  Trace Recorder  -----
+ *
+ * DAP transport that passes every transaction to another transport and appends it to a trace file.  Cheap
+ * enough to leave on:  records are copied into a preallocated ring buffer, which a background thread writes to
+ * the file in large batches.  The calling thread only blocks if the ring is full (counted as a stall), so no
+ * record is ever dropped.  usTime(), the dates, and calibrate() are passed through and not recorded; inner() is
+ * the traced transport, for callers that need its own interface (e.g. --dcm-serial-dump's serial port).
+ */
+class TraceRecorder: public DapTransport {
+
+private:
+    static constexpr size_t RING = 1 << 16;             // ring buffer's size in records (a power of 2)
+    DapTransport *t;                                    // traced transport (owned)
+    int fd;                                             // trace file
+    char fn[256];                                       // trace file's name
+    TraceRecord *ring;
+    std::atomic<uint64_t> head;                         // records appended (written by the recording thread)
+    std::atomic<uint64_t> tail;                         // records written to the file (written by the flusher)
+    std::atomic<bool> stopping;
+    std::mutex m;                                       // for cv only
+    std::condition_variable cv;                         // wakes the flusher
+    std::thread flusher;
+    uint64_t t0;                                        // trace's start time (us, CLOCK_MONOTONIC)
+    uint64_t stalls;                                    // number of times the ring was full
+    std::atomic<bool> failed;                           // true if a write to the file failed
+
+    TraceRecord &reserve();
+    void commit();
+    void append(uint8_t type, int mod, int addr, uint32_t value);
+    void appendWords(const uint32_t *w, size_t n);
+    void flush();
+
+public:
+    TraceRecorder(DapTransport *t, const char *fn);
+    ~TraceRecorder() override;
+    const char *name() override { return t->name(); }
+    uint32_t read(int mod, int addr) override;
+    void write(int mod, int addr, uint32_t data) override;
+    void execute(const DapOp *ops, size_t n, uint32_t *results) override;
+    void readBlock(int mod, int addr, size_t n, uint32_t *dst) override;
+    uint32_t usTime() override       { return t->usTime();       }
+    uint32_t creationDate() override { return t->creationDate(); }
+    uint32_t buildDate() override    { return t->buildDate();    }
+    bool calibrate(int mod, int addrA, int addrB) override { return t->calibrate(mod, addrA, addrB); }
+    DapTransport *inner() override   { return t; }
+    void printStatus() override;
+};
+
+
+// -----  Trace Replay  -----
+
+struct ReplayStats {
+    uint64_t ops;               // operations re-issued (a block read counts once)
+    uint64_t reads;             // words read and compared (all but usTime's)
+    uint64_t mismatches;        // words read that differ from the trace
+    double seconds;             // replay's duration
+};
+
+ReplayStats replayTrace(Dap &dap, const char *fn, bool timed, int maxReports = 10);
@@ -0,0 +1,378 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "app.h"
+#include "common.h"
+#include "pipeline.h"
+#include "regmap.h"
+#include "transport.h"
+
+// DAP Transports
+//
+// Links to the firmware's Debug Access Port:  memory mapped and serial (see simulator.h for the simulator)
+
+
+
+// *******************
+// *  DAP Transport  *
+// *******************
+
+
+// Execute a Batch of Operations (see Dap::execute())
+// in: ops = array of n operations, which are executed in order
+//     n = number of operations (>=0)
+// out: results = array of n 32-bit words (value read, or value written), or nullptr if not wanted
+void DapTransport::execute(const DapOp *ops, size_t n, uint32_t *results) {
+    uint32_t x;
+    for (size_t i = 0; i < n; i++) {
+        const DapOp &op = ops[i];
+        switch (op.type) {
+            case DapOp::READ:   x = read(op.mod, op.addr);  break;
+            case DapOp::WRITE:  x = op.data;  write(op.mod, op.addr, x);  break;
+            default:            x = (read(op.mod, op.addr) & ~op.mask) | (op.data & op.mask);
+                                write(op.mod, op.addr, x);
+                                break;
+        }
+        if (results != nullptr)  results[i] = x;
+    }
+}
+
+
+// Read a Block of Consecutive 32-bit Words from a Module
+// in: mod  = module (0 .. 127)
+//     addr = address of the first word in the module's address space
+//     n    = number of words
+// out: dst = array of n 32-bit words read from addresses addr .. addr+n-1
+void DapTransport::readBlock(int mod, int addr, size_t n, uint32_t *dst) {
+    for (size_t i = 0; i < n; i++)  dst[i] = read(mod, addr + int(i));
+}
+
+
+
+// *******************************
+// *  Memory-Mapped Transport  *
+// *******************************
+
+
+// Constructor
+// in: io = pointer to the DAP peripheral's memory region
+MmioTransport::MmioTransport(volatile void *io) {
+    static_assert(offsetof(IO, wdata)        == 4 * regmap::axi::wdata,        "IO does not match regmap.def");
+    static_assert(offsetof(IO, rwModAddr)    == 4 * regmap::axi::rwModAddr,    "IO does not match regmap.def");
+    static_assert(offsetof(IO, rdata)        == 4 * regmap::axi::rdata,        "IO does not match regmap.def");
+    static_assert(offsetof(IO, usTime)       == 4 * regmap::axi::usTime,       "IO does not match regmap.def");
+    static_assert(offsetof(IO, creationDate) == 4 * regmap::axi::creationDate, "IO does not match regmap.def");
+    static_assert(offsetof(IO, buildDate)    == 4 * regmap::axi::buildDate,    "IO does not match regmap.def");
+    this->io = reinterpret_cast<volatile IO *>(io);
+    memset(spins, -1, sizeof spins);
+}
+
+
+// Wait for a Read Command to Complete
+// If module mod is calibrated, do spins[mod] dummy reads of usTime, each of which is a full AXI round trip.
+// Otherwise spin until usTime has advanced 2 us (i.e., >=1 us, which is >=100 clk cycles), but give up
+// after a bounded number of reads in case the timer is not running.
+// in: mod = module (0 .. 127)
+void MmioTransport::wait(int mod) {
+    int n = spins[mod];
+    if (n >= 0)
+        while (--n >= 0)  (void) io->usTime;
+    else {
+        uint32_t t0 = io->usTime;
+        for (n = 100000; --n >= 0  &&  ((io->usTime - t0) & 0x03FFFFFF) < 2;  ) ;
+    }
+}
+
+
+// Execute a Batch of Operations (see Dap::execute())
+// Same as DapTransport::execute(), but the register accesses are inlined.
+void MmioTransport::execute(const DapOp *ops, size_t n, uint32_t *results) {
+    uint32_t x;
+    for (size_t i = 0; i < n; i++) {
+        const DapOp &op = ops[i];
+        switch (op.type) {
+            case DapOp::READ:   x = MmioTransport::read(op.mod, op.addr);  break;
+            case DapOp::WRITE:  x = op.data;  MmioTransport::write(op.mod, op.addr, x);  break;
+            default:            x = (MmioTransport::read(op.mod, op.addr) & ~op.mask) | (op.data & op.mask);
+                                MmioTransport::write(op.mod, op.addr, x);
+                                break;
+        }
+        if (results != nullptr)  results[i] = x;
+    }
+}
+
+
+// Read a Block of Consecutive 32-bit Words from a Module (see DapTransport::readBlock())
+void MmioTransport::readBlock(int mod, int addr, size_t n, uint32_t *dst) {
+    for (size_t i = 0; i < n; i++)  dst[i] = MmioTransport::read(mod, addr + int(i));
+}
+
+
+// Calibrate a Module's Read Completion Delay
+// Find the least number of dummy reads after which reads of module mod always return the correct value.
+// Reads of two addresses holding different constant values are alternated, so a stale rdata is detected.
+// in: mod   = module (0 .. 127)
+//     addrA = address of a constant 32-bit word in the module's address space
+//     addrB = address of another constant 32-bit word, whose value differs from addrA's
+// out: returns true if success, false if the module could not be calibrated (it is then left uncalibrated)
+bool MmioTransport::calibrate(int mod, int addrA, int addrB) {
+    static constexpr int TRIALS = 32;   // # of read pairs that must all be correct
+    spins[mod] = -1;
+    uint32_t a = read(mod, addrA),
+             b = read(mod, addrB);
+    if (a == b)  return false;
+    for (int n = 0; n <= maxSpins; n++) {
+        spins[mod] = n;
+        bool ok = true;
+        for (int i = 0; ok && i < TRIALS; i++)
+            ok = read(mod, addrA) == a  &&  read(mod, addrB) == b;
+        if (ok) { spins[mod] = n + spinMargin;  return true; }
+    }
+    spins[mod] = -1;
+    return false;
+}
+
+
+// Print Status (for debugging)
+void MmioTransport::printStatus() {
+    char buf[16];
+    printf("    wdata          =  0x%08X   ; 32-bit word to write\n", io->wdata);
+    printf("    rwModAddr      =  0x%08X   ; command: rw (bit 31 - 0=write 1=read), module (bits 30:24), address (bits 23:0)\n", io->rwModAddr);
+    printf("    rdata          =  0x%08X   ; last 32-bit word read\n", io->rdata);
+    printf("    usTime         =  %10u   ; 1 MHz free-running 26-bit counter\n", io->usTime);
+    printf("    creationDate   =  0x%08X  =  %s  ; 0xYYMMDDHH timestamp\n", io->creationDate, timestampToStr(io->creationDate, buf));
+    printf("    buildDate      =  0x%08X  =  %s  ; 0xYYMMDDHH timestamp\n", io->buildDate, timestampToStr(io->buildDate, buf));
+    for (int mod = 0; mod < 128; mod++)
+        if (spins[mod] >= 0)  printf("    module %-3d     =  %10d   ; read completion delay in dummy reads\n", mod, spins[mod]);
+}
+
+
+
+// **********************
+// *  Serial Transport  *
+// **********************
+
+
+// Constructor
+// Open the serial port.
+// in: dev  = serial port's device, e.g. "/dev/ttyUSB0"
+//     baud = baud rate, e.g. 921600
+// throws: Exception
+SerialTransport::SerialTransport(const char *dev, unsigned baud) {
+    fd = open(dev, baud);
+    strCpy(this->dev, sizeof this->dev, dev);
+    this->baud = baud;
+    ids[0] = ids[1] = 0;
+}
+
+
+// Destructor
+SerialTransport::~SerialTransport() {
+    if (fd >= 0)  close(fd);
+}
+
+
+// Open a Serial Port in Raw Mode
+// The port is configured for 8N1 with no flow control.  Reads return immediately with whatever bytes are
+// available, so callers should poll() for input.  Any stale input is discarded.
+// in: dev  = serial port's device, e.g. "/dev/ttyUSB0"
+//     baud = baud rate (9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600, 1000000, 2000000, or 3000000)
+// out: returns the open port's file descriptor
+// throws: Exception
+int SerialTransport::open(const char *dev, unsigned baud) {
+    speed_t speed;
+    switch (baud) {
+        case    9600:  speed = B9600;     break;
+        case   19200:  speed = B19200;    break;
+        case   38400:  speed = B38400;    break;
+        case   57600:  speed = B57600;    break;
+        case  115200:  speed = B115200;   break;
+        case  230400:  speed = B230400;   break;
+        case  460800:  speed = B460800;   break;
+        case  921600:  speed = B921600;   break;
+        case 1000000:  speed = B1000000;  break;
+        case 2000000:  speed = B2000000;  break;
+        case 3000000:  speed = B3000000;  break;
+        default:  throwException("Unsupported Baud Rate %u", baud);
+    }
+    int fd = ::open(dev, O_RDWR | O_NOCTTY);
+    if (fd < 0)  throwException("Cannot open serial port %s: %s", dev, strerror(errno));
+    struct termios tio;
+    if (tcgetattr(fd, &tio) != 0) {
+        close(fd);
+        throwException("Not a serial port: %s", dev);
+    }
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cflag &= ~(CSTOPB | CRTSCTS);
+    tio.c_cc[VMIN]  = 0;
+    tio.c_cc[VTIME] = 0;
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    if (tcsetattr(fd, TCSANOW, &tio) != 0) {
+        close(fd);
+        throwException("Cannot configure serial port %s for %u baud", dev, baud);
+    }
+    tcflush(fd, TCIOFLUSH);
+    return fd;
+}
+
+
+// Compute a Packet's Checksum
+// in: p = the packet's bytes between its header byte and its checksum byte
+//     n = number of bytes
+// out: returns 0xFF XOR'ed with the n bytes
+uint8_t SerialTransport::checksum(const uint8_t *p, size_t n) {
+    uint8_t x = 0xFF;
+    while (n-- != 0)  x ^= *p++;
+    return x;
+}
+
+
+// Encode a 6-Byte Read Command Packet
+// in: mod, addr = module (0..127) and address (0..0x00FFFFFF) to read from
+// out: packet = 6-byte packet
+void SerialTransport::encodeRead(uint8_t *packet, int mod, int addr) {
+    uint32_t cmd = 1u << 31 | uint32_t(mod) << 24 | uint32_t(addr);
+    packet[0] = COMMAND_HEADER;
+    for (int i = 0; i < 4; i++)  packet[1 + i] = uint8_t(cmd >> 8*i);
+    packet[5] = checksum(packet + 1, 4);
+}
+
+
+// Encode a 10-Byte Write Command Packet
+// in: mod, addr = module (0..127) and address (0..0x00FFFFFF) to write to
+//     data = 32-bit word to write
+// out: packet = 10-byte packet
+void SerialTransport::encodeWrite(uint8_t *packet, int mod, int addr, uint32_t data) {
+    uint32_t cmd = uint32_t(mod) << 24 | uint32_t(addr);
+    packet[0] = COMMAND_HEADER;
+    for (int i = 0; i < 4; i++) {
+        packet[1 + i] = uint8_t(cmd >> 8*i);
+        packet[5 + i] = uint8_t(data >> 8*i);
+    }
+    packet[9] = checksum(packet + 1, 8);
+}
+
+
+// Decode a 6-Byte Response Packet
+// in: packet = 6 bytes received
+// out: data = 32-bit word read (=0 if corrupt)
+//      returns true if success, false if the header or checksum is invalid
+bool SerialTransport::decodeResponse(const uint8_t *packet, uint32_t &data) {
+    data = 0;
+    if (packet[0] != RESPONSE_HEADER || packet[5] != checksum(packet + 1, 4))  return false;
+    data = uint32_t(packet[1]) | uint32_t(packet[2]) << 8 | uint32_t(packet[3]) << 16 | uint32_t(packet[4]) << 24;
+    return true;
+}
+
+
+// Send Bytes
+// in: p = bytes to send
+//     n = number of bytes
+// throws: Exception
+void SerialTransport::send(const uint8_t *p, size_t n) {
+    while (n != 0) {
+        ssize_t k = ::write(fd, p, n);
+        if (k < 0) {
+            if (errno == EINTR || errno == EAGAIN)  continue;
+            throwException("Cannot write to serial port %s: %s", dev, strerror(errno));
+        }
+        p += k;  n -= size_t(k);
+    }
+}
+
+
+// Receive Bytes
+// in: n = number of bytes wanted
+//     timeoutMs = max. time in milliseconds to wait for all n bytes
+// out: p = bytes received
+//      returns number of bytes received (0..n), which is less than n only if timed out
+// throws: Exception
+size_t SerialTransport::receive(uint8_t *p, size_t n, int timeoutMs) {
+    size_t got = 0;
+    struct timespec t0, t;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    while (got < n) {
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        int left = timeoutMs - int((t.tv_sec - t0.tv_sec) * 1000 + (t.tv_nsec - t0.tv_nsec) / 1000000);
+        if (left <= 0)  break;
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        int r = poll(&pfd, 1, left);
+        if (r < 0) {
+            if (errno == EINTR)  continue;
+            throwException("poll() failed on serial port %s: %s", dev, strerror(errno));
+        }
+        if (r == 0)  break;
+        ssize_t k = ::read(fd, p + got, n - got);
+        if (k < 0) {
+            if (errno == EINTR || errno == EAGAIN)  continue;
+            throwException("Cannot read from serial port %s: %s", dev, strerror(errno));
+        }
+        got += size_t(k);
+    }
+    return got;
+}
+
+
+// Read a 32-bit Word
+// in: mod, addr = module (0..127) and address (0..0x00FFFFFF) to read from
+// out: returns the 32-bit word read
+// throws: Exception
+uint32_t SerialTransport::read(int mod, int addr) {
+    uint8_t packet[6];
+    uint32_t data;
+    encodeRead(packet, mod, addr);
+    send(packet, sizeof packet);
+    size_t n = receive(packet, sizeof packet, TIMEOUT_MS);
+    if (n != sizeof packet)  throwException("Response packet should be 6 bytes but was %u", unsigned(n));
+    if (!decodeResponse(packet, data)) {
+        tcflush(fd, TCIFLUSH);
+        throwException("Corrupt response packet from module %d, address 0x%06X", mod, addr);
+    }
+    return data;
+}
+
+
+// Write a 32-bit Word
+// in: mod, addr = module (0..127) and address (0..0x00FFFFFF) to write to
+//     data = 32-bit word to write
+// throws: Exception
+void SerialTransport::write(int mod, int addr, uint32_t data) {
+    uint8_t packet[10];
+    encodeWrite(packet, mod, addr, data);
+    send(packet, sizeof packet);
+}
+
+
+// Execute a Batch of Operations (see Dap::execute())
+// The batch is pipelined, so it is bounded by the line rate rather than by round trips.
+void SerialTransport::execute(const DapOp *ops, size_t n, uint32_t *results) {
+    SerialPipeline pipeline(*this);
+    pipeline.execute(ops, n, results);
+}
+
+
+// Read a Block of Consecutive 32-bit Words from a Module (see DapTransport::readBlock())
+// The reads are pipelined.
+// throws: Exception if any read failed
+void SerialTransport::readBlock(int mod, int addr, size_t n, uint32_t *dst) {
+    SerialPipeline pipeline(*this);
+    for (size_t i = 0; i < n; i++)
+        pipeline.read(mod, addr + int(i), [dst, i](uint32_t data, bool /*ok*/) { dst[i] = data; });
+    pipeline.drain();
+    if (pipeline.stats().failures != 0)
+        throwException("%u of %u reads failed", unsigned(pipeline.stats().failures), unsigned(n));
+}
+
+
+// Print Status (for debugging)
+void SerialTransport::printStatus() {
+    printf("    port           =  %s at %u baud, 8N1\n", dev, baud);
+}
+
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <sys/mman.h>   // for mmap() and off_t
+
+
+// -----  DAP Transaction  -----
+// One operation of a batch executed by Dap::execute().
+struct DapOp {
+    enum Type {
+        READ  = 0,      // read the 32-bit word at mod/addr
+        WRITE = 1,      // write data to mod/addr
+        RMW   = 2       // read-modify-write: replace the bits selected by mask with those of data
+    };
+    Type type;
+    int mod;            // module (0 .. 127)
+    int addr;           // address (0 .. 0x00FFFFFF) in the module's address space
+    uint32_t data;      // WRITE: value to write; RMW: new values of the bits selected by mask; READ: ignored
+    uint32_t mask;      // RMW: bits to modify; READ and WRITE: ignored
+};
+
+
+// -----  DAP Transport  -----
+// Abstract link to the firmware's Debug Access Port.  Arguments are not range checked; class Dap does that.
+class DapTransport {
+public:
+    DapTransport() {}
+    DapTransport(const DapTransport &) = delete;                // delete copy constructor
+    DapTransport &operator=(const DapTransport &) = delete;     // delete assignment operator
+    virtual ~DapTransport() {}
+    virtual const char *name() = 0;                             // short description, e.g. "mmio"
+    virtual uint32_t read(int mod, int addr) = 0;
+    virtual void write(int mod, int addr, uint32_t data) = 0;
+    virtual void execute(const DapOp *ops, size_t n, uint32_t *results);
+    virtual void readBlock(int mod, int addr, size_t n, uint32_t *dst);
+    virtual uint32_t usTime() = 0;                              // 1 MHz free-running timer modulo 2**26
+    virtual uint32_t creationDate() = 0;                        // PL firmware's creation date in 0xYYMMDDHH format
+    virtual uint32_t buildDate() = 0;                           // PL firmware's build date in 0xYYMMDDHH format
+    virtual bool calibrate(int /*mod*/, int /*addrA*/, int /*addrB*/) { return true; }
+    virtual DapTransport *inner() { return nullptr; }          // transport this one decorates, or nullptr
+    virtual void printStatus() {}
+};
+
+
+/* -----  Memory-Mapped Transport  -----
+ *
+ * DAP transport over the DAP peripheral's AXI4-Lite registers, which must be mapped into this process by the caller.
+ *
+ * Peripheral's AXI4-Lite Register Map
+ * ===================================
+ *
+ * Note, Index (below) is a 32-bit register's index; its byte offset from this peripheral's base address is Index * 4.
+ *
+ * Index   Name           Access   Description
+ * -----   ------------   ------   ----------------------------------------------------------------------------------------------------------
+ *
+ *   0     wdata            rw     The 32-bit word that will be written if cmd is a write command
+ *
+ *   1     rwModAddr        rw     Read/write command
+ *                                   Bits   Name           Description
+ *                                   -----  -------------  ---------------------------------------------------------------------------
+ *                                   31     rw             operation: 0 = write, 1 = read
+ *                                   30:24  mod            the module being addressed (0..127)
+ *                                   23:0   addr           address (i.e., index) of a 32-bit word in the module's address space
+ *
+ *   2     rdata            ro     The last 32-bit word read (initially 0)
+ *
+ *   3     usTime           ro     26-bit free-running timer incrementing at 1 MHz (read only; bits 31:26 read 0), so it wraps every 67.1 s
+ *
+ *   4     creationDate     ro     PL firmware's creation date in 32'hYYMMDDHH format (can be used as a globally unique ID for this firmware)
+ *
+ *   5     buildDate        ro     PL firmware's build date in 32'hYYMMDDHH format
+ *
+ * Read Completion
+ * ===============
+ *
+ * The firmware has no read-done flag:  rdata is updated a fixed number of clk cycles after rwModAddr is written.
+ * read() therefore waits before sampling rdata.  Until a module is calibrated, the wait is a bounded spin until
+ * usTime has advanced 2 us.  calibrate() measures, per module, the least number of dummy usTime reads (each one
+ * a full AXI round trip) after which rdata is always correct, and read() then uses that count plus a margin.
+ * spinCount() and setSpinCount() save and restore the calibration (see Peripherals' startup state file).
+ *
+ */
+class MmioTransport: public DapTransport {
+
+private:
+    struct IO {
+        uint32_t wdata;
+        uint32_t rwModAddr;
+        uint32_t rdata;
+        uint32_t usTime;
+        uint32_t creationDate;
+        uint32_t buildDate;
+    };
+    volatile IO *io;
+    int8_t spins[128];          // per module, # dummy reads to wait for a read to complete, or -1 if uncalibrated
+    void wait(int mod);
+
+public:
+    static constexpr off_t ramPhysAddr = 0x43C00000;    // physical memory address of struct IO
+    static constexpr int maxSpins    = 64;              // max. # dummy reads calibrate() will try
+    static constexpr int spinMargin  = 1;               // # dummy reads added to the calibrated minimum
+
+    explicit MmioTransport(volatile void *io);
+    const char *name() override { return "mmio"; }
+    uint32_t read(int mod, int addr) override { io->rwModAddr = (1u << 31) | (mod << 24) | addr;  wait(mod);  return io->rdata; }
+    void write(int mod, int addr, uint32_t data) override { io->wdata = data;  io->rwModAddr = (mod << 24) | addr; }
+    void execute(const DapOp *ops, size_t n, uint32_t *results) override;
+    void readBlock(int mod, int addr, size_t n, uint32_t *dst) override;
+    uint32_t usTime() override       { return io->usTime;       }
+    uint32_t creationDate() override { return io->creationDate; }
+    uint32_t buildDate() override    { return io->buildDate;    }
+    bool calibrate(int mod, int addrA, int addrB) override;
+    int spinCount(int mod) const { return spins[mod & 127]; }            // calibrated # dummy reads, or -1
+    void setSpinCount(int mod, int n) { spins[mod & 127] = int8_t(n < -1 || n > maxSpins + spinMargin  ?  -1  :  n); }
+    void printStatus() override;
+};
+
+
+/* -----  Serial Transport  -----
+ *
+ * DAP transport over the firmware's Debug Serial Port (8N1, 115200 .. 921600 baud).
+ *
+ * A read command packet is 6 bytes:  0xC0, the 32-bit command word (LSByte first), and a checksum.  A write command
+ * packet is 10 bytes:  0xC0, the command word, the 32-bit data word, and a checksum.  The command word's bit 31 is 1
+ * for a read or 0 for a write, bits 30:24 is the module, and bits 23:0 is the address.  The firmware answers a read
+ * with a 6-byte response packet:  0xC1, the 32-bit word read, and a checksum.  Each checksum is 0xFF XOR'ed with
+ * the packet's bytes between the header and the checksum.  The firmware silently discards corrupt commands.
+ *
+ * Batches (execute() and readBlock()) are pipelined by class SerialPipeline (see pipeline.h).
+ *
+ * The DAP's usTime, creationDate, and buildDate registers are not reachable over the serial port, so this class
+ * reads their copies in firmware module 0 (Basic I/O).  The dates are read once and cached.
+ */
+class SerialTransport: public DapTransport {
+
+private:
+    int fd;                 // serial port's file descriptor
+    char dev[64];           // serial port's device, e.g. "/dev/ttyUSB0"
+    unsigned baud;          // baud rate
+    uint32_t ids[2];        // cached creationDate and buildDate, or 0 if not yet read
+
+public:
+    static constexpr uint8_t COMMAND_HEADER  = 0xC0;   // command packets' header byte
+    static constexpr uint8_t RESPONSE_HEADER = 0xC1;   // response packets' header byte
+    static constexpr int     TIMEOUT_MS      = 500;    // response timeout in milliseconds
+
+    SerialTransport(const char *dev, unsigned baud);
+    ~SerialTransport() override;
+    static int open(const char *dev, unsigned baud);
+    static uint8_t checksum(const uint8_t *p, size_t n);
+    static void encodeRead(uint8_t *packet, int mod, int addr);
+    static void encodeWrite(uint8_t *packet, int mod, int addr, uint32_t data);
+    static bool decodeResponse(const uint8_t *packet, uint32_t &data);
+    void send(const uint8_t *p, size_t n);
+    size_t receive(uint8_t *p, size_t n, int timeoutMs);
+    int fileDescriptor() { return fd; }
+    unsigned baudRate() const { return baud; }
+    const char *name() override { return "serial"; }
+    uint32_t read(int mod, int addr) override;
+    void write(int mod, int addr, uint32_t data) override;
+    void execute(const DapOp *ops, size_t n, uint32_t *results) override;
+    void readBlock(int mod, int addr, size_t n, uint32_t *dst) override;
+    uint32_t usTime() override       { return read(0, 2); }
+    uint32_t creationDate() override { return  ids[0] != 0  ?  ids[0]  :  (ids[0] = read(0, 0)); }
+    uint32_t buildDate() override    { return  ids[1] != 0  ?  ids[1]  :  (ids[1] = read(0, 1)); }
+    void printStatus() override;
+};
+
@@ -0,0 +1,72 @@
+`timescale 1ns / 1ps
+//////////////////////////////////////////////////////////////////////////////////
+// Company:
+// Engineer:
+//
+// Create Date:     10/16/2026
+// Design Name:     image_filter
+// Module Name:     blk_mem_64K_32b.v
+// Project Name:
+// Target Devices:  PYNQ-Z2
+// Tool Versions:   Xilinx Vivado 2022.2, Verilator 5
+// Description:
+//
+//      Simulation model of the blk_mem_64K_32b IP (Block Memory Generator, simple dual
+//      port RAM, 64K x 32b, one clock) for simulators without Xilinx's libraries, e.g.
+//      Verilator (see debug_capture_module_tb.cpp).  Not for synthesis.
+//
+//      Port A writes dina at addra when wea is 1.  Port B reads with a latency of 2 clocks
+//      (the primitive's output register), which debug_capture_module's rva pipeline expects.
+//
+//      debug_capture_module assigns wea with a blocking assignment in its clocked block, so
+//      which value a posedge block here would see depends on the simulator's ordering.  The
+//      write port therefore samples wea, addra, and dina on the falling edge, i.e., the
+//      values the synthesized registers hold during the clock, and writes on the next rising
+//      edge.
+//
+// Dependencies:
+//
+// Revision:
+// Revision 0.01 - File Created
+// Additional Comments:
+//
+//////////////////////////////////////////////////////////////////////////////////
+
+
+module blk_mem_64K_32b
+(
+    // Port A (write only)
+    input               clka,
+    input      [0:0]    wea,
+    input      [15:0]   addra,
+    input      [31:0]   dina,
+
+    // Port B (read only)
+    input               clkb,
+    input      [15:0]   addrb,
+    output reg [31:0]   doutb = 0
+);
+
+    reg [31:0]  mem [0:65535];
+
+    reg         wea_q    =  0;      // write port's inputs, sampled on the falling edge
+    reg [15:0]  addra_q  =  0;
+    reg [31:0]  dina_q   =  0;
+
+    reg [31:0]  doutb_z  =  0;      // read port's first stage
+
+    always @(negedge clka) begin
+        wea_q    <=  wea[0];
+        addra_q  <=  addra;
+        dina_q   <=  dina;
+    end
+
+    always @(posedge clka)
+        if (wea_q)  mem[addra_q] <= dina_q;
+
+    always @(posedge clkb) begin
+        doutb_z  <=  mem[addrb];
+        doutb    <=  doutb_z;
+    end
+
+endmodule
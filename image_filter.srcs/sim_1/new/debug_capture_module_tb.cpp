@@ -0,0 +1,293 @@
+#include <cstdint>
+#include <cstdio>
+#include "Vdebug_capture_module.h"
+#include "verilated.h"
+
+// Debug Capture Module Testbench
+//
+// Verilator testbench for debug_capture_module.v in ring mode.  Six producers offer packets on the telemetry ports
+// at fixed periods, with dcm_tester.v's req/ack/nak/valid handshake, and the DCM's decimation registers pick which
+// it grants.  A host drains the ring through the DAP interface as DcmCapture does:  it reads wrptr, reads the
+// words rdptr .. wrptr-1 at their addresses modulo size, and writes the new rdptr.
+//
+// Each packet's header is {port + 1, sequence number} (a real header has a timestamp where the sequence number is)
+// and its payload words encode the port, sequence number, and word index, so the host can check the stream:
+//
+//   1. Sustainable load:  the ring wraps several times, no packet is torn, every port's sequence numbers step by
+//      exactly its decimation, and dropped stays 0.
+//   2. Overload:  the host stops draining until the ring fills, so packets are dropped, but only whole ones:
+//      the ring never holds more than size words, no packet is torn, the sequence numbers only skip multiples of
+//      the decimation, and the packets received plus dropped are exactly the packets the decimation granted.
+//
+// Build and run with "make" in this directory (Verilator 5), or with "make model" where Verilator is not installed.
+
+
+
+static constexpr int PORTS           = 6;
+static constexpr uint32_t SIZE       = 1 << 16;     // buffer's capacity in 32-bit words (1 << ADDR_WIDTH)
+static constexpr uint32_t MAX_PACKET = 64;          // longest packet in 32-bit words
+static constexpr uint64_t LOAD_CYCLES  = 3000000;   // phase 1's length in clocks (about 3.7 wraps)
+static constexpr uint64_t STALL_CYCLES = 1200000;   // phase 2's stall in clocks (about 1.5 buffers offered)
+
+enum Register {                 // DAP addresses of the DCM's registers
+    CONTROL = 0x800000, LENGTH, SIZE_REG, DEC0, MODE = 0x800009, WRPTR, RDPTR, HWM, STATUS, DROPPED
+};
+
+struct PortConfig {
+    uint32_t len;               // packet length in 32-bit words (1 .. MAX_PACKET)
+    uint64_t period;            // clocks between offers
+    uint32_t dec;               // decimation
+};
+
+static const PortConfig CONFIG[PORTS] = {     // about 0.08 words per clock granted, of the host's 0.2
+    {  1,   50, 1 },
+    {  2,  100, 2 },
+    {  4,  150, 3 },
+    {  8,  400, 4 },
+    { 16,  500, 7 },
+    { 64, 2000, 1 },
+};
+
+static Vdebug_capture_module *dut;
+static uint64_t cycle = 0;      // clocks simulated
+static int failures = 0;        // number of failed checks
+
+
+// Check a Condition
+#define CHECK(cond)  do { if (!(cond)) { printf("FAILED at %s:%d (clock %llu):  %s\n", __FILE__, __LINE__, \
+                                                (unsigned long long) cycle, #cond);  failures++; } } while (0)
+
+
+// Packet Words
+static uint32_t header(int port, uint32_t seq) { return uint32_t(port + 1) << 26 | (seq & 0x03FFFFFF); }
+static uint32_t payload(int port, uint32_t seq, uint32_t j) { return uint32_t(port) << 28 | (seq & 0xFFFFF) << 8 | j; }
+
+
+
+// **************
+// *  Producer  *
+// **************
+
+
+// Telemetry Producer
+// Registered like dcm_tester.v:  step() runs after each rising edge, with the DCM's new ack and nak, and sets the
+// outputs for the next one.  It raises req every period clocks (later if the last packet is still going), sends
+// the packet while ack is 1, and lowers req for at least a clock after each packet.
+struct Producer {
+    enum State { IDLE, REQ, SEND };
+    int port;
+    State state;
+    uint32_t seq;               // packets offered
+    uint64_t next;              // clock of the next offer
+    uint32_t word;              // SEND:  next word's index
+    bool req, valid;
+    uint32_t dout;
+
+    void step(bool enabled, bool ack, bool nak) {
+        const PortConfig &c = CONFIG[port];
+        valid = false;
+        dout = 0;
+        switch (state) {
+            case IDLE:
+                if (req)  req = false;
+                else if (enabled && cycle >= next) {
+                    req = true;
+                    next += c.period;
+                    state = REQ;
+                }
+                break;
+            case REQ:
+                if (ack) {
+                    dout = header(port, seq);
+                    valid = true;
+                    word = 1;
+                    state = c.len > 1  ?  SEND  :  IDLE;
+                    if (c.len == 1)  seq++;
+                }
+                else if (nak) {
+                    seq++;
+                    state = IDLE;
+                }
+                break;
+            case SEND:
+                dout = payload(port, seq, word);
+                valid = true;
+                if (++word == c.len) {
+                    seq++;
+                    state = IDLE;
+                }
+                break;
+        }
+    }
+};
+
+static Producer producer[PORTS];
+static bool enabled = false;    // producers may offer packets
+
+
+// Simulate a Clock
+static void tick() {
+    CData *req[PORTS]   = { &dut->req0, &dut->req1, &dut->req2, &dut->req3, &dut->req4, &dut->req5 };
+    CData *valid[PORTS] = { &dut->valid0, &dut->valid1, &dut->valid2, &dut->valid3, &dut->valid4, &dut->valid5 };
+    IData *din[PORTS]   = { &dut->din0, &dut->din1, &dut->din2, &dut->din3, &dut->din4, &dut->din5 };
+    CData *ack[PORTS]   = { &dut->ack0, &dut->ack1, &dut->ack2, &dut->ack3, &dut->ack4, &dut->ack5 };
+    CData *nak[PORTS]   = { &dut->nak0, &dut->nak1, &dut->nak2, &dut->nak3, &dut->nak4, &dut->nak5 };
+    for (int k = 0; k < PORTS; k++) {
+        *req[k] = producer[k].req;
+        *valid[k] = producer[k].valid;
+        *din[k] = producer[k].dout;
+    }
+    dut->us_time = uint32_t(cycle / 100) & 0x03FFFFFF;     // (100 MHz clock)
+    dut->clk = 0;
+    dut->eval();
+    dut->clk = 1;
+    dut->eval();
+    cycle++;
+    for (int k = 0; k < PORTS; k++)  producer[k].step(enabled, *ack[k], *nak[k]);
+}
+
+
+
+// **********
+// *  Host  *
+// **********
+
+
+// Read a Word through the DAP Interface
+// A buffer read's data is in rdata 4 clocks after re (the block memory's latency, plus rva's pipeline).
+static uint32_t dapRead(uint32_t addr) {
+    dut->addr = addr;
+    dut->re = 1;
+    tick();
+    dut->re = 0;
+    for (int i = 0; i < 4; i++)  tick();
+    return dut->rdata;
+}
+
+
+// Write a Word through the DAP Interface
+static void dapWrite(uint32_t addr, uint32_t data) {
+    dut->addr = addr;
+    dut->wdata = data;
+    dut->we = 1;
+    tick();
+    dut->we = 0;
+    tick();
+}
+
+
+// Stream Checker
+// Parses the words drained from the ring into packets, and checks them.
+struct Checker {
+    int port = -1;                      // current packet's port, or -1 between packets
+    uint32_t seq = 0, word = 0;         // current packet's sequence number and next word's index
+    int64_t last[PORTS];                // each port's last sequence number received, or -1
+    uint64_t packets[PORTS] = {};       // packets received
+    uint64_t torn = 0;                  // words that do not continue the stream
+    uint64_t gaps = 0;                  // sequence numbers that skip a packet the decimation grants (exact)
+    uint64_t badGaps = 0;               // sequence numbers that are not the next multiple of the decimation
+
+    Checker() { for (int k = 0; k < PORTS; k++)  last[k] = -1; }
+
+    void push(uint32_t w, bool exact) {
+        if (port < 0) {
+            uint32_t type = w >> 26;
+            if (type < 1 || type > PORTS) { torn++;  return; }
+            port = int(type - 1);
+            seq = w & 0x03FFFFFF;
+            word = 1;
+            uint32_t dec = CONFIG[port].dec;
+            int64_t expect = last[port] < 0  ?  0  :  last[port] + dec;     // next sequence number granted
+            if (seq < expect || (seq - expect) % dec != 0)  badGaps++;
+            else if (exact && seq != expect)  gaps++;
+            last[port] = seq;
+            packets[port]++;
+        }
+        else {
+            if (w != payload(port, seq, word))  torn++;
+            word++;
+        }
+        if (word == CONFIG[port].len)  port = -1;
+    }
+};
+
+static Checker checker;
+static uint32_t rdptr = 0;              // words drained
+static uint32_t maxFill = 0;            // most words found in the ring
+
+
+// Drain the Ring
+// in: exact = true if no packet may have been dropped
+static void drain(bool exact) {
+    uint32_t wrptr = dapRead(WRPTR), n = wrptr - rdptr;
+    CHECK(n <= SIZE);
+    if (n > maxFill)  maxFill = n;
+    for (uint32_t i = rdptr; i != wrptr; i++)  checker.push(dapRead(i & (SIZE - 1)), exact);
+    rdptr = wrptr;
+    dapWrite(RDPTR, rdptr);
+}
+
+
+
+// **********
+// *  Main  *
+// **********
+
+
+int main(int argc, char **argv) {
+    Verilated::commandArgs(argc, argv);
+    dut = new Vdebug_capture_module;
+    for (int k = 0; k < PORTS; k++)  producer[k] = { k, Producer::IDLE, 0, 0, 0, false, false, 0 };
+    for (int i = 0; i < 10; i++)  tick();
+
+    // Set up:  decimations, then ring mode (which clears the buffer)
+    CHECK(dapRead(SIZE_REG) == SIZE);
+    for (int k = 0; k < PORTS; k++)  dapWrite(DEC0 + k, CONFIG[k].dec);
+    dapWrite(MODE, 1);
+    while (dapRead(CONTROL) & 1)  ;
+    CHECK(dapRead(MODE) == 1);
+    CHECK(dapRead(WRPTR) == 0 && dapRead(RDPTR) == 0 && dapRead(LENGTH) == 0);
+    for (int k = 0; k < PORTS; k++)  producer[k].next = cycle;
+    enabled = true;
+
+    // Phase 1:  sustainable load
+    while (cycle < LOAD_CYCLES)  drain(true);
+    uint32_t wrptr = dapRead(WRPTR);
+    printf( "load:   %llu clocks, %u words (%.2f wraps), max. fill %u words\n", (unsigned long long) cycle, wrptr,
+            double(wrptr) / SIZE, maxFill );
+    CHECK(wrptr > 3 * SIZE);
+    CHECK(dapRead(DROPPED) == 0);
+    CHECK((dapRead(STATUS) & 2) == 0);
+    CHECK(checker.torn == 0);
+    CHECK(checker.gaps == 0);
+    CHECK(checker.badGaps == 0);
+    for (int k = 0; k < PORTS; k++)  CHECK(checker.packets[k] != 0);
+
+    // Phase 2:  overload, until the ring is full
+    for (uint64_t t = 0; t < STALL_CYCLES; t++)  tick();
+    uint32_t length = dapRead(LENGTH);
+    CHECK(length <= SIZE && length > SIZE - 2 * MAX_PACKET);
+    CHECK((dapRead(STATUS) & 3) == 3);
+    CHECK(dapRead(DROPPED) != 0);
+    enabled = false;
+    for (int i = 0; i < 1000; i++)  tick();                 // (let the producers finish their packets)
+    for (int i = 0; i < 4; i++)  drain(false);
+    CHECK(dapRead(LENGTH) == 0);
+    uint32_t dropped = dapRead(DROPPED);
+    uint64_t received = 0, granted = 0;
+    for (int k = 0; k < PORTS; k++) {
+        received += checker.packets[k];
+        granted += (producer[k].seq + CONFIG[k].dec - 1) / CONFIG[k].dec;
+    }
+    printf( "stall:  ring held %u words, %u packets dropped, %llu received, %llu granted by the decimation\n",
+            length, dropped, (unsigned long long) received, (unsigned long long) granted );
+    CHECK(checker.port < 0);
+    CHECK(checker.torn == 0);
+    CHECK(checker.badGaps == 0);
+    CHECK(received + dropped == granted);
+
+    delete dut;
+    if (failures == 0)  printf("debug_capture_module_tb passed\n");
+    else  printf("debug_capture_module_tb %d checks FAILED\n", failures);
+    return failures == 0  ?  0  :  1;
+}
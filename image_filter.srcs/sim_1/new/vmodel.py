@@ -0,0 +1,752 @@
+# Verilog-to-C++ Model for the Debug Capture Module's Testbench
+#
+# Translates the Verilog subset that debug_capture_module.v, uat32.v, and blk_mem_64K_32b.v use into a C++ class
+# with the interface of the one Verilator generates (public port members and eval()), so that
+# debug_capture_module_tb.cpp can be built and run where Verilator is not installed ("make model").  The model is
+# two-state and flattened, with Verilog's nonblocking-assignment semantics and context-determined expression widths.
+# It is not a general Verilog compiler:  it stops at what it does not handle.
+#
+# To run:  python3 vmodel.py file.v ... top_module out_dir
+#          writes out_dir/Vtop_module.h and out_dir/verilated.h
+#
+# language: Python 3
+import os, re, sys
+
+TOKEN = re.compile(r"""
+    (?P<ws>\s+|//[^\n]*|/\*.*?\*/|`[^\n]*) |
+    (?P<num>\d*'[bBhHdDoO][0-9a-fA-F_xXzZ]+|\d+\.\d*(?:[eE][+-]?\d+)?|\d+[eE][+-]?\d+|\d+) |
+    (?P<id>[A-Za-z_$][A-Za-z0-9_$]*) |
+    (?P<op>\+:|-:|<<|>>|<=|>=|==|!=|&&|\|\||[-+*/%&|^~!<>?:;,.=#@()\[\]{}])
+""", re.S | re.X)
+
+
+def lex(src):
+    toks, pos = [], 0
+    while pos < len(src):
+        m = TOKEN.match(src, pos)
+        if not m:
+            sys.exit("lex error at: " + src[pos:pos + 40])
+        pos = m.end()
+        if m.lastgroup != 'ws':
+            toks.append((m.lastgroup, m.group()))
+    return toks
+
+
+class Parser:
+    def __init__(self, toks):
+        self.t, self.i = toks, 0
+
+    def peek(self, k=0):
+        return self.t[self.i + k][1] if self.i + k < len(self.t) else None
+
+    def next(self):
+        self.i += 1
+        return self.t[self.i - 1][1]
+
+    def expect(self, s):
+        x = self.next()
+        if x != s:
+            near = ' '.join(v for _, v in self.t[self.i - 8:self.i + 4])
+            sys.exit("expected %r, got %r near:  %s" % (s, x, near))
+
+    def accept(self, s):
+        if self.peek() == s:
+            self.i += 1
+            return True
+        return False
+
+    def ident(self):
+        kind, v = self.t[self.i]
+        if kind != 'id':
+            sys.exit("expected identifier, got %r" % v)
+        self.i += 1
+        return v
+
+    # modules
+    def modules(self):
+        mods = {}
+        while self.peek() is not None:
+            self.expect('module')
+            m = self.module()
+            mods[m['name']] = m
+        return mods
+
+    def module(self):
+        m = {'name': self.ident(), 'params': [], 'ports': [], 'items': []}
+        if self.accept('#'):
+            self.expect('(')
+            while True:
+                self.expect('parameter')
+                kind, rng = self.ptype()
+                name = self.ident()
+                self.expect('=')
+                m['params'].append((name, kind, rng, self.expr()))
+                if not self.accept(','):
+                    break
+            self.expect(')')
+        self.expect('(')
+        while True:
+            d = self.next()
+            assert d in ('input', 'output'), d
+            reg = self.accept('reg')
+            self.accept('wire')
+            rng = self.range_()
+            name = self.ident()
+            init = self.expr() if self.accept('=') else None
+            m['ports'].append({'dir': d, 'reg': reg, 'range': rng, 'name': name, 'init': init})
+            if not self.accept(','):
+                break
+        self.expect(')')
+        self.expect(';')
+        while not self.accept('endmodule'):
+            m['items'].append(self.item())
+        return m
+
+    def ptype(self):
+        if self.accept('real'):
+            return 'real', None
+        if self.accept('integer'):
+            return 'integer', None
+        return 'bits', self.range_()
+
+    def range_(self):
+        if self.peek() != '[':
+            return None
+        self.expect('[')
+        h = self.expr()
+        self.expect(':')
+        l = self.expr()
+        self.expect(']')
+        return (h, l)
+
+    def item(self):
+        w = self.peek()
+        if w == 'localparam':
+            self.next()
+            kind, rng = self.ptype()
+            out = []
+            while True:
+                name = self.ident()
+                self.expect('=')
+                out.append((name, self.expr()))
+                if not self.accept(','):
+                    break
+            self.expect(';')
+            return ('localparam', kind, rng, out)
+        if w in ('reg', 'wire'):
+            self.next()
+            rng = self.range_()
+            out = []
+            while True:
+                name = self.ident()
+                dims = self.range_()
+                init = self.expr() if self.accept('=') else None
+                out.append((name, dims, init))
+                if not self.accept(','):
+                    break
+            self.expect(';')
+            return (w, rng, out)
+        if w == 'assign':
+            self.next()
+            out = []
+            while True:
+                name = self.ident()
+                self.expect('=')
+                out.append((name, self.expr()))
+                if not self.accept(','):
+                    break
+            self.expect(';')
+            return ('assign', out)
+        if w == 'always':
+            self.next()
+            self.expect('@')
+            self.expect('(')
+            edge = self.next()
+            assert edge in ('posedge', 'negedge'), edge
+            clk = self.ident()
+            self.expect(')')
+            return ('always', edge, clk, self.stmt())
+        # instantiation
+        mod = self.ident()
+        params = []
+        if self.accept('#'):
+            self.expect('(')
+            while True:
+                self.expect('.')
+                p = self.ident()
+                self.expect('(')
+                params.append((p, self.expr()))
+                self.expect(')')
+                if not self.accept(','):
+                    break
+            self.expect(')')
+        inst = self.ident()
+        self.expect('(')
+        conns = []
+        while True:
+            self.expect('.')
+            p = self.ident()
+            self.expect('(')
+            conns.append((p, self.expr()))
+            self.expect(')')
+            if not self.accept(','):
+                break
+        self.expect(')')
+        self.expect(';')
+        return ('inst', mod, params, inst, conns)
+
+    def stmt(self):
+        if self.accept('begin'):
+            body = []
+            while not self.accept('end'):
+                body.append(self.stmt())
+            return ('block', body)
+        if self.accept('if'):
+            self.expect('(')
+            c = self.expr()
+            self.expect(')')
+            a = self.stmt()
+            b = self.stmt() if self.accept('else') else None
+            return ('if', c, a, b)
+        if self.accept('case'):
+            self.expect('(')
+            sel = self.expr()
+            self.expect(')')
+            items, default = [], None
+            while not self.accept('endcase'):
+                if self.accept('default'):
+                    self.accept(':')
+                    default = self.stmt()
+                    continue
+                labels = [self.expr()]
+                while self.accept(','):
+                    labels.append(self.expr())
+                self.expect(':')
+                items.append((labels, self.stmt()))
+            return ('case', sel, items, default)
+        if self.accept(';'):
+            return ('block', [])
+        name = self.ident()
+        idx = None
+        if self.accept('['):
+            idx = self.expr()
+            self.expect(']')
+        op = self.next()
+        assert op in ('<=', '='), op
+        rhs = self.expr()
+        self.expect(';')
+        return ('nba' if op == '<=' else 'ba', name, idx, rhs)
+
+    # expressions
+    BINARY = [['||'], ['&&'], ['|'], ['^'], ['&'], ['==', '!='], ['<', '<=', '>', '>='], ['<<', '>>'], ['+', '-'],
+              ['*', '/', '%']]
+
+    def expr(self):
+        c = self.binary(0)
+        if self.accept('?'):
+            a = self.expr()
+            self.expect(':')
+            b = self.expr()
+            return ('?', c, a, b)
+        return c
+
+    def binary(self, level):
+        if level == len(self.BINARY):
+            return self.unary()
+        a = self.binary(level + 1)
+        while self.peek() in self.BINARY[level]:
+            op = self.next()
+            a = ('bin', op, a, self.binary(level + 1))
+        return a
+
+    def unary(self):
+        if self.peek() in ('!', '~', '-', '+'):
+            return ('un', self.next(), self.unary())
+        return self.primary()
+
+    def primary(self):
+        kind, v = self.t[self.i]
+        if kind == 'num':
+            self.i += 1
+            return number(v)
+        if self.accept('('):
+            e = self.expr()
+            self.expect(')')
+            return e
+        if self.accept('{'):
+            first = self.expr()
+            if self.accept('{'):                        # replication
+                parts = [self.expr()]
+                while self.accept(','):
+                    parts.append(self.expr())
+                self.expect('}')
+                self.expect('}')
+                return ('rep', first, ('cat', parts))
+            parts = [first]
+            while self.accept(','):
+                parts.append(self.expr())
+            self.expect('}')
+            return ('cat', parts)
+        name = self.ident()
+        if self.accept('['):
+            a = self.expr()
+            if self.accept(':'):
+                b = self.expr()
+                self.expect(']')
+                return ('part', name, a, b)
+            if self.accept('+:'):
+                b = self.expr()
+                self.expect(']')
+                return ('plus', name, a, b)
+            self.expect(']')
+            return ('sel', name, a)
+        return ('id', name)
+
+
+def number(v):
+    if "'" in v:
+        size, rest = v.split("'")
+        base = {'b': 2, 'h': 16, 'd': 10, 'o': 8}[rest[0].lower()]
+        digits = rest[1:].replace('_', '')
+        assert not re.search('[xXzZ]', digits), v
+        return ('num', int(digits, base), int(size) if size else 32)
+    if re.search(r'[.eE]', v):
+        return ('real', float(v))
+    return ('num', int(v), 32)
+
+
+def mask(w):
+    return (1 << w) - 1
+
+
+# ----- elaboration -----
+
+class Sig:
+    def __init__(self, kind, name, width, cname, init=None, expr=None, scope=None, depth=None, lo=0):
+        self.kind, self.name, self.width, self.cname = kind, name, width, cname
+        self.init, self.expr, self.scope, self.depth, self.lo = init, expr, scope, depth, lo
+        self.assigned = set()               # 'nba' and/or 'ba'
+
+
+class Scope:
+    def __init__(self, prefix, parent=None):
+        self.prefix, self.parent, self.names = prefix, parent, {}
+
+    def const(self, e):
+        """constant-fold an expression of parameters"""
+        k = e[0]
+        if k in ('num', 'real'):
+            return e[1]
+        if k == 'id':
+            s = self.names[e[1]]
+            assert s.kind == 'const', e
+            return s.init
+        if k == 'un':
+            a = self.const(e[2])
+            return {'-': lambda: -a, '+': lambda: a, '!': lambda: int(not a), '~': lambda: ~a}[e[1]]()
+        if k == 'bin':
+            a, b = self.const(e[2]), self.const(e[3])
+            op = e[1]
+            if op == '/':
+                return a / b if isinstance(a, float) or isinstance(b, float) else a // b
+            if op == '<<':
+                return a << b
+            return {'+': a + b, '-': a - b, '*': a * b}[op]
+        sys.exit("not constant: %r" % (e,))
+
+    def width(self, rng):
+        if rng is None:
+            return 1
+        h, l = self.const(rng[0]), self.const(rng[1])
+        assert l == 0, "ranges must end at 0"
+        return h + 1
+
+
+signals = []            # all storage-bearing signals, in declaration order
+blocks = []             # (edge, clock Sig, stmt, scope)
+
+
+def elaborate(mods, mname, prefix, params, bindings, top):
+    m = mods[mname]
+    sc = Scope(prefix)
+    for name, kind, rng, e in m['params']:
+        v = params.get(name, sc.const(e))
+        sc.names[name] = Sig('const', name, 32, None, init=v)
+    for p in m['ports']:
+        name, w = p['name'], sc.width(p['range'])
+        if p['dir'] == 'input':
+            if top:
+                s = Sig('port', name, w, name)
+            else:
+                s = Sig('wire', name, w, prefix + name, expr=bindings[name][0], scope=bindings[name][1])
+        elif p['reg']:
+            s = Sig('reg', name, w, name if top else prefix + name, init=p['init'])
+            s.port = top
+            signals.append(s)
+        else:
+            s = Sig('wire', name, w, name if top else prefix + name)
+            s.port = top
+        s.scope = s.scope or sc
+        if p['dir'] == 'output' and not top:
+            pe = bindings[name][0]
+            assert pe[0] == 'id', "output ports must connect to a net"
+            bindings[name][1].names[pe[1]] = s                  # the parent's net is this signal
+        sc.names[name] = s
+    for it in m['items']:
+        k = it[0]
+        if k == 'localparam':
+            _, kind, rng, out = it
+            for name, e in out:
+                v = sc.const(e)
+                if kind == 'bits':
+                    v = int(round(v)) & mask(sc.width(rng)) if isinstance(v, float) else v & mask(sc.width(rng))
+                sc.names[name] = Sig('const', name, sc.width(rng) if kind == 'bits' else 32, None, init=v)
+        elif k in ('reg', 'wire'):
+            _, rng, out = it
+            w = sc.width(rng)
+            for name, dims, init in out:
+                if k == 'reg':
+                    if dims:
+                        lo, hi = sc.const(dims[0]), sc.const(dims[1])
+                        s = Sig('mem', name, w, prefix + name, depth=hi - lo + 1, lo=lo)
+                    else:
+                        s = Sig('reg', name, w, prefix + name, init=init)
+                    s.port = False
+                    signals.append(s)
+                elif name in sc.names and init is None:
+                    continue                                    # (already an output port's net)
+                else:
+                    s = Sig('wire', name, w, prefix + name, expr=init)
+                    s.port = False
+                s.scope = sc
+                sc.names[name] = s
+        elif k == 'assign':
+            for name, e in it[1]:
+                s = sc.names[name]
+                assert s.kind == 'wire' and s.expr is None, name
+                s.expr, s.scope = e, sc
+        elif k == 'always':
+            _, edge, clk, st = it
+            blocks.append((edge, sc.names[clk], st, sc))
+        elif k == 'inst':
+            _, mod, ps, inst, conns = it
+            pv = {p: sc.const(e) for p, e in ps}
+            b = {}
+            for p, e in conns:
+                if e[0] == 'id' and e[1] not in sc.names:       # implicit net
+                    sc.names[e[1]] = Sig('wire', e[1], 1, prefix + e[1])
+                b[p] = (e, sc)
+            elaborate(mods, mod, prefix + inst + '__', pv, b, False)
+    return sc
+
+
+def root(s):
+    """the top-level port a clock comes from"""
+    while s.kind == 'wire':
+        assert s.expr[0] == 'id', "clock must be a plain net"
+        s = s.scope.names[s.expr[1]]
+    assert s.kind == 'port', s.name
+    return s
+
+
+# ----- code generation -----
+
+def lit(v):
+    return 'UINT64_C(0x%x)' % v
+
+
+def selfw(e, sc):
+    k = e[0]
+    if k == 'num':
+        return e[2]
+    if k == 'id':
+        return sc.names[e[1]].width
+    if k == 'sel':
+        return 1
+    if k == 'part':
+        return sc.const(e[2]) - sc.const(e[3]) + 1
+    if k == 'plus':
+        return sc.const(e[3])
+    if k == 'cat':
+        return sum(selfw(x, sc) for x in e[1])
+    if k == 'rep':
+        return sc.const(e[1]) * selfw(e[2], sc)
+    if k == 'un':
+        return 1 if e[1] == '!' else selfw(e[2], sc)
+    if k == 'bin':
+        if e[1] in ('==', '!=', '<', '<=', '>', '>=', '&&', '||'):
+            return 1
+        if e[1] in ('<<', '>>'):
+            return selfw(e[2], sc)
+        return max(selfw(e[2], sc), selfw(e[3], sc))
+    if k == '?':
+        return max(selfw(e[2], sc), selfw(e[3], sc))
+    sys.exit("width of %r" % (e,))
+
+
+def value(s):
+    """C++ expression for a signal's current value"""
+    if s.kind == 'const':
+        return lit(s.init)
+    if s.kind == 'wire':
+        return 'w_%s()' % s.cname
+    return '(uint64_t) %s' % s.cname
+
+
+def gen(e, sc, w):
+    """C++ for expression e evaluated at context width w (>= its self-determined width), masked to w"""
+    k = e[0]
+    if k == 'num':
+        return lit(e[1] & mask(w))
+    if k == 'id':
+        return value(sc.names[e[1]])
+    if k == 'sel':
+        s = sc.names[e[1]]
+        if s.kind == 'mem':
+            return '(uint64_t) %s[%s]' % (s.cname, index(s, e[2], sc))
+        return '((%s >> %s) & 1)' % (value(s), gen(e[2], sc, selfw(e[2], sc)))
+    if k == 'part':
+        h, l = sc.const(e[2]), sc.const(e[3])
+        return '((%s >> %d) & %s)' % (value(sc.names[e[1]]), l, lit(mask(h - l + 1)))
+    if k == 'plus':
+        l, n = sc.const(e[2]), sc.const(e[3])
+        return '((%s >> %d) & %s)' % (value(sc.names[e[1]]), l, lit(mask(n)))
+    if k == 'cat':
+        out, shift = [], 0
+        for x in reversed(e[1]):
+            out.append('(%s << %d)' % (gen(x, sc, selfw(x, sc)), shift))
+            shift += selfw(x, sc)
+        assert shift <= 64
+        return '(' + ' | '.join(out) + ')'
+    if k == 'rep':
+        n, inner = sc.const(e[1]), e[2]
+        iw = selfw(inner, sc)
+        v = gen(inner, sc, iw)
+        return '(' + ' | '.join('(%s << %d)' % (v, i * iw) for i in range(n)) + ')'
+    if k == 'un':
+        if e[1] == '!':
+            return '(uint64_t) !%s' % gen(e[2], sc, selfw(e[2], sc))
+        if e[1] == '~':
+            return '(~%s & %s)' % (gen(e[2], sc, w), lit(mask(w)))
+        if e[1] == '-':
+            return '((0 - %s) & %s)' % (gen(e[2], sc, w), lit(mask(w)))
+        return gen(e[2], sc, w)
+    if k == 'bin':
+        op, a, b = e[1], e[2], e[3]
+        if op in ('&&', '||'):
+            return '(uint64_t) (%s %s %s)' % (gen(a, sc, selfw(a, sc)), op, gen(b, sc, selfw(b, sc)))
+        if op in ('==', '!=', '<', '<=', '>', '>='):
+            ow = max(selfw(a, sc), selfw(b, sc))
+            return '(uint64_t) (%s %s %s)' % (gen(a, sc, ow), op, gen(b, sc, ow))
+        if op in ('<<', '>>'):
+            r = '(%s %s %s)' % (gen(a, sc, w), op, gen(b, sc, selfw(b, sc)))
+            return '(%s & %s)' % (r, lit(mask(w))) if op == '<<' else r
+        if op in ('&', '|', '^'):
+            return '(%s %s %s)' % (gen(a, sc, w), op, gen(b, sc, w))
+        if op in ('+', '-', '*'):
+            return '((%s %s %s) & %s)' % (gen(a, sc, w), op, gen(b, sc, w), lit(mask(w)))
+        sys.exit("operator %s" % op)
+    if k == '?':
+        return '(%s ? %s : %s)' % (gen(e[1], sc, selfw(e[1], sc)), gen(e[2], sc, w), gen(e[3], sc, w))
+    sys.exit("expression %r" % (e,))
+
+
+def index(s, e, sc):
+    i = gen(e, sc, selfw(e, sc))
+    return '%s - %d' % (i, s.lo) if s.lo else i
+
+
+def rhs(e, sc, w):
+    assert w <= 64
+    return '(%s & %s)' % (gen(e, sc, max(w, selfw(e, sc))), lit(mask(w)))
+
+
+def stmt(st, sc, ind, out):
+    k = st[0]
+    p = ' ' * ind
+    if k == 'block':
+        for x in st[1]:
+            stmt(x, sc, ind, out)
+    elif k == 'if':
+        out.append('%sif (%s) {' % (p, gen(st[1], sc, selfw(st[1], sc))))
+        stmt(st[2], sc, ind + 4, out)
+        if st[3] is not None:
+            out.append('%s} else {' % p)
+            stmt(st[3], sc, ind + 4, out)
+        out.append('%s}' % p)
+    elif k == 'case':
+        sel, items, default = st[1], st[2], st[3]
+        ow = max([selfw(sel, sc)] + [selfw(l, sc) for labels, _ in items for l in labels])
+        out.append('%s{ uint64_t sel = %s;' % (p, gen(sel, sc, ow)))
+        first = True
+        for labels, body in items:
+            cond = ' || '.join('sel == %s' % gen(l, sc, ow) for l in labels)
+            out.append('%s%sif (%s) {' % (p, '' if first else '} else ', cond))
+            stmt(body, sc, ind + 4, out)
+            first = False
+        if default is not None:
+            out.append('%s%s{' % (p, '' if first else '} else '))
+            stmt(default, sc, ind + 4, out)
+            first = False
+        if not first:
+            out.append('%s}' % p)
+        out.append('%s}' % p)
+    elif k in ('nba', 'ba'):
+        _, name, idx, e = st
+        s = sc.names[name]
+        s.assigned.add(k)
+        if s.kind == 'mem':
+            assert k == 'nba'
+            out.append('%smemq_%s.push_back({ (uint32_t) (%s), (%s) %s });' % (
+                p, s.cname, index(s, idx, sc), ctype(s.width), rhs(e, sc, s.width)))
+        else:
+            assert s.kind == 'reg' and idx is None, name
+            if k == 'nba':
+                out.append('%snba_%s = %s;' % (p, s.cname, rhs(e, sc, s.width)))
+            else:
+                out.append('%s%s = %s;' % (p, s.cname, rhs(e, sc, s.width)))
+    else:
+        sys.exit("statement %r" % (st,))
+
+
+def ctype(w):
+    return 'CData' if w <= 8 else 'SData' if w <= 16 else 'IData' if w <= 32 else 'QData'
+
+
+def main():
+    files, top, out = sys.argv[1:-2], sys.argv[-2], sys.argv[-1]
+    if len(files) == 0:
+        sys.exit('usage:  python3 vmodel.py file.v ... top_module out_dir')
+    mods = {}
+    for f in files:
+        mods.update(Parser(lex(open(f).read())).modules())
+    sc = elaborate(mods, top, '', {}, {}, True)
+    m = mods[top]
+
+    body = []
+    edges = {}
+    for edge, clk, st, bsc in blocks:
+        edges.setdefault((edge, root(clk).name), []).append((st, bsc))
+    code = {}
+    for key, bl in edges.items():
+        lines = []
+        for st, bsc in bl:
+            stmt(st, bsc, 12, lines)
+        code[key] = lines
+
+    regs = [s for s in signals if s.kind == 'reg']
+    mems = [s for s in signals if s.kind == 'mem']
+    for s in regs:
+        assert s.assigned != {'nba', 'ba'}, "%s is assigned both ways" % s.name
+    wires = []
+    seen = set()
+
+    def collect(scope):
+        for s in scope.names.values():
+            if s.kind == 'wire' and id(s) not in seen:
+                seen.add(id(s))
+                wires.append(s)
+    # every wire reachable from any scope: walk the elaborated scopes through the signals' scopes
+    scopes = {id(sc): sc}
+    for s in signals:
+        scopes[id(s.scope)] = s.scope
+    for _, _, _, bsc in blocks:
+        scopes[id(bsc)] = bsc
+    changed = True
+    while changed:
+        changed = False
+        for x in list(scopes.values()):
+            for s in x.names.values():
+                if s.scope is not None and id(s.scope) not in scopes:
+                    scopes[id(s.scope)] = s.scope
+                    changed = True
+    for x in scopes.values():
+        collect(x)
+
+    L = []
+    L.append('// Generated by vmodel.py from %s -- do not edit' % ', '.join(os.path.basename(f) for f in files))
+    L.append('#pragma once')
+    L.append('#include <cstdint>')
+    L.append('#include <vector>')
+    L.append('#include "verilated.h"')
+    L.append('')
+    L.append('struct %s {' % ('V' + top))
+    for p in m['ports']:
+        s = sc.names[p['name']]
+        L.append('    %s %s = %s;' % (ctype(s.width), p['name'], lit(0)))
+    L.append('')
+    for s in regs:
+        if not getattr(s, 'port', False):
+            L.append('    %s %s = 0;' % (ctype(s.width), s.cname))
+    for s in regs:
+        if 'nba' in s.assigned:
+            L.append('    %s nba_%s = 0;' % (ctype(s.width), s.cname))
+    for s in mems:
+        L.append('    std::vector<%s> %s = std::vector<%s>(%d);' % (ctype(s.width), s.cname, ctype(s.width), s.depth))
+        L.append('    struct MemWrite_%s { uint32_t i; %s v; };' % (s.cname, ctype(s.width)))
+        L.append('    std::vector<MemWrite_%s> memq_%s;' % (s.cname, s.cname))
+    clocks = sorted({k[1] for k in code})
+    for c in clocks:
+        L.append('    CData last_%s = 0;' % c)
+    L.append('')
+    for s in wires:
+        if s.expr is None:
+            sys.exit("undriven wire %s" % s.name)
+        L.append('    uint64_t w_%s() const { return %s; }' % (s.cname, rhs(s.expr, s.scope, s.width)))
+    L.append('')
+    L.append('    V%s() {' % top)
+    for s in regs:
+        if s.init is not None:
+            L.append('        %s = %s;' % (s.cname, rhs(s.init, s.scope, s.width)))
+    L.append('        settle();')
+    L.append('    }')
+    L.append('')
+    L.append('    void final() {}')
+    L.append('')
+    L.append('    void settle() {')
+    for p in m['ports']:
+        s = sc.names[p['name']]
+        if p['dir'] == 'output' and s.kind == 'wire':
+            L.append('        %s = w_%s();' % (p['name'], s.cname))
+    L.append('    }')
+    L.append('')
+    L.append('    void eval() {')
+    for c in clocks:
+        L.append('        bool pos_%s = %s && !last_%s, neg_%s = !%s && last_%s;' % (c, c, c, c, c, c))
+        L.append('        last_%s = %s;' % (c, c))
+    L.append('        if (%s) {' % ' || '.join('pos_%s || neg_%s' % (c, c) for c in clocks))
+    for s in regs:
+        if 'nba' in s.assigned:
+            L.append('            nba_%s = %s;' % (s.cname, s.cname))
+    for (edge, c), lines in code.items():
+        L.append('            if (%s_%s) {' % ('pos' if edge == 'posedge' else 'neg', c))
+        L.extend('    ' + x for x in lines)
+        L.append('            }')
+    for s in regs:
+        if 'nba' in s.assigned:
+            L.append('            %s = nba_%s;' % (s.cname, s.cname))
+    for s in mems:
+        L.append('            for (const auto &w : memq_%s)  %s[w.i] = w.v;' % (s.cname, s.cname))
+        L.append('            memq_%s.clear();' % s.cname)
+    L.append('        }')
+    L.append('        settle();')
+    L.append('    }')
+    L.append('};')
+    os.makedirs(out, exist_ok=True)
+    open(os.path.join(out, 'V%s.h' % top), 'w').write('\n'.join(L) + '\n')
+    open(os.path.join(out, 'verilated.h'), 'w').write(VERILATED)
+
+
+VERILATED = '''// Generated by vmodel.py -- the parts of Verilator's header that a testbench of a vmodel.py model uses
+#pragma once
+#include <cstdint>
+typedef uint8_t  CData;
+typedef uint16_t SData;
+typedef uint32_t IData;
+typedef uint64_t QData;
+struct Verilated { static void commandArgs(int, char **) {} };
+'''
+
+
+if __name__ == '__main__':
+    main()
@@ -16,6 +16,13 @@
 //      a 32-bit word in which bits 31:26 is the packet type (which indicates the packet's
 //      source and length) and bits 25:0 is a timestamp in microseconds modulo 2**26.
 //
+//      The buffer is linear (mode 0) or a ring (mode 1).  A linear buffer fills from word 0
+//      and then discards packets until it is cleared.  A ring is appended to at wrptr and
+//      drained by the host, which reads words rdptr .. wrptr-1 (at buffer addresses modulo
+//      the size) and then writes the new rdptr.  A packet is granted only if the ring has
+//      room for MAX_PACKET words, so packets are dropped whole (and counted), never torn,
+//      and the host can stream the telemetry losslessly as long as it keeps up.
+//
 //      Address:
 //        0 .. 24'h00FFFF   data      ro     Buffer, an array of 2**16 uint32_t words
 //
@@ -28,12 +35,14 @@
 //                             buffer's length N is latched, N is then transmitted as a 32-bit word (little endian)
 //                             followed by the buffer's first N 32-bit words, and a checksum word computed as
 //                             0xFFFFFFFF - sum of the N words.  Lastly this flag will reset to 0 (this will happen
-//                             immediately before the checksum word is transmitted).
+//                             immediately before the checksum word is transmitted).  Linear mode only (in ring
+//                             mode N is 0).
 //              0     clear  Write a 1 to clear the buffer.  If a telemetry packet is being appended, the
 //                             clear operation will happen after the append operation completes.  When done,
 //                             this flag will reset to 0.
 //
-//        24'h800001        length    ro     Number of 32-bit words in the buffer (0 .. 1<<ADDR_WIDTH)
+//        24'h800001        length    ro     Number of 32-bit words in the buffer (0 .. 1<<ADDR_WIDTH); in ring
+//                                             mode, the number of words not yet drained (wrptr - rdptr)
 //
 //        24'h800002        size      ro     Buffer's capacity in 32-bit words (always 1<<ADDR_WIDTH)
 //
@@ -49,6 +58,26 @@
 //
 //        24'h800008        dec5      rw     Telemetry port 5's decimation (1..65535, or 0 to discard all packets; initially 0)
 //
+//        24'h800009        mode      rw     Buffer's mode:  bit 0 is 0 for linear (initially), 1 for ring.  Writing it
+//                                             also clears the buffer; the new mode takes effect with the clear.
+//
+//        24'h80000A        wrptr     ro     Ring mode:  number of words appended since the clear (free running)
+//
+//        24'h80000B        rdptr     rw     Ring mode:  number of words drained by the host since the clear (free
+//                                             running; must be within wrptr-size .. wrptr).  Reset by a clear.
+//
+//        24'h80000C        hwm       rw     High watermark in 32-bit words (0 .. 1<<ADDR_WIDTH; initially half the size)
+//
+//        24'h80000D        status    ro     Status register
+//
+//              Bits  Name   Description
+//              ----  -----  -------------------------------------------------------------------------------------
+//              31:2   --    Reserved (Always 0)
+//              1     drop   1 if a packet was dropped because the ring was full since the clear
+//              0     hwm    1 if the length is at least hwm
+//
+//        24'h80000E        dropped   ro     Ring mode:  number of packets dropped because the ring was full since the clear
+//
 // Dependencies: 
 // 
 // Revision:
@@ -161,9 +190,21 @@ module debug_capture_module
 
     localparam integer ADDR_WIDTH = 16;   // buffer size is 1<<ADDR_WIDTH  (1..31)
 
+    localparam integer MAX_PACKET = 64;   // longest telemetry packet in 32-bit words; a ring grants a packet only if it has room for this many
+
     reg  [ADDR_WIDTH:0]    count  =  0;                   // number of 32-bit words in the buffer (0 .. 1<<ADDR_WIDTH)
     wire                   full   =  count[ADDR_WIDTH];   // buffer-is-full flag
 
+    // Ring mode
+    reg                    ring       =  0;               // ring-mode flag (latched from ring_mode when the buffer is cleared)
+    reg  [31:0]            wrptr      =  0;               // number of words appended since the clear
+    reg  [31:0]            rdptr      =  0;               // number of words drained by the host since the clear
+    reg  [31:0]            dropped    =  0;               // number of packets dropped because the ring was full
+    wire [31:0]            fill       =  wrptr - rdptr;   // number of words in the ring (0 .. 1<<ADDR_WIDTH)
+    wire                   ring_full  =  fill >= (1 << ADDR_WIDTH);                 // ring-is-full flag
+    wire                   room       =  !ring || fill <= (1 << ADDR_WIDTH) - MAX_PACKET;   // a packet may be granted
+    wire [ADDR_WIDTH:0]    length     =  ring  ?  fill[ADDR_WIDTH:0]  :  count;     // length register
+
     reg                    wea    =  0;
     reg  [ADDR_WIDTH-1:0]  addra  =  0;
     reg  [31:0]            dina   =  0;
@@ -210,6 +251,10 @@ module debug_capture_module
     reg                 dumping        =  0;   // buffer-is-being-transmitted-out-the-serial-port flag
     reg [31:0]          dump_checksum  =  ~0;  // checksum computed as -sum(data); the header word is excluded from this sum
     reg [ADDR_WIDTH:0]  dump_count     =  0;   // number of 32-bit words left to send (0 .. 1<<ADDR_WIDTH)
+    reg                 ring_mode      =  0;   // mode register:  ring mode requested (takes effect when the buffer is cleared)
+    reg [ADDR_WIDTH:0]  hwm            =  1 << (ADDR_WIDTH-1);   // high watermark in 32-bit words
+    reg                 rdptr_we       =  0;   // rdptr-write strobe: pulses for 1 clk cycle to set rdptr to rdptr_new
+    reg [31:0]          rdptr_new      =  0;   // rdptr written by the host
 
     reg rva      =  0;    // read-from-block-mem-port-a-is-valid
     reg rva_z    =  0;    // future read-from-block-mem-port-a-is-valid 
@@ -237,6 +282,7 @@ module debug_capture_module
         clear        <=  0;
         dump         <=  0;
         uat32_valid  <=  0;
+        rdptr_we     <=  0;
     
         rva     <=  rva_z;
         rva_z   <=  rva_zz;
@@ -266,11 +312,20 @@ module debug_capture_module
                     6:  dec3  <=  wdata[15:0];
                     7:  dec4  <=  wdata[15:0];
                     8:  dec5  <=  wdata[15:0];
+                    9:  begin
+                            ring_mode  <=  wdata[0];
+                            clear      <=  1;
+                        end
+                    11: begin
+                            rdptr_new  <=  wdata;
+                            rdptr_we   <=  1;
+                        end
+                    12: hwm   <=  wdata[ADDR_WIDTH:0];
                 endcase
             if (re)
                 case (addr[3:0])
                     0:  rdata  <=  {30'b0, dumping, clearing};
-                    1:  rdata  <=  count;
+                    1:  rdata  <=  length;
                     2:  rdata  <=  1 << ADDR_WIDTH;
                     3:  rdata  <=  dec0;
                     4:  rdata  <=  dec1;
@@ -278,6 +333,12 @@ module debug_capture_module
                     6:  rdata  <=  dec3;
                     7:  rdata  <=  dec4;
                     8:  rdata  <=  dec5;
+                    9:  rdata  <=  ring_mode;
+                    10: rdata  <=  wrptr;
+                    11: rdata  <=  rdptr;
+                    12: rdata  <=  hwm;
+                    13: rdata  <=  {30'b0, dropped != 0, length >= hwm};
+                    14: rdata  <=  dropped;
                     default:  rdata  <=  32'hDEADBEEF;
                 endcase
         end
@@ -314,6 +375,8 @@ module debug_capture_module
 
         clearing <= clearing | clear;
 
+        if (rdptr_we)  rdptr <= rdptr_new;   // the host drained the ring up to rdptr_new
+
         case (state)
             STATE_INIT:     begin                   // Initialize
                                 dec0cnt   <=  1;
@@ -324,6 +387,10 @@ module debug_capture_module
                                 dec5cnt   <=  1;
                                 count     <=  0;
                                 clearing  <=  0;
+                                ring      <=  ring_mode;
+                                wrptr     <=  0;
+                                rdptr     <=  0;
+                                dropped   <=  0;
                                 // !!!NOTE Trigger-recording logic could be added here. Presently starts recording immediately.
                                 state     <=  STATE_LOOP;
                             end
@@ -331,8 +398,9 @@ module debug_capture_module
             STATE_LOOP:     state  <=  clearing ? STATE_INIT : STATE_PORT0;   // If requested to clear the buffer, clear it
 
             STATE_PORT0:    if (req0) begin         // Check telemetry port 0
-                                if (dec0cnt == 1 && dec0)  ack0 <= 1;
+                                if (dec0cnt == 1 && dec0 && room)  ack0 <= 1;
                                 else  nak0 <= 1;
+                                if (dec0cnt == 1 && dec0 && !room)  dropped <= dropped + 1;
                                 dec0cnt  <=  dec0cnt >= dec0  ?  1  :  dec0cnt + 1;
                                 state <= STATE_PORT0_;
                             end
@@ -345,8 +413,9 @@ module debug_capture_module
                             end
 
             STATE_PORT1:    if (req1) begin         // Check telemetry port 1
-                                if (dec1cnt == 1 && dec1)  ack1 <= 1;
+                                if (dec1cnt == 1 && dec1 && room)  ack1 <= 1;
                                 else  nak1 <= 1;
+                                if (dec1cnt == 1 && dec1 && !room)  dropped <= dropped + 1;
                                 dec1cnt  <=  dec1cnt >= dec1  ?  1  :  dec1cnt + 1;
                                 state <= STATE_PORT1_;
                             end
@@ -359,8 +428,9 @@ module debug_capture_module
                             end
 
             STATE_PORT2:    if (req2) begin     // Check telemetry port 2
-                                if (dec2cnt == 1 && dec2)  ack2 <= 1;
+                                if (dec2cnt == 1 && dec2 && room)  ack2 <= 1;
                                 else  nak2 <= 1;
+                                if (dec2cnt == 1 && dec2 && !room)  dropped <= dropped + 1;
                                 dec2cnt  <=  dec2cnt >= dec2  ?  1  :  dec2cnt + 1;
                                 state <= STATE_PORT2_;
                             end
@@ -373,8 +443,9 @@ module debug_capture_module
                             end
 
             STATE_PORT3:    if (req3) begin     // Check telemetry port 3
-                                if (dec3cnt == 1 && dec3)  ack3 <= 1;
+                                if (dec3cnt == 1 && dec3 && room)  ack3 <= 1;
                                 else  nak3 <= 1;
+                                if (dec3cnt == 1 && dec3 && !room)  dropped <= dropped + 1;
                                 dec3cnt  <=  dec3cnt >= dec3  ?  1  :  dec3cnt + 1;
                                 state <= STATE_PORT3_;
                             end
@@ -387,8 +458,9 @@ module debug_capture_module
                             end
 
             STATE_PORT4:    if (req4) begin     // Check telemetry port 4
-                                if (dec4cnt == 1 && dec4)  ack4 <= 1;
+                                if (dec4cnt == 1 && dec4 && room)  ack4 <= 1;
                                 else  nak4 <= 1;
+                                if (dec4cnt == 1 && dec4 && !room)  dropped <= dropped + 1;
                                 dec4cnt  <=  dec4cnt >= dec4  ?  1  :  dec4cnt + 1;
                                 state <= STATE_PORT4_;
                             end
@@ -401,8 +473,9 @@ module debug_capture_module
                             end
 
             STATE_PORT5:    if (req5) begin     // Check telemetry port 5
-                                if (dec5cnt == 1 && dec5)  ack5 <= 1;
+                                if (dec5cnt == 1 && dec5 && room)  ack5 <= 1;
                                 else  nak5 <= 1;
+                                if (dec5cnt == 1 && dec5 && !room)  dropped <= dropped + 1;
                                 dec5cnt  <=  dec5cnt >= dec5  ?  1  :  dec5cnt + 1;
                                 state <= STATE_PORT5_;
                             end
@@ -418,21 +491,24 @@ module debug_capture_module
         endcase
 
         // Append din to buffer, if din is valid and the buffer isn't full
-        addra  <=  count[ADDR_WIDTH-1:0];
+        addra  <=  ring  ?  wrptr[ADDR_WIDTH-1:0]  :  count[ADDR_WIDTH-1:0];
         dina   <=  din0 & {32{ack0}}  |
                    din1 & {32{ack1}}  |
                    din2 & {32{ack2}}  |
                    din3 & {32{ack3}}  |
                    din4 & {32{ack4}}  |
                    din5 & {32{ack5}};
-        wea    =   !full &&
+        wea    =   !(ring ? ring_full : full) &&
                    ( ack0 & valid0  |
                      ack1 & valid1  |
                      ack2 & valid2  |
                      ack3 & valid3  |
                      ack4 & valid4  |
                      ack5 & valid5 );
-        if (wea)  count <= count + 1;
+        if (wea) begin
+            if (ring)  wrptr <= wrptr + 1;
+            else  count <= count + 1;
+        end
 
     end
 
@@ -0,0 +1,177 @@
+# Read a Capture Archive
+#
+# Reads the segment files <base>.NNNN.seg written by the control utility's
+# --dcm-archive command (c++/ctrl/archive.h documents the format), without
+# the C++ code.  Packet lengths are taken from c++/ctrl/telemetry.def.  Compressed segments (<base>.NNNN.segz)
+# must first be expanded with the control utility's --dcm-expand.
+#
+# Example:
+#     a = CaptureArchive('/data/soak')
+#     a.printStatus()
+#     t, types, words, offsets = a.packets()
+#     tester = offsets[types == 0]        # offsets of the type-0 packets' header words
+#     iters = words[tester + 1] & 0xFFFF
+#     weight = a.weights(types, words, offsets)     # packets each captured packet stands for (decimation)
+#
+# author: RK
+
+import glob
+import os
+import re
+import struct
+import numpy as np
+
+
+ARCHIVE_MAGIC   = 0x414D4344   # "DCMA"
+ARCHIVE_VERSION = 1
+TIME_MASK       = 0x03FFFFFF   # header word's timestamp bits
+DECIMATION_TYPE = 62           # host-written `decimation` packet's type (see DecimationController)
+TELEMETRY_DEF   = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', '..', 'c++', 'ctrl', 'telemetry.def')
+
+
+# Read Packet Lengths from telemetry.def
+# in: fn = (str) telemetry.def's path
+# out: returns {type: (name, length)} (dict of int: (str, int))
+def readSchemas(fn = TELEMETRY_DEF):
+    schemas = {}
+    with open(fn) as f:
+        for line in f:
+            m = re.match(r'\s*PACKET\(\s*(\w+)\s*,\s*(\w+)\s*,\s*(\w+)\s*,', line)
+            if m:
+                schemas[int(m.group(2), 0)] = (m.group(1), int(m.group(3), 0))
+    return schemas
+
+
+# Read Packet Sources from telemetry.def
+# in: fn = (str) telemetry.def's path
+# out: returns {type: port} (dict of int: int) for the packet types with a DCM port (PSOURCE)
+def readSources(fn = TELEMETRY_DEF):
+    types, sources = {}, {}
+    with open(fn) as f:
+        for line in f:
+            m = re.match(r'\s*PACKET\(\s*(\w+)\s*,\s*(\w+)\s*,', line)
+            if m:
+                types[m.group(1)] = int(m.group(2), 0)
+            m = re.match(r'\s*PSOURCE\(\s*(\w+)\s*,\s*(\w+)\s*\)', line)
+            if m:
+                sources[types[m.group(1)]] = int(m.group(2), 0)
+    return sources
+
+
+# Segment Header
+# ---------------
+#
+# The 64-byte header at the start of each segment file (little endian).
+#
+class SegmentHeader:
+
+    FORMAT = '<IHHII II 6H I QQ II'
+    FIELDS = ( 'magic', 'version', 'headerSize', 'index', 'state', 'creationDate', 'buildDate',
+               'dec0', 'dec1', 'dec2', 'dec3', 'dec4', 'dec5', 'capacity', 'startTime', 'firstTime',
+               'words', 'packets' )
+    SIZE   = struct.calcsize(FORMAT)
+    OPEN   = 0
+    CLOSED = 1
+
+    # Intializer
+    # in: data = (bytes) the segment file's first SIZE bytes
+    #     fn = (str) the segment file's name, for error messages
+    def __init__(self, data, fn):
+        if len(data) < self.SIZE:
+            raise Exception(f'{fn} is not an archive segment (too short)')
+        for k, v in zip(self.FIELDS, struct.unpack(self.FORMAT, data[:self.SIZE])):
+            setattr(self, k, v)
+        if self.magic != ARCHIVE_MAGIC:
+            raise Exception(f'{fn} is not an archive segment (bad magic number)')
+        if self.version != ARCHIVE_VERSION:
+            raise Exception(f'{fn} is archive version {self.version}; only version {ARCHIVE_VERSION} is supported')
+        self.dec = [self.dec0, self.dec1, self.dec2, self.dec3, self.dec4, self.dec5]
+
+
+# Capture Archive
+# ---------------
+#
+class CaptureArchive:
+
+    # Intializer
+    # in: base = (str) segments' path without extension, e.g. '/data/soak'
+    #     schemas = ({type: (name, length)} or None) packet lengths, or None to read telemetry.def
+    def __init__(self, base, schemas = None):
+        self.files = sorted(glob.glob(glob.escape(base) + '.[0-9][0-9][0-9][0-9].seg'))
+        if not self.files:
+            raise Exception(f'No archive segments {base}.NNNN.seg')
+        self.schemas = schemas if schemas is not None else readSchemas()
+        self.sources = readSources()
+        self.headers = []
+        for fn in self.files:
+            with open(fn, 'rb') as f:
+                self.headers.append(SegmentHeader(f.read(SegmentHeader.SIZE), fn))
+
+    # Read a Segment's Committed Words
+    # in: i = (int) segment's index in self.files
+    # out: returns the words (numpy.ndarray of uint32)
+    def words(self, i):
+        h = self.headers[i]
+        return np.fromfile(self.files[i], dtype = '<u4', count = h.words, offset = h.headerSize)
+
+    # Find a Segment's Packets
+    # in: i = (int) segment's index in self.files
+    # out: returns (t, types, words, offsets):  each packet's unwrapped time in microseconds (numpy uint64),
+    #      type (numpy uint8), the segment's words, and each packet's header word's offset in words (numpy int64)
+    def segmentPackets(self, i):
+        h = self.headers[i]
+        w = self.words(i)
+        lengths = {length for _, length in self.schemas.values()}
+        if len(lengths) == 1:                       # fast path: all packets have the same length
+            offsets = np.arange(0, len(w), lengths.pop(), dtype = np.int64)
+        else:
+            offsets = np.empty(h.packets, dtype = np.int64)
+            k = 0
+            for j in range(h.packets):
+                offsets[j] = k
+                k += self.schemas[int(w[k]) >> 26][1]
+        headers = w[offsets]
+        ts = (headers & TIME_MASK).astype(np.int64)
+        prev = np.concatenate(([h.firstTime & TIME_MASK], ts[:-1]))
+        t = np.uint64(h.firstTime) + np.cumsum((ts - prev) & TIME_MASK).astype(np.uint64)
+        return t, (headers >> 26).astype(np.uint8), w, offsets
+
+    # Find All Packets
+    # out: returns (t, types, words, offsets) as segmentPackets() does, over the whole archive (offsets index the
+    #      concatenated words)
+    def packets(self):
+        parts = [self.segmentPackets(i) for i in range(len(self.files))]
+        base = np.cumsum([0] + [len(p[2]) for p in parts[:-1]])
+        return ( np.concatenate([p[0] for p in parts]),
+                 np.concatenate([p[1] for p in parts]),
+                 np.concatenate([p[2] for p in parts]),
+                 np.concatenate([p[3] + b for p, b in zip(parts, base)]) )
+
+    # Find Each Packet's Weight
+    # A packet captured at decimation d stands for d packets of its port.  The decimation starts as the first
+    # segment's header's dec, and changes at each `decimation` packet (see --dcm-auto).
+    # in: types, words, offsets = as returned by packets()
+    # out: returns each packet's weight (numpy float64; 1 for packets without a port, e.g. host-written ones)
+    def weights(self, types, words, offsets):
+        ports = np.full(64, -1, dtype = np.int64)
+        for t, p in self.sources.items():
+            ports[t] = p
+        port = ports[types]
+        weight = np.ones(len(types))
+        dec = list(self.headers[0].dec)
+        start = 0
+        for end in list(np.flatnonzero(types == DECIMATION_TYPE)) + [len(types)]:
+            for p in range(6):
+                weight[start:end][port[start:end] == p] = dec[p]
+            if end < len(types):
+                x = offsets[end]
+                dec = [int(words[x + 1 + p // 2]) >> (16 * (p % 2)) & 0xFFFF for p in range(6)]
+            start = end
+        return weight
+
+    # Print Status
+    def printStatus(self):
+        for fn, h in zip(self.files, self.headers):
+            state = 'closed' if h.state == SegmentHeader.CLOSED else 'open'
+            print(f'{fn}:  {h.packets} packets, {h.words} of {h.capacity} words, {state}, '
+                  f'firmware {h.creationDate:08X}/{h.buildDate:08X}, dec {h.dec}')
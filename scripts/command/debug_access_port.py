@@ -104,6 +104,7 @@ class Dap:
         return data
 
     # Read a Data-Capture-Module Dump
+    # (The control utility's --dcm-serial-dump receives a dump natively, streaming it to a file.)
     # out: returns DCM buffer data as an array of 32-bit words (numpy.ndarray of uint32)
     def readDump(self):
         MAX_LEN = 10_000_000   # (int) data array's max. length
@@ -119,7 +120,7 @@ class Dap:
         data = self.ser.read(b)
         if len(data) != b:
             raise Exception('Corrupt Debug Capture Module dump (too few bytes received)')
-        a = np.array([x[0] for x in struct.iter_unpack('<I', data)], dtype = np.uint32)
+        a = np.frombuffer(data, dtype = '<u4').astype(np.uint32)
         if a.sum(dtype=np.uint32) != 0xFFFFFFFF:
             raise Exception('Corrupt Debug Capture Module dump (invalid checksum)')
         return a[:-1]
@@ -217,6 +218,13 @@ class BasicIO:
 # a 32-bit word in which bits 31:26 is the packet type (which indicates the packet's
 # source and length) and bits 25:0 is a timestamp in microseconds modulo 2**26.
 #
+# The buffer is linear (mode 0) or a ring (mode 1).  A linear buffer fills from word 0
+# and then discards packets until it is cleared.  A ring is appended to at wrptr and
+# drained by the host, which reads words rdptr .. wrptr-1 (at buffer addresses modulo
+# the size) and then writes the new rdptr.  A packet is granted only if the ring has
+# room for MAX_PACKET words, so packets are dropped whole (and counted), never torn,
+# and the host can stream the telemetry losslessly as long as it keeps up.
+#
 # Address:
 #   0 .. 24'h00FFFF   data      ro     Buffer, an array of 2**16 uint32_t words
 #
@@ -227,26 +235,50 @@ class BasicIO:
 #         31:2   --    Reserved (Always 0)
 #         1     dump   Write a 1 to dump the buffer to the Debug Serial Port.  When that 1 is written, the
 #                        buffer's length N is latched, N is then transmitted as a 32-bit word (little endian)
-#                        followed by the buffer's first N 32-bit words.  Lastly this flag will reset to 0.
+#                        followed by the buffer's first N 32-bit words, and a checksum word computed as
+#                        0xFFFFFFFF - sum of the N words.  Lastly this flag will reset to 0 (this will happen
+#                        immediately before the checksum word is transmitted).  Linear mode only (in ring
+#                        mode N is 0).
 #         0     clear  Write a 1 to clear the buffer.  If a telemetry packet is being appended, the
 #                        clear operation will happen after the append operation completes.  When done,
 #                        this flag will reset to 0.
 #
-#   24'h800001        length    ro     Number of 32-bit words in the buffer (0 .. 1<<ADDR_WIDTH)
+#   24'h800001        length    ro     Number of 32-bit words in the buffer (0 .. 1<<ADDR_WIDTH); in ring
+#                                        mode, the number of words not yet drained (wrptr - rdptr)
 #
 #   24'h800002        size      ro     Buffer's capacity in 32-bit words (always 1<<ADDR_WIDTH)
 #
-#   24'h800003        dec0      rw     Telemetry port 0's decimation - 1 (0..65534, or 65535 to discard all packets; default is 65535)
+#   24'h800003        dec0      rw     Telemetry port 0's decimation (1..65535, or 0 to discard all packets; initially 0)
+#
+#   24'h800004        dec1      rw     Telemetry port 1's decimation (1..65535, or 0 to discard all packets; initially 0)
+#
+#   24'h800005        dec2      rw     Telemetry port 2's decimation (1..65535, or 0 to discard all packets; initially 0)
+#
+#   24'h800006        dec3      rw     Telemetry port 3's decimation (1..65535, or 0 to discard all packets; initially 0)
+#
+#   24'h800007        dec4      rw     Telemetry port 4's decimation (1..65535, or 0 to discard all packets; initially 0)
+#
+#   24'h800008        dec5      rw     Telemetry port 5's decimation (1..65535, or 0 to discard all packets; initially 0)
 #
-#   24'h800004        dec1      rw     Telemetry port 1's decimation - 1 (0..65534, or 65535 to discard all packets; default is 65535)
+#   24'h800009        mode      rw     Buffer's mode:  bit 0 is 0 for linear (initially), 1 for ring.  Writing it
+#                                        also clears the buffer; the new mode takes effect with the clear.
 #
-#   24'h800005        dec2      rw     Telemetry port 2's decimation - 1 (0..65534, or 65535 to discard all packets; default is 65535)
+#   24'h80000A        wrptr     ro     Ring mode:  number of words appended since the clear (free running)
 #
-#   24'h800006        dec3      rw     Telemetry port 3's decimation - 1 (0..65534, or 65535 to discard all packets; default is 65535)
+#   24'h80000B        rdptr     rw     Ring mode:  number of words drained by the host since the clear (free
+#                                        running; must be within wrptr-size .. wrptr).  Reset by a clear.
 #
-#   24'h800007        dec4      rw     Telemetry port 4's decimation - 1 (0..65534, or 65535 to discard all packets; default is 65535)
+#   24'h80000C        hwm       rw     High watermark in 32-bit words (0 .. 1<<ADDR_WIDTH; initially half the size)
+#
+#   24'h80000D        status    ro     Status register
+#
+#         Bits  Name   Description
+#         ----  -----  -------------------------------------------------------------------------------------
+#         31:2   --    Reserved (Always 0)
+#         1     drop   1 if a packet was dropped because the ring was full since the clear
+#         0     hwm    1 if the length is at least hwm
 #
-#   24'h800008        dec5      rw     Telemetry port 5's decimation - 1 (0..65534, or 65535 to discard all packets; default is 65535)
+#   24'h80000E        dropped   ro     Ring mode:  number of packets dropped because the ring was full since the clear
 #
 class DCM:
 